@@ -0,0 +1,15 @@
+# Try to find liburing
+#
+# Once done, this will define
+#
+# URING_FOUND
+# URING_INCLUDE_DIR
+# URING_LIBRARY
+
+find_path(URING_INCLUDE_DIR NAMES liburing.h)
+find_library(URING_LIBRARY NAMES uring)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(uring DEFAULT_MSG URING_LIBRARY URING_INCLUDE_DIR)
+
+mark_as_advanced(URING_INCLUDE_DIR URING_LIBRARY)
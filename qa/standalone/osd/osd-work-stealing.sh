@@ -0,0 +1,88 @@
+#!/bin/bash
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+
+source $CEPH_ROOT/qa/standalone/ceph-helpers.sh
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7147" # git grep '\<7147\>' : there must be only one
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+function get_op_wq_counter() {
+    local id=$1
+    local counter=$2
+
+    CEPH_ARGS='' ceph --format json daemon $(get_asok_path osd.$id) \
+        perf dump osd | jq ".osd.$counter"
+}
+
+#
+# A pool with a single PG maps every op to one shard, so the other
+# shards are idle and must be woken to steal once that one backs up.
+#
+function TEST_steal_from_busy_shard() {
+    local dir=$1
+
+    run_mon $dir a || return 1
+    run_mgr $dir x || return 1
+    run_osd $dir 0 \
+        --osd-op-num-shards=4 \
+        --osd-op-queue-work-stealing=true \
+        --osd-op-queue-steal-min-queue=2 || return 1
+    ceph osd pool create steal 1 1 || return 1
+    ceph osd pool set steal size 1 || return 1
+    wait_for_clean || return 1
+
+    test "$(get_op_wq_counter 0 op_wq_steal)" = 0 || return 1
+    rados -p steal bench 10 write -t 64 -b 4096 --no-cleanup || return 1
+
+    local attempts=$(get_op_wq_counter 0 op_wq_steal_attempt)
+    local steals=$(get_op_wq_counter 0 op_wq_steal)
+    echo "steal attempts $attempts steals $steals"
+    test $steals -gt 0 || return 1
+    test $attempts -ge $steals || return 1
+}
+
+function TEST_no_steal_when_disabled() {
+    local dir=$1
+
+    run_mon $dir a || return 1
+    run_mgr $dir x || return 1
+    run_osd $dir 0 \
+        --osd-op-num-shards=4 \
+        --osd-op-queue-work-stealing=false || return 1
+    ceph osd pool create steal 1 1 || return 1
+    ceph osd pool set steal size 1 || return 1
+    wait_for_clean || return 1
+
+    rados -p steal bench 5 write -t 64 -b 4096 --no-cleanup || return 1
+    test "$(get_op_wq_counter 0 op_wq_steal_attempt)" = 0 || return 1
+}
+
+main osd-work-stealing "$@"
+
+# Local Variables:
+# compile-command: "cd ../.. ; make -j4 && test/osd/osd-work-stealing.sh"
+# End:
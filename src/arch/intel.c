@@ -23,6 +23,7 @@ int ceph_arch_intel_ssse3 = 0;
 int ceph_arch_intel_sse3 = 0;
 int ceph_arch_intel_sse2 = 0;
 int ceph_arch_intel_aesni = 0;
+int ceph_arch_intel_avx2 = 0;
 
 #ifdef __x86_64__
 #include <cpuid.h>
@@ -36,6 +37,21 @@ int ceph_arch_intel_aesni = 0;
 #define CPUID_SSE3	(1)
 #define CPUID_SSE2	(1 << 26)
 #define CPUID_AESNI (1 << 25)
+#define CPUID_OSXSAVE	(1 << 27)
+#define CPUID_AVX	(1 << 28)
+
+/* leaf 7, ebx */
+#define CPUID7_AVX2	(1 << 5)
+
+/* xcr0: the os saves sse and avx (ymm) state */
+#define XCR0_SSE_AVX	0x6
+
+static unsigned int xgetbv0(void)
+{
+	unsigned int eax, edx;
+	__asm__ volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+	return eax;
+}
 
 int ceph_arch_intel_probe(void)
 {
@@ -65,6 +81,14 @@ int ceph_arch_intel_probe(void)
   if ((ecx & CPUID_AESNI) != 0) {
           ceph_arch_intel_aesni = 1;
   }
+	if ((ecx & (CPUID_OSXSAVE | CPUID_AVX)) == (CPUID_OSXSAVE | CPUID_AVX) &&
+	    (xgetbv0() & XCR0_SSE_AVX) == XCR0_SSE_AVX &&
+	    __get_cpuid_max(0, NULL) >= 7) {
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		if ((ebx & CPUID7_AVX2) != 0) {
+			ceph_arch_intel_avx2 = 1;
+		}
+	}
 
 	return 0;
 }
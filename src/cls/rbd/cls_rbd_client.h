@@ -199,6 +199,9 @@ namespace librbd {
                          const std::string &key);
     int metadata_remove(librados::IoCtx *ioctx, const std::string &oid,
                         const std::string &key);
+    void metadata_get_start(librados::ObjectReadOperation* op,
+                            const std::string &key);
+    int metadata_get_finish(bufferlist::iterator *it, std::string* value);
     int metadata_get(librados::IoCtx *ioctx, const std::string &oid,
                      const std::string &key, string *v);
 
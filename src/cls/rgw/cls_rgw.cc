@@ -450,6 +450,40 @@ int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
         CLS_LOG(20, "entry %s[%s] is not visible\n", key.name.c_str(), key.instance.c_str());
         continue;
       }
+
+      /* entries with pending ops are returned as they are so that rgw
+       * checks whether they really exist */
+      if (!op.delimiter.empty() && entry.exists && entry.pending_map.empty()) {
+        size_t delim_pos = key.name.find(op.delimiter, op.filter_prefix.size());
+        if (delim_pos != string::npos) {
+          /* return a single entry for the common prefix, and seek past
+           * everything under it rather than reading it all */
+          string prefix_key = key.name.substr(0, delim_pos + op.delimiter.size());
+          if (m.size() < op.num_entries) {
+            struct rgw_bucket_dir_entry& proxy = m[prefix_key];
+            proxy.key.name = prefix_key;
+            proxy.exists = true;
+            proxy.flags = RGW_BUCKET_DIRENT_FLAG_COMMON_PREFIX;
+          }
+          left_to_read--;
+
+          CLS_LOG(20, "got common prefix %s m.size()=%d\n", prefix_key.c_str(), (int)m.size());
+
+          start_key = prefix_key;
+          start_key.append(1, (char)0xFF);
+          kiter = keys.lower_bound(start_key);
+          if (kiter == keys.end()) {
+            break;
+          }
+          if (left_to_read == 0) {
+            more = true; /* the rest of this batch is still to be listed */
+            break;
+          }
+          --kiter; /* the loop increment moves back onto it */
+          continue;
+        }
+      }
+
       if (m.size() < op.num_entries) {
         m[kiter->first] = entry;
       }
@@ -356,6 +356,8 @@ int cls_rgw_clear_olh(librados::IoCtx& io_ctx, librados::ObjectWriteOperation& o
  * io_ctx        - IO context for rados.
  * start_obj     - marker for the listing.
  * filter_prefix - filter prefix.
+ * delimiter     - if not empty, each common prefix is returned as a single entry
+ *                 flagged RGW_BUCKET_DIRENT_FLAG_COMMON_PREFIX.
  * num_entries   - number of entries to request for each object (note the total
  *                 amount of entries returned depends on the number of shardings).
  * list_results  - the list results keyed by bucket index object id.
@@ -367,6 +369,7 @@ int cls_rgw_clear_olh(librados::IoCtx& io_ctx, librados::ObjectWriteOperation& o
 class CLSRGWIssueBucketList : public CLSRGWConcurrentIO {
   cls_rgw_obj_key start_obj;
   string filter_prefix;
+  string delimiter;
   uint32_t num_entries;
   bool list_versions;
   map<int, rgw_cls_list_ret>& result;
@@ -374,13 +377,14 @@ protected:
   int issue_op(int shard_id, const string& oid) override;
 public:
   CLSRGWIssueBucketList(librados::IoCtx& io_ctx, const cls_rgw_obj_key& _start_obj,
-                        const string& _filter_prefix, uint32_t _num_entries,
-                        bool _list_versions,
+                        const string& _filter_prefix, const string& _delimiter,
+                        uint32_t _num_entries, bool _list_versions,
                         map<int, string>& oids,
                         map<int, struct rgw_cls_list_ret>& list_results,
                         uint32_t max_aio) :
   CLSRGWConcurrentIO(io_ctx, oids, max_aio),
-  start_obj(_start_obj), filter_prefix(_filter_prefix), num_entries(_num_entries), list_versions(_list_versions), result(list_results) {}
+  start_obj(_start_obj), filter_prefix(_filter_prefix), delimiter(_delimiter),
+  num_entries(_num_entries), list_versions(_list_versions), result(list_results) {}
 };
 
 class CLSRGWIssueBILogList : public CLSRGWConcurrentIO {
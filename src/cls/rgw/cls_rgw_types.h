@@ -296,6 +296,7 @@ WRITE_CLASS_ENCODER(cls_rgw_obj_key)
 #define RGW_BUCKET_DIRENT_FLAG_CURRENT       0x2    /* the last object instance of a versioned object */
 #define RGW_BUCKET_DIRENT_FLAG_DELETE_MARKER 0x4    /* delete marker */
 #define RGW_BUCKET_DIRENT_FLAG_VER_MARKER    0x8    /* object is versioned, a placeholder for the plain entry */
+#define RGW_BUCKET_DIRENT_FLAG_COMMON_PREFIX 0x8000 /* listing only: stands for all entries under a common prefix */
 
 struct rgw_bucket_dir_entry {
   cls_rgw_obj_key key;
@@ -369,6 +370,7 @@ struct rgw_bucket_dir_entry {
     return is_current() && !is_delete_marker();
   }
   bool is_valid() { return (flags & RGW_BUCKET_DIRENT_FLAG_VER_MARKER) == 0; }
+  bool is_common_prefix() const { return (flags & RGW_BUCKET_DIRENT_FLAG_COMMON_PREFIX) != 0; }
 
   void dump(Formatter *f) const;
   void decode_json(JSONObj *obj);
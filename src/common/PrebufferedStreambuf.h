@@ -2,6 +2,8 @@
 #define CEPH_COMMON_PREBUFFEREDSTREAMBUF_H
 
 #include <streambuf>
+#include <string>
+#include <vector>
 
 /**
  * streambuf using existing buffer, overflowing into a std::string
@@ -18,6 +20,7 @@ class PrebufferedStreambuf
   char *m_buf;
   size_t m_buf_len;
   std::string m_overflow;
+  std::vector<size_t> m_marks;
 
   typedef std::char_traits<char> traits_ty;
   typedef traits_ty::int_type int_type;
@@ -39,6 +42,14 @@ public:
   // returns current size of content
   size_t size() const;
 
+  /// remember the current end of the content
+  void mark() {
+    m_marks.push_back(size());
+  }
+  const std::vector<size_t>& get_marks() const {
+    return m_marks;
+  }
+
   // extracts up to avail chars of content
   int snprintf(char* dst, size_t avail) const;
 };
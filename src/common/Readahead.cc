@@ -10,13 +10,10 @@ Readahead::Readahead()
     m_readahead_min_bytes(0),
     m_readahead_max_bytes(NO_LIMIT),
     m_alignments(),
+    m_adaptive(false),
     m_lock("Readahead::m_lock"),
-    m_nr_consec_read(0),
-    m_consec_read_bytes(0),
-    m_last_pos(0),
-    m_readahead_pos(0),
-    m_readahead_trigger_pos(0),
-    m_readahead_size(0),
+    m_streams(1),
+    m_seq(0),
     m_pending(0),
     m_pending_lock("Readahead::m_pending_lock") {
 }
@@ -26,66 +23,93 @@ Readahead::~Readahead() {
 
 Readahead::extent_t Readahead::update(const vector<extent_t>& extents, uint64_t limit) {
   m_lock.Lock();
+  stream_t *s = &m_streams[0];
   for (vector<extent_t>::const_iterator p = extents.begin(); p != extents.end(); ++p) {
-    _observe_read(p->first, p->second);
+    s = _observe_read(p->first, p->second);
   }
-  if (m_readahead_pos >= limit|| m_last_pos >= limit) {
+  if (s->readahead_pos >= limit|| s->last_pos >= limit) {
     m_lock.Unlock();
     return extent_t(0, 0);
   }
-  pair<uint64_t, uint64_t> extent = _compute_readahead(limit);
+  pair<uint64_t, uint64_t> extent = _compute_readahead(s, limit);
   m_lock.Unlock();
   return extent;
 }
 
 Readahead::extent_t Readahead::update(uint64_t offset, uint64_t length, uint64_t limit) {
   m_lock.Lock();
-  _observe_read(offset, length);
-  if (m_readahead_pos >= limit || m_last_pos >= limit) {
+  stream_t *s = _observe_read(offset, length);
+  if (s->readahead_pos >= limit || s->last_pos >= limit) {
     m_lock.Unlock();
     return extent_t(0, 0);
   }
-  extent_t extent = _compute_readahead(limit);
+  extent_t extent = _compute_readahead(s, limit);
   m_lock.Unlock();
   return extent;
 }
 
-void Readahead::_observe_read(uint64_t offset, uint64_t length) {
-  if (offset == m_last_pos) {
-    m_nr_consec_read++;
-    m_consec_read_bytes += length;
+void Readahead::report_miss(uint64_t offset, uint64_t length) {
+  Mutex::Locker lock(m_lock);
+  for (auto& s : m_streams) {
+    if (s.last_pos == offset) {
+      s.misses++;
+      break;
+    }
+  }
+}
+
+Readahead::stream_t *Readahead::_observe_read(uint64_t offset, uint64_t length) {
+  stream_t *s = nullptr;
+  for (auto& i : m_streams) {
+    if (i.last_pos == offset) {
+      s = &i;
+      break;
+    }
+  }
+  if (s) {
+    s->nr_consec_read++;
+    s->consec_read_bytes += length;
   } else {
-    m_nr_consec_read = 0;
-    m_consec_read_bytes = 0;
-    m_readahead_trigger_pos = 0;
-    m_readahead_size = 0;
-    m_readahead_pos = 0;
+    // start over with the stream that has been idle the longest
+    s = &m_streams[0];
+    for (auto& i : m_streams) {
+      if (i.last_used < s->last_used) {
+	s = &i;
+      }
+    }
+    s->reset();
   }
-  m_last_pos = offset + length;
+  s->last_pos = offset + length;
+  s->last_used = ++m_seq;
+  return s;
 }
 
-Readahead::extent_t Readahead::_compute_readahead(uint64_t limit) {
+Readahead::extent_t Readahead::_compute_readahead(stream_t *s, uint64_t limit) {
   uint64_t readahead_offset = 0;
   uint64_t readahead_length = 0;
-  if (m_nr_consec_read >= m_trigger_requests) {
+  if (s->nr_consec_read >= m_trigger_requests) {
     // currently reading sequentially
-    if (m_last_pos >= m_readahead_trigger_pos) {
+    if (s->last_pos >= s->readahead_trigger_pos) {
       // need to read ahead
-      if (m_readahead_size == 0) {
+      if (s->readahead_size == 0) {
 	// initial readahead trigger
-	m_readahead_size = m_consec_read_bytes;
-	m_readahead_pos = m_last_pos;
+	s->readahead_size = s->consec_read_bytes;
+	s->readahead_pos = s->last_pos;
       } else {
-	// continuing readahead trigger
-	m_readahead_size *= 2;
-	if (m_last_pos > m_readahead_pos) {
-	  m_readahead_pos = m_last_pos;
+	// continuing readahead trigger; when adaptive, only grow if
+	// the previous readahead did not keep the reader busy
+	if (!m_adaptive || s->misses > 0) {
+	  s->readahead_size *= 2;
+	}
+	if (s->last_pos > s->readahead_pos) {
+	  s->readahead_pos = s->last_pos;
 	}
       }
-      m_readahead_size = MAX(m_readahead_size, m_readahead_min_bytes);
-      m_readahead_size = MIN(m_readahead_size, m_readahead_max_bytes);
-      readahead_offset = m_readahead_pos;
-      readahead_length = m_readahead_size;
+      s->misses = 0;
+      s->readahead_size = MAX(s->readahead_size, m_readahead_min_bytes);
+      s->readahead_size = MIN(s->readahead_size, m_readahead_max_bytes);
+      readahead_offset = s->readahead_pos;
+      readahead_length = s->readahead_size;
 
       // Snap to the first alignment possible
       uint64_t readahead_end = readahead_offset + readahead_length;
@@ -107,15 +131,15 @@ Readahead::extent_t Readahead::_compute_readahead(uint64_t limit) {
 	  readahead_length = align_next - readahead_offset;
 	  break;
 	}
-	// Note that m_readahead_size should remain unadjusted.
+	// Note that readahead_size should remain unadjusted.
       }
 
-      if (m_readahead_pos + readahead_length > limit) {
-	readahead_length = limit - m_readahead_pos;
+      if (s->readahead_pos + readahead_length > limit) {
+	readahead_length = limit - s->readahead_pos;
       }
 
-      m_readahead_trigger_pos = m_readahead_pos + readahead_length / 2;
-      m_readahead_pos += readahead_length;
+      s->readahead_trigger_pos = s->readahead_pos + readahead_length / 2;
+      s->readahead_pos += readahead_length;
     }
   }
   return extent_t(readahead_offset, readahead_length);
@@ -195,3 +219,16 @@ void Readahead::set_alignments(const vector<uint64_t> &alignments) {
   m_alignments = alignments;
   m_lock.Unlock();
 }
+
+void Readahead::set_max_streams(unsigned max_streams) {
+  assert(max_streams > 0);
+  m_lock.Lock();
+  m_streams.resize(max_streams);
+  m_lock.Unlock();
+}
+
+void Readahead::set_adaptive(bool adaptive) {
+  m_lock.Lock();
+  m_adaptive = adaptive;
+  m_lock.Unlock();
+}
@@ -7,6 +7,7 @@
 #include "Mutex.h"
 #include "Cond.h"
 #include <list>
+#include <vector>
 
 /**
    This class provides common state and logic for code that needs to perform readahead
@@ -15,6 +16,10 @@
 
    Minimum and maximum readahead sizes may be violated by up to 50\% if alignment is enabled.
    Minimum readahead size may be violated if the end of the readahead target is reached.
+
+   Up to set_max_streams() sequential streams are tracked independently, so that
+   interleaved sequential readers of the same thing each get their own readahead.
+   A read that continues none of them replaces the least recently used stream.
  */
 class Readahead {
 public:
@@ -106,18 +111,74 @@ public:
    */
   void set_alignments(const std::vector<uint64_t> &alignments);
 
+  /**
+     Sets the number of sequential streams tracked at the same time.
+   */
+  void set_max_streams(unsigned max_streams);
+
+  /**
+     Enables adaptive readahead sizing.
+     Without it the readahead size of a stream doubles every time readahead is
+     continued.  With it, the size only grows if a read of the stream had to wait
+     for data (see report_miss()) since the previous readahead, so streams that
+     are kept ahead of do not keep fetching more and more.
+   */
+  void set_adaptive(bool adaptive);
+
+  /**
+     Records that a read had to wait for its data.
+     Must be called before update() for the same read.
+   */
+  void report_miss(uint64_t offset, uint64_t length);
+
 private:
+  struct stream_t {
+    /// Number of consecutive read requests in the stream
+    int nr_consec_read = 0;
+
+    /// Number of bytes read in the stream
+    uint64_t consec_read_bytes = 0;
+
+    /// Position of the read stream
+    uint64_t last_pos = 0;
+
+    /// Position of the readahead stream
+    uint64_t readahead_pos = 0;
+
+    /// When readahead is already triggered and the read stream crosses this point, readahead is continued
+    uint64_t readahead_trigger_pos = 0;
+
+    /// Size of the next readahead request (barring changes due to alignment, etc.)
+    uint64_t readahead_size = 0;
+
+    /// Reads that had to wait since the last readahead request
+    int misses = 0;
+
+    /// Value of m_seq when the stream was last read from
+    uint64_t last_used = 0;
+
+    void reset() {
+      nr_consec_read = 0;
+      consec_read_bytes = 0;
+      readahead_trigger_pos = 0;
+      readahead_size = 0;
+      readahead_pos = 0;
+      misses = 0;
+    }
+  };
+
   /**
      Records that a read request has been received.
      m_lock must be held while calling.
+     @returns the stream the read belongs to
    */
-  void _observe_read(uint64_t offset, uint64_t length);
+  stream_t *_observe_read(uint64_t offset, uint64_t length);
 
   /**
      Computes the next readahead request.
      m_lock must be held while calling.
   */
-  extent_t _compute_readahead(uint64_t limit);
+  extent_t _compute_readahead(stream_t *s, uint64_t limit);
 
   /// Number of sequential requests necessary to trigger readahead
   int m_trigger_requests;
@@ -131,26 +192,17 @@ private:
   /// Alignment units, in bytes
   std::vector<uint64_t> m_alignments;
 
+  /// Whether readahead sizes adapt to misses, see set_adaptive()
+  bool m_adaptive;
+
   /// Held while reading/modifying any state except m_pending
   Mutex m_lock;
 
-  /// Number of consecutive read requests in the current sequential stream
-  int m_nr_consec_read;
-
-  /// Number of bytes read in the current sequenial stream
-  uint64_t m_consec_read_bytes;
-
-  /// Position of the read stream
-  uint64_t m_last_pos;
-
-  /// Position of the readahead stream
-  uint64_t m_readahead_pos;
-
-  /// When readahead is already triggered and the read stream crosses this point, readahead is continued
-  uint64_t m_readahead_trigger_pos;
+  /// Sequential streams being tracked
+  std::vector<stream_t> m_streams;
 
-  /// Size of the next readahead request (barring changes due to alignment, etc.)
-  uint64_t m_readahead_size;
+  /// Number of reads observed, for picking the least recently used stream
+  uint64_t m_seq;
 
   /// Number of pending readahead requests, as determined by inc_pending() and dec_pending()
   int m_pending;
@@ -193,6 +193,7 @@ public:
       "log_file",
       "log_max_new",
       "log_max_recent",
+      "log_binary_capture",
       "log_to_syslog",
       "err_to_syslog",
       "log_to_stderr",
@@ -237,6 +238,10 @@ public:
       log->set_max_recent(conf->log_max_recent);
     }
 
+    if (changed.count("log_binary_capture")) {
+      log->set_binary_capture(conf->get_val<bool>("log_binary_capture"));
+    }
+
     // graylog
     if (changed.count("log_to_graylog") || changed.count("err_to_graylog")) {
       int l = conf->log_to_graylog ? 99 : (conf->err_to_graylog ? -1 : -2);
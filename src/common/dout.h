@@ -55,6 +55,8 @@ public:
     static size_t _log_exp_length = 80; 				\
     ceph::logging::Entry *_dout_e = cct->_log->create_entry(v, sub, &_log_exp_length);	\
     ostream _dout_os(&_dout_e->m_streambuf);				\
+    if (_dout_e->m_binary)						\
+      ceph::logging::binary_capture(_dout_os, &_dout_e->m_streambuf);	\
     static_assert(std::is_convertible<decltype(&*cct), 			\
 				      CephContext* >::value,		\
 		  "provided cct must be compatible with CephContext*"); \
@@ -980,6 +980,9 @@ OPTION(bdev_aio_reap_max, OPT_INT)
 OPTION(bdev_block_size, OPT_INT)
 OPTION(bdev_debug_aio, OPT_BOOL)
 OPTION(bdev_debug_aio_suicide_timeout, OPT_FLOAT)
+OPTION(bdev_type, OPT_STR) // kernel, io_uring, ...; empty means autodetect
+OPTION(bdev_ioring_hipri, OPT_BOOL)
+OPTION(bdev_ioring_sqthread_poll, OPT_BOOL)
 
 // if yes, osd will unbind all NVMe devices from kernel driver and bind them
 // to the uio_pci_generic driver. The purpose is to prevent the case where
@@ -1080,9 +1083,10 @@ OPTION(bluestore_extent_map_shard_target_size, OPT_U32)
 OPTION(bluestore_extent_map_shard_min_size, OPT_U32)
 OPTION(bluestore_extent_map_shard_target_size_slop, OPT_DOUBLE)
 OPTION(bluestore_extent_map_inline_shard_prealloc_size, OPT_U32)
+OPTION(bluestore_extent_map_lazy_read, OPT_BOOL)
 OPTION(bluestore_cache_trim_interval, OPT_DOUBLE)
 OPTION(bluestore_cache_trim_max_skip_pinned, OPT_U32) // skip this many onodes pinned in cache before we give up
-OPTION(bluestore_cache_type, OPT_STR)   // lru, 2q
+OPTION(bluestore_cache_type, OPT_STR)   // lru, 2q, clock
 OPTION(bluestore_2q_cache_kin_ratio, OPT_DOUBLE)    // kin page slot size / max page slot size
 OPTION(bluestore_2q_cache_kout_ratio, OPT_DOUBLE)   // number of kout page slot / total number of page slot
 OPTION(bluestore_cache_size, OPT_U64)
@@ -1092,7 +1096,7 @@ OPTION(bluestore_cache_meta_ratio, OPT_DOUBLE)
 OPTION(bluestore_cache_kv_ratio, OPT_DOUBLE)
 OPTION(bluestore_cache_kv_max, OPT_U64) // limit the maximum amount of cache for the kv store
 OPTION(bluestore_kvbackend, OPT_STR)
-OPTION(bluestore_allocator, OPT_STR)     // stupid | bitmap
+OPTION(bluestore_allocator, OPT_STR)     // stupid | bitmap | avl
 OPTION(bluestore_freelist_blocks_per_key, OPT_INT)
 OPTION(bluestore_bitmapallocator_blocks_per_zone, OPT_INT) // must be power of 2 aligned, e.g., 512, 1024, 2048...
 OPTION(bluestore_bitmapallocator_span_size, OPT_INT) // must be power of 2 aligned, e.g., 512, 1024, 2048...
@@ -1329,6 +1333,13 @@ OPTION(rbd_blacklist_on_break_lock, OPT_BOOL) // whether to blacklist clients wh
 OPTION(rbd_blacklist_expire_seconds, OPT_INT) // number of seconds to blacklist - set to 0 for OSD default
 OPTION(rbd_request_timed_out_seconds, OPT_INT) // number of seconds before maint request times out
 OPTION(rbd_skip_partial_discard, OPT_BOOL) // when trying to discard a range inside an object, set to true to skip zeroing the range.
+OPTION(rbd_persistent_cache, OPT_BOOL) // write-back cache image writes in a log file on local storage
+OPTION(rbd_persistent_cache_path, OPT_STR) // directory holding the persistent cache log files
+OPTION(rbd_persistent_cache_size, OPT_U64) // size of each persistent cache log file
+OPTION(rbd_persistent_cache_persist_on_flush, OPT_BOOL) // only sync the log on flush; writes complete once handed to the local file system
+OPTION(rbd_parent_cache_enabled, OPT_BOOL) // cache the parent objects of clones in a local directory shared by all clients on the host
+OPTION(rbd_parent_cache_path, OPT_STR) // directory holding the parent cache
+OPTION(rbd_parent_cache_size, OPT_U64) // target size of the parent cache directory
 OPTION(rbd_enable_alloc_hint, OPT_BOOL) // when writing a object, it will issue a hint to osd backend to indicate the expected size object need
 OPTION(rbd_tracing, OPT_BOOL) // true if LTTng-UST tracepoints should be enabled
 OPTION(rbd_blkin_trace_all, OPT_BOOL) // create a blkin trace for all RBD requests
@@ -1446,6 +1457,7 @@ OPTION(rgw_data, OPT_STR)
 OPTION(rgw_enable_apis, OPT_STR)
 OPTION(rgw_cache_enabled, OPT_BOOL)   // rgw cache enabled
 OPTION(rgw_cache_lru_size, OPT_INT)   // num of entries in rgw cache
+OPTION(rgw_cache_shards, OPT_INT)   // num of independently locked partitions of the rgw cache
 OPTION(rgw_socket_path, OPT_STR)   // path to unix domain socket, if not specified, rgw will not run as external fcgi
 OPTION(rgw_host, OPT_STR)  // host for radosgw, can be an IP, default is 0.0.0.0
 OPTION(rgw_port, OPT_STR)  // port to listen, format as "8080" "5000", if not specified, rgw will not run external fcgi
@@ -1516,6 +1528,7 @@ OPTION(rgw_remote_addr_param, OPT_STR)  // e.g. X-Forwarded-For, if you have a r
 OPTION(rgw_op_thread_timeout, OPT_INT)
 OPTION(rgw_op_thread_suicide_timeout, OPT_INT)
 OPTION(rgw_thread_pool_size, OPT_INT)
+OPTION(rgw_beast_enable_async, OPT_BOOL)
 OPTION(rgw_num_control_oids, OPT_INT)
 OPTION(rgw_num_rados_handles, OPT_U32)
 OPTION(rgw_verify_ssl, OPT_BOOL) // should http_client try to verify ssl when sent https request
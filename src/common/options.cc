@@ -301,6 +301,12 @@ std::vector<Option> get_global_options() {
     .set_description("recent log entries to keep in memory to dump in the event of a crash")
     .set_long_description("The purpose of this option is to log at a higher debug level only to the in-memory buffer, and write out the detailed log messages only if there is a crash.  Only log entries below the lower log level will be written unconditionally to the log.  For example, debug_osd=1/5 will write everything <= 1 to the log unconditionally but keep entries at levels 2-5 in memory.  If there is a seg fault or assertion failure, all entries will be dumped to the log."),
 
+    Option("log_binary_capture", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("store numbers in log entries raw and format them only when the entry is written out")
+    .set_long_description("Formatting integers and floating point values is a large part of the cost of gathering log entries.  With this option they are stored raw and only formatted by the log thread when the entry is written to the log, or dumped after a crash, which makes raising debug levels on a busy daemon cheaper.  Values printed with non-default stream formatting (hex, width, precision) are still formatted right away.")
+    .add_see_also("log_max_recent"),
+
     Option("log_to_stderr", Option::TYPE_BOOL, Option::LEVEL_BASIC)
     .set_default(true)
     .set_daemon_default(false)
@@ -719,6 +725,18 @@ std::vector<Option> get_global_options() {
     .set_default("")
     .set_description(""),
 
+    Option("ms_async_zerocopy_send", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("send large buffers with MSG_ZEROCOPY (posix stack)")
+    .set_long_description("Avoid copying large message payloads into kernel socket buffers by sending them with MSG_ZEROCOPY.  The buffers stay referenced until the kernel reports that it is done with them.  Requires Linux 4.14 or later; sockets fall back to ordinary copying sends where it is unsupported.")
+    .add_see_also("ms_async_zerocopy_min_size"),
+
+    Option("ms_async_zerocopy_min_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(65536)
+    .set_description("minimum buffer size sent with MSG_ZEROCOPY")
+    .set_long_description("Page pinning and completion notification make zero-copy more expensive than a copy for small buffers.")
+    .add_see_also("ms_async_zerocopy_send"),
+
     Option("ms_async_rdma_device_name", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("")
     .set_description(""),
@@ -859,6 +877,18 @@ std::vector<Option> get_global_options() {
     .set_default(4096)
     .set_description(""),
 
+    Option("mon_osd_mapping_incremental", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Only recompute the PG mappings an OSDMap incremental can affect")
+    .set_long_description("When a new OSDMap epoch is the result of a single incremental, only remap the pools and PGs it can have moved instead of every PG in the cluster.  Incrementals that change the CRUSH map or max_osd still trigger a full recompute.")
+    .add_see_also("mon_osd_mapping_incremental_check"),
+
+    Option("mon_osd_mapping_incremental_check", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(false)
+    .set_description("Verify incremental PG mappings against a full recompute")
+    .set_long_description("After each incremental mapping update, recompute every PG mapping and abort if any differs.  This is expensive and only meant for testing.")
+    .add_see_also("mon_osd_mapping_incremental"),
+
     Option("mon_osd_max_creating_pgs", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(1024)
     .set_description(""),
@@ -1891,6 +1921,19 @@ std::vector<Option> get_global_options() {
     .set_default(8)
     .set_description(""),
 
+    Option("osd_op_queue_work_stealing", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("let idle op worker threads take work from other shards")
+    .set_long_description("ops are hashed by PG onto a fixed op queue shard, so a few hot PGs can keep one shard's threads busy while the others sit idle.  With this enabled a worker whose own shard is empty dequeues from another shard's queue instead of sleeping; per-PG ordering is still preserved.")
+    .add_see_also("osd_op_queue_steal_min_queue")
+    .add_see_also("osd_op_num_shards"),
+
+    Option("osd_op_queue_steal_min_queue", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(2)
+    .set_min(1)
+    .set_description("minimum queue length of a shard before idle workers steal from it")
+    .add_see_also("osd_op_queue_work_stealing"),
+
     Option("osd_op_queue", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("wpq")
     .set_enum_allowed( { "wpq", "prioritized", "mclock_opclass", "mclock_client", "debug_random" } )
@@ -2213,6 +2256,11 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("osd_ec_parity_delta_writes", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Update the coding chunks of partially overwritten erasure coded stripes from the old and new data of the written chunks")
+    .set_long_description("A small overwrite on a pool with allow_ec_overwrites then reads and writes only the touched data chunks and the coding chunks instead of whole stripes. It is only used for plugins implementing a linear code (jerasure, isa) when the object has no other write in flight and all of its shards are available."),
+
     Option("osd_recover_clone_overlap_limit", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(10)
     .set_description(""),
@@ -2861,6 +2909,10 @@ std::vector<Option> get_global_options() {
     .set_default(4096)
     .set_description("The block size for index partitions. (0 = rocksdb default)"),
 
+    Option("rocksdb_debug_reshard_interrupt", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(0)
+    .set_description("Stop a reshard with EINTR after moving this many keys of a prefix (0 = never)"),
+
     Option("mon_rocksdb_options", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("write_buffer_size=33554432,compression=kNoCompression")
     .set_description(""),
@@ -3040,6 +3092,24 @@ std::vector<Option> get_global_options() {
     .set_default(60.0)
     .set_description(""),
 
+    Option("bdev_type", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("")
+    .set_enum_allowed( { "", "kernel", "io_uring", "ust-nvme", "pmem" } )
+    .set_description("block device backend to use for BlueStore and BlueFS")
+    .set_long_description("If empty, the backend is detected from the device path (spdk: prefix, pmem mapping) and defaults to kernel (libaio). io_uring uses the same code path as kernel but submits and reaps io through io_uring with registered files.")
+    .add_see_also("bdev_ioring_hipri")
+    .add_see_also("bdev_ioring_sqthread_poll"),
+
+    Option("bdev_ioring_hipri", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("use polled (IORING_SETUP_IOPOLL) completions for io_uring")
+    .add_see_also("bdev_type"),
+
+    Option("bdev_ioring_sqthread_poll", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("use a kernel submission polling thread (IORING_SETUP_SQPOLL) for io_uring")
+    .add_see_also("bdev_type"),
+
     Option("bdev_nvme_unbind_from_kernel", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
@@ -3323,12 +3393,54 @@ std::vector<Option> get_global_options() {
     .set_safe()
     .set_description(""),
 
+    Option("bluestore_compression_threads", Option::TYPE_INT, Option::LEVEL_ADVANCED)
+    .set_default(2)
+    .set_min(0)
+    .set_description("Number of threads compressing the blobs of large writes in parallel")
+    .set_long_description("A write that is split into several compressed blobs has them compressed by these threads and the submitting thread together, instead of one after another on the submitting thread.  With 0 all compression is done inline.  Takes effect on mount."),
+
     Option("bluestore_compression_required_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
     .set_default(.875)
     .set_safe()
     .set_description("Compression ratio required to store compressed data")
     .set_long_description("If we compress data and get less than this we discard the result and store the original uncompressed data."),
 
+    Option("bluestore_compression_dict", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Compress small blobs with dictionaries trained on the data of their pool")
+    .set_long_description("Small blobs compress poorly on their own.  With this enabled, and an algorithm that supports it (zstd), a dictionary is trained per pool from a sample of its writes, stored in the OSD's metadata and used for blobs up to bluestore_compression_dict_max_blob_size.  Dictionaries are kept forever so that old blobs stay readable."),
+
+    Option("bluestore_compression_dict_max_blob_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64*1024)
+    .set_description("Largest blob compressed with a dictionary"),
+
+    Option("bluestore_compression_dict_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64*1024)
+    .set_description("Maximum size of a trained compression dictionary"),
+
+    Option("bluestore_compression_dict_sample_bytes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(4*1024*1024)
+    .set_description("Amount of written data to train a compression dictionary on"),
+
+    Option("bluestore_compression_dict_retrain_blobs", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1000000)
+    .set_description("Retrain the dictionary of a pool after compressing this many blobs with it")
+    .set_long_description("Lets the dictionary follow the data as it changes.  0 never retrains."),
+
+    Option("bluestore_compression_estimate", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Estimate the compressibility of blobs from a sample before compressing them")
+    .set_long_description("Blobs whose estimated compression ratio is above bluestore_compression_required_ratio, like already compressed or encrypted data, are stored uncompressed without paying for an attempt."),
+
+    Option("bluestore_compression_backoff", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(4)
+    .set_description("Blobs of an object failing to compress in a row before its writes stop being compressed for a while")
+    .set_long_description("The number of writes to the object stored uncompressed doubles each time compression fails again, up to bluestore_compression_backoff_max, and a successful compression resets it.  The state is kept with the cached object only.  0 disables the back-off."),
+
+    Option("bluestore_compression_backoff_max", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64)
+    .set_description("Maximum number of writes to an object stored uncompressed in a row by the compression back-off"),
+
     Option("bluestore_extent_map_shard_max_size", Option::TYPE_UINT, Option::LEVEL_DEV)
     .set_default(1200)
     .set_description("Max size (bytes) for a single extent map shard before splitting"),
@@ -3349,6 +3461,11 @@ std::vector<Option> get_global_options() {
     .set_default(256)
     .set_description("Preallocated buffer for inline shards"),
 
+    Option("bluestore_extent_map_lazy_read", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Serve reads from extent map shards without decoding them")
+    .set_long_description("Reads that touch extent map shards that are not loaded look up the extents they need directly in the encoded shard, which is kept in the onode, and only decode the blobs they touch.  The shard is fully decoded only when it is written to.  This saves memory and CPU for small reads of large objects, but such reads do not populate the buffer cache."),
+
     Option("bluestore_cache_trim_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
     .set_default(.2)
     .set_description("How frequently we trim the bluestore cache"),
@@ -3359,8 +3476,9 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_cache_type", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("2q")
-    .set_enum_allowed({"2q", "lru"})
-    .set_description("Cache replacement algorithm"),
+    .set_enum_allowed({"2q", "lru", "clock"})
+    .set_description("Cache replacement algorithm")
+    .set_long_description("clock uses reference bits instead of relinking lists on every hit, so onode lookups do not take the cache shard lock; it trades some hit rate for less lock contention under many small reads."),
 
     Option("bluestore_2q_cache_kin_ratio", Option::TYPE_FLOAT, Option::LEVEL_DEV)
     .set_default(.5)
@@ -3402,9 +3520,21 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_allocator", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("bitmap")
+    .set_enum_allowed({"bitmap", "stupid", "avl"})
     .add_tag("mkfs")
     .set_description(""),
 
+    Option("bluestore_avl_alloc_bf_threshold", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(131072)
+    .set_description("Requests of at least this size are served best-fit by the avl allocator")
+    .set_long_description("Smaller requests are served first-fit from a cursor, which is faster and keeps related allocations together.")
+    .add_see_also("bluestore_allocator"),
+
+    Option("bluestore_avl_alloc_bf_free_pct", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(4)
+    .set_description("Below this percentage of free space the avl allocator serves every request best-fit")
+    .add_see_also("bluestore_allocator"),
+
     Option("bluestore_freelist_blocks_per_key", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(128)
     .set_description("Block (and bits) per database key"),
@@ -3425,6 +3555,29 @@ std::vector<Option> get_global_options() {
     .set_default("compression=kNoCompression,max_write_buffer_number=4,min_write_buffer_number_to_merge=1,recycle_log_file_num=4,write_buffer_size=268435456,writable_file_max_buffer_size=0,compaction_readahead_size=2097152")
     .set_description("Rocksdb options"),
 
+    Option("bluestore_kv_sync_pipeline_depth", Option::TYPE_INT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Number of kv commit batches that may wait on a sync while kv_sync_thread submits the next one")
+    .set_long_description("With 0 kv_sync_thread submits and syncs each batch itself.  Otherwise the synchronous commit (the rocksdb WAL fsync) is done by a separate thread so it overlaps with flushing and submitting the following batch.  Takes effect on mount."),
+
+    Option("bluestore_kv_finalize_threads", Option::TYPE_INT, Option::LEVEL_ADVANCED)
+    .set_default(1)
+    .set_min(1)
+    .set_description("Number of threads running completion callbacks for committed transactions")
+    .set_long_description("Each OpSequencer is served by a single thread so completions stay in order per sequencer.  Takes effect on mount."),
+
+    Option("bluestore_rocksdb_cf", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Create new BlueStore rocksdb instances with per-prefix column families")
+    .set_long_description("Only affects mkfs; existing stores keep the layout they were created with until they are resharded with ceph-kvstore-tool.")
+    .add_see_also("bluestore_rocksdb_cfs"),
+
+    Option("bluestore_rocksdb_cfs", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("O= M= L= b=")
+    .set_description("Column family layout for BlueStore's rocksdb")
+    .set_long_description("Whitespace separated list of prefix[(shards)]=options. Each listed key prefix gets its own column family, optionally hash sharded over several, with the given rocksdb column family options (e.g. O(4)=write_buffer_size=64M M(4)= L=). Options are also applied at mount for column families that already exist.")
+    .add_see_also("bluestore_rocksdb_cf"),
+
     Option("bluestore_fsck_on_mount", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .set_description("Run fsck at mount"),
@@ -4147,6 +4300,11 @@ std::vector<Option> get_rgw_options() {
     .set_default(4 * 1024 * 1024)
     .set_description(""),
 
+    Option("rgw_compression_estimate_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.95)
+    .set_description("Store objects uncompressed if their first part is estimated to compress worse than this")
+    .set_long_description("The estimate is taken on a sample of the data, and saves compressing already compressed or encrypted objects for no gain.  1 disables it."),
+
     Option("rgw_put_obj_min_window_size", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(16 * 1024 * 1024)
     .set_description(""),
@@ -4199,6 +4357,15 @@ std::vector<Option> get_rgw_options() {
     .set_default(10000)
     .set_description(""),
 
+    Option("rgw_cache_shards", Option::TYPE_INT, Option::LEVEL_ADVANCED)
+    .set_default(16)
+    .set_min(1)
+    .set_description("number of partitions of the metadata cache")
+    .set_long_description("Each partition has its own lock and LRU and holds "
+                          "up to rgw_cache_lru_size / rgw_cache_shards "
+                          "entries.")
+    .add_see_also("rgw_cache_lru_size"),
+
     Option("rgw_socket_path", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("")
     .set_description(""),
@@ -4443,6 +4610,17 @@ std::vector<Option> get_rgw_options() {
     .set_default(100)
     .set_description(""),
 
+    Option("rgw_beast_enable_async", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("suspend beast frontend requests on rados operations instead of blocking")
+    .set_long_description("When enabled, the beast frontend passes the coroutine "
+                          "of each connection down to the object, bucket index and "
+                          "system object reads and writes of the request, which "
+                          "then wait for their rados operations without blocking "
+                          "a frontend thread. This lets rgw_thread_pool_size stay "
+                          "small with many concurrent connections.")
+    .add_see_also("rgw_thread_pool_size"),
+
     Option("rgw_num_control_oids", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(8)
     .set_description(""),
@@ -5128,6 +5306,58 @@ static std::vector<Option> get_rbd_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("rbd_persistent_cache", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("enable the persistent write-back cache")
+    .set_long_description("Writes are appended to a log file on local storage "
+                          "(ideally an SSD) and completed from there; a "
+                          "background thread writes them back to the cluster "
+                          "in order. The log is replayed when the image is "
+                          "next opened, so the same host must open the image "
+                          "again after a crash.")
+    .add_see_also("rbd_persistent_cache_path")
+    .add_see_also("rbd_persistent_cache_size"),
+
+    Option("rbd_persistent_cache_path", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("/tmp")
+    .set_description("directory holding the persistent cache log files"),
+
+    Option("rbd_persistent_cache_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1ull << 30)
+    .set_min(1ull << 20)
+    .set_description("size of the persistent cache log file of an image"),
+
+    Option("rbd_persistent_cache_persist_on_flush", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("only sync the persistent cache log when the user flushes")
+    .set_long_description("If false, every write is synced to the log before "
+                          "it is completed, which is safer for users that "
+                          "never flush but slower."),
+
+    Option("rbd_parent_cache_enabled", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("cache parent image objects on local storage")
+    .set_long_description("Objects read from the parent snapshot of a clone "
+                          "are stored whole in a local directory and later "
+                          "reads of them are served from there. The directory "
+                          "can be shared by every client on the host, so "
+                          "clones of the same parent only fetch each parent "
+                          "object from the cluster once.")
+    .add_see_also("rbd_parent_cache_path")
+    .add_see_also("rbd_parent_cache_size"),
+
+    Option("rbd_parent_cache_path", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("/tmp/rbd_parent_cache")
+    .set_description("directory holding the parent cache"),
+
+    Option("rbd_parent_cache_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(10ull << 30)
+    .set_min(64ull << 20)
+    .set_description("size the parent cache directory is trimmed to")
+    .set_long_description("Least recently used objects are removed once the "
+                          "directory grows past this size. The limit is "
+                          "enforced by every client using the directory."),
+
     Option("rbd_enable_alloc_hint", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(true)
     .set_description(""),
@@ -5762,6 +5992,17 @@ std::vector<Option> get_mds_client_options() {
     .set_default(4)
     .set_description(""),
 
+    Option("client_readahead_max_streams", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(4)
+    .set_min(1)
+    .set_description("number of interleaved sequential read streams per open file that get their own readahead"),
+
+    Option("client_readahead_adaptive", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("only grow the readahead of a stream when its reads have to wait for data")
+    .set_long_description("Without this the readahead size of a sequential stream doubles every time readahead is continued, up to client_readahead_max_bytes and client_readahead_max_periods.  With it, the size only grows after a read of the stream found its data missing from the cache.")
+    .add_see_also({"client_readahead_max_bytes", "client_readahead_max_periods"}),
+
     Option("client_reconnect_stale", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
@@ -172,7 +172,16 @@ void PerfCounters::inc(int idx, uint64_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  if (data.type & PERFCOUNTER_LONGRUNAVG) {
+  if (data.shards) {
+    perf_counter_shard_d *shard = data.pick_a_shard();
+    if (data.type & PERFCOUNTER_LONGRUNAVG) {
+      shard->avgcount++;
+      shard->u64 += amt;
+      shard->avgcount2++;
+    } else {
+      shard->u64 += amt;
+    }
+  } else if (data.type & PERFCOUNTER_LONGRUNAVG) {
     data.avgcount++;
     data.u64 += amt;
     data.avgcount2++;
@@ -192,7 +201,12 @@ void PerfCounters::dec(int idx, uint64_t amt)
   assert(!(data.type & PERFCOUNTER_LONGRUNAVG));
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  data.u64 -= amt;
+  if (data.shards) {
+    // the shards only matter summed up, wrapping one below zero is fine
+    data.pick_a_shard()->u64 -= amt;
+  } else {
+    data.u64 -= amt;
+  }
 }
 
 void PerfCounters::set(int idx, uint64_t amt)
@@ -208,6 +222,15 @@ void PerfCounters::set(int idx, uint64_t amt)
 
   ANNOTATE_BENIGN_RACE_SIZED(&data.u64, sizeof(data.u64),
                              "perf counter atomic");
+  if (data.shards) {
+    // the value is replaced but the sample count is kept, so move the
+    // latter out of the shards.  not atomic with respect to concurrent
+    // updates, but neither is set() on a counter somebody is bumping.
+    pair<uint64_t,uint64_t> a = data.read_avg();
+    data.clear_shards();
+    data.avgcount = a.second;
+    data.avgcount2 = a.second;
+  }
   if (data.type & PERFCOUNTER_LONGRUNAVG) {
     data.avgcount++;
     data.u64 = amt;
@@ -227,7 +250,7 @@ uint64_t PerfCounters::get(int idx) const
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return 0;
-  return data.u64;
+  return data.read_u64();
 }
 
 void PerfCounters::tinc(int idx, utime_t amt, uint32_t avgcount)
@@ -240,7 +263,16 @@ void PerfCounters::tinc(int idx, utime_t amt, uint32_t avgcount)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
-  if (data.type & PERFCOUNTER_LONGRUNAVG) {
+  if (data.shards) {
+    perf_counter_shard_d *shard = data.pick_a_shard();
+    if (data.type & PERFCOUNTER_LONGRUNAVG) {
+      shard->avgcount++;
+      shard->u64 += amt.to_nsec();
+      shard->avgcount2++;
+    } else {
+      shard->u64 += amt.to_nsec();
+    }
+  } else if (data.type & PERFCOUNTER_LONGRUNAVG) {
     data.avgcount++;
     data.u64 += amt.to_nsec();
     data.avgcount2++;
@@ -259,7 +291,16 @@ void PerfCounters::tinc(int idx, ceph::timespan amt, uint32_t avgcount)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
-  if (data.type & PERFCOUNTER_LONGRUNAVG) {
+  if (data.shards) {
+    perf_counter_shard_d *shard = data.pick_a_shard();
+    if (data.type & PERFCOUNTER_LONGRUNAVG) {
+      shard->avgcount++;
+      shard->u64 += amt.count();
+      shard->avgcount2++;
+    } else {
+      shard->u64 += amt.count();
+    }
+  } else if (data.type & PERFCOUNTER_LONGRUNAVG) {
     data.avgcount++;
     data.u64 += amt.count();
     data.avgcount2++;
@@ -278,6 +319,7 @@ void PerfCounters::tset(int idx, utime_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
+  data.clear_shards();
   data.u64 = amt.to_nsec();
   if (data.type & PERFCOUNTER_LONGRUNAVG)
     ceph_abort();
@@ -293,7 +335,7 @@ utime_t PerfCounters::tget(int idx) const
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return utime_t();
-  uint64_t v = data.u64;
+  uint64_t v = data.read_u64();
   return utime_t(v / 1000000000ull, v % 1000000000ull);
 }
 
@@ -436,7 +478,7 @@ void PerfCounters::dump_formatted_generic(Formatter *f, bool schema,
         d->histogram->dump_formatted(f);
         f->close_section();
       } else {
-	uint64_t v = d->u64;
+	uint64_t v = d->read_u64();
 	if (d->type & PERFCOUNTER_U64) {
 	  f->dump_unsigned(d->name, v);
 	} else if (d->type & PERFCOUNTER_TIME) {
@@ -554,6 +596,21 @@ void PerfCountersBuilder::add_impl(
   data.histogram = std::move(histogram);
 }
 
+void PerfCountersBuilder::set_sharded(int idx)
+{
+  assert(idx > m_perf_counters->m_lower_bound);
+  assert(idx < m_perf_counters->m_upper_bound);
+  PerfCounters::perf_counter_data_vec_t &vec(m_perf_counters->m_data);
+  PerfCounters::perf_counter_data_any_d
+    &data(vec[idx - m_perf_counters->m_lower_bound - 1]);
+  // gauges are set() rather than accumulated, histograms have their own
+  // storage
+  assert(data.type & (PERFCOUNTER_COUNTER | PERFCOUNTER_LONGRUNAVG));
+  assert(!(data.type & PERFCOUNTER_HISTOGRAM));
+  data.shards.reset(
+    new PerfCounters::perf_counter_shard_d[PerfCounters::num_shards]);
+}
+
 PerfCounters *PerfCountersBuilder::create_perf_counters()
 {
   PerfCounters::perf_counter_data_vec_t::const_iterator d = m_perf_counters->m_data.begin();
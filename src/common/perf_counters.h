@@ -22,6 +22,7 @@
 #include <memory>
 #include <atomic>
 #include <cstdint>
+#include <pthread.h>
 
 #include "common/perf_histogram.h"
 #include "include/utime.h"
@@ -70,6 +71,24 @@ enum perfcounter_type_d : uint8_t
 class PerfCounters
 {
 public:
+  // hot counters can spread their updates over per-thread shards to
+  // avoid bouncing a single cacheline between all the threads bumping
+  // them; the shards are only summed up when the counter is read.
+  enum {
+    num_shard_bits = 5
+  };
+  enum {
+    num_shards = 1 << num_shard_bits
+  };
+
+  // align shard to a cacheline
+  struct perf_counter_shard_d {
+    std::atomic<uint64_t> u64 = { 0 };
+    std::atomic<uint64_t> avgcount = { 0 };
+    std::atomic<uint64_t> avgcount2 = { 0 };
+    char __padding[128 - sizeof(std::atomic<uint64_t>)*3];
+  } __attribute__ ((aligned (128)));
+
   /** Represents a PerfCounters data element. */
   struct perf_counter_data_any_d {
     perf_counter_data_any_d()
@@ -83,7 +102,7 @@ public:
         description(other.description),
         nick(other.nick),
 	type(other.type),
-	u64(other.u64.load()) {
+	u64(other.read_u64()) {
       pair<uint64_t,uint64_t> a = other.read_avg();
       u64 = a.first;
       avgcount = a.second;
@@ -102,6 +121,7 @@ public:
     std::atomic<uint64_t> avgcount = { 0 };
     std::atomic<uint64_t> avgcount2 = { 0 };
     std::unique_ptr<PerfHistogram<>> histogram;
+    std::unique_ptr<perf_counter_shard_d[]> shards;
 
     void reset()
     {
@@ -109,21 +129,65 @@ public:
 	    u64 = 0;
 	    avgcount = 0;
 	    avgcount2 = 0;
+	    clear_shards();
       }
       if (histogram) {
         histogram->reset();
       }
     }
 
+    void clear_shards() {
+      if (shards) {
+	for (unsigned i = 0; i < num_shards; i++) {
+	  shards[i].u64 = 0;
+	  shards[i].avgcount = 0;
+	  shards[i].avgcount2 = 0;
+	}
+      }
+    }
+
+    perf_counter_shard_d *pick_a_shard() {
+      // pthread_self() is the address of a page aligned thread block, so
+      // its low bits are the same for every thread.  instead, threads
+      // take consecutive shards as they first come through here.
+      static std::atomic<unsigned> next_shard = {0};
+      static thread_local unsigned shard =
+	next_shard++ & ((1 << num_shard_bits) - 1);
+      return &shards[shard];
+    }
+
+    uint64_t read_u64() const {
+      uint64_t v = u64;
+      if (shards) {
+	for (unsigned i = 0; i < num_shards; i++)
+	  v += shards[i].u64;
+      }
+      return v;
+    }
+
     // read <sum, count> safely by making sure the post- and pre-count
     // are identical; in other words the whole loop needs to be run
-    // without any intervening calls to inc, set, or tinc.
+    // without any intervening calls to inc, set, or tinc.  sharded
+    // counters do this for every shard, so each sample is accounted
+    // either fully or not at all.
     pair<uint64_t,uint64_t> read_avg() const {
       uint64_t sum, count;
       do {
 	count = avgcount;
 	sum = u64;
       } while (avgcount2 != count);
+      if (shards) {
+	for (unsigned i = 0; i < num_shards; i++) {
+	  const perf_counter_shard_d &shard = shards[i];
+	  uint64_t shard_sum, shard_count;
+	  do {
+	    shard_count = shard.avgcount;
+	    shard_sum = shard.u64;
+	  } while (shard.avgcount2 != shard_count);
+	  sum += shard_sum;
+	  count += shard_count;
+	}
+      }
       return make_pair(sum, count);
     }
   };
@@ -313,6 +377,10 @@ public:
     const char* nick = NULL,
     int prio=0);
 
+  /// spread the updates of a hot counter or average over per-thread
+  /// shards; call after adding it
+  void set_sharded(int key);
+
   PerfCounters* create_perf_counters();
 private:
   PerfCountersBuilder(const PerfCountersBuilder &rhs);
@@ -12,6 +12,8 @@
  *
  */
 
+#include <cmath>
+#include <cstring>
 #include <random>
 #include <sstream>
 
@@ -111,3 +113,54 @@ CompressorRef Compressor::create(CephContext *cct, int alg)
   std::string type_name = get_comp_alg_name(alg);
   return create(cct, type_name);
 }
+
+double Compressor::estimate_ratio(const bufferlist &in)
+{
+  // sample a few windows spread over the data
+  static const unsigned WINDOWS = 4;
+  static const unsigned WINDOW_LEN = 1024;
+  static const unsigned MIN_LEN = 64;
+  unsigned len = in.length();
+  if (len < MIN_LEN) {
+    return 0;  // too little to tell, and to matter
+  }
+  char sample[WINDOWS * WINDOW_LEN];
+  unsigned n;
+  if (len <= sizeof(sample)) {
+    in.copy(0, len, sample);
+    n = len;
+  } else {
+    for (unsigned w = 0; w < WINDOWS; ++w) {
+      uint64_t off = (uint64_t)w * (len - WINDOW_LEN) / (WINDOWS - 1);
+      in.copy(off, WINDOW_LEN, sample + w * WINDOW_LEN);
+    }
+    n = sizeof(sample);
+  }
+
+  // order-0 entropy alone misses runs and repeated strings, which is
+  // what LZ-style compressors feed on, so also count 4-byte sequences
+  // seen earlier in the sample
+  unsigned counts[256] = {0};
+  uint16_t last[4096] = {0};  // hash of 4 bytes -> position + 1
+  unsigned repeats = 0;
+  for (unsigned i = 0; i < n; ++i) {
+    ++counts[(unsigned char)sample[i]];
+    if (i + 4 <= n) {
+      uint32_t v;
+      memcpy(&v, sample + i, 4);
+      unsigned h = (v * 2654435761u) >> 20;
+      if (last[h] && memcmp(sample + last[h] - 1, sample + i, 4) == 0) {
+	++repeats;
+      }
+      last[h] = i + 1;
+    }
+  }
+  double entropy = 0;
+  for (unsigned c : counts) {
+    if (c) {
+      double p = (double)c / n;
+      entropy -= p * log2(p);
+    }
+  }
+  return std::min(entropy / 8, 1.0 - (double)repeats / (n - 3));
+}
@@ -16,8 +16,10 @@
 #define CEPH_COMPRESSOR_H
 
 
+#include <errno.h>
 #include <memory>
 #include <string>
+#include <vector>
 #include <boost/optional.hpp>
 #include "include/assert.h"	// boost clobbers this
 #include "include/buffer.h"
@@ -66,9 +68,49 @@ public:
   // alignment with decode methods
   virtual int decompress(ceph::bufferlist::iterator &p, size_t compressed_len, ceph::bufferlist &out) = 0;
 
+  /// a trained dictionary, prepared for use by compressors of one type
+  class Dictionary {
+  public:
+    virtual ~Dictionary() {}
+  };
+  typedef std::shared_ptr<Dictionary> DictionaryRef;
+
+  virtual bool supports_dictionaries() const {
+    return false;
+  }
+  /// train a dictionary of at most max_len bytes on samples of the data
+  /// to compress; -EOPNOTSUPP if the algorithm has no dictionaries
+  virtual int train_dictionary(const std::vector<ceph::bufferlist> &samples,
+			       size_t max_len, ceph::bufferlist *dict) {
+    return -EOPNOTSUPP;
+  }
+  /// prepare a trained dictionary, nullptr if it can't be used
+  virtual DictionaryRef load_dictionary(const ceph::bufferlist &dict) {
+    return DictionaryRef();
+  }
+  /// data compressed with a dictionary needs the same one to decompress
+  virtual int compress(const ceph::bufferlist &in, ceph::bufferlist &out,
+		       const Dictionary *dict) {
+    assert(!dict);
+    return compress(in, out);
+  }
+  /// the data was compressed from at most max_len bytes; refuse
+  /// anything claiming to be larger rather than allocating for it
+  virtual int decompress(ceph::bufferlist::iterator &p, size_t compressed_len,
+			 ceph::bufferlist &out, const Dictionary *dict,
+			 size_t max_len) {
+    assert(!dict);
+    return decompress(p, compressed_len, out);
+  }
+
   static CompressorRef create(CephContext *cct, const std::string &type);
   static CompressorRef create(CephContext *cct, int alg);
 
+  /// guess the ratio compressed/original size of the data from a few
+  /// KB sampled from it, at a fraction of the cost of compressing it.
+  /// Close to 1 for random looking (compressed, encrypted) data.
+  static double estimate_ratio(const ceph::bufferlist &in);
+
 protected:
   CompressionAlgorithm alg;
   std::string type;
@@ -16,16 +16,35 @@
 #define CEPH_ZSTDCOMPRESSOR_H
 
 #include "zstd/lib/zstd.h"
+#include "zstd/lib/dictBuilder/zdict.h"
 #include "include/buffer.h"
 #include "include/encoding.h"
 #include "compressor/Compressor.h"
 
 #define COMPRESSION_LEVEL 5
 
+class ZstdDictionary : public Compressor::Dictionary {
+ public:
+  ZSTD_CDict *cdict;
+  ZSTD_DDict *ddict;
+
+  // both copy the dictionary content
+  ZstdDictionary(const char *dict, size_t len)
+    : cdict(ZSTD_createCDict(dict, len, COMPRESSION_LEVEL)),
+      ddict(ZSTD_createDDict(dict, len)) {}
+  ~ZstdDictionary() override {
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+  }
+};
+
 class ZstdCompressor : public Compressor {
  public:
   ZstdCompressor() : Compressor(COMP_ALG_ZSTD, "zstd") {}
 
+  using Compressor::compress;
+  using Compressor::decompress;
+
   int compress(const bufferlist &src, bufferlist &dst) override {
     bufferptr outptr = buffer::create_page_aligned(
       ZSTD_compressBound(src.length()));
@@ -94,6 +113,95 @@ class ZstdCompressor : public Compressor {
     dst.append(dstptr, 0, outbuf.pos);
     return 0;
   }
+
+  bool supports_dictionaries() const override {
+    return true;
+  }
+
+  int train_dictionary(const std::vector<bufferlist> &samples,
+		       size_t max_len, bufferlist *dict) override {
+    bufferlist all;
+    std::vector<size_t> sizes;
+    for (auto& s : samples) {
+      all.append(s);
+      sizes.push_back(s.length());
+    }
+    bufferptr dictptr(max_len);
+    size_t r = ZDICT_trainFromBuffer(dictptr.c_str(), max_len, all.c_str(),
+				     sizes.data(), (unsigned)sizes.size());
+    if (ZDICT_isError(r)) {
+      return -EINVAL;
+    }
+    dict->append(dictptr, 0, r);
+    return 0;
+  }
+
+  DictionaryRef load_dictionary(const bufferlist &dict) override {
+    bufferlist flat = dict;
+    auto d = std::make_shared<ZstdDictionary>(flat.c_str(), flat.length());
+    if (!d->cdict || !d->ddict) {
+      return DictionaryRef();
+    }
+    return d;
+  }
+
+  // the dictionary is meant for small buffers, so these work on flat
+  // copies rather than streaming
+  int compress(const bufferlist &src, bufferlist &dst,
+	       const Dictionary *dict) override {
+    if (!dict) {
+      return compress(src, dst);
+    }
+    auto zd = static_cast<const ZstdDictionary*>(dict);
+    bufferlist in = src;
+    bufferptr outptr = buffer::create_page_aligned(
+      ZSTD_compressBound(in.length()));
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    size_t r = ZSTD_compress_usingCDict(cctx, outptr.c_str(), outptr.length(),
+					in.c_str(), in.length(), zd->cdict);
+    ZSTD_freeCCtx(cctx);
+    if (ZSTD_isError(r)) {
+      return -EIO;
+    }
+
+    // prefix with decompressed length
+    ::encode((uint32_t)src.length(), dst);
+    dst.append(outptr, 0, r);
+    return 0;
+  }
+
+  int decompress(bufferlist::iterator &p,
+		 size_t compressed_len,
+		 bufferlist &dst,
+		 const Dictionary *dict,
+		 size_t max_len) override {
+    if (!dict) {
+      return decompress(p, compressed_len, dst);
+    }
+    if (compressed_len < 4) {
+      return -1;
+    }
+    compressed_len -= 4;
+    uint32_t dst_len;
+    ::decode(dst_len, p);
+    if (dst_len > max_len) {
+      return -1;
+    }
+
+    auto zd = static_cast<const ZstdDictionary*>(dict);
+    bufferlist in;
+    p.copy(compressed_len, in);
+    bufferptr dstptr(dst_len);
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    size_t r = ZSTD_decompress_usingDDict(dctx, dstptr.c_str(), dstptr.length(),
+					  in.c_str(), in.length(), zd->ddict);
+    ZSTD_freeDCtx(dctx);
+    if (ZSTD_isError(r)) {
+      return -1;
+    }
+    dst.append(dstptr, 0, r);
+    return 0;
+  }
 };
 
 #endif
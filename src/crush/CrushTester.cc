@@ -471,6 +471,13 @@ void CrushTester::check_overlapped_rules() const
 
 int CrushTester::test()
 {
+  if (check_straw2_simd && !crush_straw2_simd()) {
+    err << "straw2 simd is not available or is disabled on this host"
+        << std::endl;
+    return -EINVAL;
+  }
+  int straw2_simd_mismatches = 0;
+
   if (min_rule < 0 || max_rule < 0) {
     min_rule = 0;
     max_rule = crush.get_max_rules() - 1;
@@ -616,6 +623,18 @@ int CrushTester::test()
               real_x = crush_hash32_2(CRUSH_HASH_RJENKINS1, x, (uint32_t)pool_id);
             }
             crush.do_rule(r, real_x, out, nr, weight, 0);
+            if (check_straw2_simd) {
+              vector<int> scalar_out;
+              crush_set_straw2_simd(0);
+              crush.do_rule(r, real_x, scalar_out, nr, weight, 0);
+              crush_set_straw2_simd(1);
+              if (scalar_out != out) {
+                err << "straw2 simd mismatch rule " << r << " x " << x
+                    << " simd " << out << " scalar " << scalar_out
+                    << std::endl;
+                ++straw2_simd_mismatches;
+              }
+            }
           } else {
             if (output_mappings)
 	      err << "RNG"; // prepend RNG to placement output to denote simulation
@@ -721,5 +740,9 @@ int CrushTester::test()
     crush.stop_choose_profile();
   }
 
+  if (straw2_simd_mismatches) {
+    err << straw2_simd_mismatches << " straw2 simd mismatches" << std::endl;
+    return -EINVAL;
+  }
   return 0;
 }
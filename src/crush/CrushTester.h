@@ -21,6 +21,7 @@ class CrushTester {
 
   int num_batches;
   bool use_crush;
+  bool check_straw2_simd;
 
   float mark_down_device_ratio;
   float mark_down_bucket_ratio;
@@ -175,6 +176,7 @@ public:
       pool_id(-1),
       num_batches(1),
       use_crush(true),
+      check_straw2_simd(false),
       mark_down_device_ratio(0.0),
       mark_down_bucket_ratio(1.0),
       output_utilization(false),
@@ -266,6 +268,17 @@ public:
     return use_crush == false;
   }
 
+  /*
+   * map every input a second time with the scalar straw2 code and report
+   * any difference from the vectorized result
+   */
+  void set_check_straw2_simd(bool b) {
+    check_straw2_simd = b;
+  }
+  bool get_check_straw2_simd() const {
+    return check_straw2_simd;
+  }
+
   void set_bucket_down_ratio(float bucket_ratio) {
     mark_down_bucket_ratio = bucket_ratio;
   }
@@ -25,6 +25,12 @@
 #include "crush_ln_table.h"
 #include "mapper.h"
 
+#if !defined(__KERNEL__) && defined(HAVE_INTEL_AVX2)
+# include "arch/intel.h"
+# include "mapper_avx2.h"
+# define CRUSH_STRAW2_AVX2 1
+#endif
+
 #define dprintk(args...) /* printf(args) */
 
 /*
@@ -319,6 +325,65 @@ static inline __s32 *get_choose_arg_ids(const struct crush_bucket_straw2 *bucket
   return arg->ids;
 }
 
+#ifndef __KERNEL__
+static int straw2_simd = 1;
+
+void crush_set_straw2_simd(int enable)
+{
+	straw2_simd = enable;
+}
+
+int crush_straw2_simd(void)
+{
+#ifdef CRUSH_STRAW2_AVX2
+	return straw2_simd && ceph_arch_intel_avx2;
+#else
+	return 0;
+#endif
+}
+#endif
+
+#ifdef CRUSH_STRAW2_AVX2
+/*
+ * same as the loop in bucket_straw2_choose(), but with the hash and ln
+ * computed by crush_straw2_ln_avx2() for 8 items at a time.  the 64-bit
+ * division by the item weight is left scalar.
+ */
+static int bucket_straw2_choose_avx2(const struct crush_bucket_straw2 *bucket,
+				     int x, int r, const __u32 *weights,
+				     const __s32 *ids)
+{
+	unsigned int i, j, n, high = 0;
+	unsigned int size = bucket->h.size;
+	unsigned int vsize = size & ~(CRUSH_STRAW2_AVX2_LANES - 1);
+	__s64 ln[CRUSH_STRAW2_AVX2_LANES], draw, high_draw = 0;
+
+	for (i = 0; i < size; i += n) {
+		if (i < vsize) {
+			crush_straw2_ln_avx2(x, r, ids + i, ln);
+			n = CRUSH_STRAW2_AVX2_LANES;
+		} else {
+			unsigned int u = crush_hash32_3(bucket->h.hash, x,
+							ids[i], r) & 0xffff;
+			ln[0] = crush_ln(u) - 0x1000000000000ll;
+			n = 1;
+		}
+		for (j = 0; j < n; j++) {
+			if (weights[i + j])
+				draw = div64_s64(ln[j], weights[i + j]);
+			else
+				draw = S64_MIN;
+			if (i + j == 0 || draw > high_draw) {
+				high = i + j;
+				high_draw = draw;
+			}
+		}
+	}
+
+	return bucket->h.items[high];
+}
+#endif
+
 static int bucket_straw2_choose(const struct crush_bucket_straw2 *bucket,
 				int x, int r, const struct crush_choose_arg *arg,
                                 int position)
@@ -328,6 +393,10 @@ static int bucket_straw2_choose(const struct crush_bucket_straw2 *bucket,
 	__s64 ln, draw, high_draw = 0;
         __u32 *weights = get_choose_arg_weights(bucket, arg, position);
         __s32 *ids = get_choose_arg_ids(bucket, arg);
+#ifdef CRUSH_STRAW2_AVX2
+	if (bucket->h.hash == CRUSH_HASH_RJENKINS1 && crush_straw2_simd())
+		return bucket_straw2_choose_avx2(bucket, x, r, weights, ids);
+#endif
 	for (i = 0; i < bucket->h.size; i++) {
                 dprintk("weight 0x%x item %d\n", weights[i], ids[i]);
 		if (weights[i]) {
@@ -11,6 +11,18 @@
 #include "crush.h"
 
 extern int crush_find_rule(const struct crush_map *map, int ruleset, int type, int size);
+
+#ifndef __KERNEL__
+/*
+ * straw2 draws are computed with a vectorized kernel (AVX2) where the cpu
+ * supports it.  the mappings are identical either way; the switch exists
+ * so the two paths can be compared and benchmarked.  it is process wide,
+ * so only flip it when nothing else is mapping.
+ */
+extern void crush_set_straw2_simd(int enable);
+/* return 1 if straw2 draws are currently vectorized */
+extern int crush_straw2_simd(void);
+#endif
 /** @ingroup API
  *
  * Map __x__ to __result_max__ items and store them in the __result__
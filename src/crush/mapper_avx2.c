@@ -0,0 +1,126 @@
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * straw2 draws for 8 bucket items at a time.  Each step below mirrors the
+ * scalar crush_hash32_rjenkins1_3() (hash.c) and crush_ln() (mapper.c)
+ * lane by lane, so the results are bit-identical; any change to either
+ * of those must be reflected here.
+ *
+ * This file is built with -mavx2; callers must check for AVX2 support
+ * at runtime before calling into it.
+ */
+
+#include <immintrin.h>
+
+#include "crush_compat.h"
+#include "crush_ln_table.h"
+#include "mapper_avx2.h"
+
+/*
+ * one line of crush_hashmix(): a = a-b; a = a-c; a = a^shifted
+ */
+#define hashmix_step(a, b, c, shifted)					\
+	a = _mm256_xor_si256(_mm256_sub_epi32(_mm256_sub_epi32(a, b), c), \
+			     shifted)
+
+#define hashmix(a, b, c) do {						\
+		hashmix_step(a, b, c, _mm256_srli_epi32(c, 13));	\
+		hashmix_step(b, c, a, _mm256_slli_epi32(a, 8));		\
+		hashmix_step(c, a, b, _mm256_srli_epi32(b, 13));	\
+		hashmix_step(a, b, c, _mm256_srli_epi32(c, 12));	\
+		hashmix_step(b, c, a, _mm256_slli_epi32(a, 16));	\
+		hashmix_step(c, a, b, _mm256_srli_epi32(b, 5));		\
+		hashmix_step(a, b, c, _mm256_srli_epi32(c, 3));		\
+		hashmix_step(b, c, a, _mm256_slli_epi32(a, 10));	\
+		hashmix_step(c, a, b, _mm256_srli_epi32(b, 15));	\
+	} while (0)
+
+/* crush_hash32_rjenkins1_3(a, b, c) with a and c shared by all lanes */
+static inline __m256i hash32_rjenkins1_3(__u32 x, __m256i b, __u32 r)
+{
+	__m256i a = _mm256_set1_epi32(x);
+	__m256i c = _mm256_set1_epi32(r);
+	__m256i hash = _mm256_xor_si256(_mm256_set1_epi32(1315423911 ^ x ^ r),
+					b);
+	__m256i vx = _mm256_set1_epi32(231232);
+	__m256i vy = _mm256_set1_epi32(1232);
+
+	hashmix(a, b, hash);
+	hashmix(c, vx, hash);
+	hashmix(vy, a, hash);
+	hashmix(b, vx, hash);
+	hashmix(vy, c, hash);
+	return hash;
+}
+
+/*
+ * crush_ln() for the 4 lanes of x (already normalized into
+ * [0x8000, 0x10000]) and iexpon, returning 2^44*log2(xin+1) in 64-bit
+ * lanes
+ */
+static inline __m256i ln_half(__m128i x, __m128i iexpon)
+{
+	const long long *rh_lh = (const long long *)__RH_LH_tbl;
+	const long long *ll_tbl = (const long long *)__LL_tbl;
+
+	/* index1 = (x >> 8) << 1, relative to the start of the table */
+	__m128i index1 = _mm_sub_epi32(_mm_slli_epi32(_mm_srli_epi32(x, 8), 1),
+				       _mm_set1_epi32(256));
+	__m256i RH = _mm256_i32gather_epi64(rh_lh, index1, 8);
+	__m256i LH = _mm256_i32gather_epi64(rh_lh + 1, index1, 8);
+
+	/* xl64 = (x * RH) >> 48; x < 2^17, so two 32x32 products suffice */
+	__m256i x64 = _mm256_cvtepu32_epi64(x);
+	__m256i xl64 = _mm256_add_epi64(
+		_mm256_mul_epu32(x64, RH),
+		_mm256_slli_epi64(
+			_mm256_mul_epu32(x64, _mm256_srli_epi64(RH, 32)), 32));
+	xl64 = _mm256_srli_epi64(xl64, 48);
+
+	__m256i index2 = _mm256_and_si256(xl64, _mm256_set1_epi64x(0xff));
+	__m256i LL = _mm256_i64gather_epi64(ll_tbl, index2, 8);
+
+	LH = _mm256_srli_epi64(_mm256_add_epi64(LH, LL), 48 - 12 - 32);
+	return _mm256_add_epi64(
+		_mm256_slli_epi64(_mm256_cvtepu32_epi64(iexpon), 12 + 32), LH);
+}
+
+void crush_straw2_ln_avx2(int x, int r, const __s32 *ids, __s64 *ln)
+{
+	__m256i vids = _mm256_loadu_si256((const __m256i *)ids);
+	__m256i u = _mm256_and_si256(hash32_rjenkins1_3(x, vids, r),
+				     _mm256_set1_epi32(0xffff));
+
+	/* crush_ln(): x = u + 1, normalized so that bit 15 or 16 is set */
+	__m256i vx = _mm256_add_epi32(u, _mm256_set1_epi32(1));
+
+	/*
+	 * vx is at most 0x10000, so it converts to float exactly and the
+	 * exponent field is floor(log2(vx)); the shift is 15 minus that,
+	 * or 0 if bit 15 or 16 is already set.
+	 */
+	__m256i log2x = _mm256_sub_epi32(
+		_mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(vx)), 23),
+		_mm256_set1_epi32(127));
+	__m256i bits = _mm256_max_epi32(
+		_mm256_sub_epi32(_mm256_set1_epi32(15), log2x),
+		_mm256_setzero_si256());
+	vx = _mm256_sllv_epi32(vx, bits);
+	__m256i iexpon = _mm256_sub_epi32(_mm256_set1_epi32(15), bits);
+
+	const __m256i bias = _mm256_set1_epi64x(0x1000000000000ll);
+	__m256i lo = ln_half(_mm256_castsi256_si128(vx),
+			     _mm256_castsi256_si128(iexpon));
+	__m256i hi = ln_half(_mm256_extracti128_si256(vx, 1),
+			     _mm256_extracti128_si256(iexpon, 1));
+	_mm256_storeu_si256((__m256i *)ln, _mm256_sub_epi64(lo, bias));
+	_mm256_storeu_si256((__m256i *)(ln + 4), _mm256_sub_epi64(hi, bias));
+}
@@ -0,0 +1,25 @@
+#ifndef CEPH_CRUSH_MAPPER_AVX2_H
+#define CEPH_CRUSH_MAPPER_AVX2_H
+
+/*
+ * AVX2 kernel for straw2 bucket selection.
+ *
+ * LGPL2
+ */
+
+#include "crush.h"
+
+/* number of bucket items handled per call */
+#define CRUSH_STRAW2_AVX2_LANES 8
+
+/*
+ * For i in [0, CRUSH_STRAW2_AVX2_LANES), compute
+ *
+ *   ln[i] = crush_ln(crush_hash32_rjenkins1_3(x, ids[i], r) & 0xffff) - 2^48
+ *
+ * i.e. the numerator of the straw2 draw for each item, bit-identical to
+ * the scalar code in mapper.c.  Only valid if the cpu supports AVX2.
+ */
+extern void crush_straw2_ln_avx2(int x, int r, const __s32 *ids, __s64 *ln);
+
+#endif
@@ -222,6 +222,51 @@ int ErasureCode::decode_chunks(const set<int> &want_to_read,
   assert("ErasureCode::decode_chunks not implemented" == 0);
 }
 
+int ErasureCode::encode_stripes(const set<int> &want_to_encode,
+				unsigned chunk_size,
+				map<int, bufferlist> *encoded)
+{
+  unsigned length = encoded->begin()->second.length();
+  assert(length % chunk_size == 0);
+  for (unsigned offset = 0; offset < length; offset += chunk_size) {
+    // the chunks of a stripe share the memory of the whole buffers,
+    // encode_chunks writes the coding chunks through them
+    map<int, bufferlist> stripe;
+    for (auto &&i : *encoded) {
+      assert(i.second.length() == length);
+      stripe[i.first].substr_of(i.second, offset, chunk_size);
+    }
+    int r = encode_chunks(want_to_encode, &stripe);
+    if (r)
+      return r;
+  }
+  return 0;
+}
+
+int ErasureCode::decode_stripes(const set<int> &want_to_read,
+				unsigned chunk_size,
+				const map<int, bufferlist> &chunks,
+				map<int, bufferlist> *decoded)
+{
+  unsigned length = chunks.begin()->second.length();
+  assert(length % chunk_size == 0);
+  for (unsigned offset = 0; offset < length; offset += chunk_size) {
+    map<int, bufferlist> stripe;
+    for (auto &&i : chunks) {
+      assert(i.second.length() == length);
+      stripe[i.first].substr_of(i.second, offset, chunk_size);
+    }
+    map<int, bufferlist> stripe_decoded;
+    int r = decode(want_to_read, stripe, &stripe_decoded);
+    if (r)
+      return r;
+    for (auto &&i : stripe_decoded) {
+      (*decoded)[i.first].claim_append(i.second);
+    }
+  }
+  return 0;
+}
+
 int ErasureCode::parse(const ErasureCodeProfile &profile,
 		       ostream *ss)
 {
@@ -320,3 +365,61 @@ int ErasureCode::decode_concat(const map<int, bufferlist> &chunks,
   }
   return r;
 }
+
+int ErasureCode::apply_delta(const map<int, bufferlist> &old_data,
+			     const map<int, bufferlist> &new_data,
+			     map<int, bufferlist> *coding)
+{
+  if (!supports_parity_delta())
+    return -EOPNOTSUPP;
+  if (new_data.empty() || old_data.size() != new_data.size())
+    return -EINVAL;
+  unsigned int k = get_data_chunk_count();
+  unsigned int m = get_chunk_count() - k;
+  unsigned blocksize = new_data.begin()->second.length();
+
+  // the code is linear: encoding the xor of the old and new data, with
+  // the untouched data chunks set to zero, yields the coding deltas
+  map<int, bufferlist> delta;
+  for (unsigned int i = 0; i < k + m; i++) {
+    bufferptr buf(buffer::create_aligned(blocksize, SIMD_ALIGN));
+    if (i < k && new_data.count(i)) {
+      auto old_iter = old_data.find(i);
+      if (old_iter == old_data.end() ||
+	  old_iter->second.length() != blocksize ||
+	  new_data.find(i)->second.length() != blocksize)
+	return -EINVAL;
+      bufferlist o = old_iter->second;
+      bufferlist n = new_data.find(i)->second;
+      const char *op = o.c_str();
+      const char *np = n.c_str();
+      char *dp = buf.c_str();
+      for (unsigned j = 0; j < blocksize; j++)
+	dp[j] = op[j] ^ np[j];
+    } else {
+      buf.zero();
+    }
+    delta[i].push_back(std::move(buf));
+  }
+  set<int> want_to_encode;
+  for (unsigned int i = 0; i < k + m; i++)
+    want_to_encode.insert(i);
+  int r = encode_chunks(want_to_encode, &delta);
+  if (r)
+    return r;
+
+  for (auto &&i : *coding) {
+    if (i.first < (int)k || i.first >= (int)(k + m) ||
+	i.second.length() != blocksize)
+      return -EINVAL;
+    bufferptr buf(buffer::create_aligned(blocksize, SIMD_ALIGN));
+    const char *cp = i.second.c_str();
+    const char *dp = delta[i.first].c_str();
+    char *bp = buf.c_str();
+    for (unsigned j = 0; j < blocksize; j++)
+      bp[j] = cp[j] ^ dp[j];
+    i.second.clear();
+    i.second.push_back(std::move(buf));
+  }
+  return 0;
+}
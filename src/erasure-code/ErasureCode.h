@@ -82,6 +82,15 @@ namespace ceph {
                               const std::map<int, bufferlist> &chunks,
                               std::map<int, bufferlist> *decoded) override;
 
+    int encode_stripes(const std::set<int> &want_to_encode,
+                       unsigned chunk_size,
+                       std::map<int, bufferlist> *encoded) override;
+
+    int decode_stripes(const std::set<int> &want_to_read,
+                       unsigned chunk_size,
+                       const std::map<int, bufferlist> &chunks,
+                       std::map<int, bufferlist> *decoded) override;
+
     const std::vector<int> &get_chunk_mapping() const override;
 
     int to_mapping(const ErasureCodeProfile &profile,
@@ -108,6 +117,14 @@ namespace ceph {
     int decode_concat(const std::map<int, bufferlist> &chunks,
 			      bufferlist *decoded) override;
 
+    bool supports_parity_delta() const override {
+      return false;
+    }
+
+    int apply_delta(const std::map<int, bufferlist> &old_data,
+		    const std::map<int, bufferlist> &new_data,
+		    std::map<int, bufferlist> *coding) override;
+
   protected:
     int parse(const ErasureCodeProfile &profile,
 	      std::ostream *ss);
@@ -358,6 +358,31 @@ namespace ceph {
     virtual int encode_chunks(const std::set<int> &want_to_encode,
                               std::map<int, bufferlist> *encoded) = 0;
 
+    /**
+     * Encode several stripes in a single call. Each bufferlist of
+     * **encoded** holds the chunks of one index for all the stripes,
+     * back to back: the stripes are **chunk_size** bytes apart in
+     * each of them. There must be a contiguous bufferlist, SIMD
+     * aligned, for every chunk index. The data chunks are filled in
+     * by the caller and the coding chunks are computed in place.
+     *
+     * **chunk_size** must be a chunk size returned by
+     * **get_chunk_size**. The result is the same as encoding each
+     * stripe on its own, which is what the default implementation
+     * does, but plugins can run their encoding loops over all the
+     * stripes at once.
+     *
+     * Returns 0 on success.
+     *
+     * @param [in] want_to_encode chunk indexes to be encoded
+     * @param [in] chunk_size size of a chunk in one stripe
+     * @param [in,out] encoded map chunk indexes to chunk data
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int encode_stripes(const std::set<int> &want_to_encode,
+                               unsigned chunk_size,
+                               std::map<int, bufferlist> *encoded) = 0;
+
     /**
      * Decode the **chunks** and store at least **want_to_read**
      * chunks in **decoded**.
@@ -399,6 +424,27 @@ namespace ceph {
                               const std::map<int, bufferlist> &chunks,
                               std::map<int, bufferlist> *decoded) = 0;
 
+    /**
+     * Decode several stripes in a single call, as **decode** would
+     * for each of them. Each bufferlist of **chunks** holds the
+     * chunks of one index for all the stripes, back to back, and
+     * each bufferlist of **decoded** will hold them the same way.
+     * All the bufferlists of **chunks** have the same length, a
+     * multiple of **chunk_size**.
+     *
+     * Returns 0 on success.
+     *
+     * @param [in] want_to_read chunk indexes to be decoded
+     * @param [in] chunk_size size of a chunk in one stripe
+     * @param [in] chunks map chunk indexes to chunk data
+     * @param [out] decoded map chunk indexes to chunk data
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int decode_stripes(const std::set<int> &want_to_read,
+                               unsigned chunk_size,
+                               const std::map<int, bufferlist> &chunks,
+                               std::map<int, bufferlist> *decoded) = 0;
+
     /**
      * Return the ordered list of chunks or an empty vector
      * if no remapping is necessary.
@@ -446,6 +492,37 @@ namespace ceph {
      */
     virtual int decode_concat(const std::map<int, bufferlist> &chunks,
 			      bufferlist *decoded) = 0;
+
+    /**
+     * Return true if **apply_delta** can update coding chunks from
+     * the old and new content of a subset of the data chunks. This
+     * holds for linear codes that do not remap chunks.
+     *
+     * @return **true** if parity delta updates are supported
+     */
+    virtual bool supports_parity_delta() const = 0;
+
+    /**
+     * Update the **coding** chunks of a stripe after the data chunks
+     * in **old_data** were replaced with the content of
+     * **new_data**. The data chunks that are not in **old_data** are
+     * unchanged and do not need to be provided. **old_data** and
+     * **new_data** must have the same keys, all chunks have the same
+     * size, which must be a chunk size the plugin can encode.
+     *
+     * Each coding chunk in **coding** is replaced with its updated
+     * content, the keys not in **coding** are not computed.
+     *
+     * Returns -EOPNOTSUPP if **supports_parity_delta** is false.
+     *
+     * @param [in] old_data map data chunk indexes to their old content
+     * @param [in] new_data map data chunk indexes to their new content
+     * @param [in,out] coding map coding chunk indexes to their content
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int apply_delta(const std::map<int, bufferlist> &old_data,
+			    const std::map<int, bufferlist> &new_data,
+			    std::map<int, bufferlist> *coding) = 0;
   };
 
   typedef std::shared_ptr<ErasureCodeInterface> ErasureCodeInterfaceRef;
@@ -89,6 +89,23 @@ int ErasureCodeIsa::encode_chunks(const set<int> &want_to_encode,
   return 0;
 }
 
+int ErasureCodeIsa::encode_stripes(const set<int> &want_to_encode,
+                                   unsigned chunk_size,
+                                   map<int, bufferlist> *encoded)
+{
+  // the codes work byte by byte, the stripes are encoded as if they
+  // were one long chunk
+  return encode_chunks(want_to_encode, encoded);
+}
+
+int ErasureCodeIsa::decode_stripes(const set<int> &want_to_read,
+                                   unsigned chunk_size,
+                                   const map<int, bufferlist> &chunks,
+                                   map<int, bufferlist> *decoded)
+{
+  return decode(want_to_read, chunks, decoded);
+}
+
 int ErasureCodeIsa::decode_chunks(const set<int> &want_to_read,
                                   const map<int, bufferlist> &chunks,
                                   map<int, bufferlist> *decoded)
@@ -106,6 +106,24 @@ int ErasureCodeJerasure::encode_chunks(const set<int> &want_to_encode,
   return 0;
 }
 
+int ErasureCodeJerasure::encode_stripes(const set<int> &want_to_encode,
+					unsigned chunk_size,
+					map<int, bufferlist> *encoded)
+{
+  // every technique encodes w-bit words or w * packetsize blocks
+  // independently of each other and chunk_size is a multiple of both,
+  // the stripes are encoded as if they were one long chunk
+  return encode_chunks(want_to_encode, encoded);
+}
+
+int ErasureCodeJerasure::decode_stripes(const set<int> &want_to_read,
+					unsigned chunk_size,
+					const map<int, bufferlist> &chunks,
+					map<int, bufferlist> *decoded)
+{
+  return decode(want_to_read, chunks, decoded);
+}
+
 int ErasureCodeJerasure::decode_chunks(const set<int> &want_to_read,
 				       const map<int, bufferlist> &chunks,
 				       map<int, bufferlist> *decoded)
@@ -63,6 +63,19 @@ public:
 			    const std::map<int, bufferlist> &chunks,
 			    std::map<int, bufferlist> *decoded) override;
 
+  int encode_stripes(const std::set<int> &want_to_encode,
+                     unsigned chunk_size,
+                     std::map<int, bufferlist> *encoded) override;
+
+  int decode_stripes(const std::set<int> &want_to_read,
+                     unsigned chunk_size,
+                     const std::map<int, bufferlist> &chunks,
+                     std::map<int, bufferlist> *decoded) override;
+
+  bool supports_parity_delta() const override {
+    return chunk_mapping.empty();
+  }
+
   int init(ErasureCodeProfile &profile, std::ostream *ss) override;
 
   virtual void jerasure_encode(char **data,
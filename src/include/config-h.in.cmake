@@ -108,6 +108,9 @@
 /* PMEM conditional compilation */
 #cmakedefine HAVE_PMEM
 
+/* Defined if you have liburing */
+#cmakedefine HAVE_LIBURING
+
 /* Defined if LevelDB supports bloom filters */
 #cmakedefine HAVE_LEVELDB_FILTER_POLICY
 
@@ -232,6 +235,9 @@
 /* Support SSE2 (Streaming SIMD Extensions 2) instructions */
 #cmakedefine HAVE_SSE2
 
+/* Compiler supports AVX2 (-mavx2) */
+#cmakedefine HAVE_INTEL_AVX2
+
 /* Define to 1 if you have the `pipe2' function. */
 #cmakedefine HAVE_PIPE2 1
 
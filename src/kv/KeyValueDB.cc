@@ -2,6 +2,8 @@
 // vim: ts=8 sw=2 smarttab
 
 #include "KeyValueDB.h"
+#include "include/str_list.h"
+#include "common/strtol.h"
 #ifdef WITH_LEVELDB
 #include "LevelDBStore.h"
 #endif
@@ -64,3 +66,38 @@ int KeyValueDB::test_init(const string& type, const string& dir)
   }
   return -EINVAL;
 }
+
+int KeyValueDB::parse_column_families(const string& spec,
+				      std::vector<ColumnFamily> *cfs)
+{
+  for (auto& item : get_str_vec(spec, " \t\n")) {
+    size_t eq = item.find('=');
+    if (eq == string::npos || eq == 0)
+      return -EINVAL;
+    string name = item.substr(0, eq);
+    string options = item.substr(eq + 1);
+    size_t shard_cnt = 1;
+    size_t paren = name.find('(');
+    if (paren != string::npos) {
+      if (name.back() != ')' || paren == 0)
+	return -EINVAL;
+      string err;
+      int n = strict_strtol(name.substr(paren + 1,
+					name.size() - paren - 2).c_str(),
+			    10, &err);
+      if (!err.empty() || n < 1)
+	return -EINVAL;
+      shard_cnt = n;
+      name = name.substr(0, paren);
+    }
+    // '-' separates the shard number in the backend's family names
+    if (name.find('-') != string::npos || name == "default")
+      return -EINVAL;
+    for (auto& cf : *cfs) {
+      if (cf.name == name)
+	return -EINVAL;
+    }
+    cfs->emplace_back(name, shard_cnt, options);
+  }
+  return 0;
+}
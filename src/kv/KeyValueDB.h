@@ -8,6 +8,7 @@
 #include <set>
 #include <map>
 #include <string>
+#include <vector>
 #include "include/memory.h"
 #include <boost/scoped_ptr.hpp>
 #include "include/encoding.h"
@@ -146,6 +147,44 @@ public:
   virtual int create_and_open(std::ostream &out) = 0;
   virtual void close() { }
 
+  /// a prefix that is stored apart from the rest of the keyspace
+  struct ColumnFamily {
+    std::string name;      ///< key prefix mapped onto this column family
+    size_t shard_cnt = 1;  ///< number of hash shards the prefix is split into
+    std::string options;   ///< backend option string for this family
+
+    ColumnFamily(const std::string &name, size_t shard_cnt,
+		 const std::string &options)
+      : name(name), shard_cnt(shard_cnt), options(options) {}
+  };
+
+  /**
+   * parse a column family layout
+   *
+   * The layout is a whitespace separated list of name[(shards)]=options
+   * items, e.g. "O(4)= M(4)= L=write_buffer_size=16M b=".
+   */
+  static int parse_column_families(const std::string &spec,
+				   std::vector<ColumnFamily> *cfs);
+
+  /// Setup the column family layout, this needs to be done BEFORE the DB is
+  /// opened.  New dbs are created with this layout; existing dbs keep the
+  /// layout they were created (or resharded) with and only pick up options.
+  virtual int set_column_families(const std::vector<ColumnFamily> &cfs) {
+    return -EOPNOTSUPP;
+  }
+  /// Open a db whose last reshard may have been interrupted.  Such a db
+  /// must only be resharded; open() refuses it because some keys are not
+  /// visible until the reshard is finished.
+  virtual int open_for_reshard(std::ostream &out) {
+    return open(out);
+  }
+  /// move the keys of an open db into a new column family layout
+  virtual int reshard(const std::vector<ColumnFamily> &cfs,
+		      std::ostream &out) {
+    return -EOPNOTSUPP;
+  }
+
   virtual Transaction get_transaction() = 0;
   virtual int submit_transaction(Transaction) = 0;
   virtual int submit_transaction_sync(Transaction t) {
@@ -296,7 +335,7 @@ public:
   }
 
   Iterator get_iterator(const std::string &prefix) {
-    return std::make_shared<IteratorImpl>(prefix, get_iterator());
+    return _get_iterator(prefix);
   }
 
   virtual uint64_t get_estimated_size(std::map<std::string,uint64_t> &extra) = 0;
@@ -356,6 +395,9 @@ protected:
 			std::shared_ptr<MergeOperator> > > merge_ops;
 
   virtual WholeSpaceIterator _get_iterator() = 0;
+  virtual Iterator _get_iterator(const std::string &prefix) {
+    return std::make_shared<IteratorImpl>(prefix, get_iterator());
+  }
 };
 
 #endif
@@ -1,6 +1,7 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include <algorithm>
 #include <set>
 #include <map>
 #include <string>
@@ -21,6 +22,7 @@
 using std::string;
 #include "common/perf_counters.h"
 #include "common/debug.h"
+#include "include/ceph_hash.h"
 #include "include/str_list.h"
 #include "include/stringify.h"
 #include "include/str_map.h"
@@ -106,6 +108,145 @@ int RocksDBStore::set_merge_operator(
   return 0;
 }
 
+//
+// Merge operator for a column family that holds a single prefix; keys in
+// the family carry no prefix so we link straight to its operator.
+//
+class RocksDBStore::MergeOperatorLinker
+  : public rocksdb::AssociativeMergeOperator {
+  std::shared_ptr<KeyValueDB::MergeOperator> mop;
+  string name;
+public:
+  explicit MergeOperatorLinker(
+    const std::shared_ptr<KeyValueDB::MergeOperator> &o)
+    : mop(o), name(o->name()) {}
+
+  const char *Name() const override {
+    return name.c_str();
+  }
+
+  bool Merge(const rocksdb::Slice& key,
+	     const rocksdb::Slice* existing_value,
+	     const rocksdb::Slice& value,
+	     std::string* new_value,
+	     rocksdb::Logger* logger) const override {
+    if (existing_value) {
+      mop->merge(existing_value->data(), existing_value->size(),
+		 value.data(), value.size(),
+		 new_value);
+    } else {
+      mop->merge_nonexistent(value.data(), value.size(), new_value);
+    }
+    return true;
+  }
+};
+
+int RocksDBStore::set_column_families(const std::vector<ColumnFamily> &cfs)
+{
+  // If you fail here, it's because you can't do this on an open database
+  assert(db == nullptr);
+  cf_specs = cfs;
+  return 0;
+}
+
+string RocksDBStore::get_cf_name(const string &prefix, size_t shard,
+				 size_t shard_cnt)
+{
+  if (shard_cnt == 1)
+    return prefix;
+  return prefix + "-" + stringify(shard);
+}
+
+rocksdb::ColumnFamilyHandle *RocksDBStore::get_cf_handle(
+  const string &prefix, const char *key, size_t keylen)
+{
+  auto p = cf_handles.find(prefix);
+  if (p == cf_handles.end())
+    return nullptr;
+  if (p->second.size() == 1)
+    return p->second[0];
+  return p->second[ceph_str_hash_rjenkins(key, keylen) % p->second.size()];
+}
+
+int RocksDBStore::_make_cf_options(const string &prefix,
+				   const string &opt_str,
+				   rocksdb::ColumnFamilyOptions *cf_opt)
+{
+  *cf_opt = *base_cf_opt;
+  cf_opt->merge_operator.reset();
+  for (auto& p : merge_ops) {
+    if (p.first == prefix) {
+      cf_opt->merge_operator.reset(new MergeOperatorLinker(p.second));
+      break;
+    }
+  }
+  if (opt_str.length()) {
+    // accept the same ',' separators as rocksdb_options
+    string opts = opt_str;
+    std::replace(opts.begin(), opts.end(), ',', ';');
+    rocksdb::ColumnFamilyOptions base = *cf_opt;
+    rocksdb::Status status =
+      rocksdb::GetColumnFamilyOptionsFromString(base, opts, cf_opt);
+    if (!status.ok()) {
+      derr << __func__ << " invalid options '" << opt_str
+	   << "' for column family " << prefix << ": " << status.ToString()
+	   << dendl;
+      return -EINVAL;
+    }
+  }
+  return 0;
+}
+
+int RocksDBStore::_create_cfs(
+  const ColumnFamily &cf,
+  std::vector<rocksdb::ColumnFamilyHandle*> *handles)
+{
+  rocksdb::ColumnFamilyOptions cf_opt;
+  int r = _make_cf_options(cf.name, cf.options, &cf_opt);
+  if (r < 0)
+    return r;
+  for (size_t i = 0; i < cf.shard_cnt; ++i) {
+    string name = get_cf_name(cf.name, i, cf.shard_cnt);
+    rocksdb::ColumnFamilyHandle *h;
+    rocksdb::Status status = db->CreateColumnFamily(cf_opt, name, &h);
+    if (!status.ok()) {
+      derr << __func__ << " failed to create column family " << name
+	   << ": " << status.ToString() << dendl;
+      return -EINVAL;
+    }
+    dout(10) << __func__ << " created column family " << name << dendl;
+    handles->push_back(h);
+  }
+  return 0;
+}
+
+void RocksDBStore::_drop_cfs(std::vector<rocksdb::ColumnFamilyHandle*> &handles)
+{
+  for (auto h : handles) {
+    dout(10) << __func__ << " dropping column family " << h->GetName()
+	     << dendl;
+    rocksdb::Status status = db->DropColumnFamily(h);
+    if (!status.ok()) {
+      derr << __func__ << " failed to drop column family " << h->GetName()
+	   << ": " << status.ToString() << dendl;
+    }
+    delete h;
+  }
+  handles.clear();
+}
+
+void RocksDBStore::_close_cfs()
+{
+  for (auto& p : cf_handles) {
+    for (auto h : p.second) {
+      delete h;
+    }
+  }
+  cf_handles.clear();
+  delete default_cf;
+  default_cf = nullptr;
+}
+
 class CephRocksdbLogger : public rocksdb::Logger {
   CephContext *cct;
 public:
@@ -242,10 +383,11 @@ int RocksDBStore::create_and_open(ostream &out)
       return r;
     }
   }
-  return do_open(out, true);
+  return do_open(out, true, false);
 }
 
-int RocksDBStore::do_open(ostream &out, bool create_if_missing)
+int RocksDBStore::do_open(ostream &out, bool create_if_missing,
+			  bool for_reshard)
 {
   rocksdb::Options opt;
   rocksdb::Status status;
@@ -362,10 +504,110 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing)
 	   << dendl;
 
   opt.merge_operator.reset(new MergeOperatorRouter(*this));
-  status = rocksdb::DB::Open(opt, path, &db);
+  base_cf_opt.reset(new rocksdb::ColumnFamilyOptions(opt));
+
+  // the on-disk column family layout wins over the requested one; the
+  // latter is only applied to freshly created dbs (or by reshard()).
+  std::vector<string> existing_cfs;
+  status = rocksdb::DB::ListColumnFamilies(rocksdb::DBOptions(opt), path,
+					   &existing_cfs);
   if (!status.ok()) {
-    derr << status.ToString() << dendl;
-    return -EINVAL;
+    existing_cfs.clear();
+  }
+  if (existing_cfs.size() <= 1) {
+    status = rocksdb::DB::Open(opt, path, &db);
+    if (!status.ok()) {
+      derr << status.ToString() << dendl;
+      return -EINVAL;
+    }
+    if (create_if_missing && existing_cfs.empty()) {
+      for (auto& cf : cf_specs) {
+	int r = _create_cfs(cf, &cf_handles[cf.name]);
+	if (r < 0) {
+	  return r;
+	}
+      }
+    }
+  } else {
+    std::vector<rocksdb::ColumnFamilyDescriptor> column_families;
+    std::vector<std::pair<string,size_t>> cf_shards;
+    for (auto& name : existing_cfs) {
+      if (name == rocksdb::kDefaultColumnFamilyName) {
+	column_families.push_back(
+	  rocksdb::ColumnFamilyDescriptor(name, *base_cf_opt));
+	cf_shards.push_back(std::make_pair(string(), 0));
+	continue;
+      }
+      string prefix = name;
+      size_t shard = 0;
+      size_t pos = name.rfind('-');
+      if (pos != string::npos && pos + 1 < name.size() &&
+	  name.find_first_not_of("0123456789", pos + 1) == string::npos) {
+	prefix = name.substr(0, pos);
+	shard = atoi(name.c_str() + pos + 1);
+      }
+      string cf_opt_str;
+      for (auto& cf : cf_specs) {
+	if (cf.name == prefix) {
+	  cf_opt_str = cf.options;
+	}
+      }
+      rocksdb::ColumnFamilyOptions cf_opt;
+      int r = _make_cf_options(prefix, cf_opt_str, &cf_opt);
+      if (r < 0) {
+	return r;
+      }
+      column_families.push_back(rocksdb::ColumnFamilyDescriptor(name, cf_opt));
+      cf_shards.push_back(std::make_pair(prefix, shard));
+    }
+    std::vector<rocksdb::ColumnFamilyHandle*> handles;
+    status = rocksdb::DB::Open(rocksdb::DBOptions(opt), path,
+			       column_families, &handles, &db);
+    if (!status.ok()) {
+      derr << status.ToString() << dendl;
+      return -EINVAL;
+    }
+    for (size_t i = 0; i < handles.size(); ++i) {
+      if (cf_shards[i].first.empty()) {
+	default_cf = handles[i];
+	continue;
+      }
+      auto& v = cf_handles[cf_shards[i].first];
+      if (v.size() <= cf_shards[i].second) {
+	v.resize(cf_shards[i].second + 1);
+      }
+      v[cf_shards[i].second] = handles[i];
+    }
+    for (auto& p : cf_handles) {
+      for (size_t i = 0; i < p.second.size(); ++i) {
+	if (!p.second[i]) {
+	  derr << __func__ << " column family " << p.first << " is missing shard "
+	       << i << " of " << p.second.size() << dendl;
+	  return -EIO;
+	}
+      }
+      dout(10) << __func__ << " prefix " << p.first << " has "
+	       << p.second.size() << " column families" << dendl;
+
+      // keys of a sharded prefix in the default family are left over
+      // from an interrupted reshard and invisible until it is rerun, so
+      // serving reads (or writes that the rerun would then overwrite)
+      // before that is not safe
+      std::unique_ptr<rocksdb::Iterator> it(
+	db->NewIterator(rocksdb::ReadOptions(), default_cf));
+      string start = combine_strings(p.first, string());
+      it->Seek(start);
+      if (it->Valid() && it->key().starts_with(start)) {
+	derr << __func__ << " prefix " << p.first << " has keys left in the"
+	     << " default column family by an interrupted reshard; rerun"
+	     << " reshard to finish it" << dendl;
+	out << "prefix " << p.first << " has keys left in the default column"
+	    << " family by an interrupted reshard" << std::endl;
+	if (!for_reshard) {
+	  return -EIO;
+	}
+      }
+    }
   }
   
   PerfCountersBuilder plb(g_ceph_context, "rocksdb", l_rocksdb_first, l_rocksdb_last);
@@ -411,6 +653,9 @@ RocksDBStore::~RocksDBStore()
   close();
   delete logger;
 
+  // column family handles must go before the db itself
+  _close_cfs();
+
   // Ensure db is destroyed before dependent db_cache and filterpolicy
   delete db;
   db = nullptr;
@@ -610,70 +855,122 @@ RocksDBStore::RocksDBTransactionImpl::RocksDBTransactionImpl(RocksDBStore *_db)
   db = _db;
 }
 
-void RocksDBStore::RocksDBTransactionImpl::set(
-  const string &prefix,
-  const string &k,
+static void put_bat(
+  rocksdb::WriteBatch& bat,
+  rocksdb::ColumnFamilyHandle *cf,
+  const string &key,
   const bufferlist &to_set_bl)
 {
-  string key = combine_strings(prefix, k);
-
   // bufferlist::c_str() is non-constant, so we can't call c_str()
   if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
-    bat.Put(rocksdb::Slice(key),
-	     rocksdb::Slice(to_set_bl.buffers().front().c_str(),
-			    to_set_bl.length()));
+    bat.Put(cf,
+	    rocksdb::Slice(key),
+	    rocksdb::Slice(to_set_bl.buffers().front().c_str(),
+			   to_set_bl.length()));
   } else {
     rocksdb::Slice key_slice(key);
     vector<rocksdb::Slice> value_slices(to_set_bl.buffers().size());
-    bat.Put(nullptr, rocksdb::SliceParts(&key_slice, 1),
+    bat.Put(cf,
+	    rocksdb::SliceParts(&key_slice, 1),
             prepare_sliceparts(to_set_bl, &value_slices));
   }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::set(
   const string &prefix,
-  const char *k, size_t keylen,
+  const string &k,
   const bufferlist &to_set_bl)
 {
-  string key;
-  combine_strings(prefix, k, keylen, &key);
+  auto cf = db->get_cf_handle(prefix, k);
+  if (cf) {
+    note_cf_key(cf, k);
+    put_bat(bat, cf, k, to_set_bl);
+  } else {
+    put_bat(bat, nullptr, combine_strings(prefix, k), to_set_bl);
+  }
+}
 
-  // bufferlist::c_str() is non-constant, so we can't call c_str()
-  if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
-    bat.Put(rocksdb::Slice(key),
-	     rocksdb::Slice(to_set_bl.buffers().front().c_str(),
-			    to_set_bl.length()));
+void RocksDBStore::RocksDBTransactionImpl::set(
+  const string &prefix,
+  const char *k, size_t keylen,
+  const bufferlist &to_set_bl)
+{
+  auto cf = db->get_cf_handle(prefix, k, keylen);
+  if (cf) {
+    string key(k, keylen);
+    note_cf_key(cf, key);
+    put_bat(bat, cf, key, to_set_bl);
   } else {
-    rocksdb::Slice key_slice(key);
-    vector<rocksdb::Slice> value_slices(to_set_bl.buffers().size());
-    bat.Put(nullptr, rocksdb::SliceParts(&key_slice, 1),
-            prepare_sliceparts(to_set_bl, &value_slices));
+    string key;
+    combine_strings(prefix, k, keylen, &key);
+    put_bat(bat, nullptr, key, to_set_bl);
   }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const string &k)
 {
-  bat.Delete(combine_strings(prefix, k));
+  auto cf = db->get_cf_handle(prefix, k);
+  if (cf) {
+    bat.Delete(cf, rocksdb::Slice(k));
+  } else {
+    bat.Delete(combine_strings(prefix, k));
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const char *k,
 						 size_t keylen)
 {
-  string key;
-  combine_strings(prefix, k, keylen, &key);
-  bat.Delete(key);
+  auto cf = db->get_cf_handle(prefix, k, keylen);
+  if (cf) {
+    bat.Delete(cf, rocksdb::Slice(k, keylen));
+  } else {
+    string key;
+    combine_strings(prefix, k, keylen, &key);
+    bat.Delete(key);
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 					                 const string &k)
 {
-  bat.SingleDelete(combine_strings(prefix, k));
+  auto cf = db->get_cf_handle(prefix, k);
+  if (cf) {
+    bat.SingleDelete(cf, k);
+  } else {
+    bat.SingleDelete(combine_strings(prefix, k));
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
+  auto p = db->cf_handles.find(prefix);
+  if (p != db->cf_handles.end()) {
+    // every key in these families belongs to the prefix
+    for (auto cf : p->second) {
+      std::unique_ptr<rocksdb::Iterator> it(
+	db->db->NewIterator(rocksdb::ReadOptions(), cf));
+      if (db->enable_rmrange) {
+	// from the smallest possible key up to and including the largest
+	// one either in the db or written earlier in this batch
+	auto q = cf_last_key.find(cf);
+	it->SeekToLast();
+	if (!it->Valid() && q == cf_last_key.end())
+	  continue;
+	string last = it->Valid() ? it->key().ToString() : string();
+	if (q != cf_last_key.end() && q->second > last)
+	  last = q->second;
+	bat.DeleteRange(cf, rocksdb::Slice(), last);
+	bat.Delete(cf, last);
+      } else {
+	for (it->SeekToFirst(); it->Valid(); it->Next()) {
+	  bat.Delete(cf, it->key());
+	}
+      }
+    }
+    return;
+  }
   if (db->enable_rmrange) {
     string endprefix = prefix;
     endprefix.push_back('\x01');
@@ -693,6 +990,24 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
                                                          const string &start,
                                                          const string &end)
 {
+  auto p = db->cf_handles.find(prefix);
+  if (p != db->cf_handles.end()) {
+    // hash sharding scatters the range over all of the families
+    for (auto cf : p->second) {
+      if (db->enable_rmrange) {
+	bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+      } else {
+	std::unique_ptr<rocksdb::Iterator> it(
+	  db->db->NewIterator(rocksdb::ReadOptions(), cf));
+	for (it->Seek(start);
+	     it->Valid() && it->key().compare(rocksdb::Slice(end)) < 0;
+	     it->Next()) {
+	  bat.Delete(cf, it->key());
+	}
+      }
+    }
+    return;
+  }
   if (db->enable_rmrange) {
     bat.DeleteRange(combine_strings(prefix, start), combine_strings(prefix, end));
   } else {
@@ -713,18 +1028,24 @@ void RocksDBStore::RocksDBTransactionImpl::merge(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  string key = combine_strings(prefix, k);
+  auto cf = db->get_cf_handle(prefix, k);
+  string key = cf ? k : combine_strings(prefix, k);
+  if (cf) {
+    note_cf_key(cf, k);
+  }
 
   // bufferlist::c_str() is non-constant, so we can't call c_str()
   if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
-    bat.Merge(rocksdb::Slice(key),
-	       rocksdb::Slice(to_set_bl.buffers().front().c_str(),
-			    to_set_bl.length()));
+    bat.Merge(cf,
+	      rocksdb::Slice(key),
+	      rocksdb::Slice(to_set_bl.buffers().front().c_str(),
+			     to_set_bl.length()));
   } else {
     // make a copy
     rocksdb::Slice key_slice(key);
     vector<rocksdb::Slice> value_slices(to_set_bl.buffers().size());
-    bat.Merge(nullptr, rocksdb::SliceParts(&key_slice, 1),
+    bat.Merge(cf,
+	      rocksdb::SliceParts(&key_slice, 1),
               prepare_sliceparts(to_set_bl, &value_slices));
   }
 }
@@ -739,8 +1060,14 @@ int RocksDBStore::get(
   for (std::set<string>::const_iterator i = keys.begin();
        i != keys.end(); ++i) {
     std::string value;
-    std::string bound = combine_strings(prefix, *i);
-    auto status = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(bound), &value);
+    rocksdb::Status status;
+    auto cf = get_cf_handle(prefix, *i);
+    if (cf) {
+      status = db->Get(rocksdb::ReadOptions(), cf, rocksdb::Slice(*i), &value);
+    } else {
+      std::string bound = combine_strings(prefix, *i);
+      status = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(bound), &value);
+    }
     if (status.ok()) {
       (*out)[*i].append(value);
     } else if (status.IsIOError()) {
@@ -764,8 +1091,13 @@ int RocksDBStore::get(
   int r = 0;
   string value, k;
   rocksdb::Status s;
-  k = combine_strings(prefix, key);
-  s = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(k), &value);
+  auto cf = get_cf_handle(prefix, key);
+  if (cf) {
+    s = db->Get(rocksdb::ReadOptions(), cf, rocksdb::Slice(key), &value);
+  } else {
+    k = combine_strings(prefix, key);
+    s = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(k), &value);
+  }
   if (s.ok()) {
     out->append(value);
   } else if (s.IsNotFound()) {
@@ -789,9 +1121,15 @@ int RocksDBStore::get(
   utime_t start = ceph_clock_now();
   int r = 0;
   string value, k;
-  combine_strings(prefix, key, keylen, &k);
   rocksdb::Status s;
-  s = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(k), &value);
+  auto cf = get_cf_handle(prefix, key, keylen);
+  if (cf) {
+    s = db->Get(rocksdb::ReadOptions(), cf, rocksdb::Slice(key, keylen),
+		&value);
+  } else {
+    combine_strings(prefix, key, keylen, &k);
+    s = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(k), &value);
+  }
   if (s.ok()) {
     out->append(value);
   } else if (s.IsNotFound()) {
@@ -830,6 +1168,26 @@ void RocksDBStore::compact()
   logger->inc(l_rocksdb_compact);
   rocksdb::CompactRangeOptions options;
   db->CompactRange(options, nullptr, nullptr);
+  for (auto& p : cf_handles) {
+    compact_cf_range(p.second, nullptr, nullptr);
+  }
+}
+
+void RocksDBStore::compact_cf_range(
+  const std::vector<rocksdb::ColumnFamilyHandle*>& cfs,
+  const string *start, const string *end)
+{
+  rocksdb::CompactRangeOptions options;
+  rocksdb::Slice cstart, cend;
+  if (start)
+    cstart = rocksdb::Slice(*start);
+  if (end)
+    cend = rocksdb::Slice(*end);
+  for (auto cf : cfs) {
+    db->CompactRange(options, cf,
+		     start ? &cstart : nullptr,
+		     end ? &cend : nullptr);
+  }
 }
 
 
@@ -903,6 +1261,19 @@ bool RocksDBStore::check_omap_dir(string &omap_dir)
 }
 void RocksDBStore::compact_range(const string& start, const string& end)
 {
+  if (!cf_handles.empty()) {
+    // ranges are queued as combined keys; peel the prefix back off
+    string prefix, kstart, eprefix, kend;
+    if (split_key(start, &prefix, &kstart) == 0) {
+      auto p = cf_handles.find(prefix);
+      if (p != cf_handles.end()) {
+	bool bounded = split_key(end, &eprefix, &kend) == 0 &&
+	  eprefix == prefix;
+	compact_cf_range(p->second, &kstart, bounded ? &kend : nullptr);
+	return;
+      }
+    }
+  }
   rocksdb::CompactRangeOptions options;
   rocksdb::Slice cstart(start);
   rocksdb::Slice cend(end);
@@ -1037,9 +1408,441 @@ string RocksDBStore::past_prefix(const string &prefix)
   return limit;
 }
 
+//
+// Iterates over the default family and any number of per-prefix column
+// families as if they were still a single keyspace ordered by prefix\0key.
+// All sources read from the same snapshot.
+//
+class RocksDBStore::CFMergeIteratorImpl
+  : public KeyValueDB::WholeSpaceIteratorImpl {
+  struct Source {
+    string prefix;            ///< empty for the default family
+    rocksdb::Iterator *iter;
+    bool exhausted;
+
+    bool valid() const {
+      return !exhausted && iter->Valid();
+    }
+  };
+
+  rocksdb::DB *db;
+  const rocksdb::Snapshot *snapshot;
+  std::vector<Source> sources;
+  Source *cur = nullptr;
+  bool forward = true;
+
+  static void split(const Source &s, rocksdb::Slice *prefix,
+		    rocksdb::Slice *key) {
+    if (!s.prefix.empty()) {
+      *prefix = rocksdb::Slice(s.prefix);
+      *key = s.iter->key();
+      return;
+    }
+    rocksdb::Slice in = s.iter->key();
+    const char *sep = static_cast<const char*>(memchr(in.data(), 0, in.size()));
+    if (!sep) {
+      *prefix = in;
+      *key = rocksdb::Slice();
+      return;
+    }
+    size_t plen = sep - in.data();
+    *prefix = rocksdb::Slice(in.data(), plen);
+    *key = rocksdb::Slice(sep + 1, in.size() - plen - 1);
+  }
+
+  static int compare(const Source &a, const Source &b) {
+    rocksdb::Slice ap, ak, bp, bk;
+    split(a, &ap, &ak);
+    split(b, &bp, &bk);
+    int r = ap.compare(bp);
+    if (r)
+      return r;
+    return ak.compare(bk);
+  }
+
+  /// make cur the smallest (forward) or largest (reverse) valid source
+  void pick() {
+    cur = nullptr;
+    for (auto& s : sources) {
+      if (!s.valid())
+	continue;
+      if (!cur) {
+	cur = &s;
+	continue;
+      }
+      int r = compare(s, *cur);
+      if (forward ? r < 0 : r > 0)
+	cur = &s;
+    }
+  }
+
+  /// position s at the first key >= (inclusive) or > prefix/key
+  static void seek_forward(Source &s, const string &prefix, const string &key,
+			   bool inclusive) {
+    s.exhausted = false;
+    string bound;
+    if (s.prefix.empty()) {
+      bound = combine_strings(prefix, key);
+    } else {
+      int r = s.prefix.compare(prefix);
+      if (r < 0) {
+	s.exhausted = true;
+	return;
+      }
+      if (r > 0) {
+	s.iter->SeekToFirst();
+	return;
+      }
+      bound = key;
+    }
+    s.iter->Seek(bound);
+    if (!inclusive && s.iter->Valid() &&
+	s.iter->key() == rocksdb::Slice(bound))
+      s.iter->Next();
+  }
+
+  /// position s at the last key < prefix/key
+  static void seek_backward(Source &s, const string &prefix,
+			    const string &key) {
+    s.exhausted = false;
+    string bound;
+    if (s.prefix.empty()) {
+      bound = combine_strings(prefix, key);
+    } else {
+      int r = s.prefix.compare(prefix);
+      if (r > 0) {
+	s.exhausted = true;
+	return;
+      }
+      if (r < 0) {
+	s.iter->SeekToLast();
+	return;
+      }
+      bound = key;
+    }
+    s.iter->Seek(bound);
+    if (s.iter->Valid())
+      s.iter->Prev();
+    else
+      s.iter->SeekToLast();
+  }
+
+public:
+  explicit CFMergeIteratorImpl(rocksdb::DB *db)
+    : db(db), snapshot(db->GetSnapshot()) {}
+  ~CFMergeIteratorImpl() override {
+    for (auto& s : sources)
+      delete s.iter;
+    db->ReleaseSnapshot(snapshot);
+  }
+
+  void add_source(const string &prefix, rocksdb::ColumnFamilyHandle *cf) {
+    assert(cur == nullptr);
+    rocksdb::ReadOptions options;
+    options.snapshot = snapshot;
+    sources.push_back(Source{prefix, db->NewIterator(options, cf), true});
+  }
+
+  int seek_to_first() override {
+    for (auto& s : sources) {
+      s.exhausted = false;
+      s.iter->SeekToFirst();
+    }
+    forward = true;
+    pick();
+    return status();
+  }
+  int seek_to_first(const string &prefix) override {
+    return lower_bound(prefix, string());
+  }
+  int seek_to_last() override {
+    for (auto& s : sources) {
+      s.exhausted = false;
+      s.iter->SeekToLast();
+    }
+    forward = false;
+    pick();
+    return status();
+  }
+  int seek_to_last(const string &prefix) override {
+    string limit = past_prefix(prefix);
+    for (auto& s : sources) {
+      s.exhausted = false;
+      if (s.prefix.empty()) {
+	s.iter->Seek(limit);
+	if (s.iter->Valid())
+	  s.iter->Prev();
+	else
+	  s.iter->SeekToLast();
+      } else if (s.prefix.compare(prefix) <= 0) {
+	s.iter->SeekToLast();
+      } else {
+	s.exhausted = true;
+      }
+    }
+    forward = false;
+    pick();
+    return status();
+  }
+  int upper_bound(const string &prefix, const string &after) override {
+    for (auto& s : sources)
+      seek_forward(s, prefix, after, false);
+    forward = true;
+    pick();
+    return status();
+  }
+  int lower_bound(const string &prefix, const string &to) override {
+    for (auto& s : sources)
+      seek_forward(s, prefix, to, true);
+    forward = true;
+    pick();
+    return status();
+  }
+  bool valid() override {
+    return cur != nullptr;
+  }
+  int next() override {
+    if (!cur)
+      return status();
+    if (!forward) {
+      // the other sources sit before cur; move them past it
+      pair<string,string> k = raw_key();
+      for (auto& s : sources)
+	seek_forward(s, k.first, k.second, false);
+      forward = true;
+    } else {
+      cur->iter->Next();
+    }
+    pick();
+    assert(status() == 0);
+    return 0;
+  }
+  int prev() override {
+    if (!cur)
+      return status();
+    if (forward) {
+      // the other sources sit after cur; move them before it
+      pair<string,string> k = raw_key();
+      for (auto& s : sources)
+	seek_backward(s, k.first, k.second);
+      forward = false;
+    } else {
+      cur->iter->Prev();
+    }
+    pick();
+    assert(status() == 0);
+    return 0;
+  }
+  string key() override {
+    rocksdb::Slice prefix, key;
+    split(*cur, &prefix, &key);
+    return key.ToString();
+  }
+  pair<string,string> raw_key() override {
+    rocksdb::Slice prefix, key;
+    split(*cur, &prefix, &key);
+    return make_pair(prefix.ToString(), key.ToString());
+  }
+  bool raw_key_is_prefixed(const string &prefix) override {
+    rocksdb::Slice p, key;
+    split(*cur, &p, &key);
+    return p == rocksdb::Slice(prefix);
+  }
+  bufferlist value() override {
+    return to_bufferlist(cur->iter->value());
+  }
+  bufferptr value_as_ptr() override {
+    rocksdb::Slice val = cur->iter->value();
+    return bufferptr(val.data(), val.size());
+  }
+  int status() override {
+    for (auto& s : sources) {
+      if (!s.iter->status().ok())
+	return -1;
+    }
+    return 0;
+  }
+  size_t key_size() override {
+    if (cur->prefix.empty())
+      return cur->iter->key().size();
+    return cur->prefix.size() + 1 + cur->iter->key().size();
+  }
+  size_t value_size() override {
+    return cur->iter->value().size();
+  }
+};
+
 RocksDBStore::WholeSpaceIterator RocksDBStore::_get_iterator()
 {
-  return std::make_shared<RocksDBWholeSpaceIteratorImpl>(
-        db->NewIterator(rocksdb::ReadOptions()));
+  if (cf_handles.empty()) {
+    return std::make_shared<RocksDBWholeSpaceIteratorImpl>(
+      db->NewIterator(rocksdb::ReadOptions()));
+  }
+  auto it = std::make_shared<CFMergeIteratorImpl>(db);
+  it->add_source(string(), db->DefaultColumnFamily());
+  for (auto& p : cf_handles) {
+    for (auto cf : p.second) {
+      it->add_source(p.first, cf);
+    }
+  }
+  return it;
+}
+
+KeyValueDB::Iterator RocksDBStore::_get_iterator(const std::string &prefix)
+{
+  auto p = cf_handles.find(prefix);
+  if (p == cf_handles.end()) {
+    // everything for this prefix lives in the default family
+    return std::make_shared<IteratorImpl>(
+      prefix,
+      std::make_shared<RocksDBWholeSpaceIteratorImpl>(
+	db->NewIterator(rocksdb::ReadOptions())));
+  }
+  auto it = std::make_shared<CFMergeIteratorImpl>(db);
+  for (auto cf : p->second) {
+    it->add_source(prefix, cf);
+  }
+  return std::make_shared<IteratorImpl>(prefix, it);
+}
+
+int RocksDBStore::_move_keys(
+  const string &prefix,
+  const std::vector<rocksdb::ColumnFamilyHandle*> &from,
+  const std::vector<rocksdb::ColumnFamilyHandle*> &to,
+  uint64_t *moved)
+{
+  const unsigned keys_per_batch = 10000;
+  const uint64_t interrupt_at =
+    g_conf->get_val<uint64_t>("rocksdb_debug_reshard_interrupt");
+  rocksdb::WriteOptions woptions;
+  woptions.sync = true;
+
+  // an empty set of families means the default family, where the keys
+  // carry their prefix
+  std::vector<rocksdb::ColumnFamilyHandle*> srcs = from;
+  if (srcs.empty())
+    srcs.push_back(db->DefaultColumnFamily());
+  string start = combine_strings(prefix, string());
+
+  for (auto src : srcs) {
+    std::unique_ptr<rocksdb::Iterator> it(
+      db->NewIterator(rocksdb::ReadOptions(), src));
+    if (from.empty())
+      it->Seek(start);
+    else
+      it->SeekToFirst();
+    rocksdb::WriteBatch bat;
+    unsigned n = 0;
+    for (; it->Valid(); it->Next()) {
+      rocksdb::Slice key = it->key();
+      if (from.empty()) {
+	if (!key.starts_with(start))
+	  break;
+	key.remove_prefix(start.size());
+      }
+      if (to.empty()) {
+	bat.Put(combine_strings(prefix, key.ToString()), it->value());
+      } else {
+	auto dst = to[ceph_str_hash_rjenkins(key.data(), key.size()) %
+		      to.size()];
+	bat.Put(dst, key, it->value());
+      }
+      // put and delete land in the same batch, so an interrupted
+      // reshard never loses a key; rerun it to finish the move
+      bat.Delete(src, it->key());
+      ++*moved;
+      bool interrupt = interrupt_at && *moved >= interrupt_at;
+      if (++n == keys_per_batch || interrupt) {
+	rocksdb::Status status = db->Write(woptions, &bat);
+	if (!status.ok()) {
+	  derr << __func__ << " " << status.ToString() << dendl;
+	  return -EIO;
+	}
+	bat.Clear();
+	n = 0;
+      }
+      if (interrupt) {
+	derr << __func__ << " interrupted after " << *moved << " keys of "
+	     << prefix << " (rocksdb_debug_reshard_interrupt)" << dendl;
+	return -EINTR;
+      }
+    }
+    if (!it->status().ok()) {
+      derr << __func__ << " " << it->status().ToString() << dendl;
+      return -EIO;
+    }
+    if (n) {
+      rocksdb::Status status = db->Write(woptions, &bat);
+      if (!status.ok()) {
+	derr << __func__ << " " << status.ToString() << dendl;
+	return -EIO;
+      }
+    }
+  }
+  return 0;
+}
+
+int RocksDBStore::reshard(const std::vector<ColumnFamily> &cfs, ostream &out)
+{
+  std::set<string> prefixes;
+  for (auto& p : cf_handles)
+    prefixes.insert(p.first);
+  for (auto& cf : cfs)
+    prefixes.insert(cf.name);
+
+  for (auto& prefix : prefixes) {
+    const ColumnFamily *target = nullptr;
+    for (auto& cf : cfs) {
+      if (cf.name == prefix)
+	target = &cf;
+    }
+    auto p = cf_handles.find(prefix);
+    size_t cur_cnt = p == cf_handles.end() ? 0 : p->second.size();
+    size_t new_cnt = target ? target->shard_cnt : 0;
+    uint64_t moved = 0;
+    if (cur_cnt == new_cnt) {
+      // the layout matches, but an earlier reshard may have been
+      // interrupted after creating the families and before moving all
+      // keys out of the default family.  finish that move.
+      if (cur_cnt) {
+	int r = _move_keys(prefix, {}, p->second, &moved);
+	if (r < 0)
+	  return r;
+      }
+      out << "prefix " << prefix << ": " << cur_cnt
+	  << " column families, unchanged";
+      if (moved)
+	out << ", moved " << moved << " leftover keys";
+      out << std::endl;
+      continue;
+    }
+
+    // fold the prefix back into the default family, then split it out
+    // again.  family names are reused across shard counts so we cannot
+    // create the new families next to the old ones.
+    if (p != cf_handles.end()) {
+      int r = _move_keys(prefix, p->second, {}, &moved);
+      if (r < 0)
+	return r;
+      _drop_cfs(p->second);
+      cf_handles.erase(p);
+    }
+    if (target) {
+      std::vector<rocksdb::ColumnFamilyHandle*> handles;
+      int r = _create_cfs(*target, &handles);
+      if (r < 0) {
+	_drop_cfs(handles);
+	return r;
+      }
+      cf_handles[prefix] = handles;
+      r = _move_keys(prefix, {}, handles, &moved);
+      if (r < 0)
+	return r;
+    }
+    out << "prefix " << prefix << ": " << cur_cnt << " -> " << new_cnt
+	<< " column families, moved " << moved << " keys" << std::endl;
+  }
+  cf_specs = cfs;
+  return 0;
 }
 
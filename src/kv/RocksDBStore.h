@@ -10,6 +10,7 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <unordered_map>
 #include <boost/scoped_ptr.hpp>
 #include "rocksdb/write_batch.h"
 #include "rocksdb/perf_context.h"
@@ -55,7 +56,9 @@ namespace rocksdb{
   class WriteBatch;
   class Iterator;
   class Logger;
+  class ColumnFamilyHandle;
   struct Options;
+  struct ColumnFamilyOptions;
   struct BlockBasedTableOptions;
 }
 
@@ -78,7 +81,36 @@ class RocksDBStore : public KeyValueDB {
   uint64_t cache_size = 0;
   bool set_cache_flag = false;
 
-  int do_open(ostream &out, bool create_if_missing);
+  /// requested column family layout and per-family options
+  std::vector<ColumnFamily> cf_specs;
+  /// options every column family starts from (table factory, caches, ...)
+  std::unique_ptr<rocksdb::ColumnFamilyOptions> base_cf_opt;
+  rocksdb::ColumnFamilyHandle *default_cf = nullptr;
+  /// prefix -> column family handles, one per hash shard
+  std::unordered_map<std::string,
+		     std::vector<rocksdb::ColumnFamilyHandle*>> cf_handles;
+
+  int do_open(ostream &out, bool create_if_missing, bool for_reshard);
+  int _make_cf_options(const string &prefix, const string &opt_str,
+		       rocksdb::ColumnFamilyOptions *cf_opt);
+  int _create_cfs(const ColumnFamily &cf,
+		  std::vector<rocksdb::ColumnFamilyHandle*> *handles);
+  void _drop_cfs(std::vector<rocksdb::ColumnFamilyHandle*> &handles);
+  void _close_cfs();
+  int _move_keys(const string &prefix,
+		 const std::vector<rocksdb::ColumnFamilyHandle*> &from,
+		 const std::vector<rocksdb::ColumnFamilyHandle*> &to,
+		 uint64_t *moved);
+
+  /// family holding prefix/key, or nullptr for the default family
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const string &prefix,
+					     const char *key, size_t keylen);
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const string &prefix,
+					     const string &key) {
+    return get_cf_handle(prefix, key.data(), key.size());
+  }
+  static string get_cf_name(const string &prefix, size_t shard,
+			    size_t shard_cnt);
 
   // manage async compactions
   Mutex compact_queue_lock;
@@ -100,6 +132,8 @@ class RocksDBStore : public KeyValueDB {
 
   void compact_range(const string& start, const string& end);
   void compact_range_async(const string& start, const string& end);
+  void compact_cf_range(const std::vector<rocksdb::ColumnFamilyHandle*>& cfs,
+			const string *start, const string *end);
 
 public:
   /// compact the underlying rocksdb store
@@ -148,13 +182,19 @@ public:
   static bool check_omap_dir(string &omap_dir);
   /// Opens underlying db
   int open(ostream &out) override {
-    return do_open(out, false);
+    return do_open(out, false, false);
+  }
+  int open_for_reshard(ostream &out) override {
+    return do_open(out, false, true);
   }
   /// Creates underlying db if missing and opens it
   int create_and_open(ostream &out) override;
 
   void close() override;
 
+  int set_column_families(const std::vector<ColumnFamily> &cfs) override;
+  int reshard(const std::vector<ColumnFamily> &cfs, ostream &out) override;
+
   void split_stats(const std::string &s, char delim, std::vector<std::string> &elems);
   void get_statistics(Formatter *f) override;
 
@@ -245,6 +285,52 @@ public:
 
       num_seen++;
     }
+    rocksdb::Status PutCF(uint32_t cf_id, const rocksdb::Slice& key,
+			  const rocksdb::Slice& value) override {
+      if (cf_id == 0) {
+	Put(key, value);
+	return rocksdb::Status::OK();
+      }
+      seen += "\nPut( cf = " + std::to_string(cf_id) + " key = "
+	+ pretty_binary_string(key.ToString())
+	+ " Value size = " + std::to_string(value.size()) + ")";
+      num_seen++;
+      return rocksdb::Status::OK();
+    }
+    rocksdb::Status SingleDeleteCF(uint32_t cf_id,
+				   const rocksdb::Slice& key) override {
+      if (cf_id == 0) {
+	SingleDelete(key);
+	return rocksdb::Status::OK();
+      }
+      seen += "\nSingleDelete( cf = " + std::to_string(cf_id) + " key = "
+	+ pretty_binary_string(key.ToString()) + ")";
+      num_seen++;
+      return rocksdb::Status::OK();
+    }
+    rocksdb::Status DeleteCF(uint32_t cf_id,
+			     const rocksdb::Slice& key) override {
+      if (cf_id == 0) {
+	Delete(key);
+	return rocksdb::Status::OK();
+      }
+      seen += "\nDelete( cf = " + std::to_string(cf_id) + " key = "
+	+ pretty_binary_string(key.ToString()) + ")";
+      num_seen++;
+      return rocksdb::Status::OK();
+    }
+    rocksdb::Status MergeCF(uint32_t cf_id, const rocksdb::Slice& key,
+			    const rocksdb::Slice& value) override {
+      if (cf_id == 0) {
+	Merge(key, value);
+	return rocksdb::Status::OK();
+      }
+      seen += "\nMerge( cf = " + std::to_string(cf_id) + " key = "
+	+ pretty_binary_string(key.ToString())
+	+ " Value size = " + std::to_string(value.size()) + ")";
+      num_seen++;
+      return rocksdb::Status::OK();
+    }
     bool Continue() override { return num_seen < 50; }
 
   };
@@ -254,8 +340,16 @@ public:
   public:
     rocksdb::WriteBatch bat;
     RocksDBStore *db;
+    // largest key this batch writes to each sharded column family, so
+    // rmkeys_by_prefix() also covers keys not yet in the db
+    std::map<rocksdb::ColumnFamilyHandle*, string> cf_last_key;
 
     explicit RocksDBTransactionImpl(RocksDBStore *_db);
+    void note_cf_key(rocksdb::ColumnFamilyHandle *cf, const string &k) {
+      string &last = cf_last_key[cf];
+      if (k > last)
+	last = k;
+    }
     void set(
       const string &prefix,
       const string &k,
@@ -367,7 +461,10 @@ public:
   static string past_prefix(const string &prefix);
 
   class MergeOperatorRouter;
+  class MergeOperatorLinker;
   friend class MergeOperatorRouter;
+  /// merges the per-family iterators back into prefix/key order
+  class CFMergeIteratorImpl;
   int set_merge_operator(const std::string& prefix,
 				 std::shared_ptr<KeyValueDB::MergeOperator> mop) override;
   string assoc_name; ///< Name of associative operator
@@ -446,6 +543,7 @@ err:
 
 protected:
   WholeSpaceIterator _get_iterator() override;
+  Iterator _get_iterator(const std::string &prefix) override;
 };
 
 
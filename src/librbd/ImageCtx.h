@@ -47,7 +47,7 @@ namespace librbd {
   template <typename> class Operations;
   class LibrbdWriteback;
 
-  namespace cache { struct ImageCache; }
+  namespace cache { struct ImageCache; class ParentCache; }
   namespace exclusive_lock { struct Policy; }
   namespace io {
   class AioCompletion;
@@ -133,6 +133,7 @@ namespace librbd {
     file_layout_t layout;
 
     cache::ImageCache *image_cache = nullptr;
+    cache::ParentCache *parent_cache = nullptr; // set on parent images
     ObjectCacher *object_cacher;
     LibrbdWriteback *writeback_handler;
     ObjectCacher::ObjectSet *object_set;
@@ -162,6 +163,8 @@ namespace librbd {
 
     // Configuration
     static const string METADATA_CONF_PREFIX;
+    /// names the host whose persistent cache holds unwritten image data
+    static const string METADATA_PERSISTENT_CACHE_OWNER;
     bool non_blocking_aio;
     bool cache;
     bool cache_writethrough_until_flush;
@@ -196,6 +199,11 @@ namespace librbd {
     bool mirroring_resync_after_disconnect;
     int mirroring_replay_delay;
     bool skip_partial_discard;
+    bool persistent_cache;
+    std::string persistent_cache_path;
+    uint64_t persistent_cache_size;
+    bool persistent_cache_persist_on_flush;
+    bool parent_cache_enabled;
 
     LibrbdAdminSocketHook *asok_hook;
 
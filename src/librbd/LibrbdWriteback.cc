@@ -18,6 +18,7 @@
 #include "librbd/ObjectMap.h"
 #include "librbd/Journal.h"
 #include "librbd/Utils.h"
+#include "librbd/cache/ParentCache.h"
 #include "librbd/io/AioCompletion.h"
 #include "librbd/io/ObjectRequest.h"
 
@@ -216,6 +217,12 @@ namespace librbd {
       }
     }
 
+    if (m_ictx->parent_cache != nullptr && snapid != CEPH_NOSNAP) {
+      m_ictx->parent_cache->read(m_ictx, oid.name, object_no, snapid, off,
+                                 len, pbl, req);
+      return;
+    }
+
     librados::ObjectReadOperation op;
     op.read(off, len, pbl, NULL);
     op.set_op_flags2(op_flags);
@@ -0,0 +1,799 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "FileImageCache.h"
+#include "include/Context.h"
+#include "include/stringify.h"
+#include "cls/rbd/cls_rbd_client.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/hostname.h"
+#include "common/WorkQueue.h"
+#include "librbd/ExclusiveLock.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/Utils.h"
+#include <algorithm>
+#include <limits>
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::FileImageCache: " << this << " " \
+                           <<  __func__ << ": "
+
+namespace librbd {
+namespace cache {
+
+using util::create_async_context_callback;
+using util::create_rados_callback;
+
+namespace {
+
+// upper bound on the data written back (and flushed) in one batch
+const uint64_t MAX_DESTAGE_BYTES = 4 << 20;
+
+template <typename I>
+std::string get_log_name(I &image_ctx) {
+  return stringify(image_ctx.md_ctx.get_id()) + "." + image_ctx.id;
+}
+
+template <typename I>
+std::string get_log_path(I &image_ctx) {
+  return image_ctx.persistent_cache_path + "/rbd-" + get_log_name(image_ctx) +
+         ".log";
+}
+
+} // anonymous namespace
+
+template <typename I>
+struct FileImageCache<I>::C_ReadRequest : public Context {
+  file::LogMap::Extents extents; ///< log hits and misses, in request order
+  std::list<bufferlist> hits;
+  bufferlist miss_bl;
+  bufferlist *bl;
+  Context *on_finish;
+
+  C_ReadRequest(bufferlist *bl, Context *on_finish)
+    : bl(bl), on_finish(on_finish) {
+  }
+
+  void finish(int r) override {
+    if (r >= 0) {
+      auto hit_it = hits.begin();
+      uint64_t miss_offset = 0;
+      for (auto &extent : extents) {
+        if (extent.seq != 0) {
+          bl->claim_append(*hit_it);
+          ++hit_it;
+        } else {
+          bufferlist sub_bl;
+          sub_bl.substr_of(miss_bl, miss_offset, extent.length);
+          bl->claim_append(sub_bl);
+          miss_offset += extent.length;
+        }
+      }
+      r = 0;
+    }
+    on_finish->complete(r);
+  }
+};
+
+template <typename I>
+FileImageCache<I>::FileImageCache(I &image_ctx)
+  : m_image_ctx(image_ctx), m_image_writeback(image_ctx),
+    m_log(image_ctx.cct, get_log_path(image_ctx)), m_log_thread(this),
+    m_owner(ceph_get_hostname() + ":" + get_log_path(image_ctx)),
+    m_lock("librbd::cache::FileImageCache::m_lock") {
+}
+
+template <typename I>
+FileImageCache<I>::~FileImageCache() {
+  assert(!m_log_thread.is_started());
+  assert(m_ops.empty());
+}
+
+template <typename I>
+void FileImageCache<I>::aio_read(Extents &&image_extents, bufferlist *bl,
+                                 int fadvise_flags, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  auto req = new C_ReadRequest(bl, on_finish);
+  Extents miss_extents;
+  int r = 0;
+  {
+    // the log space behind a hit cannot be reused while we hold the lock
+    Mutex::Locker locker(m_lock);
+    for (auto &image_extent : image_extents) {
+      m_log_map.map(image_extent.first, image_extent.second, &req->extents);
+    }
+    for (auto &extent : req->extents) {
+      if (extent.seq == 0) {
+        if (!miss_extents.empty() &&
+            miss_extents.back().first + miss_extents.back().second ==
+              extent.image_offset) {
+          miss_extents.back().second += extent.length;
+        } else {
+          miss_extents.emplace_back(extent.image_offset, extent.length);
+        }
+        continue;
+      }
+
+      req->hits.emplace_back();
+      r = m_log.read(extent.log_offset, extent.length, &req->hits.back());
+      if (r < 0) {
+        break;
+      }
+    }
+  }
+
+  if (r < 0 || miss_extents.empty()) {
+    m_image_ctx.op_work_queue->queue(req, r);
+    return;
+  }
+
+  ldout(cct, 20) << "hits=" << req->hits.size() << ", "
+                 << "misses=" << miss_extents << dendl;
+  m_image_writeback.aio_read(std::move(miss_extents), &req->miss_bl,
+                             fadvise_flags, req);
+}
+
+template <typename I>
+void FileImageCache<I>::aio_write(Extents &&image_extents,
+                                  bufferlist&& bl,
+                                  int fadvise_flags,
+                                  Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  uint64_t max_length = std::min(m_log.get_max_entry_length(),
+                                 MAX_DESTAGE_BYTES);
+  C_Gather *gather_ctx = new C_Gather(cct, on_finish);
+  uint64_t buffer_offset = 0;
+  for (auto &image_extent : image_extents) {
+    for (uint64_t offset = 0; offset < image_extent.second;
+         offset += max_length) {
+      uint64_t length = std::min(max_length, image_extent.second - offset);
+      bufferlist sub_bl;
+      sub_bl.substr_of(bl, buffer_offset + offset, length);
+      queue_op(OP_TYPE_WRITE, image_extent.first + offset, std::move(sub_bl),
+               gather_ctx->new_sub());
+    }
+    buffer_offset += image_extent.second;
+  }
+  gather_ctx->activate();
+}
+
+template <typename I>
+void FileImageCache<I>::aio_discard(uint64_t offset, uint64_t length,
+                                    bool skip_partial_discard,
+                                    Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  // older writes must reach the image first
+  Context *ctx = new FunctionContext(
+    [this, offset, length, skip_partial_discard, on_finish](int r) {
+      if (r < 0) {
+        on_finish->complete(r);
+        return;
+      }
+      RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+      m_image_writeback.aio_discard(offset, length, skip_partial_discard,
+                                    on_finish);
+    });
+  flush(ctx);
+}
+
+template <typename I>
+void FileImageCache<I>::aio_flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "on_finish=" << on_finish << dendl;
+
+  queue_op(OP_TYPE_FLUSH, 0, bufferlist(), on_finish);
+}
+
+template <typename I>
+void FileImageCache<I>::aio_writesame(uint64_t offset, uint64_t length,
+                                      bufferlist&& bl, int fadvise_flags,
+                                      Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "data_len=" << bl.length() << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  Context *ctx = new FunctionContext(
+    [this, offset, length, bl, fadvise_flags, on_finish](int r) mutable {
+      if (r < 0) {
+        on_finish->complete(r);
+        return;
+      }
+      RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+      m_image_writeback.aio_writesame(offset, length, std::move(bl),
+                                      fadvise_flags, on_finish);
+    });
+  flush(ctx);
+}
+
+template <typename I>
+void FileImageCache<I>::aio_compare_and_write(Extents &&image_extents,
+                                              bufferlist&& cmp_bl,
+                                              bufferlist&& bl,
+                                              uint64_t *mismatch_offset,
+                                              int fadvise_flags,
+                                              Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  // the comparison must see the latest data, so write back first
+  Context *ctx = new FunctionContext(
+    [this, image_extents, cmp_bl, bl, mismatch_offset, fadvise_flags,
+     on_finish](int r) mutable {
+      if (r < 0) {
+        on_finish->complete(r);
+        return;
+      }
+      RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+      m_image_writeback.aio_compare_and_write(
+        std::move(image_extents), std::move(cmp_bl), std::move(bl),
+        mismatch_offset, fadvise_flags, on_finish);
+    });
+  flush(ctx);
+}
+
+template <typename I>
+void FileImageCache<I>::init(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  int r = m_log.open(get_log_name(m_image_ctx),
+                     m_image_ctx.persistent_cache_size, &m_replay_entries);
+  if (r < 0) {
+    lderr(cct) << "failed to open persistent cache log: " << cpp_strerror(r)
+               << dendl;
+    m_image_ctx.op_work_queue->queue(on_finish, r);
+    return;
+  }
+
+  // the log may only be replayed if the image still names it
+  librados::ObjectReadOperation op;
+  cls_client::metadata_get_start(&op,
+                                 ImageCtx::METADATA_PERSISTENT_CACHE_OWNER);
+
+  Context *ctx = new FunctionContext([this, on_finish](int r) {
+      handle_get_owner(r, on_finish);
+    });
+  librados::AioCompletion *comp = create_rados_callback(ctx);
+  m_out_bl.clear();
+  r = m_image_ctx.md_ctx.aio_operate(m_image_ctx.header_oid, comp, &op,
+                                     &m_out_bl);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void FileImageCache<I>::handle_get_owner(int r, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "r=" << r << dendl;
+
+  std::string owner;
+  if (r == 0) {
+    bufferlist::iterator it = m_out_bl.begin();
+    r = cls_client::metadata_get_finish(&it, &owner);
+  }
+  if (r == -ENOENT) {
+    r = 0;
+  }
+  if (r < 0) {
+    lderr(cct) << "failed to read persistent cache owner: "
+               << cpp_strerror(r) << dendl;
+  } else if (!owner.empty() && owner != m_owner) {
+    lderr(cct) << "image has unwritten data in the persistent cache of "
+               << owner << ": write it back from there or remove image "
+               << "metadata key " << ImageCtx::METADATA_PERSISTENT_CACHE_OWNER
+               << " to discard it" << dendl;
+    r = -EBUSY;
+  }
+
+  Entries entries;
+  entries.swap(m_replay_entries);
+  if (r == 0 && !entries.empty() && owner.empty()) {
+    // the image moved on without us: others may have written to it since,
+    // so the log must not be written back over their data
+    lderr(cct) << "discarding " << entries.size() << " stale log entries "
+               << "(seq " << entries.front().seq << ".."
+               << entries.back().seq << "): image does not name "
+               << m_owner << " as owner of unwritten data" << dendl;
+    r = m_log.retire(entries.back());
+    if (r < 0) {
+      lderr(cct) << "failed to discard log entries: " << cpp_strerror(r)
+                 << dendl;
+    }
+    entries.clear();
+  }
+  if (r < 0) {
+    m_log.close();
+    m_image_ctx.op_work_queue->queue(on_finish, r);
+    return;
+  }
+
+  {
+    Mutex::Locker locker(m_lock);
+    m_owner_recorded = !owner.empty();
+    for (auto &entry : entries) {
+      if (entry.type == file::WriteLog::ENTRY_TYPE_WRITE) {
+        m_log_map.add(entry.image_offset, entry.length, entry.seq,
+                      entry.data_offset());
+      }
+      m_dirty.push_back(entry);
+      m_last_seq = entry.seq;
+    }
+    m_writes_since_sync = (!entries.empty() &&
+                           entries.back().type ==
+                             file::WriteLog::ENTRY_TYPE_WRITE);
+  }
+  if (!entries.empty()) {
+    ldout(cct, 5) << "replayed " << entries.size() << " log entries" << dendl;
+  }
+
+  m_log_thread.create("rbd_pcache");
+  m_image_ctx.op_work_queue->queue(on_finish, 0);
+}
+
+template <typename I>
+void FileImageCache<I>::shut_down(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  Context *ctx = new FunctionContext([this, on_finish](int r) {
+      {
+        Mutex::Locker locker(m_lock);
+        m_stopping = true;
+        m_cond.Signal();
+      }
+      m_log_thread.join();
+      m_log.close();
+      on_finish->complete(r);
+    });
+
+  if (!is_lock_owner()) {
+    Mutex::Locker locker(m_lock);
+    if (!m_dirty.empty()) {
+      // the image keeps naming this log, which blocks writes from anyone
+      // else until this host writes it back
+      lderr(cct) << "not lock owner, leaving " << m_dirty.size()
+                 << " unwritten log entries" << dendl;
+      m_image_ctx.op_work_queue->queue(ctx, 0);
+      return;
+    }
+  }
+  invalidate(ctx);
+}
+
+template <typename I>
+void FileImageCache<I>::invalidate(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "on_finish=" << on_finish << dendl;
+
+  // the log only holds dirty data; once that is in the image the image
+  // no longer depends on this log
+  Context *ctx = new FunctionContext([this, on_finish](int r) {
+      if (r < 0) {
+        on_finish->complete(r);
+        return;
+      }
+      queue_op(OP_TYPE_RELEASE, 0, bufferlist(), on_finish);
+    });
+  flush(ctx);
+}
+
+template <typename I>
+void FileImageCache<I>::flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "on_finish=" << on_finish << dendl;
+
+  queue_op(OP_TYPE_DESTAGE, 0, bufferlist(), on_finish);
+}
+
+template <typename I>
+void FileImageCache<I>::queue_op(OpType type, uint64_t image_offset,
+                                 bufferlist &&bl, Context *on_finish) {
+  Mutex::Locker locker(m_lock);
+  m_ops.push_back(Op{type, image_offset, std::move(bl), on_finish});
+
+  // give a failed destage another chance
+  m_destage_r = 0;
+  m_cond.Signal();
+}
+
+template <typename I>
+void FileImageCache<I>::log_thread_entry() {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << "start" << dendl;
+
+  Mutex::Locker locker(m_lock);
+  while (true) {
+    if (!m_destaged.empty()) {
+      retire();
+      continue;
+    }
+    if (!m_ops.empty() &&
+        (m_ops.front().type != OP_TYPE_WRITE ||
+         m_log.can_append(m_ops.front().bl.length()))) {
+      process_ops();
+      continue;
+    }
+    if (m_stopping && !m_destaging) {
+      break;
+    }
+    if (can_destage()) {
+      m_lock.Unlock();
+      bool lock_owner = is_lock_owner();
+      m_lock.Lock();
+      if (lock_owner) {
+        destage();
+      } else {
+        // replayed entries wait for the next write to acquire the lock
+        m_cond.WaitInterval(m_lock, utime_t(1, 0));
+      }
+      continue;
+    }
+    m_cond.Wait(m_lock);
+  }
+
+  // only left behind if the final flush failed
+  for (auto &op : m_ops) {
+    m_image_ctx.op_work_queue->queue(op.on_finish, -ESHUTDOWN);
+  }
+  m_ops.clear();
+  if (!m_destage_waiters.empty()) {
+    complete_destage_waiters(-ESHUTDOWN);
+  }
+  ldout(cct, 10) << "finish" << dendl;
+}
+
+template <typename I>
+void FileImageCache<I>::process_ops() {
+  assert(m_lock.is_locked());
+  CephContext *cct = m_image_ctx.cct;
+
+  while (!m_ops.empty()) {
+    if (m_ops.front().type == OP_TYPE_WRITE &&
+        !m_log.can_append(m_ops.front().bl.length())) {
+      ldout(cct, 20) << "log full, used=" << m_log.get_used() << dendl;
+      break;
+    }
+
+    Op op = std::move(m_ops.front());
+    m_ops.pop_front();
+
+    if (op.type == OP_TYPE_DESTAGE) {
+      m_destage_waiters.push_back(DestageWaiter{m_last_seq, op.on_finish});
+      complete_destage_waiters(0);
+      continue;
+    }
+    if (op.type == OP_TYPE_RELEASE) {
+      int r = 0;
+      if (m_owner_recorded && m_dirty.empty()) {
+        // the next write records us again
+        m_owner_recorded = false;
+        m_lock.Unlock();
+        r = remove_owner();
+        m_lock.Lock();
+        if (r < 0) {
+          m_owner_recorded = true;
+        }
+      }
+      m_image_ctx.op_work_queue->queue(op.on_finish, r);
+      continue;
+    }
+
+    file::WriteLog::Entry entry;
+    int r = 0;
+    bool record = (op.type == OP_TYPE_WRITE && !m_owner_recorded);
+    m_lock.Unlock();
+    if (op.type == OP_TYPE_WRITE) {
+      if (record) {
+        r = record_owner();
+        record = (r == 0);
+      }
+      if (r == 0) {
+        r = m_log.append_write(op.image_offset, op.bl, &entry);
+      }
+    } else {
+      if (m_writes_since_sync) {
+        // barrier for destaging
+        r = m_log.append_sync(&entry);
+      }
+      if (r == 0) {
+        r = m_log.sync();
+      }
+    }
+    m_lock.Lock();
+    if (record) {
+      m_owner_recorded = true;
+    }
+
+    if (r < 0) {
+      lderr(cct) << "failed to log " << (op.type == OP_TYPE_WRITE ?
+                                           "write" : "flush")
+                 << ": " << cpp_strerror(r) << dendl;
+      if (op.type == OP_TYPE_FLUSH) {
+        complete_unsynced(r);
+      }
+      m_image_ctx.op_work_queue->queue(op.on_finish, r);
+      continue;
+    }
+
+    if (entry.seq != 0) {
+      m_dirty.push_back(entry);
+      m_last_seq = entry.seq;
+    }
+    if (op.type == OP_TYPE_WRITE) {
+      m_log_map.add(entry.image_offset, entry.length, entry.seq,
+                    entry.data_offset());
+      m_writes_since_sync = true;
+      if (m_image_ctx.persistent_cache_persist_on_flush) {
+        m_image_ctx.op_work_queue->queue(op.on_finish, 0);
+      } else {
+        m_unsynced.push_back(op.on_finish);
+      }
+    } else {
+      m_writes_since_sync = false;
+      complete_unsynced(0);
+      m_image_ctx.op_work_queue->queue(op.on_finish, 0);
+    }
+  }
+
+  if (!m_unsynced.empty()) {
+    // one sync for everything appended above
+    m_lock.Unlock();
+    int r = m_log.sync();
+    m_lock.Lock();
+    complete_unsynced(r);
+  }
+}
+
+template <typename I>
+int FileImageCache<I>::record_owner() {
+  CephContext *cct = m_image_ctx.cct;
+
+  // a new lock owner checks the record after acquiring the lock, so a
+  // cache on another host cannot start writing back behind our back
+  std::string owner;
+  int r = cls_client::metadata_get(&m_image_ctx.md_ctx,
+                                   m_image_ctx.header_oid,
+                                   ImageCtx::METADATA_PERSISTENT_CACHE_OWNER,
+                                   &owner);
+  if (r == 0 && owner != m_owner) {
+    lderr(cct) << "image has unwritten data in the persistent cache of "
+               << owner << dendl;
+    return -EBUSY;
+  } else if (r == 0) {
+    return 0;
+  } else if (r != -ENOENT) {
+    lderr(cct) << "failed to read persistent cache owner: "
+               << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  ldout(cct, 10) << "owner=" << m_owner << dendl;
+  bufferlist bl;
+  bl.append(m_owner);
+  r = cls_client::metadata_set(
+    &m_image_ctx.md_ctx, m_image_ctx.header_oid,
+    {{ImageCtx::METADATA_PERSISTENT_CACHE_OWNER, bl}});
+  if (r < 0) {
+    lderr(cct) << "failed to record persistent cache owner: "
+               << cpp_strerror(r) << dendl;
+  }
+  return r;
+}
+
+template <typename I>
+int FileImageCache<I>::remove_owner() {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << dendl;
+
+  int r = cls_client::metadata_remove(
+    &m_image_ctx.md_ctx, m_image_ctx.header_oid,
+    ImageCtx::METADATA_PERSISTENT_CACHE_OWNER);
+  if (r == -ENOENT) {
+    r = 0;
+  } else if (r < 0) {
+    lderr(cct) << "failed to remove persistent cache owner: "
+               << cpp_strerror(r) << dendl;
+  }
+  return r;
+}
+
+template <typename I>
+void FileImageCache<I>::complete_unsynced(int r) {
+  assert(m_lock.is_locked());
+  for (auto ctx : m_unsynced) {
+    m_image_ctx.op_work_queue->queue(ctx, r);
+  }
+  m_unsynced.clear();
+}
+
+template <typename I>
+bool FileImageCache<I>::is_lock_owner() {
+  RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+  return (m_image_ctx.exclusive_lock == nullptr ||
+          m_image_ctx.exclusive_lock->is_lock_owner());
+}
+
+template <typename I>
+bool FileImageCache<I>::can_destage() const {
+  assert(m_lock.is_locked());
+  return (!m_destaging && m_destaged.empty() && !m_dirty.empty() &&
+          m_destage_r == 0);
+}
+
+template <typename I>
+void FileImageCache<I>::destage() {
+  assert(m_lock.is_locked());
+  CephContext *cct = m_image_ctx.cct;
+
+  // a batch never crosses a flush barrier
+  Entries entries;
+  uint64_t bytes = 0;
+  for (auto &entry : m_dirty) {
+    if (entry.type == file::WriteLog::ENTRY_TYPE_WRITE) {
+      if (!entries.empty() && bytes + entry.length > MAX_DESTAGE_BYTES) {
+        break;
+      }
+      bytes += entry.length;
+    }
+    entries.push_back(entry);
+    if (entry.type == file::WriteLog::ENTRY_TYPE_SYNC) {
+      break;
+    }
+  }
+  assert(!entries.empty());
+
+  ldout(cct, 20) << "seq=" << entries.front().seq << ".."
+                 << entries.back().seq << ", bytes=" << bytes << dendl;
+  m_destaging = true;
+  m_lock.Unlock();
+
+  // coalesce the batch: the newest write to each extent wins
+  file::LogMap batch_map;
+  uint64_t start = std::numeric_limits<uint64_t>::max();
+  uint64_t end = 0;
+  for (auto &entry : entries) {
+    if (entry.type != file::WriteLog::ENTRY_TYPE_WRITE || entry.length == 0) {
+      continue;
+    }
+    batch_map.add(entry.image_offset, entry.length, entry.seq,
+                  entry.data_offset());
+    start = std::min(start, entry.image_offset);
+    end = std::max(end, entry.image_offset + entry.length);
+  }
+
+  Extents image_extents;
+  bufferlist bl;
+  int r = 0;
+  if (start < end) {
+    file::LogMap::Extents extents;
+    batch_map.map(start, end - start, &extents);
+    for (auto &extent : extents) {
+      if (extent.seq == 0) {
+        continue;
+      }
+      r = m_log.read(extent.log_offset, extent.length, &bl);
+      if (r < 0) {
+        break;
+      }
+      if (!image_extents.empty() &&
+          image_extents.back().first + image_extents.back().second ==
+            extent.image_offset) {
+        image_extents.back().second += extent.length;
+      } else {
+        image_extents.emplace_back(extent.image_offset, extent.length);
+      }
+    }
+  }
+
+  Context *ctx = new FunctionContext(
+    [this, entries](int r) mutable {
+      handle_destage(std::move(entries), r);
+    });
+  if (r < 0 || image_extents.empty()) {
+    ctx->complete(r);
+    m_lock.Lock();
+    return;
+  }
+
+  ldout(cct, 20) << "image_extents=" << image_extents << dendl;
+  ctx = new FunctionContext([this, ctx](int r) {
+      if (r < 0) {
+        ctx->complete(r);
+        return;
+      }
+      // the log may only be retired once the writes are stable
+      RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+      m_image_writeback.aio_flush(ctx);
+    });
+  {
+    RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+    m_image_writeback.aio_write(std::move(image_extents), std::move(bl), 0,
+                                create_async_context_callback(m_image_ctx,
+                                                              ctx));
+  }
+  m_lock.Lock();
+}
+
+template <typename I>
+void FileImageCache<I>::handle_destage(Entries &&entries, int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "r=" << r << dendl;
+
+  Mutex::Locker locker(m_lock);
+  assert(m_destaging);
+  m_destaging = false;
+  if (r < 0) {
+    lderr(cct) << "failed to write back log entries: " << cpp_strerror(r)
+               << dendl;
+    m_destage_r = r;
+    complete_destage_waiters(r);
+  } else {
+    m_destaged = std::move(entries);
+  }
+  m_cond.Signal();
+}
+
+template <typename I>
+void FileImageCache<I>::retire() {
+  assert(m_lock.is_locked());
+  CephContext *cct = m_image_ctx.cct;
+
+  Entries entries;
+  entries.swap(m_destaged);
+  for (auto &entry : entries) {
+    assert(!m_dirty.empty() && m_dirty.front().seq == entry.seq);
+    m_dirty.pop_front();
+    if (entry.type == file::WriteLog::ENTRY_TYPE_WRITE) {
+      m_log_map.remove(entry.image_offset, entry.length, entry.seq);
+    }
+  }
+
+  // the map no longer points at these entries, so their space may be
+  // reused as soon as the tail moves
+  m_lock.Unlock();
+  int r = m_log.retire(entries.back());
+  m_lock.Lock();
+  if (r < 0) {
+    // harmless: the entries are replayed again after a crash
+    lderr(cct) << "failed to retire log entries: " << cpp_strerror(r)
+               << dendl;
+  }
+
+  complete_destage_waiters(0);
+}
+
+template <typename I>
+void FileImageCache<I>::complete_destage_waiters(int r) {
+  assert(m_lock.is_locked());
+  uint64_t destaged_seq = (m_dirty.empty() ? m_last_seq :
+                                             m_dirty.front().seq - 1);
+  for (auto it = m_destage_waiters.begin();
+       it != m_destage_waiters.end(); ) {
+    if (r < 0 || it->seq <= destaged_seq) {
+      m_image_ctx.op_work_queue->queue(it->on_finish, r);
+      it = m_destage_waiters.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+} // namespace cache
+} // namespace librbd
+
+template class librbd::cache::FileImageCache<librbd::ImageCtx>;
@@ -0,0 +1,162 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_CACHE_FILE_IMAGE_CACHE
+#define CEPH_LIBRBD_CACHE_FILE_IMAGE_CACHE
+
+#include "ImageCache.h"
+#include "ImageWriteback.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "include/buffer.h"
+#include "librbd/cache/file/LogMap.h"
+#include "librbd/cache/file/WriteLog.h"
+#include <deque>
+#include <list>
+
+namespace librbd {
+
+struct ImageCtx;
+
+namespace cache {
+
+/**
+ * Persistent write-back cache backed by a log file on local storage.
+ *
+ * Writes are appended to a file::WriteLog and completed as soon as they
+ * reach the local file system (or, unless
+ * rbd_persistent_cache_persist_on_flush is set, once they are synced);
+ * aio_flush syncs the log and leaves a barrier in it.  A dedicated thread
+ * performs all log I/O and destages the log to the image in order,
+ * coalescing overwrites within each batch. Batches never span a barrier
+ * and are flushed to the cluster before the next one starts, so the image
+ * is always consistent as of some user flush. Reads are served from the
+ * log where it holds newer data than the image.
+ *
+ * Before the log first holds data that is not in the image, the image
+ * metadata is updated to name this host's log as the owner of that data;
+ * the record is dropped once the log has been written back on lock
+ * release or close. A log is only replayed while the image still names
+ * it, and nobody else may write to the image while it names another log.
+ */
+template <typename ImageCtxT = librbd::ImageCtx>
+class FileImageCache : public ImageCache {
+public:
+  FileImageCache(ImageCtxT &image_ctx);
+  ~FileImageCache() override;
+
+  /// client AIO methods
+  void aio_read(Extents&& image_extents, ceph::bufferlist *bl,
+                int fadvise_flags, Context *on_finish) override;
+  void aio_write(Extents&& image_extents, ceph::bufferlist&& bl,
+                 int fadvise_flags, Context *on_finish) override;
+  void aio_discard(uint64_t offset, uint64_t length,
+                   bool skip_partial_discard, Context *on_finish) override;
+  void aio_flush(Context *on_finish) override;
+  void aio_writesame(uint64_t offset, uint64_t length,
+                     ceph::bufferlist&& bl,
+                     int fadvise_flags, Context *on_finish) override;
+  void aio_compare_and_write(Extents&& image_extents,
+                             ceph::bufferlist&& cmp_bl, ceph::bufferlist&& bl,
+                             uint64_t *mismatch_offset,int fadvise_flags,
+                             Context *on_finish) override;
+
+  /// internal state methods
+  void init(Context *on_finish) override;
+  void shut_down(Context *on_finish) override;
+
+  void invalidate(Context *on_finish) override;
+  void flush(Context *on_finish) override;
+
+private:
+  struct C_ReadRequest;
+
+  enum OpType {
+    OP_TYPE_WRITE,   ///< append image data
+    OP_TYPE_FLUSH,   ///< sync the log (aio_flush)
+    OP_TYPE_DESTAGE, ///< wait until everything before is in the image
+    OP_TYPE_RELEASE, ///< stop naming this log in the image if it is clean
+  };
+
+  struct Op {
+    OpType type;
+    uint64_t image_offset;
+    ceph::bufferlist bl;
+    Context *on_finish;
+  };
+
+  struct DestageWaiter {
+    uint64_t seq;
+    Context *on_finish;
+  };
+
+  class LogThread : public Thread {
+  public:
+    LogThread(FileImageCache *cache) : m_cache(cache) {
+    }
+  protected:
+    void *entry() override {
+      m_cache->log_thread_entry();
+      return nullptr;
+    }
+  private:
+    FileImageCache *m_cache;
+  };
+
+  typedef std::list<file::WriteLog::Entry> Entries;
+
+  ImageCtxT &m_image_ctx;
+  ImageWriteback<ImageCtxT> m_image_writeback;
+  file::WriteLog m_log;
+  LogThread m_log_thread;
+  std::string m_owner;                ///< identifies this host's log
+
+  Mutex m_lock;
+  Cond m_cond;
+  bool m_stopping = false;
+  bool m_owner_recorded = false;      ///< the image names us as dirty
+
+  Entries m_replay_entries;           ///< found by init, not yet validated
+  ceph::bufferlist m_out_bl;
+
+  std::deque<Op> m_ops;               ///< waiting to be appended
+  std::list<Context*> m_unsynced;     ///< appended writes waiting for a sync
+  bool m_writes_since_sync = false;
+
+  file::LogMap m_log_map;             ///< dirty image extents
+  std::deque<file::WriteLog::Entry> m_dirty; ///< not yet destaged
+  uint64_t m_last_seq = 0;            ///< last appended entry
+
+  bool m_destaging = false;
+  int m_destage_r = 0;                ///< last destage error, until retried
+  Entries m_destaged;                 ///< in the image, waiting to be retired
+  std::list<DestageWaiter> m_destage_waiters;
+
+  void handle_get_owner(int r, Context *on_finish);
+  int record_owner();
+  int remove_owner();
+
+  void log_thread_entry();
+
+  void process_ops();
+  void complete_unsynced(int r);
+
+  bool is_lock_owner();
+
+  bool can_destage() const;
+  void destage();
+  void handle_destage(Entries &&entries, int r);
+  void retire();
+  void complete_destage_waiters(int r);
+
+  void queue_op(OpType type, uint64_t image_offset, ceph::bufferlist &&bl,
+                Context *on_finish);
+};
+
+} // namespace cache
+} // namespace librbd
+
+extern template class librbd::cache::FileImageCache<librbd::ImageCtx>;
+
+#endif // CEPH_LIBRBD_CACHE_FILE_IMAGE_CACHE
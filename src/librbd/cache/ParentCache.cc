@@ -0,0 +1,451 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "librbd/cache/ParentCache.h"
+#include "include/compat.h"
+#include "include/stringify.h"
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/perf_counters.h"
+#include "common/safe_io.h"
+#include "common/WorkQueue.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/Utils.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iomanip>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::cache::ParentCache: " << this << " " \
+                           << __func__ << ": "
+
+namespace librbd {
+namespace cache {
+
+namespace {
+
+enum {
+  l_librbd_parent_cache_first = 26100,
+  l_librbd_parent_cache_hit,
+  l_librbd_parent_cache_hit_bytes,
+  l_librbd_parent_cache_miss,
+  l_librbd_parent_cache_coalesced,
+  l_librbd_parent_cache_fetch_bytes,
+  l_librbd_parent_cache_fetch_latency,
+  l_librbd_parent_cache_write_error,
+  l_librbd_parent_cache_evict,
+  l_librbd_parent_cache_bytes,
+  l_librbd_parent_cache_last,
+};
+
+// leftovers of clients that died while writing an object
+const char *TMP_PREFIX = ".tmp.";
+const time_t TMP_MAX_AGE = 3600;
+
+// empty file standing in for an object that the parent does not have
+const char *MARKER_SUFFIX = ".none";
+
+uint64_t copy_range(const bufferlist &data, uint64_t off, uint64_t len,
+                    bufferlist *bl) {
+  if (off >= data.length()) {
+    return 0;
+  }
+
+  bufferlist sub;
+  sub.substr_of(data, off, std::min<uint64_t>(len, data.length() - off));
+  uint64_t length = sub.length();
+  bl->claim_append(sub);
+  return length;
+}
+
+} // anonymous namespace
+
+ParentCache *ParentCache::get_instance(CephContext *cct) {
+  ParentCache *parent_cache;
+  cct->lookup_or_create_singleton_object<ParentCache>(
+    parent_cache, "librbd::cache::ParentCache");
+  return parent_cache;
+}
+
+ParentCache::ParentCache(CephContext *cct)
+  : m_cct(cct), m_path(cct->_conf->rbd_parent_cache_path),
+    m_max_size(cct->_conf->rbd_parent_cache_size),
+    m_lock("librbd::cache::ParentCache::m_lock") {
+  PerfCountersBuilder plb(cct, "librbd-parent-cache",
+                          l_librbd_parent_cache_first,
+                          l_librbd_parent_cache_last);
+  plb.add_u64_counter(l_librbd_parent_cache_hit, "hit",
+                      "Reads served from the cache");
+  plb.add_u64_counter(l_librbd_parent_cache_hit_bytes, "hit_bytes",
+                      "Data read from the cache");
+  plb.add_u64_counter(l_librbd_parent_cache_miss, "miss",
+                      "Objects fetched from the cluster");
+  plb.add_u64_counter(l_librbd_parent_cache_coalesced, "coalesced",
+                      "Reads that waited for an in-flight fetch");
+  plb.add_u64_counter(l_librbd_parent_cache_fetch_bytes, "fetch_bytes",
+                      "Data fetched from the cluster");
+  plb.add_time_avg(l_librbd_parent_cache_fetch_latency, "fetch_latency",
+                   "Latency of object fetches");
+  plb.add_u64_counter(l_librbd_parent_cache_write_error, "write_error",
+                      "Fetched objects that could not be stored");
+  plb.add_u64_counter(l_librbd_parent_cache_evict, "evict",
+                      "Objects removed to stay within the size limit");
+  plb.add_u64(l_librbd_parent_cache_bytes, "bytes",
+              "Size of the cache directory");
+  m_perf_counters = plb.create_perf_counters();
+  cct->get_perfcounters_collection()->add(m_perf_counters);
+}
+
+ParentCache::~ParentCache() {
+  assert(m_fetches.empty());
+  m_cct->get_perfcounters_collection()->remove(m_perf_counters);
+  delete m_perf_counters;
+}
+
+void ParentCache::read(ImageCtx *image_ctx, const std::string &oid,
+                       uint64_t object_no, librados::snap_t snap_id,
+                       uint64_t off, uint64_t len, bufferlist *bl,
+                       Context *on_finish) {
+  std::string name = get_name(image_ctx, snap_id, object_no);
+  ldout(m_cct, 20) << name << " " << off << "~" << len << dendl;
+
+  Waiter waiter{off, len, bl, on_finish};
+  auto join_fetch = [this, image_ctx, &name, &waiter]() {
+    assert(m_lock.is_locked());
+    auto it = m_fetches.find(name);
+    if (it == m_fetches.end()) {
+      return false;
+    }
+
+    Fetch &fetch = it->second;
+    m_perf_counters->inc(l_librbd_parent_cache_coalesced);
+    if (!fetch.done) {
+      fetch.waiters.push_back(waiter);
+      return true;
+    }
+
+    // fetched but still being written out
+    uint64_t length = 0;
+    if (fetch.exists) {
+      length = copy_range(fetch.data, waiter.off, waiter.len, waiter.bl);
+    }
+    m_perf_counters->inc(l_librbd_parent_cache_hit);
+    m_perf_counters->inc(l_librbd_parent_cache_hit_bytes, length);
+    image_ctx->op_work_queue->queue(waiter.on_finish,
+                                    fetch.exists ? 0 : -ENOENT);
+    return true;
+  };
+
+  {
+    Mutex::Locker locker(m_lock);
+    if (join_fetch()) {
+      return;
+    }
+  }
+
+  int r = read_file(name, off, len, bl);
+  if (r >= 0) {
+    m_perf_counters->inc(l_librbd_parent_cache_hit);
+    m_perf_counters->inc(l_librbd_parent_cache_hit_bytes, r);
+    image_ctx->op_work_queue->queue(on_finish, 0);
+    return;
+  } else if (r != -ENOENT) {
+    lderr(m_cct) << "failed to read " << name << ": " << cpp_strerror(r)
+                 << dendl;
+  } else if (::utimensat(AT_FDCWD, get_marker_path(name).c_str(), nullptr,
+                         0) == 0) {
+    m_perf_counters->inc(l_librbd_parent_cache_hit);
+    image_ctx->op_work_queue->queue(on_finish, -ENOENT);
+    return;
+  }
+
+  bufferlist *data;
+  {
+    Mutex::Locker locker(m_lock);
+    if (join_fetch()) {
+      return;
+    }
+
+    Fetch &fetch = m_fetches[name];
+    fetch.waiters.push_back(waiter);
+    data = &fetch.data;
+  }
+
+  m_perf_counters->inc(l_librbd_parent_cache_miss);
+  fetch(image_ctx, oid, snap_id, name, data);
+}
+
+std::string ParentCache::get_name(ImageCtx *image_ctx,
+                                  librados::snap_t snap_id,
+                                  uint64_t object_no) const {
+  std::string fsid;
+  librados::Rados rados(image_ctx->data_ctx);
+  rados.cluster_fsid(&fsid);
+
+  std::ostringstream oss;
+  oss << fsid << "." << image_ctx->data_ctx.get_id() << "." << image_ctx->id
+      << "." << std::hex << snap_id << "." << std::setfill('0')
+      << std::setw(16) << object_no;
+  return oss.str();
+}
+
+std::string ParentCache::get_file_path(const std::string &name) const {
+  return m_path + "/" + name;
+}
+
+std::string ParentCache::get_marker_path(const std::string &name) const {
+  return get_file_path(name) + MARKER_SUFFIX;
+}
+
+int ParentCache::read_file(const std::string &name, uint64_t off,
+                           uint64_t len, bufferlist *bl) {
+  int fd = ::open(get_file_path(name).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return -errno;
+  }
+
+  bufferptr bp = buffer::create(len);
+  ssize_t r = safe_pread(fd, bp.c_str(), len, off);
+  if (r > 0) {
+    bp.set_length(r);
+    bl->append(bp);
+  }
+  if (r >= 0) {
+    // the modification time orders objects for eviction
+    ::futimens(fd, nullptr);
+  }
+  VOID_TEMP_FAILURE_RETRY(::close(fd));
+  return r;
+}
+
+void ParentCache::fetch(ImageCtx *image_ctx, const std::string &oid,
+                        librados::snap_t snap_id, const std::string &name,
+                        bufferlist *data) {
+  ldout(m_cct, 20) << name << dendl;
+
+  librados::ObjectReadOperation op;
+  op.read(0, image_ctx->layout.object_size, data, nullptr);
+  int flags = image_ctx->get_read_flags(snap_id);
+
+  // the work queue outlives the image, which may be closed as soon as
+  // the last waiter is completed
+  ContextWQ *op_work_queue = image_ctx->op_work_queue;
+  utime_t start_time = ceph_clock_now();
+  Context *ctx = new FunctionContext(
+    [this, op_work_queue, name, start_time](int r) {
+      handle_fetch(op_work_queue, name, start_time, r);
+    });
+  librados::AioCompletion *rados_completion =
+    util::create_rados_callback(ctx);
+  int r = image_ctx->data_ctx.aio_operate(oid, rados_completion, &op, flags,
+                                          nullptr);
+  assert(r == 0);
+  rados_completion->release();
+}
+
+void ParentCache::handle_fetch(ContextWQ *op_work_queue,
+                               const std::string &name,
+                               const utime_t &start_time, int r) {
+  ldout(m_cct, 20) << name << " r=" << r << dendl;
+
+  // holes are remembered as well, a sparse parent would otherwise be
+  // asked for them on every read
+  bool cache = r >= 0 || r == -ENOENT;
+  std::list<Waiter> waiters;
+  bufferlist data;
+  {
+    Mutex::Locker locker(m_lock);
+    auto it = m_fetches.find(name);
+    assert(it != m_fetches.end());
+    waiters.swap(it->second.waiters);
+    if (!cache) {
+      m_fetches.erase(it);
+    } else {
+      it->second.done = true;
+      it->second.exists = r >= 0;
+      data = it->second.data;
+    }
+  }
+
+  if (!cache) {
+    lderr(m_cct) << "failed to fetch " << name << ": " << cpp_strerror(r)
+                 << dendl;
+  } else if (r >= 0) {
+    m_perf_counters->inc(l_librbd_parent_cache_fetch_bytes, data.length());
+    m_perf_counters->tinc(l_librbd_parent_cache_fetch_latency,
+                          ceph_clock_now() - start_time);
+  }
+
+  // this is the rados callback thread, which every completion of the
+  // client goes through, so the file system work is left to the op work
+  // queue.  queued before the waiters are completed, as that may let
+  // the image be closed.
+  if (cache) {
+    op_work_queue->queue(new FunctionContext([this, name](int r) {
+        store(name);
+      }), 0);
+  }
+
+  // readers do not wait for the object to be stored
+  for (auto &waiter : waiters) {
+    if (r >= 0) {
+      copy_range(data, waiter.off, waiter.len, waiter.bl);
+    }
+    waiter.on_finish->complete(r < 0 ? r : 0);
+  }
+}
+
+void ParentCache::store(const std::string &name) {
+  bufferlist data;
+  bool exists;
+  {
+    Mutex::Locker locker(m_lock);
+    auto it = m_fetches.find(name);
+    assert(it != m_fetches.end() && it->second.done);
+    data = it->second.data;
+    exists = it->second.exists;
+  }
+
+  int r = write_file(exists ? get_file_path(name) : get_marker_path(name),
+                     data);
+  if (r < 0) {
+    lderr(m_cct) << "failed to store " << name << ": " << cpp_strerror(r)
+                 << dendl;
+    m_perf_counters->inc(l_librbd_parent_cache_write_error);
+  }
+
+  bool trim_needed = false;
+  {
+    Mutex::Locker locker(m_lock);
+    m_fetches.erase(name);
+    if (r == 0) {
+      m_size += data.length();
+      m_perf_counters->set(l_librbd_parent_cache_bytes, m_size);
+    }
+    if (!m_trimming && (!m_scanned || m_size > m_max_size)) {
+      m_trimming = true;
+      trim_needed = true;
+    }
+  }
+
+  if (trim_needed) {
+    trim();
+  }
+}
+
+int ParentCache::write_file(const std::string &path, bufferlist &data) {
+  std::string tmp_path;
+  {
+    Mutex::Locker locker(m_lock);
+    tmp_path = m_path + "/" + TMP_PREFIX + stringify(getpid()) + "." +
+               stringify(++m_tmp_seq);
+  }
+
+  int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                  0644);
+  if (fd < 0 && errno == ENOENT) {
+    if (::mkdir(m_path.c_str(), 0755) < 0 && errno != EEXIST) {
+      return -errno;
+    }
+    fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                0644);
+  }
+  if (fd < 0) {
+    return -errno;
+  }
+
+  // the object must be complete before anybody can find it under its name
+  int r = data.write_fd(fd);
+  if (r == 0 && ::fdatasync(fd) < 0) {
+    r = -errno;
+  }
+  VOID_TEMP_FAILURE_RETRY(::close(fd));
+
+  if (r == 0 && ::rename(tmp_path.c_str(), path.c_str()) < 0) {
+    r = -errno;
+  }
+  if (r < 0) {
+    ::unlink(tmp_path.c_str());
+  }
+  return r;
+}
+
+void ParentCache::trim() {
+  struct File {
+    time_t mtime;
+    uint64_t size;
+    std::string name;
+  };
+
+  std::vector<File> files;
+  uint64_t size = 0;
+  uint64_t evicted = 0;
+
+  DIR *dir = ::opendir(m_path.c_str());
+  if (dir != nullptr) {
+    time_t now = ::time(nullptr);
+    struct dirent *de;
+    while ((de = ::readdir(dir)) != nullptr) {
+      struct stat st;
+      if (::fstatat(::dirfd(dir), de->d_name, &st, 0) < 0 ||
+          !S_ISREG(st.st_mode)) {
+        continue;
+      }
+
+      if (de->d_name[0] == '.') {
+        if (strncmp(de->d_name, TMP_PREFIX, strlen(TMP_PREFIX)) == 0 &&
+            now - st.st_mtime > TMP_MAX_AGE) {
+          ::unlinkat(::dirfd(dir), de->d_name, 0);
+        }
+        continue;
+      }
+
+      files.push_back(File{st.st_mtime, static_cast<uint64_t>(st.st_size),
+                           de->d_name});
+      size += st.st_size;
+    }
+
+    if (size > m_max_size) {
+      std::sort(files.begin(), files.end(),
+                [](const File &lhs, const File &rhs) {
+                  return lhs.mtime < rhs.mtime;
+                });
+
+      // leave some room so that we do not rescan after every fetch
+      uint64_t target_size = m_max_size - m_max_size / 10;
+      for (auto &file : files) {
+        if (size <= target_size) {
+          break;
+        }
+        if (::unlinkat(::dirfd(dir), file.name.c_str(), 0) == 0 ||
+            errno == ENOENT) {
+          size -= file.size;
+          ++evicted;
+        }
+      }
+    }
+    ::closedir(dir);
+  } else {
+    lderr(m_cct) << "failed to open " << m_path << ": "
+                 << cpp_strerror(-errno) << dendl;
+  }
+
+  ldout(m_cct, 10) << "size=" << size << ", evicted=" << evicted << dendl;
+  m_perf_counters->inc(l_librbd_parent_cache_evict, evicted);
+
+  Mutex::Locker locker(m_lock);
+  m_size = size;
+  m_scanned = true;
+  m_trimming = false;
+  m_perf_counters->set(l_librbd_parent_cache_bytes, m_size);
+}
+
+} // namespace cache
+} // namespace librbd
@@ -0,0 +1,103 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_CACHE_PARENT_CACHE
+#define CEPH_LIBRBD_CACHE_PARENT_CACHE
+
+#include "include/buffer.h"
+#include "include/int_types.h"
+#include "include/rados/librados.hpp"
+#include "include/utime.h"
+#include "common/Mutex.h"
+#include <list>
+#include <map>
+#include <string>
+
+class CephContext;
+class Context;
+class ContextWQ;
+class PerfCounters;
+
+namespace librbd {
+
+struct ImageCtx;
+
+namespace cache {
+
+/**
+ * Host-level read-only cache of parent image objects.
+ *
+ * The objects of a parent snapshot never change, so they are fetched
+ * whole and stored in rbd_parent_cache_path under a name derived from
+ * the cluster, pool, image, snapshot and object number. Every client on
+ * the host pointing at the same directory reuses them. Files are
+ * published with rename(2), so concurrent clients at worst fetch an
+ * object twice; within a process, reads of an object that is being
+ * fetched wait for that fetch. Objects missing from a sparse parent are
+ * remembered by an empty marker file. Storing, and trimming the
+ * directory to rbd_parent_cache_size by removing the least recently read
+ * objects, happen on the op work queue rather than the rados callback.
+ */
+class ParentCache {
+public:
+  static ParentCache *get_instance(CephContext *cct);
+
+  explicit ParentCache(CephContext *cct);
+  ~ParentCache();
+
+  /// read off~len of a parent object, fetching the whole object on a miss
+  void read(ImageCtx *image_ctx, const std::string &oid, uint64_t object_no,
+            librados::snap_t snap_id, uint64_t off, uint64_t len,
+            ceph::bufferlist *bl, Context *on_finish);
+
+private:
+  struct C_Fetch;
+
+  struct Waiter {
+    uint64_t off;
+    uint64_t len;
+    ceph::bufferlist *bl;
+    Context *on_finish;
+  };
+
+  struct Fetch {
+    bool done = false;          ///< data is valid, being written out
+    bool exists = true;         ///< false if the object is a hole
+    ceph::bufferlist data;
+    std::list<Waiter> waiters;
+  };
+
+  CephContext *m_cct;
+  std::string m_path;
+  uint64_t m_max_size;
+  PerfCounters *m_perf_counters = nullptr;
+
+  Mutex m_lock;
+  std::map<std::string, Fetch> m_fetches;
+  uint64_t m_size = 0;          ///< directory size as of the last scan,
+                                ///< plus what we have added since
+  bool m_scanned = false;
+  bool m_trimming = false;
+  uint64_t m_tmp_seq = 0;
+
+  std::string get_name(ImageCtx *image_ctx, librados::snap_t snap_id,
+                       uint64_t object_no) const;
+  std::string get_file_path(const std::string &name) const;
+  std::string get_marker_path(const std::string &name) const;
+
+  int read_file(const std::string &name, uint64_t off, uint64_t len,
+                ceph::bufferlist *bl);
+  void fetch(ImageCtx *image_ctx, const std::string &oid,
+             librados::snap_t snap_id, const std::string &name,
+             ceph::bufferlist *data);
+  void handle_fetch(ContextWQ *op_work_queue, const std::string &name,
+                    const utime_t &start_time, int r);
+  void store(const std::string &name);
+  int write_file(const std::string &path, ceph::bufferlist &data);
+  void trim();
+};
+
+} // namespace cache
+} // namespace librbd
+
+#endif // CEPH_LIBRBD_CACHE_PARENT_CACHE
@@ -0,0 +1,93 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "librbd/cache/file/LogMap.h"
+#include "include/assert.h"
+#include <limits>
+
+namespace librbd {
+namespace cache {
+namespace file {
+
+void LogMap::punch(uint64_t image_offset, uint64_t length, uint64_t max_seq) {
+  uint64_t end = image_offset + length;
+  auto it = m_pieces.upper_bound(image_offset);
+  if (it != m_pieces.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second.length > image_offset) {
+      it = prev;
+    }
+  }
+
+  while (it != m_pieces.end() && it->first < end) {
+    uint64_t piece_start = it->first;
+    Piece &piece = it->second;
+    uint64_t piece_end = piece_start + piece.length;
+    if (piece.seq > max_seq) {
+      ++it;
+      continue;
+    }
+
+    if (piece_end > end) {
+      // keep the tail beyond the punched range
+      m_pieces[end] = Piece{piece_end - end, piece.seq,
+                            piece.log_offset + (end - piece_start)};
+    }
+    if (piece_start < image_offset) {
+      // keep the head before the punched range
+      piece.length = image_offset - piece_start;
+      ++it;
+    } else {
+      it = m_pieces.erase(it);
+    }
+  }
+}
+
+void LogMap::add(uint64_t image_offset, uint64_t length, uint64_t seq,
+                 uint64_t log_offset) {
+  assert(seq > 0);
+  if (length == 0) {
+    return;
+  }
+  punch(image_offset, length, std::numeric_limits<uint64_t>::max());
+  m_pieces[image_offset] = Piece{length, seq, log_offset};
+}
+
+void LogMap::map(uint64_t image_offset, uint64_t length,
+                 Extents *extents) const {
+  uint64_t end = image_offset + length;
+  uint64_t pos = image_offset;
+  auto it = m_pieces.upper_bound(image_offset);
+  if (it != m_pieces.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second.length > image_offset) {
+      it = prev;
+    }
+  }
+
+  for (; it != m_pieces.end() && it->first < end; ++it) {
+    uint64_t piece_start = std::max(it->first, image_offset);
+    uint64_t piece_end = std::min(it->first + it->second.length, end);
+    if (pos < piece_start) {
+      extents->push_back(Extent{pos, piece_start - pos, 0, 0});
+    }
+    extents->push_back(Extent{
+      piece_start, piece_end - piece_start, it->second.seq,
+      it->second.log_offset + (piece_start - it->first)});
+    pos = piece_end;
+  }
+  if (pos < end) {
+    extents->push_back(Extent{pos, end - pos, 0, 0});
+  }
+}
+
+void LogMap::remove(uint64_t image_offset, uint64_t length, uint64_t seq) {
+  if (length == 0) {
+    return;
+  }
+  punch(image_offset, length, seq);
+}
+
+} // namespace file
+} // namespace cache
+} // namespace librbd
@@ -0,0 +1,63 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_CACHE_FILE_LOG_MAP
+#define CEPH_LIBRBD_CACHE_FILE_LOG_MAP
+
+#include "include/int_types.h"
+#include <map>
+#include <vector>
+
+namespace librbd {
+namespace cache {
+namespace file {
+
+/**
+ * Tracks which image extents are dirty in the write log and where the
+ * newest copy of their data lives.
+ */
+class LogMap {
+public:
+  struct Extent {
+    uint64_t image_offset;
+    uint64_t length;
+    uint64_t seq;        ///< 0 if the extent is not in the log
+    uint64_t log_offset; ///< log file offset of the data at image_offset
+  };
+  typedef std::vector<Extent> Extents;
+
+  /// record that entry seq holds image_offset~length, replacing older data
+  void add(uint64_t image_offset, uint64_t length, uint64_t seq,
+           uint64_t log_offset);
+
+  /// split image_offset~length into log hits and misses, in image order
+  void map(uint64_t image_offset, uint64_t length, Extents *extents) const;
+
+  /// forget image_offset~length where it is backed by entries up to seq
+  void remove(uint64_t image_offset, uint64_t length, uint64_t seq);
+
+  bool empty() const {
+    return m_pieces.empty();
+  }
+  size_t size() const {
+    return m_pieces.size();
+  }
+
+private:
+  struct Piece {
+    uint64_t length;
+    uint64_t seq;
+    uint64_t log_offset;
+  };
+
+  // non-overlapping pieces keyed by image offset
+  std::map<uint64_t, Piece> m_pieces;
+
+  void punch(uint64_t image_offset, uint64_t length, uint64_t max_seq);
+};
+
+} // namespace file
+} // namespace cache
+} // namespace librbd
+
+#endif // CEPH_LIBRBD_CACHE_FILE_LOG_MAP
@@ -0,0 +1,531 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "librbd/cache/file/WriteLog.h"
+#include "include/buffer.h"
+#include "include/compat.h"
+#include "include/encoding.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/safe_io.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "include/assert.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::cache::file::WriteLog: " << this << " " \
+                           <<  __func__ << ": "
+
+namespace librbd {
+namespace cache {
+namespace file {
+
+namespace {
+
+const uint64_t SUPERBLOCK_MAGIC = 0x7262642d77616c31ull; // "rbd-wal1"
+const uint32_t ENTRY_MAGIC = 0x7277616c;                 // "rwal"
+
+// everything in the header but the trailing crc
+const uint64_t HEADER_CRC_LENGTH = WriteLog::HEADER_SIZE - sizeof(uint32_t);
+
+struct EntryHeader {
+  uint32_t magic = ENTRY_MAGIC;
+  uint32_t type = 0;
+  uint64_t seq = 0;
+  uint64_t session = 0;
+  uint64_t image_offset = 0;
+  uint64_t length = 0;
+  uint32_t data_crc = 0;
+
+  void encode(bufferlist &bl) const {
+    bufferlist hbl;
+    ::encode(magic, hbl);
+    ::encode(type, hbl);
+    ::encode(seq, hbl);
+    ::encode(session, hbl);
+    ::encode(image_offset, hbl);
+    ::encode(length, hbl);
+    ::encode(data_crc, hbl);
+    hbl.append_zero(HEADER_CRC_LENGTH - hbl.length());
+    uint32_t header_crc = hbl.crc32c(-1);
+    ::encode(header_crc, hbl);
+    assert(hbl.length() == WriteLog::HEADER_SIZE);
+    bl.claim_append(hbl);
+  }
+
+  /// @return false if the header is torn or was never written
+  bool decode(bufferlist &bl) {
+    if (bl.length() != WriteLog::HEADER_SIZE) {
+      return false;
+    }
+    bufferlist hbl;
+    hbl.substr_of(bl, 0, HEADER_CRC_LENGTH);
+    uint32_t header_crc;
+    auto it = bl.begin();
+    it.advance(HEADER_CRC_LENGTH);
+    ::decode(header_crc, it);
+    if (header_crc != hbl.crc32c(-1)) {
+      return false;
+    }
+    it = bl.begin();
+    ::decode(magic, it);
+    ::decode(type, it);
+    ::decode(seq, it);
+    ::decode(session, it);
+    ::decode(image_offset, it);
+    ::decode(length, it);
+    ::decode(data_crc, it);
+    return magic == ENTRY_MAGIC;
+  }
+};
+
+} // anonymous namespace
+
+WriteLog::WriteLog(CephContext *cct, const std::string &path)
+  : m_cct(cct), m_path(path) {
+}
+
+WriteLog::~WriteLog() {
+  close();
+}
+
+uint64_t WriteLog::entry_size(uint64_t length) {
+  return HEADER_SIZE + P2ROUNDUP(length, ENTRY_ALIGN);
+}
+
+uint64_t WriteLog::wrap(uint64_t pos) const {
+  // a header never straddles the end of the ring
+  if (pos + HEADER_SIZE > m_size) {
+    return DATA_START;
+  }
+  return pos;
+}
+
+uint64_t WriteLog::get_max_entry_length() const {
+  // small enough that the ring always holds a few entries, so that
+  // destaging can make progress while appends wait for space
+  return P2ALIGN((m_size - DATA_START) / 4, ENTRY_ALIGN) - HEADER_SIZE;
+}
+
+uint64_t WriteLog::get_used() const {
+  if (m_head >= m_tail) {
+    return m_head - m_tail;
+  }
+  return (m_size - m_tail) + (m_head - DATA_START);
+}
+
+bool WriteLog::can_append(uint64_t length) const {
+  if (length > get_max_entry_length()) {
+    return false;
+  }
+  uint64_t need = entry_size(length);
+  if (empty()) {
+    // prepare_append() restarts at the beginning of the ring if need be
+    return true;
+  }
+  if (m_head > m_tail) {
+    if (m_head + need <= m_size && wrap(m_head + need) != m_tail) {
+      return true;
+    }
+    // pad to the end of the ring and continue from the beginning
+    return DATA_START + need < m_tail;
+  }
+  // the ring may never fill up completely: head == tail means empty
+  return m_head + need < m_tail;
+}
+
+int WriteLog::open(const std::string &name, uint64_t size,
+                   std::list<Entry> *entries) {
+  ldout(m_cct, 10) << "path=" << m_path << ", name=" << name << dendl;
+  assert(m_fd < 0);
+
+  m_name = name;
+  m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (m_fd < 0) {
+    int r = -errno;
+    lderr(m_cct) << "failed to open " << m_path << ": " << cpp_strerror(r)
+                 << dendl;
+    return r;
+  }
+
+  struct stat st;
+  int r = ::fstat(m_fd, &st);
+  if (r < 0) {
+    r = -errno;
+    lderr(m_cct) << "failed to stat " << m_path << ": " << cpp_strerror(r)
+                 << dendl;
+    close();
+    return r;
+  }
+
+  if (st.st_size == 0) {
+    m_size = P2ALIGN(size, ENTRY_ALIGN);
+    if (m_size < DATA_START + 4 * (HEADER_SIZE + ENTRY_ALIGN)) {
+      lderr(m_cct) << "log size " << size << " is too small" << dendl;
+      close();
+      return -EINVAL;
+    }
+    r = ::ftruncate(m_fd, m_size);
+    if (r < 0) {
+      r = -errno;
+      lderr(m_cct) << "failed to resize " << m_path << ": "
+                   << cpp_strerror(r) << dendl;
+      close();
+      return r;
+    }
+    m_head = m_tail = DATA_START;
+    m_next_seq = m_tail_seq = 1;
+    m_session = 1;
+    m_generation = 0;
+    r = write_superblock();
+    if (r < 0) {
+      close();
+      return r;
+    }
+    ldout(m_cct, 5) << "created " << m_path << " with size " << m_size
+                    << dendl;
+    return 0;
+  }
+
+  r = read_superblock();
+  if (r < 0) {
+    lderr(m_cct) << m_path << " does not hold a valid log" << dendl;
+    close();
+    return r;
+  }
+  if (m_name != name) {
+    lderr(m_cct) << m_path << " belongs to " << m_name << dendl;
+    close();
+    return -EEXIST;
+  }
+  if ((uint64_t)st.st_size < m_size) {
+    lderr(m_cct) << m_path << " is truncated: " << st.st_size << " < "
+                 << m_size << dendl;
+    close();
+    return -EINVAL;
+  }
+  if (size != m_size) {
+    ldout(m_cct, 1) << "keeping existing log size " << m_size << dendl;
+  }
+
+  r = replay(entries);
+  if (r < 0) {
+    close();
+    return r;
+  }
+
+  // entries from now on must not be confused with anything written after
+  // the torn tail of the previous session
+  ++m_session;
+  r = write_superblock();
+  if (r < 0) {
+    close();
+    return r;
+  }
+  ldout(m_cct, 5) << "replayed " << entries->size() << " entries, "
+                  << "used=" << get_used() << dendl;
+  return 0;
+}
+
+void WriteLog::close() {
+  if (m_fd >= 0) {
+    VOID_TEMP_FAILURE_RETRY(::close(m_fd));
+    m_fd = -1;
+  }
+}
+
+int WriteLog::write_superblock() {
+  ++m_generation;
+
+  bufferlist payload;
+  ENCODE_START(1, 1, payload);
+  ::encode(SUPERBLOCK_MAGIC, payload);
+  ::encode(m_generation, payload);
+  ::encode(m_session, payload);
+  ::encode(m_size, payload);
+  ::encode(m_tail, payload);
+  ::encode(m_tail_seq, payload);
+  ::encode(m_name, payload);
+  ENCODE_FINISH(payload);
+
+  bufferlist bl;
+  ::encode(payload, bl);
+  ::encode(payload.crc32c(-1), bl);
+  assert(bl.length() <= SUPERBLOCK_SIZE);
+  bl.append_zero(SUPERBLOCK_SIZE - bl.length());
+
+  // alternate between the two slots so that a torn write leaves the
+  // previous superblock intact
+  int r = bl.write_fd(m_fd, (m_generation % 2) * SUPERBLOCK_SIZE);
+  if (r == 0 && ::fdatasync(m_fd) < 0) {
+    r = -errno;
+  }
+  if (r < 0) {
+    lderr(m_cct) << "failed to write superblock: " << cpp_strerror(r)
+                 << dendl;
+  }
+  return r;
+}
+
+int WriteLog::read_superblock() {
+  bool found = false;
+  for (uint64_t slot = 0; slot < 2; ++slot) {
+    bufferptr bp(SUPERBLOCK_SIZE);
+    int r = safe_pread_exact(m_fd, bp.c_str(), SUPERBLOCK_SIZE,
+                             slot * SUPERBLOCK_SIZE);
+    if (r < 0) {
+      ldout(m_cct, 5) << "failed to read superblock " << slot << ": "
+                      << cpp_strerror(r) << dendl;
+      continue;
+    }
+
+    bufferlist bl;
+    bl.append(bp);
+    try {
+      bufferlist payload;
+      uint32_t crc;
+      auto it = bl.begin();
+      ::decode(payload, it);
+      ::decode(crc, it);
+      if (crc != payload.crc32c(-1)) {
+        ldout(m_cct, 5) << "superblock " << slot << " crc mismatch" << dendl;
+        continue;
+      }
+
+      uint64_t magic, generation, session, size, tail, tail_seq;
+      std::string name;
+      auto p = payload.begin();
+      DECODE_START(1, p);
+      ::decode(magic, p);
+      ::decode(generation, p);
+      ::decode(session, p);
+      ::decode(size, p);
+      ::decode(tail, p);
+      ::decode(tail_seq, p);
+      ::decode(name, p);
+      DECODE_FINISH(p);
+      if (magic != SUPERBLOCK_MAGIC || tail < DATA_START || tail >= size) {
+        continue;
+      }
+      if (found && generation <= m_generation) {
+        continue;
+      }
+      found = true;
+      m_generation = generation;
+      m_session = session;
+      m_size = size;
+      m_tail = tail;
+      m_tail_seq = tail_seq;
+      m_name = name;
+    } catch (const buffer::error &err) {
+      ldout(m_cct, 5) << "failed to decode superblock " << slot << ": "
+                      << err.what() << dendl;
+    }
+  }
+  return found ? 0 : -EINVAL;
+}
+
+int WriteLog::replay(std::list<Entry> *entries) {
+  uint64_t pos = m_tail;
+  uint64_t seq = m_tail_seq;
+  uint64_t session = 0;
+  uint64_t replayed = 0;
+
+  while (replayed < m_size - DATA_START) {
+    bufferlist bl;
+    int r = read(pos, HEADER_SIZE, &bl);
+    if (r < 0) {
+      return r;
+    }
+
+    EntryHeader header;
+    if (!header.decode(bl) || header.seq != seq ||
+        header.session < session || header.session > m_session) {
+      break;
+    }
+
+    uint64_t length = entry_size(header.length);
+    if (pos + length > m_size) {
+      break;
+    }
+    if (header.type == ENTRY_TYPE_PAD) {
+      replayed += m_size - pos;
+      pos = DATA_START;
+      ++seq;
+      session = header.session;
+      continue;
+    }
+    if (header.type != ENTRY_TYPE_WRITE && header.type != ENTRY_TYPE_SYNC) {
+      break;
+    }
+
+    if (header.length > 0) {
+      bufferlist data;
+      r = read(pos + HEADER_SIZE, header.length, &data);
+      if (r < 0) {
+        return r;
+      }
+      if (data.crc32c(-1) != header.data_crc) {
+        ldout(m_cct, 5) << "torn entry seq=" << seq << " at " << pos
+                        << dendl;
+        break;
+      }
+    }
+
+    Entry entry;
+    entry.type = header.type;
+    entry.seq = header.seq;
+    entry.image_offset = header.image_offset;
+    entry.length = header.length;
+    entry.log_offset = pos;
+    entries->push_back(entry);
+
+    replayed += length;
+    pos = wrap(pos + length);
+    ++seq;
+    session = header.session;
+  }
+
+  m_head = pos;
+  m_next_seq = seq;
+  return 0;
+}
+
+int WriteLog::prepare_append(uint64_t length, uint64_t *pos) {
+  if (!can_append(length)) {
+    return -ENOSPC;
+  }
+
+  uint64_t need = entry_size(length);
+  if (empty()) {
+    if (m_head + need > m_size) {
+      // nothing to preserve: restart at the beginning of the ring
+      uint64_t pos = m_head;
+      uint64_t tail_seq = m_tail_seq;
+      m_head = m_tail = DATA_START;
+      m_tail_seq = m_next_seq;
+      int r = write_superblock();
+      if (r < 0) {
+        m_head = m_tail = pos;
+        m_tail_seq = tail_seq;
+        return r;
+      }
+    }
+  } else if (m_head > m_tail &&
+             (m_head + need > m_size || wrap(m_head + need) == m_tail)) {
+    // fill the rest of the ring with a pad entry
+    EntryHeader header;
+    header.type = ENTRY_TYPE_PAD;
+    header.seq = m_next_seq;
+    header.session = m_session;
+    header.length = m_size - m_head - HEADER_SIZE;
+
+    bufferlist bl;
+    header.encode(bl);
+    int r = bl.write_fd(m_fd, m_head);
+    if (r < 0) {
+      lderr(m_cct) << "failed to write pad entry: " << cpp_strerror(r)
+                   << dendl;
+      return r;
+    }
+    ++m_next_seq;
+    m_head = DATA_START;
+  }
+
+  *pos = m_head;
+  return 0;
+}
+
+int WriteLog::append(uint32_t type, uint64_t image_offset,
+                     const bufferlist &data, Entry *entry) {
+  uint64_t pos;
+  int r = prepare_append(data.length(), &pos);
+  if (r < 0) {
+    return r;
+  }
+
+  EntryHeader header;
+  header.type = type;
+  header.seq = m_next_seq;
+  header.session = m_session;
+  header.image_offset = image_offset;
+  header.length = data.length();
+  header.data_crc = data.crc32c(-1);
+
+  bufferlist bl;
+  header.encode(bl);
+  bl.append(data);
+  uint64_t length = entry_size(data.length());
+  if (bl.length() < length) {
+    bl.append_zero(length - bl.length());
+  }
+
+  r = bl.write_fd(m_fd, pos);
+  if (r < 0) {
+    lderr(m_cct) << "failed to write entry: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  entry->type = type;
+  entry->seq = m_next_seq++;
+  entry->image_offset = image_offset;
+  entry->length = data.length();
+  entry->log_offset = pos;
+  m_head = wrap(pos + length);
+  return 0;
+}
+
+int WriteLog::append_write(uint64_t image_offset, const bufferlist &bl,
+                           Entry *entry) {
+  return append(ENTRY_TYPE_WRITE, image_offset, bl, entry);
+}
+
+int WriteLog::append_sync(Entry *entry) {
+  return append(ENTRY_TYPE_SYNC, 0, bufferlist(), entry);
+}
+
+int WriteLog::sync() {
+  if (::fdatasync(m_fd) < 0) {
+    int r = -errno;
+    lderr(m_cct) << "failed to sync: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  return 0;
+}
+
+int WriteLog::read(uint64_t log_offset, uint64_t length,
+                   bufferlist *bl) const {
+  bufferptr bp = buffer::create(length);
+  int r = safe_pread_exact(m_fd, bp.c_str(), length, log_offset);
+  if (r < 0) {
+    lderr(m_cct) << "failed to read " << log_offset << "~" << length << ": "
+                 << cpp_strerror(r) << dendl;
+    return r;
+  }
+  bl->append(std::move(bp));
+  return 0;
+}
+
+int WriteLog::retire(const Entry &entry) {
+  ldout(m_cct, 20) << "seq=" << entry.seq << dendl;
+  assert(entry.seq >= m_tail_seq && entry.seq < m_next_seq);
+
+  uint64_t tail = m_tail;
+  uint64_t tail_seq = m_tail_seq;
+  m_tail = wrap(entry.log_offset + entry_size(entry.length));
+  m_tail_seq = entry.seq + 1;
+  int r = write_superblock();
+  if (r < 0) {
+    // the space may not be reused until the superblock says so
+    m_tail = tail;
+    m_tail_seq = tail_seq;
+  }
+  return r;
+}
+
+} // namespace file
+} // namespace cache
+} // namespace librbd
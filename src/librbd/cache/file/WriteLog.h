@@ -0,0 +1,126 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_CACHE_FILE_WRITE_LOG
+#define CEPH_LIBRBD_CACHE_FILE_WRITE_LOG
+
+#include "include/buffer_fwd.h"
+#include "include/int_types.h"
+#include <list>
+#include <string>
+
+struct CephContext;
+
+namespace librbd {
+namespace cache {
+namespace file {
+
+/**
+ * Ring buffer of image writes persisted in a local file.
+ *
+ * The file starts with two superblock slots, written alternately, that
+ * record the ring geometry and the oldest live entry (the tail).  Each
+ * entry is a fixed size header followed by its data and carries a
+ * sequence number one higher than its predecessor; replay walks forward
+ * from the tail and stops at the first entry that is torn, stale or out
+ * of sequence.  The session number bumped on every open keeps entries
+ * from an earlier incarnation from being picked up after a torn tail.
+ *
+ * Only read() may be called concurrently with the other methods; all
+ * mutating calls must come from a single thread.
+ */
+class WriteLog {
+public:
+  enum EntryType {
+    ENTRY_TYPE_WRITE = 1, ///< image data
+    ENTRY_TYPE_SYNC  = 2, ///< user flush barrier
+    ENTRY_TYPE_PAD   = 3, ///< filler up to the end of the ring
+  };
+
+  struct Entry {
+    uint32_t type = 0;
+    uint64_t seq = 0;
+    uint64_t image_offset = 0;
+    uint64_t length = 0;
+    uint64_t log_offset = 0; ///< offset of the entry header in the file
+
+    uint64_t data_offset() const {
+      return log_offset + HEADER_SIZE;
+    }
+  };
+
+  static const uint64_t SUPERBLOCK_SIZE = 2048;
+  static const uint64_t DATA_START = 2 * SUPERBLOCK_SIZE;
+  static const uint64_t HEADER_SIZE = 64;
+  static const uint64_t ENTRY_ALIGN = 8;
+
+  WriteLog(CephContext *cct, const std::string &path);
+  ~WriteLog();
+
+  WriteLog(const WriteLog&) = delete;
+  WriteLog &operator=(const WriteLog&) = delete;
+
+  /**
+   * Open the log, creating a size byte file if it does not exist yet.
+   * An existing file keeps its geometry. The live WRITE and SYNC entries
+   * are returned oldest first.
+   */
+  int open(const std::string &name, uint64_t size, std::list<Entry> *entries);
+  void close();
+
+  /// the largest data payload a single entry may carry
+  uint64_t get_max_entry_length() const;
+  uint64_t get_size() const {
+    return m_size;
+  }
+  uint64_t get_used() const;
+  bool empty() const {
+    return m_head == m_tail;
+  }
+  /// true if an entry with length bytes of data fits right now
+  bool can_append(uint64_t length) const;
+
+  /// append a WRITE entry; -ENOSPC if it does not fit
+  int append_write(uint64_t image_offset, const ceph::bufferlist &bl,
+                   Entry *entry);
+  /// append a SYNC entry; -ENOSPC if it does not fit
+  int append_sync(Entry *entry);
+  /// make all appended entries durable
+  int sync();
+
+  /// read length bytes of entry data starting at log_offset
+  int read(uint64_t log_offset, uint64_t length, ceph::bufferlist *bl) const;
+
+  /// free all entries up to and including entry
+  int retire(const Entry &entry);
+
+private:
+  CephContext *m_cct;
+  std::string m_path;
+  std::string m_name;
+  int m_fd = -1;
+
+  uint64_t m_size = 0;
+  uint64_t m_head = DATA_START;
+  uint64_t m_tail = DATA_START;
+  uint64_t m_next_seq = 1; ///< seq of the next appended entry
+  uint64_t m_tail_seq = 1; ///< seq of the entry at m_tail
+  uint64_t m_session = 0;
+  uint64_t m_generation = 0; ///< superblock generation
+
+  static uint64_t entry_size(uint64_t length);
+  uint64_t wrap(uint64_t pos) const;
+
+  int write_superblock();
+  int read_superblock();
+  int replay(std::list<Entry> *entries);
+  int prepare_append(uint64_t length, uint64_t *pos);
+  int append(uint32_t type, uint64_t image_offset,
+             const ceph::bufferlist &bl, Entry *entry);
+};
+
+} // namespace file
+} // namespace cache
+} // namespace librbd
+
+#endif // CEPH_LIBRBD_CACHE_FILE_WRITE_LOG
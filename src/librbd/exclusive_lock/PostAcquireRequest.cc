@@ -4,6 +4,7 @@
 #include "librbd/exclusive_lock/PostAcquireRequest.h"
 #include "cls/lock/cls_lock_client.h"
 #include "cls/lock/cls_lock_types.h"
+#include "cls/rbd/cls_rbd_client.h"
 #include "common/dout.h"
 #include "common/errno.h"
 #include "common/WorkQueue.h"
@@ -62,7 +63,7 @@ void PostAcquireRequest<I>::send() {
 template <typename I>
 void PostAcquireRequest<I>::send_refresh() {
   if (!m_image_ctx.state->is_refresh_required()) {
-    send_open_object_map();
+    send_get_persistent_cache_owner();
     return;
   }
 
@@ -97,6 +98,66 @@ void PostAcquireRequest<I>::handle_refresh(int r) {
     return;
   }
 
+  send_get_persistent_cache_owner();
+}
+
+template <typename I>
+void PostAcquireRequest<I>::send_get_persistent_cache_owner() {
+  if (m_image_ctx.image_cache != nullptr) {
+    // the persistent cache checks the owner before it logs any write
+    send_open_object_map();
+    return;
+  }
+
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << dendl;
+
+  librados::ObjectReadOperation op;
+  cls_client::metadata_get_start(&op,
+                                 ImageCtx::METADATA_PERSISTENT_CACHE_OWNER);
+
+  using klass = PostAcquireRequest<I>;
+  librados::AioCompletion *rados_completion = create_rados_callback<
+    klass, &klass::handle_get_persistent_cache_owner>(this);
+  m_out_bl.clear();
+  int r = m_image_ctx.md_ctx.aio_operate(m_image_ctx.header_oid,
+                                         rados_completion, &op, &m_out_bl);
+  assert(r == 0);
+  rados_completion->release();
+}
+
+template <typename I>
+void PostAcquireRequest<I>::handle_get_persistent_cache_owner(int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << "r=" << r << dendl;
+
+  std::string owner;
+  if (r == 0) {
+    bufferlist::iterator it = m_out_bl.begin();
+    r = cls_client::metadata_get_finish(&it, &owner);
+  }
+
+  if (r == -ENOENT || r == -EOPNOTSUPP) {
+    r = 0;
+  } else if (r < 0) {
+    lderr(cct) << "failed to read persistent cache owner: "
+               << cpp_strerror(r) << dendl;
+  } else {
+    // writing now would be undone when that cache is written back
+    lderr(cct) << "image has unwritten data in the persistent cache of "
+               << owner << ": write it back from there or remove image "
+               << "metadata key " << ImageCtx::METADATA_PERSISTENT_CACHE_OWNER
+               << " to discard it" << dendl;
+    r = -EBUSY;
+  }
+
+  if (r < 0) {
+    save_result(r);
+    revert();
+    finish();
+    return;
+  }
+
   send_open_object_map();
 }
 
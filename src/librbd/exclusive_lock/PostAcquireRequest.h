@@ -37,6 +37,9 @@ private:
    * REFRESH (skip if not
    *      |   needed)
    *      v
+   * GET_PERSISTENT_CACHE_OWNER (skip if
+   *      |                      image cache)
+   *      v
    * OPEN_OBJECT_MAP (skip if
    *      |           disabled)
    *      v
@@ -73,9 +76,14 @@ private:
   bool m_prepare_lock_completed = false;
   int m_error_result;
 
+  bufferlist m_out_bl;
+
   void send_refresh();
   void handle_refresh(int r);
 
+  void send_get_persistent_cache_owner();
+  void handle_get_persistent_cache_owner(int r);
+
   void send_open_journal();
   void handle_open_journal(int r);
 
@@ -11,6 +11,7 @@
 #include "librbd/Journal.h"
 #include "librbd/ObjectMap.h"
 #include "librbd/Utils.h"
+#include "librbd/cache/ImageCache.h"
 #include "librbd/io/ImageRequestWQ.h"
 
 #define dout_subsys ceph_subsys_rbd
@@ -156,6 +157,43 @@ void PreReleaseRequest<I>::handle_wait_for_ops(int r) {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 10) << dendl;
 
+  send_flush_image_cache();
+}
+
+template <typename I>
+void PreReleaseRequest<I>::send_flush_image_cache() {
+  if (m_image_ctx.image_cache == nullptr) {
+    send_invalidate_cache(false);
+    return;
+  }
+
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << dendl;
+
+  // dirty data must reach the image while we still own the lock, and a
+  // persistent cache must stop claiming the image before the next owner
+  // may write to it
+  Context *ctx = create_async_context_callback(
+    m_image_ctx, create_context_callback<
+      PreReleaseRequest<I>,
+      &PreReleaseRequest<I>::handle_flush_image_cache>(this));
+  m_image_ctx.image_cache->invalidate(ctx);
+}
+
+template <typename I>
+void PreReleaseRequest<I>::handle_flush_image_cache(int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << "r=" << r << dendl;
+
+  if (r < 0) {
+    lderr(cct) << "failed to flush image cache: " << cpp_strerror(r)
+               << dendl;
+    m_image_ctx.io_work_queue->unblock_writes();
+    save_result(r);
+    finish();
+    return;
+  }
+
   send_invalidate_cache(false);
 }
 
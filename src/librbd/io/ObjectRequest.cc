@@ -15,6 +15,7 @@
 #include "librbd/ImageCtx.h"
 #include "librbd/ObjectMap.h"
 #include "librbd/Utils.h"
+#include "librbd/cache/ParentCache.h"
 #include "librbd/io/AioCompletion.h"
 #include "librbd/io/CopyupRequest.h"
 #include "librbd/io/ImageRequest.h"
@@ -309,6 +310,16 @@ void ObjectReadRequest<I>::send() {
     }
   }
 
+  if (image_ctx->parent_cache != nullptr &&
+      this->m_snap_id != CEPH_NOSNAP) {
+    // the cache returns the data without an extent map, like a plain read
+    image_ctx->parent_cache->read(
+      image_ctx, this->m_oid, this->m_object_no, this->m_snap_id,
+      this->m_object_off, this->m_object_len, &m_read_data,
+      util::create_context_callback<ObjectRequest<I> >(this));
+    return;
+  }
+
   librados::ObjectReadOperation op;
   int flags = image_ctx->get_read_flags(this->m_snap_id);
   if (m_sparse) {
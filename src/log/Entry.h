@@ -6,7 +6,9 @@
 
 #include "include/utime.h"
 #include "common/PrebufferedStreambuf.h"
+#include "log/BinaryCapture.h"
 #include <pthread.h>
+#include <algorithm>
 #include <string>
 
 
@@ -22,6 +24,8 @@ struct Entry {
   PrebufferedStreambuf m_streambuf;
   size_t m_buf_len;
   size_t* m_exp_len;
+  bool m_binary;                  ///< may hold raw records, see BinaryCapture.h
+  mutable std::string m_rendered; ///< text of a binary entry, once rendered
   char m_static_buf[1];
 
   Entry()
@@ -29,7 +33,8 @@ struct Entry {
       m_next(NULL),
       m_streambuf(m_static_buf, sizeof(m_static_buf)),
       m_buf_len(sizeof(m_static_buf)),
-      m_exp_len(NULL)
+      m_exp_len(NULL),
+      m_binary(false)
   {}
   Entry(utime_t s, pthread_t t, short pr, short sub,
   const char *msg = NULL)
@@ -37,7 +42,8 @@ struct Entry {
         m_next(NULL),
         m_streambuf(m_static_buf, sizeof(m_static_buf)),
         m_buf_len(sizeof(m_static_buf)),
-        m_exp_len(NULL)
+        m_exp_len(NULL),
+        m_binary(false)
     {
       if (msg) {
         ostream os(&m_streambuf);
@@ -50,7 +56,8 @@ struct Entry {
       m_next(NULL),
       m_streambuf(buf, buf_len),
       m_buf_len(buf_len),
-      m_exp_len(exp_len)
+      m_exp_len(exp_len),
+      m_binary(false)
   {
     if (msg) {
       ostream os(&m_streambuf);
@@ -78,17 +85,40 @@ struct Entry {
     os << s;
   }
 
+  // format the raw records of a binary entry; done by the log thread
+  void render() const {
+    if (m_binary && m_rendered.empty()) {
+      render_binary(m_streambuf.get_str(), m_streambuf.get_marks(),
+		    &m_rendered);
+    }
+  }
+
   std::string get_str() const {
+    if (m_binary) {
+      render();
+      return m_rendered;
+    }
     return m_streambuf.get_str();
   }
 
   // returns current size of content
   size_t size() const {
+    if (m_binary) {
+      render();
+      return m_rendered.size();
+    }
     return m_streambuf.size();
   }
 
   // extracts up to avail chars of content
   int snprintf(char* dst, size_t avail) const {
+    if (m_binary) {
+      render();
+      size_t len = std::min(m_rendered.size(), avail - 1);
+      memcpy(dst, m_rendered.data(), len);
+      dst[len] = 0;
+      return m_rendered.size();
+    }
     return m_streambuf.snprintf(dst, avail);
   }
 };
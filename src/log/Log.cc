@@ -43,7 +43,8 @@ Log::Log(SubsystemMap *s)
     m_subs(s),
     m_queue_mutex_holder(0),
     m_flush_mutex_holder(0),
-    m_new(), m_recent(),
+    m_flusher_waiting(false),
+    m_recent(),
     m_fd(-1),
     m_uid(0),
     m_gid(0),
@@ -54,7 +55,8 @@ Log::Log(SubsystemMap *s)
     m_stop(false),
     m_max_new(DEFAULT_MAX_NEW),
     m_max_recent(DEFAULT_MAX_RECENT),
-    m_inject_segv(false)
+    m_inject_segv(false),
+    m_binary_capture(false)
 {
   int ret;
 
@@ -83,6 +85,8 @@ Log::~Log()
   }
 
   assert(!is_started());
+  EntryQueue t;
+  _take_new(&t);
   if (m_fd >= 0)
     VOID_TEMP_FAILURE_RETRY(::close(m_fd));
 
@@ -187,6 +191,11 @@ void Log::set_graylog_level(int log, int crash)
   pthread_mutex_unlock(&m_flush_mutex);
 }
 
+void Log::set_binary_capture(bool b)
+{
+  m_binary_capture = b;
+}
+
 void Log::start_graylog()
 {
   pthread_mutex_lock(&m_flush_mutex);
@@ -205,29 +214,110 @@ void Log::stop_graylog()
 
 void Log::submit_entry(Entry *e)
 {
-  pthread_mutex_lock(&m_queue_mutex);
-  m_queue_mutex_holder = pthread_self();
-
   if (m_inject_segv)
     *(volatile int *)(0) = 0xdead;
 
-  // wait for flush to catch up
-  while (m_new.m_len > m_max_new)
-    pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+  // wait for flush to catch up.  the other shards are only looked at
+  // once ours holds more than its share.
+  new_shard_t& shard = _pick_new_shard();
+  if (shard.len > m_max_new / NUM_NEW_SHARDS && _new_len() > m_max_new) {
+    pthread_mutex_lock(&m_queue_mutex);
+    m_queue_mutex_holder = pthread_self();
+    while (_new_len() > m_max_new && !m_stop)
+      pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+    m_queue_mutex_holder = 0;
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
 
-  m_new.enqueue(e);
-  pthread_cond_signal(&m_cond_flusher);
-  m_queue_mutex_holder = 0;
-  pthread_mutex_unlock(&m_queue_mutex);
+  // unless more threads are logging than there are shards, nobody else
+  // touches this cacheline but the log thread
+  Entry *head = shard.head.load(std::memory_order_relaxed);
+  do {
+    e->m_next = head;
+  } while (!shard.head.compare_exchange_weak(head, e));
+  shard.len++;
+
+  // the log thread sets m_flusher_waiting before it looks at the shards
+  // a last time, so either it sees our entry or we see it waiting
+  if (m_flusher_waiting) {
+    pthread_mutex_lock(&m_queue_mutex);
+    pthread_cond_signal(&m_cond_flusher);
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
+}
+
+Log::new_shard_t& Log::_pick_new_shard()
+{
+  // threads take consecutive shards as they first log something
+  static std::atomic<unsigned> next_shard = { 0 };
+  static thread_local unsigned i = next_shard++ % NUM_NEW_SHARDS;
+  return m_new[i];
+}
+
+bool Log::_have_new() const
+{
+  for (auto& shard : m_new) {
+    if (shard.head)
+      return true;
+  }
+  return false;
+}
+
+int Log::_new_len() const
+{
+  int len = 0;
+  for (auto& shard : m_new)
+    len += shard.len;
+  return len;
+}
+
+void Log::_take_new(EntryQueue *t)
+{
+  // each shard's entries were pushed newest first
+  Entry *oldest[NUM_NEW_SHARDS];
+  int n = 0;
+  for (auto& shard : m_new) {
+    Entry *e = shard.head.exchange(nullptr);
+    Entry *prev = nullptr;
+    int len = 0;
+    while (e) {
+      Entry *next = e->m_next;
+      e->m_next = prev;
+      prev = e;
+      e = next;
+      len++;
+    }
+    if (prev) {
+      shard.len -= len;
+      oldest[n++] = prev;
+    }
+  }
+
+  // merge the shards by time stamp, keeping each shard's own order
+  while (n > 0) {
+    int min = 0;
+    for (int i = 1; i < n; i++) {
+      if (oldest[i]->m_stamp < oldest[min]->m_stamp)
+	min = i;
+    }
+    Entry *e = oldest[min];
+    oldest[min] = e->m_next;
+    if (!oldest[min])
+      oldest[min] = oldest[--n];
+    e->m_next = NULL;
+    t->enqueue(e);
+  }
 }
 
 
 Entry *Log::create_entry(int level, int subsys)
 {
   if (true) {
-    return new Entry(ceph_clock_now(),
-		     pthread_self(),
-		     level, subsys);
+    Entry *e = new Entry(ceph_clock_now(),
+			 pthread_self(),
+			 level, subsys);
+    e->m_binary = m_binary_capture;
+    return e;
   } else {
     // kludge for perf testing
     Entry *e = m_recent.dequeue();
@@ -246,9 +336,11 @@ Entry *Log::create_entry(int level, int subsys, size_t* expected_size)
                                "Log hint");
     size_t size = __atomic_load_n(expected_size, __ATOMIC_RELAXED);
     void *ptr = ::operator new(sizeof(Entry) + size);
-    return new(ptr) Entry(ceph_clock_now(),
+    Entry *e = new(ptr) Entry(ceph_clock_now(),
        pthread_self(), level, subsys,
        reinterpret_cast<char*>(ptr) + sizeof(Entry), size, expected_size);
+    e->m_binary = m_binary_capture;
+    return e;
   } else {
     // kludge for perf testing
     Entry *e = m_recent.dequeue();
@@ -264,10 +356,10 @@ void Log::flush()
 {
   pthread_mutex_lock(&m_flush_mutex);
   m_flush_mutex_holder = pthread_self();
+  EntryQueue t;
+  _take_new(&t);
   pthread_mutex_lock(&m_queue_mutex);
   m_queue_mutex_holder = pthread_self();
-  EntryQueue t;
-  t.swap(m_new);
   pthread_cond_broadcast(&m_cond_loggers);
   m_queue_mutex_holder = 0;
   pthread_mutex_unlock(&m_queue_mutex);
@@ -377,14 +469,8 @@ void Log::dump_recent()
   pthread_mutex_lock(&m_flush_mutex);
   m_flush_mutex_holder = pthread_self();
 
-  pthread_mutex_lock(&m_queue_mutex);
-  m_queue_mutex_holder = pthread_self();
-
   EntryQueue t;
-  t.swap(m_new);
-
-  m_queue_mutex_holder = 0;
-  pthread_mutex_unlock(&m_queue_mutex);
+  _take_new(&t);
   _flush(&t, &m_recent, false);
 
   EntryQueue old;
@@ -442,7 +528,7 @@ void *Log::entry()
   pthread_mutex_lock(&m_queue_mutex);
   m_queue_mutex_holder = pthread_self();
   while (!m_stop) {
-    if (!m_new.empty()) {
+    if (_have_new()) {
       m_queue_mutex_holder = 0;
       pthread_mutex_unlock(&m_queue_mutex);
       flush();
@@ -451,7 +537,10 @@ void *Log::entry()
       continue;
     }
 
-    pthread_cond_wait(&m_cond_flusher, &m_queue_mutex);
+    m_flusher_waiting = true;
+    if (!_have_new())
+      pthread_cond_wait(&m_cond_flusher, &m_queue_mutex);
+    m_flusher_waiting = false;
   }
   m_queue_mutex_holder = 0;
   pthread_mutex_unlock(&m_queue_mutex);
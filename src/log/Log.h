@@ -4,6 +4,8 @@
 #ifndef __CEPH_LOG_LOG_H
 #define __CEPH_LOG_LOG_H
 
+#include <atomic>
+
 #include "common/Thread.h"
 
 #include "EntryQueue.h"
@@ -29,7 +31,18 @@ class Log : private Thread
   pthread_t m_queue_mutex_holder;
   pthread_t m_flush_mutex_holder;
 
-  EntryQueue m_new;    ///< new entries
+  /// new entries, pushed without taking m_queue_mutex onto the list of
+  /// the submitting thread's shard, newest first
+  enum {
+    NUM_NEW_SHARDS = 32
+  };
+  struct new_shard_t {
+    std::atomic<Entry*> head = { nullptr };
+    std::atomic<int> len = { 0 };
+    char __padding[128 - sizeof(std::atomic<Entry*>) - sizeof(std::atomic<int>)];
+  } __attribute__ ((aligned (128)));
+  new_shard_t m_new[NUM_NEW_SHARDS];
+  std::atomic<bool> m_flusher_waiting; ///< log thread sleeps on m_cond_flusher
   EntryQueue m_recent; ///< recent (less new) entries we've already written at low detail
 
   std::string m_log_file;
@@ -51,8 +64,15 @@ class Log : private Thread
 
   bool m_inject_segv;
 
+  std::atomic<bool> m_binary_capture;
+
   void *entry() override;
 
+  new_shard_t& _pick_new_shard();
+  bool _have_new() const;
+  int _new_len() const;
+  void _take_new(EntryQueue *q);
+
   void _flush(EntryQueue *q, EntryQueue *requeue, bool crash);
 
   void _log_message(const char *s, bool crash);
@@ -76,6 +96,7 @@ public:
   void set_syslog_level(int log, int crash);
   void set_stderr_level(int log, int crash);
   void set_graylog_level(int log, int crash);
+  void set_binary_capture(bool b);
 
   void start_graylog();
   void stop_graylog();
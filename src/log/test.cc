@@ -6,6 +6,10 @@
 #include "include/coredumpctl.h"
 #include "SubsystemMap.h"
 
+#include <fstream>
+#include <iomanip>
+#include <thread>
+
 using namespace ceph::logging;
 
 TEST(Log, Simple)
@@ -233,3 +237,76 @@ TEST(Log, LargeLog)
   log.flush();
   log.stop();
 }
+
+TEST(Log, BinaryCapture)
+{
+  Entry e(ceph_clock_now(), pthread_self(), 1, 1);
+  e.m_binary = true;
+  ostream os(&e.m_streambuf);
+  binary_capture(os, &e.m_streambuf);
+
+  ostringstream expected;
+  string nul(1, '\0');
+  // caller text that looks like records of every kind, with and
+  // without the NUL that used to start one
+  string fake;
+  for (char tag = 1; tag <= 6; tag++) {
+    fake += nul + tag + "abcdefgh" + tag + "abcdefgh";
+  }
+  fake += nul + nul + "end";
+  int ptr_target;
+  // do the same to both streams
+  for (ostream *o : { &os, static_cast<ostream*>(&expected) }) {
+    *o << "int " << 42 << " long " << -7L << " ull "
+       << 18446744073709551615ull << " double " << 1.5 << " " << 1e-9
+       << " hex " << std::hex << 255 << std::dec << " width "
+       << std::setw(5) << 3 << " ptr " << (void*)&ptr_target
+       << " null " << (void*)0 << " nul " << nul << "x" << 17 << nul
+       << fake << '\0' << (char)1 << 5 << '\0';
+  }
+  ASSERT_EQ(expected.str(), e.get_str());
+  ASSERT_EQ(expected.str().size(), e.size());
+
+  char buf[16];
+  ASSERT_EQ((int)expected.str().size(), e.snprintf(buf, sizeof(buf)));
+  ASSERT_EQ(expected.str().substr(0, sizeof(buf) - 1), string(buf));
+}
+
+TEST(Log, ConcurrentSubmit)
+{
+  SubsystemMap subs;
+  subs.add(1, "foo", 20, 1);
+  Log log(&subs);
+  log.set_max_new(10);
+  log.start();
+  std::string fn = "/tmp/ceph_test_log_concurrent." + std::to_string(getpid());
+  log.set_log_file(fn);
+  log.reopen_log_file();
+  // more threads than shards, so some of them share one
+  const int num_threads = 40, per_thread = 1000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&log]() {
+	for (int i = 0; i < per_thread; i++) {
+	  log.submit_entry(new Entry(ceph_clock_now(), pthread_self(), 10, 1,
+				     "concurrent"));
+	}
+      });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  log.flush();
+  log.stop();
+
+  // nothing is lost
+  std::ifstream in(fn);
+  std::string line;
+  int lines = 0;
+  while (std::getline(in, line)) {
+    if (line.find("concurrent") != std::string::npos)
+      lines++;
+  }
+  ASSERT_EQ(num_threads * per_thread, lines);
+  ::unlink(fn.c_str());
+}
@@ -256,10 +256,13 @@ void MgrClient::send_report()
 	session->declared.insert(path);
       }
 
-      ::encode(static_cast<uint64_t>(data.u64), report->packed);
       if (data.type & PERFCOUNTER_LONGRUNAVG) {
-        ::encode(static_cast<uint64_t>(data.avgcount), report->packed);
-        ::encode(static_cast<uint64_t>(data.avgcount2), report->packed);
+        pair<uint64_t,uint64_t> a = data.read_avg();
+        ::encode(a.first, report->packed);
+        ::encode(a.second, report->packed);
+        ::encode(a.second, report->packed);
+      } else {
+        ::encode(data.read_u64(), report->packed);
       }
     }
     ENCODE_FINISH(report->packed);
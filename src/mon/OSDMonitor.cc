@@ -381,6 +381,7 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
     OSDMap::Incremental inc(inc_bl);
     err = osdmap.apply_incremental(inc);
     assert(err == 0);
+    mapping_inc = inc;
 
     if (!t)
       t.reset(new MonitorDBStore::Transaction);
@@ -414,6 +415,8 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
 	     << dendl;
 	osdmap = OSDMap();
 	osdmap.decode(orig_full_bl);
+	// the mapping cannot follow along incrementally
+	mapping_inc = OSDMap::Incremental();
       }
     } else {
       assert(!inc.have_crc);
@@ -512,8 +515,17 @@ void OSDMonitor::start_mapping()
   }
   if (!osdmap.get_pools().empty()) {
     auto fin = new C_UpdateCreatingPGs(this, osdmap.get_epoch());
-    mapping_job = mapping.start_update(osdmap, mapper,
-				       g_conf->mon_osd_mapping_pgs_per_chunk);
+    if (mapping_inc.epoch == osdmap.get_epoch() &&
+	g_conf->get_val<bool>("mon_osd_mapping_incremental")) {
+      // falls back to a full update if the mapping is not at epoch - 1
+      mapping_job = mapping.start_update(
+	osdmap, mapping_inc, mapper,
+	g_conf->mon_osd_mapping_pgs_per_chunk,
+	g_conf->get_val<bool>("mon_osd_mapping_incremental_check"));
+    } else {
+      mapping_job = mapping.start_update(osdmap, mapper,
+					 g_conf->mon_osd_mapping_pgs_per_chunk);
+    }
     dout(10) << __func__ << " started mapping job " << mapping_job.get()
 	     << " at " << fin->start << dendl;
     mapping_job->set_finish_event(fin);
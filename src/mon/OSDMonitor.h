@@ -229,6 +229,7 @@ private:
   ParallelPGMapper mapper;                        ///< for background pg work
   OSDMapMapping mapping;                          ///< pg <-> osd mappings
   unique_ptr<ParallelPGMapper::Job> mapping_job;  ///< background mapping job
+  OSDMap::Incremental mapping_inc;  ///< last incremental applied to osdmap
   void start_mapping();
 
   void update_logger();
@@ -19,8 +19,12 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
 
 #include <algorithm>
+#include <deque>
 
 #include "PosixStack.h"
 
@@ -36,11 +40,58 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "PosixStack "
 
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define HAVE_MSG_ZEROCOPY
+#endif
+
+// drop our references to buffers the kernel has finished sending
+static void reap_zerocopy(int fd, zerocopy_pending_t &pending,
+                          PerfCounters *logger)
+{
+#ifdef HAVE_MSG_ZEROCOPY
+  while (!pending.empty()) {
+    char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0)
+      break;  // EAGAIN: nothing has completed yet
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+         cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+          !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+        continue;
+      struct sock_extended_err *serr =
+        reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cm));
+      if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+        logger->inc(l_msgr_send_zerocopy_fallback);
+      // the notification covers ids [ee_info, ee_data].  tcp completes
+      // sends in order, so everything up to ee_data is done.
+      uint32_t hi = serr->ee_data;
+      while (!pending.empty() &&
+             (int32_t)(pending.front().first - hi) <= 0)
+        pending.pop_front();
+    }
+  }
+#endif
+}
+
 class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   NetHandler &handler;
   int _fd;
   entity_addr_t sa;
   bool connected;
+  PosixWorker *worker;
+  PerfCounters *logger;
+
+  /// buffers of at least this size are sent with MSG_ZEROCOPY; 0 = never
+  uint64_t zerocopy_min_size = 0;
+  /// notification id the kernel will assign to our next zero-copy send
+  uint32_t zerocopy_next_id = 0;
+  zerocopy_pending_t zerocopy_pending;
 #if !defined(MSG_NOSIGNAL) && !defined(SO_NOSIGPIPE)
   sigset_t sigpipe_mask;
   bool sigpipe_pending;
@@ -48,8 +99,23 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
 #endif
 
  public:
-  explicit PosixConnectedSocketImpl(NetHandler &h, const entity_addr_t &sa, int f, bool connected)
-      : handler(h), _fd(f), sa(sa), connected(connected) {}
+  explicit PosixConnectedSocketImpl(NetHandler &h, PosixWorker *w, const entity_addr_t &sa, int f, bool connected)
+      : handler(h), _fd(f), sa(sa), connected(connected),
+        worker(w), logger(w->get_perf_counter()) {
+#ifdef HAVE_MSG_ZEROCOPY
+    CephContext *cct = w->cct;
+    if (cct->_conf->get_val<bool>("ms_async_zerocopy_send")) {
+      int one = 1;
+      if (::setsockopt(_fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0) {
+        zerocopy_min_size = std::max<uint64_t>(
+          1, cct->_conf->get_val<uint64_t>("ms_async_zerocopy_min_size"));
+      } else {
+        ldout(cct, 5) << __func__ << " SO_ZEROCOPY not supported: "
+                      << cpp_strerror(errno) << dendl;
+      }
+    }
+#endif
+  }
 
   int is_connected() override {
     if (connected)
@@ -71,6 +137,10 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   }
 
   ssize_t read(char *buf, size_t len) override {
+    // completions are reported through the error queue, which also wakes
+    // up the read handler
+    if (!zerocopy_pending.empty())
+      reap_zerocopy();
     ssize_t r = ::read(_fd, buf, len);
     if (r < 0)
       r = -errno;
@@ -141,28 +211,51 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
 
   // return the sent length
   // < 0 means error occured
-  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more)
+  //
+  // if zc_calls is given the data is sent with MSG_ZEROCOPY; on return it
+  // holds the number of sendmsg calls made with it (each one consumes a
+  // notification id) and zc_bytes the bytes they carried.
+  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more,
+                            unsigned *zc_calls = nullptr,
+                            size_t *zc_bytes = nullptr)
   {
     suppress_sigpipe();
 
+    int flags = more ? MSG_MORE : 0;
+  #if defined(MSG_NOSIGNAL)
+    flags |= MSG_NOSIGNAL;
+  #endif /* defined(MSG_NOSIGNAL) */
+  #ifdef HAVE_MSG_ZEROCOPY
+    if (zc_calls)
+      flags |= MSG_ZEROCOPY;
+  #endif
+
     size_t sent = 0;
     while (1) {
       ssize_t r;
-  #if defined(MSG_NOSIGNAL)
-      r = ::sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
-  #else
-      r = ::sendmsg(fd, &msg, (more ? MSG_MORE : 0));
-  #endif /* defined(MSG_NOSIGNAL) */
+      r = ::sendmsg(fd, &msg, flags);
 
       if (r < 0) {
         if (errno == EINTR) {
           continue;
         } else if (errno == EAGAIN) {
           break;
+  #ifdef HAVE_MSG_ZEROCOPY
+        } else if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+          // too many notifications outstanding (optmem); copy the rest
+          flags &= ~MSG_ZEROCOPY;
+          continue;
+  #endif
         }
         return -errno;
       }
 
+  #ifdef HAVE_MSG_ZEROCOPY
+      if (flags & MSG_ZEROCOPY) {
+        ++*zc_calls;
+        *zc_bytes += r;
+      }
+  #endif
       sent += r;
       if (len == sent) break;
 
@@ -183,32 +276,61 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
     return (ssize_t)sent;
   }
 
+  bool is_zerocopy(const bufferptr &bp) const {
+    return zerocopy_min_size && bp.length() >= zerocopy_min_size;
+  }
+
+  void reap_zerocopy() {
+    ::reap_zerocopy(_fd, zerocopy_pending, logger);
+  }
+
   ssize_t send(bufferlist &bl, bool more) override {
+    if (!zerocopy_pending.empty())
+      reap_zerocopy();
+    worker->reap_lingering();
+
     size_t sent_bytes = 0;
     std::list<bufferptr>::const_iterator pb = bl.buffers().begin();
     uint64_t left_pbrs = bl.buffers().size();
     while (left_pbrs) {
       struct msghdr msg;
       struct iovec msgvec[IOV_MAX];
-      uint64_t size = MIN(left_pbrs, IOV_MAX);
-      left_pbrs -= size;
       memset(&msg, 0, sizeof(msg));
       msg.msg_iovlen = 0;
       msg.msg_iov = msgvec;
       unsigned msglen = 0;
-      while (size > 0) {
+      // MSG_ZEROCOPY applies to a whole sendmsg call, so each batch holds
+      // either only large buffers or only small ones.  the large ones are
+      // kept referenced until the kernel is done with them.
+      bool zc = is_zerocopy(*pb);
+      bufferlist pinned;
+      while (left_pbrs > 0 && msg.msg_iovlen < IOV_MAX &&
+             is_zerocopy(*pb) == zc) {
         msgvec[msg.msg_iovlen].iov_base = (void*)(pb->c_str());
         msgvec[msg.msg_iovlen].iov_len = pb->length();
         msg.msg_iovlen++;
         msglen += pb->length();
+        if (zc)
+          pinned.append(*pb);
         ++pb;
-        size--;
+        left_pbrs--;
       }
 
-      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more);
+      unsigned zc_calls = 0;
+      size_t zc_bytes = 0;
+      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more,
+                             zc ? &zc_calls : nullptr, &zc_bytes);
       if (r < 0)
         return r;
 
+      if (zc_calls) {
+        zerocopy_next_id += zc_calls;
+        zerocopy_pending.emplace_back(zerocopy_next_id - 1, std::move(pinned));
+        logger->inc(l_msgr_send_zerocopy_bytes, zc_bytes);
+      }
+      if (zerocopy_min_size)
+        logger->inc(l_msgr_send_copy_bytes, r - zc_bytes);
+
       // "r" is the remaining length
       sent_bytes += r;
       if (static_cast<unsigned>(r) < msglen)
@@ -232,7 +354,17 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
     ::shutdown(_fd, SHUT_RDWR);
   }
   void close() override {
-    ::close(_fd);
+    if (!zerocopy_pending.empty())
+      reap_zerocopy();
+    if (zerocopy_pending.empty()) {
+      ::close(_fd);
+    } else {
+      // the kernel may still be sending from the pinned buffers and
+      // reports that only through this fd's error queue
+      worker->linger_zerocopy(_fd, std::move(zerocopy_pending));
+      zerocopy_pending.clear();
+    }
+    worker->reap_lingering();
   }
   int fd() const override {
     return _fd;
@@ -283,7 +415,8 @@ int PosixServerSocketImpl::accept(ConnectedSocket *sock, const SocketOptions &op
   out->set_sockaddr((sockaddr*)&ss);
   handler.set_priority(sd, opt.priority, out->get_family());
 
-  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(handler, *out, sd, true));
+  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(
+      handler, static_cast<PosixWorker*>(w), *out, sd, true));
   *sock = ConnectedSocket(std::move(csi));
   return 0;
 }
@@ -292,6 +425,56 @@ void PosixWorker::initialize()
 {
 }
 
+void PosixWorker::destroy()
+{
+  // give the kernel a moment to finish what closed sockets were sending
+  for (int i = 0; i < 100 && have_lingering.load(); ++i) {
+    _reap_lingering();
+    if (have_lingering.load())
+      usleep(10000);
+  }
+  close_lingering();
+}
+
+void PosixWorker::close_lingering()
+{
+  std::lock_guard<std::mutex> l(zerocopy_lock);
+  for (auto &p : zerocopy_lingering) {
+    ldout(cct, 1) << __func__ << " fd " << p.first << " still has "
+                  << p.second.size() << " zero-copy sends in flight" << dendl;
+    ::close(p.first);
+  }
+  zerocopy_lingering.clear();
+  have_lingering = false;
+}
+
+void PosixWorker::linger_zerocopy(int fd, zerocopy_pending_t &&pending)
+{
+  ldout(cct, 10) << __func__ << " fd " << fd << " " << pending.size()
+                 << " zero-copy sends in flight" << dendl;
+  // stop reading and let the peer see the close once the data is out
+  ::shutdown(fd, SHUT_RDWR);
+  std::lock_guard<std::mutex> l(zerocopy_lock);
+  zerocopy_lingering.emplace_back(fd, std::move(pending));
+  have_lingering = true;
+}
+
+void PosixWorker::_reap_lingering()
+{
+  std::lock_guard<std::mutex> l(zerocopy_lock);
+  for (auto p = zerocopy_lingering.begin(); p != zerocopy_lingering.end(); ) {
+    reap_zerocopy(p->first, p->second, perf_logger);
+    if (p->second.empty()) {
+      ldout(cct, 10) << __func__ << " closing fd " << p->first << dendl;
+      ::close(p->first);
+      p = zerocopy_lingering.erase(p);
+    } else {
+      ++p;
+    }
+  }
+  have_lingering = !zerocopy_lingering.empty();
+}
+
 int PosixWorker::listen(entity_addr_t &sa, const SocketOptions &opt,
                         ServerSocket *sock)
 {
@@ -351,7 +534,7 @@ int PosixWorker::connect(const entity_addr_t &addr, const SocketOptions &opts, C
 
   net.set_priority(sd, opts.priority, addr.get_family());
   *socket = ConnectedSocket(
-      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, addr, sd, !opts.nonblock)));
+      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, this, addr, sd, !opts.nonblock)));
   return 0;
 }
 
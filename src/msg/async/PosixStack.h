@@ -17,6 +17,9 @@
 #ifndef CEPH_MSG_ASYNC_POSIXSTACK_H
 #define CEPH_MSG_ASYNC_POSIXSTACK_H
 
+#include <deque>
+#include <list>
+#include <mutex>
 #include <thread>
 
 #include "msg/msg_types.h"
@@ -24,15 +27,41 @@
 
 #include "Stack.h"
 
+/// MSG_ZEROCOPY buffers the kernel may still read from, keyed by the last
+/// notification id that refers to them
+typedef std::deque<std::pair<uint32_t, bufferlist>> zerocopy_pending_t;
+
 class PosixWorker : public Worker {
   NetHandler net;
+
+  /// closed sockets kept open until the kernel releases their zero-copy
+  /// buffers
+  std::mutex zerocopy_lock;
+  std::list<std::pair<int, zerocopy_pending_t>> zerocopy_lingering;
+  std::atomic<bool> have_lingering = {false};
+
   void initialize() override;
+  void destroy() override;
+  void close_lingering();
  public:
   PosixWorker(CephContext *c, unsigned i)
       : Worker(c, i), net(c) {}
+  ~PosixWorker() override {
+    close_lingering();
+  }
   int listen(entity_addr_t &sa, const SocketOptions &opt,
                      ServerSocket *socks) override;
   int connect(const entity_addr_t &addr, const SocketOptions &opts, ConnectedSocket *socket) override;
+
+  /// take over a closed socket's fd until @p pending has been reaped
+  void linger_zerocopy(int fd, zerocopy_pending_t &&pending);
+  /// reap lingering sockets, closing those the kernel is done with
+  void reap_lingering() {
+    if (have_lingering.load())
+      _reap_lingering();
+  }
+ private:
+  void _reap_lingering();
 };
 
 class PosixNetworkStack : public NetworkStack {
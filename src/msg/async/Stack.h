@@ -199,6 +199,10 @@ enum {
   l_msgr_running_recv_time,
   l_msgr_running_fast_dispatch_time,
 
+  l_msgr_send_zerocopy_bytes,
+  l_msgr_send_copy_bytes,
+  l_msgr_send_zerocopy_fallback,
+
   l_msgr_last,
 };
 
@@ -239,6 +243,10 @@ class Worker {
     plb.add_time(l_msgr_running_recv_time, "msgr_running_recv_time", "The total time of message receiving");
     plb.add_time(l_msgr_running_fast_dispatch_time, "msgr_running_fast_dispatch_time", "The total time of fast dispatch");
 
+    plb.add_u64_counter(l_msgr_send_zerocopy_bytes, "msgr_send_zerocopy_bytes", "Network bytes sent with MSG_ZEROCOPY");
+    plb.add_u64_counter(l_msgr_send_copy_bytes, "msgr_send_copy_bytes", "Network bytes copied into socket buffers on send");
+    plb.add_u64_counter(l_msgr_send_zerocopy_fallback, "msgr_send_zerocopy_fallback", "Zero-copy sends the kernel completed by copying");
+
     perf_logger = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perf_logger);
   }
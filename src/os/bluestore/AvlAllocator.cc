@@ -0,0 +1,356 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <limits>
+
+#include "AvlAllocator.h"
+#include "bluestore_types.h"
+#include "common/debug.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "avlalloc "
+
+MEMPOOL_DEFINE_OBJECT_FACTORY(range_seg_t, range_seg_t, bluestore_alloc);
+
+namespace {
+  // returned by the pickers when no segment fits
+  const uint64_t NOT_FOUND = std::numeric_limits<uint64_t>::max();
+}
+
+AvlAllocator::AvlAllocator(CephContext* cct, int64_t device_size)
+  : cct(cct),
+    num_total(device_size),
+    range_size_alloc_threshold(
+      cct->_conf->get_val<uint64_t>("bluestore_avl_alloc_bf_threshold")),
+    range_size_alloc_free_pct(
+      cct->_conf->get_val<uint64_t>("bluestore_avl_alloc_bf_free_pct"))
+{
+}
+
+AvlAllocator::~AvlAllocator()
+{
+  shutdown();
+}
+
+/*
+ * first-fit: walk the offset tree from *cursor, wrapping around once, and
+ * take the first segment that holds an aligned extent of size bytes.
+ */
+uint64_t AvlAllocator::_block_picker(uint64_t *cursor,
+				     uint64_t size,
+				     uint64_t align)
+{
+  const auto compare = range_tree.key_comp();
+  auto rs_start = range_tree.lower_bound(*cursor, compare);
+  for (auto rs = rs_start; rs != range_tree.end(); ++rs) {
+    uint64_t offset = P2ROUNDUP(rs->start, align);
+    if (offset + size <= rs->end) {
+      *cursor = offset + size;
+      return offset;
+    }
+  }
+  // if we reached the end, search from the beginning up to the cursor
+  for (auto rs = range_tree.begin(); rs != rs_start; ++rs) {
+    uint64_t offset = P2ROUNDUP(rs->start, align);
+    if (offset + size <= rs->end) {
+      *cursor = offset + size;
+      return offset;
+    }
+  }
+  return NOT_FOUND;
+}
+
+/*
+ * best-fit: the shortest segment that holds an aligned extent of size
+ * bytes, lowest offset first among segments of equal length.
+ */
+uint64_t AvlAllocator::_best_fit(uint64_t size, uint64_t align)
+{
+  range_seg_t key(0, size);
+  for (auto rs = range_size_tree.lower_bound(key);
+       rs != range_size_tree.end();
+       ++rs) {
+    uint64_t offset = P2ROUNDUP(rs->start, align);
+    if (offset + size <= rs->end) {
+      return offset;
+    }
+  }
+  return NOT_FOUND;
+}
+
+void AvlAllocator::_add_to_tree(uint64_t start, uint64_t size)
+{
+  assert(size != 0);
+
+  uint64_t end = start + size;
+
+  auto rs_after = range_tree.upper_bound(start, range_tree.key_comp());
+
+  /* Make sure we don't overlap with either of our neighbors */
+  auto rs_before = range_tree.end();
+  if (rs_after != range_tree.begin()) {
+    rs_before = std::prev(rs_after);
+  }
+  assert(rs_before == range_tree.end() || rs_before->end <= start);
+  assert(rs_after == range_tree.end() || rs_after->start >= end);
+
+  bool merge_before = (rs_before != range_tree.end() &&
+		       rs_before->end == start);
+  bool merge_after = (rs_after != range_tree.end() &&
+		      rs_after->start == end);
+
+  if (merge_before && merge_after) {
+    range_size_tree.erase(range_size_tree.iterator_to(*rs_before));
+    range_size_tree.erase(range_size_tree.iterator_to(*rs_after));
+    rs_after->start = rs_before->start;
+    range_tree.erase_and_dispose(rs_before, dispose_rs{});
+    range_size_tree.insert(*rs_after);
+  } else if (merge_before) {
+    range_size_tree.erase(range_size_tree.iterator_to(*rs_before));
+    rs_before->end = end;
+    range_size_tree.insert(*rs_before);
+  } else if (merge_after) {
+    range_size_tree.erase(range_size_tree.iterator_to(*rs_after));
+    rs_after->start = start;
+    range_size_tree.insert(*rs_after);
+  } else {
+    auto new_rs = new range_seg_t{start, end};
+    range_tree.insert_before(rs_after, *new_rs);
+    range_size_tree.insert(*new_rs);
+  }
+  num_free += size;
+}
+
+void AvlAllocator::_remove_from_tree(uint64_t start, uint64_t size)
+{
+  uint64_t end = start + size;
+
+  assert(size != 0);
+  assert(size <= num_free);
+
+  // the segment containing start must also contain all of [start, end),
+  // since adjacent free extents are always coalesced
+  auto rs = range_tree.upper_bound(start, range_tree.key_comp());
+  assert(rs != range_tree.begin());
+  --rs;
+  assert(rs->start <= start);
+  assert(rs->end >= end);
+
+  bool left_over = (rs->start != start);
+  bool right_over = (rs->end != end);
+
+  range_size_tree.erase(range_size_tree.iterator_to(*rs));
+
+  if (left_over && right_over) {
+    auto new_seg = new range_seg_t{end, rs->end};
+    rs->end = start;
+    range_tree.insert_before(std::next(rs), *new_seg);
+    range_size_tree.insert(*new_seg);
+    range_size_tree.insert(*rs);
+  } else if (left_over) {
+    rs->end = start;
+    range_size_tree.insert(*rs);
+  } else if (right_over) {
+    rs->start = end;
+    range_size_tree.insert(*rs);
+  } else {
+    range_tree.erase_and_dispose(rs, dispose_rs{});
+  }
+  num_free -= size;
+}
+
+int AvlAllocator::_allocate(
+  uint64_t want,
+  uint64_t unit,
+  int64_t hint,
+  uint64_t *offset,
+  uint64_t *length)
+{
+  uint64_t max_size = 0;
+  if (!range_size_tree.empty()) {
+    max_size = range_size_tree.rbegin()->length();
+  }
+
+  // extents handed back are 32 bits long
+  want = std::min(want, P2ALIGN((uint64_t)std::numeric_limits<uint32_t>::max(),
+				unit));
+
+  bool force_range_size_alloc = false;
+  if (max_size < want) {
+    if (max_size < unit) {
+      return -ENOSPC;
+    }
+    // nothing is big enough; take what the largest segment can give
+    want = P2ALIGN(max_size, unit);
+    force_range_size_alloc = true;
+  }
+
+  if (cct->_conf->bluestore_debug_small_allocations) {
+    uint64_t max =
+      unit * (rand() % cct->_conf->bluestore_debug_small_allocations);
+    if (max && want > max) {
+      dout(10) << __func__ << " shortening allocation of 0x" << std::hex
+	       << want << " -> 0x"
+	       << max << " due to debug_small_allocations" << std::dec << dendl;
+      want = max;
+    }
+  }
+
+  const int free_pct = num_total ? num_free * 100 / num_total : 0;
+  uint64_t start = NOT_FOUND;
+  if (!force_range_size_alloc &&
+      want < range_size_alloc_threshold &&
+      free_pct >= range_size_alloc_free_pct) {
+    // requests of the same alignment share a cursor, so that e.g. a run
+    // of 4k writes is laid out sequentially
+    const uint64_t align = want & -want;
+    assert(align != 0);
+    uint64_t *cursor = &lbas[cbits(align) - 1];
+    if (hint > 0 && (uint64_t)hint < num_total) {
+      *cursor = hint;
+    }
+    start = _block_picker(cursor, want, unit);
+    dout(20) << __func__ << " first fit 0x" << std::hex << want
+	     << " -> 0x" << start << std::dec << dendl;
+  }
+  if (start == NOT_FOUND) {
+    // misalignment can defeat every candidate, so shrink until we fit
+    while (true) {
+      start = _best_fit(want, unit);
+      if (start != NOT_FOUND || want <= unit) {
+	break;
+      }
+      want = std::max(unit, P2ALIGN(want / 2, unit));
+    }
+    dout(20) << __func__ << " best fit 0x" << std::hex << want
+	     << " -> 0x" << start << std::dec << dendl;
+    if (start == NOT_FOUND) {
+      return -ENOSPC;
+    }
+  }
+
+  _remove_from_tree(start, want);
+  *offset = start;
+  *length = want;
+  return 0;
+}
+
+int AvlAllocator::reserve(uint64_t need)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " need 0x" << std::hex << need
+	   << " num_free 0x" << num_free
+	   << " num_reserved 0x" << num_reserved << std::dec << dendl;
+  if (need > num_free - num_reserved)
+    return -ENOSPC;
+  num_reserved += need;
+  return 0;
+}
+
+void AvlAllocator::unreserve(uint64_t unused)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " unused 0x" << std::hex << unused
+	   << " num_free 0x" << num_free
+	   << " num_reserved 0x" << num_reserved << std::dec << dendl;
+  assert(num_reserved >= unused);
+  num_reserved -= unused;
+}
+
+int64_t AvlAllocator::allocate(
+  uint64_t want_size,
+  uint64_t alloc_unit,
+  uint64_t max_alloc_size,
+  int64_t hint,
+  mempool::bluestore_alloc::vector<AllocExtent> *extents)
+{
+  dout(10) << __func__ << " want_size 0x" << std::hex << want_size
+	   << " alloc_unit 0x" << alloc_unit
+	   << " max_alloc_size 0x" << max_alloc_size
+	   << " hint 0x" << hint
+	   << std::dec << dendl;
+  assert(ISP2(alloc_unit));
+
+  if (max_alloc_size == 0) {
+    max_alloc_size = want_size;
+  }
+
+  ExtentList block_list = ExtentList(extents, 1, max_alloc_size);
+
+  std::lock_guard<std::mutex> l(lock);
+  uint64_t allocated_size = 0;
+  while (allocated_size < want_size) {
+    uint64_t offset, length;
+    int r = _allocate(std::min(max_alloc_size, want_size - allocated_size),
+		      alloc_unit, hint, &offset, &length);
+    if (r < 0) {
+      // allocation failed
+      break;
+    }
+    block_list.add_extents(offset, length);
+    allocated_size += length;
+    hint = offset + length;
+  }
+
+  if (allocated_size == 0) {
+    return -ENOSPC;
+  }
+  assert(num_reserved >= allocated_size);
+  num_reserved -= allocated_size;
+  return allocated_size;
+}
+
+void AvlAllocator::release(uint64_t offset, uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  _add_to_tree(offset, length);
+}
+
+uint64_t AvlAllocator::get_free()
+{
+  std::lock_guard<std::mutex> l(lock);
+  return num_free;
+}
+
+void AvlAllocator::dump()
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(0) << __func__ << " range_tree: " << range_tree.size()
+	  << " extents" << dendl;
+  for (auto& rs : range_tree) {
+    dout(0) << __func__ << "  0x" << std::hex << rs.start << "~" << rs.length()
+	    << std::dec << dendl;
+  }
+  if (!range_size_tree.empty()) {
+    dout(0) << __func__ << " range_size_tree: shortest 0x" << std::hex
+	    << range_size_tree.begin()->length() << " longest 0x"
+	    << range_size_tree.rbegin()->length() << std::dec << dendl;
+  }
+}
+
+void AvlAllocator::init_add_free(uint64_t offset, uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  _add_to_tree(offset, length);
+}
+
+void AvlAllocator::init_rm_free(uint64_t offset, uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  _remove_from_tree(offset, length);
+}
+
+void AvlAllocator::shutdown()
+{
+  std::lock_guard<std::mutex> l(lock);
+  range_size_tree.clear();
+  range_tree.clear_and_dispose(dispose_rs{});
+}
@@ -0,0 +1,136 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_OS_BLUESTORE_AVLALLOCATOR_H
+#define CEPH_OS_BLUESTORE_AVLALLOCATOR_H
+
+#include <mutex>
+#include <boost/intrusive/avl_set.hpp>
+
+#include "Allocator.h"
+#include "os/bluestore/bluestore_types.h"
+#include "include/mempool.h"
+
+/// a free extent [start, end), linked into both trees of AvlAllocator
+struct range_seg_t {
+  MEMPOOL_CLASS_HELPERS();  ///< memory monitoring
+  uint64_t start;  ///< starting offset of this segment
+  uint64_t end;	   ///< ending offset (non-inclusive)
+
+  range_seg_t(uint64_t start, uint64_t end)
+    : start{start},
+      end{end}
+  {}
+  uint64_t length() const {
+    return end - start;
+  }
+
+  // key-value comparison functor for the offset tree
+  struct before_t {
+    bool operator()(uint64_t offset, const range_seg_t& rs) const {
+      return offset < rs.start;
+    }
+    bool operator()(const range_seg_t& rs, uint64_t offset) const {
+      return rs.start < offset;
+    }
+    bool operator()(const range_seg_t& lhs, const range_seg_t& rhs) const {
+      return lhs.start < rhs.start;
+    }
+  };
+  boost::intrusive::avl_set_member_hook<> offset_hook;
+
+  // the size tree orders by length, then by offset
+  struct shorter_t {
+    bool operator()(const range_seg_t& lhs, const range_seg_t& rhs) const {
+      if (lhs.length() != rhs.length()) {
+	return lhs.length() < rhs.length();
+      }
+      return lhs.start < rhs.start;
+    }
+  };
+  boost::intrusive::avl_set_member_hook<> size_hook;
+};
+
+/**
+ * Extent tree allocator
+ *
+ * Free space is kept as coalesced extents in two AVL trees, one ordered
+ * by offset and one by size.  Small requests are served first-fit from
+ * a cursor per request alignment, which keeps related allocations close
+ * together and is cheap; requests of at least
+ * bluestore_avl_alloc_bf_threshold bytes, or any request once free
+ * space drops below bluestore_avl_alloc_bf_free_pct, are served best-fit
+ * from the size tree to limit fragmentation.
+ */
+class AvlAllocator : public Allocator {
+  CephContext* cct;
+  std::mutex lock;
+
+  struct dispose_rs {
+    void operator()(range_seg_t* p) {
+      delete p;
+    }
+  };
+
+  typedef boost::intrusive::avl_set<
+    range_seg_t,
+    boost::intrusive::compare<range_seg_t::before_t>,
+    boost::intrusive::member_hook<
+      range_seg_t,
+      boost::intrusive::avl_set_member_hook<>,
+      &range_seg_t::offset_hook>> range_tree_t;
+  range_tree_t range_tree;    ///< main range tree
+
+  typedef boost::intrusive::avl_set<
+    range_seg_t,
+    boost::intrusive::compare<range_seg_t::shorter_t>,
+    boost::intrusive::member_hook<
+      range_seg_t,
+      boost::intrusive::avl_set_member_hook<>,
+      &range_seg_t::size_hook>> range_size_tree_t;
+  range_size_tree_t range_size_tree;  ///< same segments, by size
+
+  const uint64_t num_total;   ///< device size
+  uint64_t num_free = 0;      ///< total bytes in freelist
+  uint64_t num_reserved = 0;  ///< reserved bytes
+
+  /// first-fit cursors, indexed by log2 of the request alignment
+  uint64_t lbas[64] = {0};
+
+  /// requests of at least this many bytes are served best-fit
+  uint64_t range_size_alloc_threshold;
+  /// below this percentage of free space everything is served best-fit
+  int range_size_alloc_free_pct;
+
+  uint64_t _block_picker(uint64_t *cursor, uint64_t size, uint64_t align);
+  uint64_t _best_fit(uint64_t size, uint64_t align);
+  void _add_to_tree(uint64_t start, uint64_t size);
+  void _remove_from_tree(uint64_t start, uint64_t size);
+  int _allocate(uint64_t want, uint64_t unit, int64_t hint,
+		uint64_t *offset, uint64_t *length);
+
+public:
+  AvlAllocator(CephContext* cct, int64_t device_size);
+  ~AvlAllocator() override;
+
+  int reserve(uint64_t need) override;
+  void unreserve(uint64_t unused) override;
+
+  int64_t allocate(
+    uint64_t want_size, uint64_t alloc_unit, uint64_t max_alloc_size,
+    int64_t hint, mempool::bluestore_alloc::vector<AllocExtent> *extents) override;
+
+  void release(
+    uint64_t offset, uint64_t length) override;
+
+  uint64_t get_free() override;
+
+  void dump() override;
+
+  void init_add_free(uint64_t offset, uint64_t length) override;
+  void init_rm_free(uint64_t offset, uint64_t length) override;
+
+  void shutdown() override;
+};
+
+#endif
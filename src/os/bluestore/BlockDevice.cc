@@ -18,6 +18,9 @@
 #include <unistd.h>
 
 #include "KernelDevice.h"
+#ifdef HAVE_LIBURING
+#include "IoRingDevice.h"
+#endif
 #if defined(HAVE_SPDK)
 #include "NVMEDevice.h"
 #endif
@@ -75,6 +78,10 @@ BlockDevice *BlockDevice::create(CephContext* cct, const string& path,
   }
 #endif
 
+  if (!cct->_conf->bdev_type.empty() && type == "kernel") {
+    type = cct->_conf->bdev_type;
+  }
+
   dout(1) << __func__ << " path " << path << " type " << type << dendl;
 
 #if defined(HAVE_PMEM)
@@ -83,6 +90,22 @@ BlockDevice *BlockDevice::create(CephContext* cct, const string& path,
   }
 #endif
 
+#ifdef HAVE_LIBURING
+  if (type == "io_uring") {
+    if (IoRingDevice::supported()) {
+      return new IoRingDevice(cct, cb, cbpriv);
+    }
+    derr << __func__ << " io_uring not supported by this kernel, "
+	 << "falling back to kernel (libaio)" << dendl;
+    type = "kernel";
+  }
+#else
+  if (type == "io_uring") {
+    derr << __func__ << " built without liburing, "
+	 << "falling back to kernel (libaio)" << dendl;
+    type = "kernel";
+  }
+#endif
   if (type == "kernel") {
     return new KernelDevice(cct, cb, cbpriv);
   }
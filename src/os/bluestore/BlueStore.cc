@@ -66,6 +66,7 @@ const string PREFIX_OMAP = "M";    // u64 + keyname -> value
 const string PREFIX_DEFERRED = "L";  // id -> deferred_transaction_t
 const string PREFIX_ALLOC = "B";   // u64 offset -> u64 length (freelist)
 const string PREFIX_SHARED_BLOB = "X"; // u64 offset -> shared_blob_t
+const string PREFIX_COMPRESS_DICT = "D"; // u32 id -> compression_dict_t
 
 // write a label in the first block.  always use this size.  note that
 // bluefs makes a matching assumption about the location of its
@@ -770,6 +771,8 @@ BlueStore::Cache *BlueStore::Cache::create(CephContext* cct, string type,
     c = new LRUCache(cct);
   else if (type == "2q")
     c = new TwoQCache(cct);
+  else if (type == "clock")
+    c = new ClockCache(cct);
   else
     assert(0 == "unrecognized cache type");
 
@@ -1366,7 +1369,7 @@ void BlueStore::BufferSpace::read(
   uint32_t end = offset + length;
 
   {
-    std::lock_guard<std::recursive_mutex> l(cache->lock);
+    auto l = cache->counted_lock();
     for (auto i = _data_lower_bound(offset);
          i != buffer_map.end() && offset < end && i->first < end;
          ++i) {
@@ -1503,6 +1506,107 @@ void BlueStore::BufferSpace::split(Cache* cache, size_t pos, BlueStore::BufferSp
   assert(writing.empty());
 }
 
+// ClockCache
+#undef dout_prefix
+#define dout_prefix *_dout << "bluestore.ClockCache(" << this << ") "
+
+void BlueStore::ClockCache::_trim(uint64_t onode_max, uint64_t buffer_max)
+{
+  dout(20) << __func__ << " onodes " << onode_ring.size() << " / " << onode_max
+	   << " buffers " << buffer_size << " / " << buffer_max
+	   << dendl;
+
+  _audit("trim start");
+  uint64_t spared = 0;
+
+  // buffers.  a full sweep clears every reference bit, so two sweeps
+  // always find a victim if there is one.
+  uint64_t budget = 2 * buffer_ring.size();
+  while (buffer_size > buffer_max && budget > 0) {
+    --budget;
+    if (buffer_hand == buffer_ring.end()) {
+      buffer_hand = buffer_ring.begin();
+    }
+    Buffer *b = &*buffer_hand;
+    if (b->cache_private) {
+      b->cache_private = 0;
+      ++buffer_hand;
+      ++spared;
+      continue;
+    }
+    assert(b->is_clean());
+    dout(20) << __func__ << " rm " << *b << dendl;
+    b->space->_rm_buffer(this, b);  // advances buffer_hand
+  }
+
+  // onodes
+  int num = onode_ring.size() - onode_max;
+  int skipped = 0;
+  int max_skipped = g_conf->bluestore_cache_trim_max_skip_pinned;
+  budget = 2 * onode_ring.size();
+  while (num > 0 && budget > 0) {
+    --budget;
+    if (onode_hand == onode_ring.end()) {
+      onode_hand = onode_ring.begin();
+    }
+    Onode *o = &*onode_hand;
+    if (o->cache_ref.load(std::memory_order_relaxed)) {
+      o->cache_ref.store(false, std::memory_order_relaxed);
+      ++onode_hand;
+      ++spared;
+      continue;
+    }
+    int refs = o->nref.load();
+    if (refs > 1) {
+      dout(20) << __func__ << "  " << o->oid << " has " << refs
+	       << " refs, skipping" << dendl;
+      if (++skipped >= max_skipped) {
+        dout(20) << __func__ << " maximum skip pinned reached; stopping with "
+                 << num << " left to trim" << dendl;
+        break;
+      }
+      ++onode_hand;
+      continue;
+    }
+    // lookups do not take our lock, so recheck under the map lock
+    OnodeRef ref(o);
+    if (!o->c->onode_map.evict(o)) {
+      dout(20) << __func__ << "  " << o->oid << " raced with lookup, skipping"
+	       << dendl;
+      ++onode_hand;
+      continue;
+    }
+    dout(30) << __func__ << "  rm " << o->oid << dendl;
+    onode_hand = onode_ring.erase(onode_hand);
+    --num;
+  }
+
+  if (spared) {
+    logger->inc(l_bluestore_cache_clock_spared, spared);
+  }
+}
+
+#ifdef DEBUG_CACHE
+void BlueStore::ClockCache::_audit(const char *when)
+{
+  dout(10) << __func__ << " " << when << " start" << dendl;
+  uint64_t s = 0;
+  for (auto i = buffer_ring.begin(); i != buffer_ring.end(); ++i) {
+    s += i->length;
+  }
+  if (s != buffer_size) {
+    derr << __func__ << " buffer_size " << buffer_size << " actual " << s
+	 << dendl;
+    for (auto i = buffer_ring.begin(); i != buffer_ring.end(); ++i) {
+      derr << __func__ << " " << *i << dendl;
+    }
+    assert(s == buffer_size);
+  }
+  dout(20) << __func__ << " " << when << " buffer_size " << buffer_size
+	   << " ok" << dendl;
+}
+#endif
+
 // OnodeSpace
 
 #undef dout_prefix
@@ -1511,6 +1615,7 @@ void BlueStore::BufferSpace::split(Cache* cache, size_t pos, BlueStore::BufferSp
 BlueStore::OnodeRef BlueStore::OnodeSpace::add(const ghobject_t& oid, OnodeRef o)
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
+  RWLock::WLocker ml(map_lock);
   auto p = onode_map.find(oid);
   if (p != onode_map.end()) {
     ldout(cache->cct, 30) << __func__ << " " << oid << " " << o
@@ -1530,8 +1635,18 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
   OnodeRef o;
   bool hit = false;
 
-  {
-    std::lock_guard<std::recursive_mutex> l(cache->lock);
+  if (cache->lockless_onode_touch()) {
+    RWLock::RLocker l(map_lock);
+    auto p = onode_map.find(oid);
+    if (p != onode_map.end()) {
+      cache->_touch_onode(p->second);
+      hit = true;
+      o = p->second;
+    }
+    ldout(cache->cct, 30) << __func__ << " " << oid
+			  << (hit ? " hit " : " miss ") << o << dendl;
+  } else {
+    auto l = cache->counted_lock();
     ceph::unordered_map<ghobject_t,OnodeRef>::iterator p = onode_map.find(oid);
     if (p == onode_map.end()) {
       ldout(cache->cct, 30) << __func__ << " " << oid << " miss" << dendl;
@@ -1555,6 +1670,7 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
 void BlueStore::OnodeSpace::clear()
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
+  RWLock::WLocker ml(map_lock);
   ldout(cache->cct, 10) << __func__ << dendl;
   for (auto &p : onode_map) {
     cache->_rm_onode(p.second);
@@ -1575,6 +1691,7 @@ void BlueStore::OnodeSpace::rename(
   const mempool::bluestore_cache_other::string& new_okey)
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
+  RWLock::WLocker ml(map_lock);
   ldout(cache->cct, 30) << __func__ << " " << old_oid << " -> " << new_oid
 			<< dendl;
   ceph::unordered_map<ghobject_t,OnodeRef>::iterator po, pn;
@@ -1603,6 +1720,20 @@ void BlueStore::OnodeSpace::rename(
   o->key = new_okey;
 }
 
+bool BlueStore::OnodeSpace::evict(Onode *o)
+{
+  // called from Cache::_trim with cache->lock held; the caller holds one
+  // ref and we hold another, anything else is a racing lookup.
+  RWLock::WLocker l(map_lock);
+  if (o->nref.load() > 2 || o->cache_ref.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  auto p = onode_map.find(o->oid);
+  assert(p != onode_map.end() && p->second == o);
+  onode_map.erase(p);
+  return true;
+}
+
 bool BlueStore::OnodeSpace::map_any(std::function<bool(OnodeRef)> f)
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
@@ -1928,6 +2059,17 @@ void BlueStore::Blob::decode(
     }
   }
 }
+
+void BlueStore::Blob::skip(
+  bufferptr::iterator& p,
+  uint64_t struct_v)
+{
+  // mirrors decode()
+  uint32_t flags = bluestore_blob_t::skip(p, struct_v);
+  if (flags & bluestore_blob_t::FLAG_SHARED) {
+    p.advance(sizeof(uint64_t));  // sbid
+  }
+}
 #endif
 
 // Extent
@@ -2546,6 +2688,173 @@ unsigned BlueStore::ExtentMap::decode_some(bufferlist& bl)
   return num;
 }
 
+BlueStore::ExtentMap::ShardView::ShardView(const bufferptr& bp)
+  : bp(bp),
+    p(bp.begin())
+{
+  denc(struct_v, p);
+  assert(struct_v == 1 || struct_v == 2);
+  uint32_t num;
+  denc_varint(num, p);
+}
+
+bool BlueStore::ExtentMap::ShardView::next(Item *item)
+{
+  // mirrors decode_some()
+  if (p.end()) {
+    return false;
+  }
+  uint64_t blobid;
+  denc_varint(blobid, p);
+  if ((blobid & BLOBID_FLAG_CONTIGUOUS) == 0) {
+    uint64_t gap;
+    denc_varint_lowz(gap, p);
+    pos += gap;
+  }
+  item->logical_offset = pos;
+  if ((blobid & BLOBID_FLAG_ZEROOFFSET) == 0) {
+    denc_varint_lowz(item->blob_offset, p);
+  } else {
+    item->blob_offset = 0;
+  }
+  if ((blobid & BLOBID_FLAG_SAMELENGTH) == 0) {
+    denc_varint_lowz(prev_len, p);
+  }
+  item->length = prev_len;
+  if (blobid & BLOBID_FLAG_SPANNING) {
+    item->spanning_blob_id = blobid >> BLOBID_SHIFT_BITS;
+    item->blob_here = false;
+  } else {
+    item->spanning_blob_id = -1;
+    blobid >>= BLOBID_SHIFT_BITS;
+    if (blobid) {
+      item->blob_index = blobid - 1;
+      item->blob_here = false;
+    } else {
+      item->blob_index = n;
+      item->blob_pos = p.get_offset();
+      item->blob_here = true;
+      Blob::skip(p, struct_v);
+    }
+  }
+  pos += prev_len;
+  ++n;
+  return true;
+}
+
+uint32_t BlueStore::ExtentMap::ShardView::find_blob(unsigned index) const
+{
+  ShardView v(bp);
+  Item item;
+  while (v.next(&item)) {
+    if (item.blob_here && item.blob_index == index) {
+      return item.blob_pos;
+    }
+  }
+  assert(0 == "blob not found in shard");
+  return 0;
+}
+
+BlueStore::BlobRef BlueStore::ExtentMap::decode_view_blob(
+  const bufferptr& bp,
+  uint32_t pos,
+  uint8_t struct_v)
+{
+  BlobRef b(new Blob());
+  uint64_t sbid = 0;
+  auto p = bp.begin(pos);
+  b->decode(onode->c, p, struct_v, &sbid, false);
+  onode->c->open_shared_blob(sbid, b);
+  return b;
+}
+
+template <typename F>
+void BlueStore::ExtentMap::lazy_map_range(
+  KeyValueDB *db,
+  uint32_t offset,
+  uint32_t length,
+  F&& f)
+{
+  auto cct = onode->c->store->cct; //used by dout
+  uint32_t end = offset + length;
+  int s = seek_shard(offset);
+  if (s < 0) {
+    // unsharded; everything was decoded with the onode
+    for (auto ep = seek_lextent(offset);
+	 ep != extent_map.end() && ep->logical_offset < end;
+	 ++ep) {
+      if (!f(ep->logical_offset, ep->blob_offset, ep->length, ep->blob)) {
+	return;
+      }
+    }
+    return;
+  }
+  int last = seek_shard(end - 1);
+  for (; s <= last; ++s) {
+    Shard& shard = shards[s];
+    uint32_t shard_begin = std::max(offset, shard.shard_info->offset);
+    uint32_t shard_end = end;
+    if ((size_t)s + 1 < shards.size()) {
+      shard_end = std::min(end, shards[s + 1].shard_info->offset);
+    }
+    if (shard.loaded) {
+      for (auto ep = seek_lextent(shard_begin);
+	   ep != extent_map.end() && ep->logical_offset < shard_end;
+	   ++ep) {
+	if (!f(ep->logical_offset, ep->blob_offset, ep->length, ep->blob)) {
+	  return;
+	}
+      }
+      continue;
+    }
+
+    if (shard.encoded.length() == 0) {
+      read_shard(db, shard, &shard.encoded);
+      assert(shard.encoded.length() == shard.shard_info->bytes);
+      if (shard.encoded.get_num_buffers() > 1) {
+	shard.encoded.rebuild();
+      }
+      onode->c->store->logger->inc(l_bluestore_onode_shard_misses);
+    } else {
+      onode->c->store->logger->inc(l_bluestore_onode_shard_hits);
+    }
+    dout(30) << __func__ << " shard 0x" << std::hex
+	     << shard.shard_info->offset << std::dec << " ("
+	     << shard.encoded.length() << " bytes)" << dendl;
+
+    const bufferptr& bp = shard.encoded.front();
+    ShardView v(bp);
+    ShardView::Item item;
+    map<unsigned, BlobRef> blobs;  // by index, only those we touch
+    while (v.next(&item)) {
+      if (item.logical_offset >= shard_end) {
+	break;
+      }
+      if (item.logical_offset + item.length <= shard_begin) {
+	continue;
+      }
+      BlobRef b;
+      if (item.spanning_blob_id >= 0) {
+	b = get_spanning_blob(item.spanning_blob_id);
+      } else {
+	auto q = blobs.find(item.blob_index);
+	if (q != blobs.end()) {
+	  b = q->second;
+	} else {
+	  uint32_t blob_pos = item.blob_here ?
+	    item.blob_pos :
+	    v.find_blob(item.blob_index);  // encoded before the range
+	  b = decode_view_blob(bp, blob_pos, v.get_struct_v());
+	  blobs[item.blob_index] = b;
+	}
+      }
+      if (!f(item.logical_offset, item.blob_offset, item.length, b)) {
+	return;
+      }
+    }
+  }
+}
+
 void BlueStore::ExtentMap::bound_encode_spanning_blobs(size_t& p)
 {
   // Version 2 differs from v1 in blob's ref_map
@@ -2609,10 +2918,32 @@ void BlueStore::ExtentMap::init_shards(bool loaded, bool dirty)
     shards[i].shard_info = &s;
     shards[i].loaded = loaded;
     shards[i].dirty = dirty;
+    shards[i].encoded.clear();
     ++i;
   }
 }
 
+void BlueStore::ExtentMap::read_shard(
+  KeyValueDB *db,
+  const Shard& shard,
+  bufferlist *v)
+{
+  auto cct = onode->c->store->cct; //used by dout
+  string key;
+  generate_extent_shard_key_and_apply(
+    onode->key, shard.shard_info->offset, &key,
+    [&](const string& final_key) {
+      int r = db->get(PREFIX_OBJ, final_key, v);
+      if (r < 0) {
+	derr << __func__ << " missing shard 0x" << std::hex
+	     << shard.shard_info->offset << std::dec << " for " << onode->oid
+	     << dendl;
+	assert(r >= 0);
+      }
+    }
+  );
+}
+
 void BlueStore::ExtentMap::fault_range(
   KeyValueDB *db,
   uint32_t offset,
@@ -2628,7 +2959,6 @@ void BlueStore::ExtentMap::fault_range(
     return;
 
   assert(last >= start);
-  string key;
   while (start <= last) {
     assert((size_t)start < shards.size());
     auto p = &shards[start];
@@ -2636,18 +2966,14 @@ void BlueStore::ExtentMap::fault_range(
       dout(30) << __func__ << " opening shard 0x" << std::hex
 	       << p->shard_info->offset << std::dec << dendl;
       bufferlist v;
-      generate_extent_shard_key_and_apply(
-	onode->key, p->shard_info->offset, &key,
-        [&](const string& final_key) {
-          int r = db->get(PREFIX_OBJ, final_key, &v);
-          if (r < 0) {
-	    derr << __func__ << " missing shard 0x" << std::hex
-		 << p->shard_info->offset << std::dec << " for " << onode->oid
-		 << dendl;
-	    assert(r >= 0);
-          }
-        }
-      );
+      if (p->encoded.length()) {
+	// already read by lazy_map_range
+	v.claim(p->encoded);
+	onode->c->store->logger->inc(l_bluestore_onode_shard_hits);
+      } else {
+	read_shard(db, *p, &v);
+	onode->c->store->logger->inc(l_bluestore_onode_shard_misses);
+      }
       p->extents = decode_some(v);
       p->loaded = true;
       dout(20) << __func__ << " open shard 0x" << std::hex
@@ -2655,7 +2981,6 @@ void BlueStore::ExtentMap::fault_range(
 	       << " (" << v.length() << " bytes)" << dendl;
       assert(p->dirty == false);
       assert(v.length() == p->shard_info->bytes);
-      onode->c->store->logger->inc(l_bluestore_onode_shard_misses);
     } else {
       onode->c->store->logger->inc(l_bluestore_onode_shard_hits);
     }
@@ -3247,6 +3572,8 @@ void BlueStore::Collection::split_cache(
   std::lock(cache->lock, dest->cache->lock);
   std::lock_guard<std::recursive_mutex> l(cache->lock, std::adopt_lock);
   std::lock_guard<std::recursive_mutex> l2(dest->cache->lock, std::adopt_lock);
+  RWLock::WLocker ml(onode_map.map_lock);
+  RWLock::WLocker ml2(dest->onode_map.map_lock);
 
   int destbits = dest->cnode.bits;
   spg_t destpg;
@@ -3471,7 +3798,7 @@ BlueStore::BlueStore(CephContext *cct, const string& path)
 		       cct->_conf->bluestore_throttle_bytes +
 		       cct->_conf->bluestore_throttle_deferred_bytes),
     kv_sync_thread(this),
-    kv_finalize_thread(this),
+    kv_commit_thread(this),
     mempool_thread(this)
 {
   _init_logger();
@@ -3489,7 +3816,7 @@ BlueStore::BlueStore(CephContext *cct,
 		       cct->_conf->bluestore_throttle_bytes +
 		       cct->_conf->bluestore_throttle_deferred_bytes),
     kv_sync_thread(this),
-    kv_finalize_thread(this),
+    kv_commit_thread(this),
     min_alloc_size(_min_alloc_size),
     min_alloc_size_order(ctz(_min_alloc_size)),
     mempool_thread(this)
@@ -3532,6 +3859,12 @@ const char **BlueStore::get_tracked_conf_keys() const
     "bluestore_compression_max_blob_size_ssd",
     "bluestore_compression_max_blob_size_hdd",
     "bluestore_compression_required_ratio",
+    "bluestore_compression_dict",
+    "bluestore_compression_dict_max_blob_size",
+    "bluestore_compression_dict_retrain_blobs",
+    "bluestore_compression_estimate",
+    "bluestore_compression_backoff",
+    "bluestore_compression_backoff_max",
     "bluestore_max_alloc_size",
     "bluestore_prefer_deferred_size",
     "bluestore_deferred_batch_ops",
@@ -3559,7 +3892,13 @@ void BlueStore::handle_conf_change(const struct md_config_t *conf,
   if (changed.count("bluestore_compression_mode") ||
       changed.count("bluestore_compression_algorithm") ||
       changed.count("bluestore_compression_min_blob_size") ||
-      changed.count("bluestore_compression_max_blob_size")) {
+      changed.count("bluestore_compression_max_blob_size") ||
+      changed.count("bluestore_compression_dict") ||
+      changed.count("bluestore_compression_dict_max_blob_size") ||
+      changed.count("bluestore_compression_dict_retrain_blobs") ||
+      changed.count("bluestore_compression_estimate") ||
+      changed.count("bluestore_compression_backoff") ||
+      changed.count("bluestore_compression_backoff_max")) {
     if (bdev) {
       _set_compression();
     }
@@ -3643,6 +3982,19 @@ void BlueStore::_set_compression()
     }
   }
 
+  if (cct->_conf->get_val<bool>("bluestore_compression_dict")) {
+    comp_dict_max_blob_size =
+      cct->_conf->get_val<uint64_t>("bluestore_compression_dict_max_blob_size");
+  } else {
+    comp_dict_max_blob_size = 0;
+  }
+  comp_dict_retrain_blobs =
+    cct->_conf->get_val<uint64_t>("bluestore_compression_dict_retrain_blobs");
+  comp_estimate = cct->_conf->get_val<bool>("bluestore_compression_estimate");
+  comp_backoff = cct->_conf->get_val<uint64_t>("bluestore_compression_backoff");
+  comp_backoff_max =
+    cct->_conf->get_val<uint64_t>("bluestore_compression_backoff_max");
+
   auto& alg_name = cct->_conf->bluestore_compression_algorithm;
   if (!alg_name.empty()) {
     compressor = Compressor::create(cct, alg_name);
@@ -3776,6 +4128,38 @@ void BlueStore::_init_logger()
   b.add_time_avg(l_bluestore_kv_lat, "kv_lat",
 		 "Average kv_thread sync latency",
 		 "k_l", PerfCountersBuilder::PRIO_INTERESTING);
+
+  // x: latency, y: txcs in the kv batch
+  PerfHistogramCommon::axis_config_d kv_hist_x_axis_config{
+    "Latency (usec)",
+    PerfHistogramCommon::SCALE_LOG2, ///< Latency in logarithmic scale
+    0,                               ///< Start at 0
+    10000,                           ///< Quantization unit is 10usec
+    24,                              ///< Up to ~80 seconds
+  };
+  PerfHistogramCommon::axis_config_d kv_hist_y_axis_config{
+    "Batch size (txcs)",
+    PerfHistogramCommon::SCALE_LOG2, ///< Batch size in logarithmic scale
+    0,                               ///< Start at 0
+    1,                               ///< Quantization unit is one txc
+    16,                              ///< Up to 16k txcs per batch
+  };
+  b.add_u64_counter_histogram(
+    l_bluestore_kv_submit_lat_hist, "kv_submit_latency_histogram",
+    kv_hist_x_axis_config, kv_hist_y_axis_config,
+    "Histogram of kv_sync_thread flush + submit latency per batch");
+  b.add_u64_counter_histogram(
+    l_bluestore_kv_sync_wait_lat_hist, "kv_sync_wait_latency_histogram",
+    kv_hist_x_axis_config, kv_hist_y_axis_config,
+    "Histogram of time a submitted batch waited for its sync to start");
+  b.add_u64_counter_histogram(
+    l_bluestore_kv_sync_lat_hist, "kv_sync_latency_histogram",
+    kv_hist_x_axis_config, kv_hist_y_axis_config,
+    "Histogram of synchronous kv commit latency per batch");
+  b.add_u64_counter_histogram(
+    l_bluestore_kv_finalize_lat_hist, "kv_finalize_latency_histogram",
+    kv_hist_x_axis_config, kv_hist_y_axis_config,
+    "Histogram of kv_finalize_thread latency per batch");
   b.add_time_avg(l_bluestore_state_prepare_lat, "state_prepare_lat",
     "Average prepare state latency");
   b.add_time_avg(l_bluestore_state_aio_wait_lat, "state_aio_wait_lat",
@@ -3825,6 +4209,15 @@ void BlueStore::_init_logger()
     "Sum for beneficial compress ops");
   b.add_u64_counter(l_bluestore_compress_rejected_count, "compress_rejected_count",
     "Sum for compress ops rejected due to low net gain of space");
+  b.add_u64_counter(l_bluestore_compress_dict_count, "compress_dict_count",
+    "Sum for blobs compressed with a trained dictionary");
+  b.add_u64_counter(l_bluestore_compress_dict_trained, "compress_dict_trained",
+    "Compression dictionaries trained");
+  b.add_u64_counter(l_bluestore_compress_attempted_bytes,
+    "compress_attempted_bytes", "Sum for bytes of blobs compression was tried on");
+  b.add_u64_counter(l_bluestore_compress_skipped_bytes,
+    "compress_skipped_bytes",
+    "Sum for bytes of blobs estimated incompressible or skipped by back-off");
   b.add_u64_counter(l_bluestore_write_pad_bytes, "write_pad_bytes",
     "Sum for write-op padded bytes");
   b.add_u64_counter(l_bluestore_deferred_write_ops, "deferred_write_ops",
@@ -3867,6 +4260,12 @@ void BlueStore::_init_logger()
     "Sum for bytes of read hit in the cache");
   b.add_u64(l_bluestore_buffer_miss_bytes, "bluestore_buffer_miss_bytes",
     "Sum for bytes of read missed in the cache");
+  b.add_u64_counter(l_bluestore_cache_lock_contended,
+		    "bluestore_cache_lock_contended",
+		    "Cache shard lock acquisitions on the read path that had to wait");
+  b.add_u64_counter(l_bluestore_cache_clock_spared,
+		    "bluestore_cache_clock_spared",
+		    "Onodes and buffers spared by CLOCK eviction because they were referenced");
 
   b.add_u64_counter(l_bluestore_write_big, "bluestore_write_big",
 		    "Large aligned writes into fresh blobs");
@@ -3901,6 +4300,21 @@ void BlueStore::_init_logger()
   b.add_u64_counter(l_bluestore_gc_merged, "bluestore_gc_merged",
 		    "Sum for extents that have been merged due to garbage "
 		    "collection");
+
+  // every transaction passes through these, from many threads at once
+  for (int idx : { l_bluestore_state_prepare_lat,
+		   l_bluestore_state_aio_wait_lat,
+		   l_bluestore_state_io_done_lat,
+		   l_bluestore_state_kv_queued_lat,
+		   l_bluestore_state_kv_committing_lat,
+		   l_bluestore_state_kv_done_lat,
+		   l_bluestore_state_finishing_lat,
+		   l_bluestore_state_done_lat,
+		   l_bluestore_throttle_lat,
+		   l_bluestore_submit_lat,
+		   l_bluestore_commit_lat }) {
+    b.set_sharded(idx);
+  }
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -4678,8 +5092,31 @@ int BlueStore::_open_db(bool create)
 
   db->set_cache_size(cache_size * cache_kv_ratio);
 
-  if (kv_backend == "rocksdb")
+  if (kv_backend == "rocksdb") {
     options = cct->_conf->bluestore_rocksdb_options;
+    if (cct->_conf->get_val<bool>("bluestore_rocksdb_cf")) {
+      std::vector<KeyValueDB::ColumnFamily> cfs;
+      r = KeyValueDB::parse_column_families(
+	cct->_conf->get_val<std::string>("bluestore_rocksdb_cfs"), &cfs);
+      if (r < 0) {
+	derr << __func__ << " invalid bluestore_rocksdb_cfs '"
+	     << cct->_conf->get_val<std::string>("bluestore_rocksdb_cfs")
+	     << "'" << dendl;
+      } else {
+	r = db->set_column_families(cfs);
+      }
+      if (r < 0) {
+	if (bluefs) {
+	  bluefs->umount();
+	  delete bluefs;
+	  bluefs = NULL;
+	}
+	delete db;
+	db = NULL;
+	return r;
+      }
+    }
+  }
   db->init(options);
   if (create)
     r = db->create_and_open(err);
@@ -5313,6 +5750,10 @@ int BlueStore::_mount(bool kv_only)
   if (r < 0)
     goto out_db;
 
+  r = _open_compress_dicts();
+  if (r < 0)
+    goto out_db;
+
   r = _open_fm(false);
   if (r < 0)
     goto out_db;
@@ -5380,6 +5821,7 @@ int BlueStore::umount()
   _kv_stop();
   _reap_collections();
   _flush_cache();
+  _close_compress_dicts();
   dout(20) << __func__ << " closing" << dendl;
 
   mounted = false;
@@ -6378,10 +6820,18 @@ int BlueStore::_do_read(
     length = o->onode.size - offset;
   }
 
+  bool lazy = cct->_conf->bluestore_extent_map_lazy_read;
   utime_t start = ceph_clock_now();
-  o->extent_map.fault_range(db, offset, length);
-  logger->tinc(l_bluestore_read_onode_meta_lat, ceph_clock_now() - start);
-  _dump_onode(o);
+  if (!lazy) {
+    o->extent_map.fault_range(db, offset, length);
+    logger->tinc(l_bluestore_read_onode_meta_lat, ceph_clock_now() - start);
+    _dump_onode(o);
+  } else if (buffered) {
+    // blobs of unloaded shards are not kept, so there is nothing to
+    // attach cached buffers to
+    dout(20) << __func__ << " lazy extent map, not buffering" << dendl;
+    buffered = false;
+  }
 
   ready_regions_t ready_regions;
 
@@ -6390,28 +6840,30 @@ int BlueStore::_do_read(
   unsigned left = length;
   uint64_t pos = offset;
   unsigned num_regions = 0;
-  auto lp = o->extent_map.seek_lextent(offset);
-  while (left > 0 && lp != o->extent_map.extent_map.end()) {
-    if (pos < lp->logical_offset) {
-      unsigned hole = lp->logical_offset - pos;
+  auto read_lextent = [&](uint32_t logical_offset, uint32_t blob_offset,
+			  uint32_t lext_length, const BlobRef& bptr) {
+    if (left == 0) {
+      return false;
+    }
+    if (pos < logical_offset) {
+      unsigned hole = logical_offset - pos;
       if (hole >= left) {
-	break;
+	return false;
       }
-      dout(30) << __func__ << "  hole 0x" << std::hex << pos << "~" << hole
+      dout(30) << "_do_read" << "  hole 0x" << std::hex << pos << "~" << hole
 	       << std::dec << dendl;
       pos += hole;
       left -= hole;
     }
-    BlobRef bptr = lp->blob;
-    unsigned l_off = pos - lp->logical_offset;
-    unsigned b_off = l_off + lp->blob_offset;
-    unsigned b_len = std::min(left, lp->length - l_off);
+    unsigned l_off = pos - logical_offset;
+    unsigned b_off = l_off + blob_offset;
+    unsigned b_len = std::min(left, lext_length - l_off);
 
     ready_regions_t cache_res;
     interval_set<uint32_t> cache_interval;
     bptr->shared_blob->bc.read(
       bptr->shared_blob->get_cache(), b_off, b_len, cache_res, cache_interval);
-    dout(20) << __func__ << "  blob " << *bptr << std::hex
+    dout(20) << "_do_read" << "  blob " << *bptr << std::hex
 	     << " need 0x" << b_off << "~" << b_len
 	     << " cache has 0x" << cache_interval
 	     << std::dec << dendl;
@@ -6423,7 +6875,7 @@ int BlueStore::_do_read(
 	  pc->first == b_off) {
 	l = pc->second.length();
 	ready_regions[pos].claim(pc->second);
-	dout(30) << __func__ << "    use cache 0x" << std::hex << pos << ": 0x"
+	dout(30) << "_do_read" << "    use cache 0x" << std::hex << pos << ": 0x"
 		 << b_off << "~" << l << std::dec << dendl;
 	++pc;
       } else {
@@ -6432,7 +6884,7 @@ int BlueStore::_do_read(
 	  assert(pc->first > b_off);
 	  l = pc->first - b_off;
 	}
-	dout(30) << __func__ << "    will read 0x" << std::hex << pos << ": 0x"
+	dout(30) << "_do_read" << "    will read 0x" << std::hex << pos << ": 0x"
 		 << b_off << "~" << l << std::dec << dendl;
 	blobs2read[bptr].emplace_back(region_t(pos, b_off, l));
 	++num_regions;
@@ -6442,7 +6894,20 @@ int BlueStore::_do_read(
       left -= l;
       b_len -= l;
     }
-    ++lp;
+    return true;
+  };
+  if (lazy) {
+    o->extent_map.lazy_map_range(db, offset, length, read_lextent);
+    logger->tinc(l_bluestore_read_onode_meta_lat, ceph_clock_now() - start);
+  } else {
+    for (auto lp = o->extent_map.seek_lextent(offset);
+	 lp != o->extent_map.extent_map.end();
+	 ++lp) {
+      if (!read_lextent(lp->logical_offset, lp->blob_offset, lp->length,
+			lp->blob)) {
+	break;
+      }
+    }
   }
 
   // read raw blob data.  use aio if we have >1 blobs to read.
@@ -6542,7 +7007,8 @@ int BlueStore::_do_read(
 	return -EIO;
       }
       bufferlist raw_bl;
-      r = _decompress(compressed_bl, &raw_bl);
+      r = _decompress(compressed_bl, bptr->get_blob().get_logical_length(),
+		      &raw_bl);
       if (r < 0)
 	return r;
       if (buffered) {
@@ -6643,7 +7109,8 @@ int BlueStore::_verify_csum(OnodeRef& o,
   return r;
 }
 
-int BlueStore::_decompress(bufferlist& source, bufferlist* result)
+int BlueStore::_decompress(bufferlist& source, uint64_t max_len,
+			   bufferlist* result)
 {
   int r = 0;
   utime_t start = ceph_clock_now();
@@ -6662,7 +7129,15 @@ int BlueStore::_decompress(bufferlist& source, bufferlist* result)
     derr << __func__ << " can't load decompressor " << alg << dendl;
     r = -EIO;
   } else {
-    r = cp->decompress(i, chdr.length, *result);
+    Compressor::DictionaryRef dict;
+    if (chdr.dict_id) {
+      dict = _load_compress_dict(cp, chdr.dict_id);
+      if (!dict) {
+	logger->tinc(l_bluestore_decompress_lat, ceph_clock_now() - start);
+	return -EIO;
+      }
+    }
+    r = cp->decompress(i, chdr.length, *result, dict.get(), max_len);
     if (r < 0) {
       derr << __func__ << " decompression failed with exit code " << r << dendl;
       r = -EIO;
@@ -8143,9 +8618,9 @@ void BlueStore::_osr_drain_all()
     std::lock_guard<std::mutex> l(kv_lock);
     kv_cond.notify_one();
   }
-  {
-    std::lock_guard<std::mutex> l(kv_finalize_lock);
-    kv_finalize_cond.notify_one();
+  for (auto s : kv_finalize_shards) {
+    std::lock_guard<std::mutex> l(s->lock);
+    s->cond.notify_one();
   }
   for (auto osr : s) {
     dout(20) << __func__ << " drain " << osr << dendl;
@@ -8211,8 +8686,27 @@ void BlueStore::_kv_start()
   for (auto f : finishers) {
     f->start();
   }
+
+  kv_pipeline_depth =
+    cct->_conf->get_val<int64_t>("bluestore_kv_sync_pipeline_depth");
+  int64_t num_finalize =
+    std::max<int64_t>(1, cct->_conf->get_val<int64_t>(
+			   "bluestore_kv_finalize_threads"));
+  dout(10) << __func__ << " pipeline depth " << kv_pipeline_depth
+	   << ", " << num_finalize << " finalize threads" << dendl;
+  assert(kv_finalize_shards.empty());
+  for (int64_t i = 0; i < num_finalize; ++i) {
+    kv_finalize_shards.push_back(new KVFinalizeShard(this, i));
+  }
+
   kv_sync_thread.create("bstore_kv_sync");
-  kv_finalize_thread.create("bstore_kv_final");
+  if (kv_pipeline_depth) {
+    kv_commit_thread.create("bstore_kv_commit");
+  }
+  for (auto s : kv_finalize_shards) {
+    s->thread.create("bstore_kv_final");
+  }
+  _compress_start();
 }
 
 void BlueStore::_kv_stop()
@@ -8226,24 +8720,41 @@ void BlueStore::_kv_stop()
     kv_stop = true;
     kv_cond.notify_all();
   }
-  {
-    std::unique_lock<std::mutex> l(kv_finalize_lock);
-    while (!kv_finalize_started) {
-      kv_finalize_cond.wait(l);
-    }
-    kv_finalize_stop = true;
-    kv_finalize_cond.notify_all();
-  }
   kv_sync_thread.join();
-  kv_finalize_thread.join();
   {
     std::lock_guard<std::mutex> l(kv_lock);
     kv_stop = false;
   }
-  {
-    std::lock_guard<std::mutex> l(kv_finalize_lock);
-    kv_finalize_stop = false;
+  // stop downstream stages only once upstream has drained into them
+  if (kv_pipeline_depth) {
+    {
+      std::unique_lock<std::mutex> l(kv_commit_lock);
+      while (!kv_commit_started) {
+	kv_commit_cond.wait(l);
+      }
+      kv_commit_stop = true;
+      kv_commit_cond.notify_all();
+    }
+    kv_commit_thread.join();
+    {
+      std::lock_guard<std::mutex> l(kv_commit_lock);
+      kv_commit_stop = false;
+    }
+  }
+  for (auto s : kv_finalize_shards) {
+    std::unique_lock<std::mutex> l(s->lock);
+    while (!s->started) {
+      s->cond.wait(l);
+    }
+    s->stop = true;
+    s->cond.notify_all();
   }
+  for (auto s : kv_finalize_shards) {
+    s->thread.join();
+    delete s;
+  }
+  kv_finalize_shards.clear();
+  _compress_stop();
   dout(10) << __func__ << " stopping finishers" << dendl;
   for (auto f : finishers) {
     f->wait_for_empty();
@@ -8252,6 +8763,290 @@ void BlueStore::_kv_stop()
   dout(10) << __func__ << " stopped" << dendl;
 }
 
+void BlueStore::_compress_start()
+{
+  int64_t num =
+    cct->_conf->get_val<int64_t>("bluestore_compression_threads");
+  dout(10) << __func__ << " " << num << " compress threads" << dendl;
+  assert(compress_threads.empty());
+  for (int64_t i = 0; i < num; ++i) {
+    CompressThread *t = new CompressThread(this);
+    compress_threads.push_back(t);
+    t->create("bstore_compress");
+  }
+  comp_dict_finisher = new Finisher(cct, "compress_dict", "bstore_dict");
+  comp_dict_finisher->start();
+}
+
+void BlueStore::_compress_stop()
+{
+  comp_dict_finisher->wait_for_empty();
+  comp_dict_finisher->stop();
+  delete comp_dict_finisher;
+  comp_dict_finisher = nullptr;
+  {
+    std::lock_guard<std::mutex> l(compress_lock);
+    compress_stop = true;
+    compress_cond.notify_all();
+  }
+  for (auto t : compress_threads) {
+    t->join();
+    delete t;
+  }
+  compress_threads.clear();
+  std::lock_guard<std::mutex> l(compress_lock);
+  assert(compress_queue.empty());
+  compress_stop = false;
+}
+
+void BlueStore::_compress_thread()
+{
+  std::unique_lock<std::mutex> l(compress_lock);
+  while (true) {
+    if (compress_queue.empty()) {
+      if (compress_stop)
+	break;
+      compress_cond.wait(l);
+      continue;
+    }
+    CompressBatch *b = compress_queue.front();
+    ++b->workers;
+    l.unlock();
+    while (b->run_one()) ;
+    l.lock();
+    // every job is claimed; the first thread back retires the batch
+    if (!compress_queue.empty() && compress_queue.front() == b) {
+      compress_queue.pop_front();
+    }
+    if (--b->workers == 0) {
+      compress_done_cond.notify_all();
+    }
+  }
+}
+
+void BlueStore::_compress_batch(CompressBatch *b)
+{
+  if (compress_threads.empty() || b->jobs.size() < 2) {
+    while (b->run_one()) ;
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> l(compress_lock);
+    compress_queue.push_back(b);
+  }
+  if (b->jobs.size() - 1 < compress_threads.size()) {
+    for (size_t i = 1; i < b->jobs.size(); ++i) {
+      compress_cond.notify_one();
+    }
+  } else {
+    compress_cond.notify_all();
+  }
+  // do our share rather than sleep
+  while (b->run_one()) ;
+  // the jobs the compress threads claimed are done once they all let go
+  std::unique_lock<std::mutex> l(compress_lock);
+  auto p = std::find(compress_queue.begin(), compress_queue.end(), b);
+  if (p != compress_queue.end()) {
+    compress_queue.erase(p);
+  }
+  compress_done_cond.wait(l, [b] { return b->workers == 0; });
+}
+
+int BlueStore::_open_compress_dicts()
+{
+  std::lock_guard<std::mutex> l(comp_dict_lock);
+  comp_dicts.clear();
+  comp_pool_dicts.clear();
+  comp_dict_last_id = 0;
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_COMPRESS_DICT);
+  map<int64_t, bluestore_compression_dict_t> newest;
+  for (it->lower_bound(string()); it->valid(); it->next()) {
+    uint32_t id;
+    _key_decode_u32(it->key().c_str(), &id);
+    bluestore_compression_dict_t cd;
+    bufferlist bl = it->value();
+    bufferlist::iterator p = bl.begin();
+    try {
+      ::decode(cd, p);
+    } catch (buffer::error& e) {
+      derr << __func__ << " failed to decode compression dict " << id << dendl;
+      return -EIO;
+    }
+    // ids only grow, so the last one seen for a pool is its newest
+    comp_dict_last_id = id;
+    comp_pool_dicts[cd.pool].id = id;
+    newest[cd.pool] = cd;
+  }
+  // older dictionaries are only needed to read old blobs; load them lazily
+  for (auto& p : newest) {
+    uint32_t id = comp_pool_dicts[p.first].id;
+    CompressorRef c = Compressor::create(cct, p.second.type);
+    Compressor::DictionaryRef d;
+    if (c) {
+      d = c->load_dictionary(p.second.data);
+    }
+    if (!d) {
+      // keep going, we may never need it; blobs using it fail to read
+      derr << __func__ << " unable to load compression dict " << id
+	   << " of pool " << p.first << dendl;
+      comp_pool_dicts[p.first].id = 0;
+      continue;
+    }
+    comp_dicts[id] = CompressDict{p.second.type, d};
+    dout(10) << __func__ << " pool " << p.first << " dict " << id
+	     << " type " << (int)p.second.type << " len "
+	     << p.second.data.length() << dendl;
+  }
+  return 0;
+}
+
+void BlueStore::_close_compress_dicts()
+{
+  std::lock_guard<std::mutex> l(comp_dict_lock);
+  comp_dicts.clear();
+  comp_pool_dicts.clear();
+}
+
+Compressor::DictionaryRef BlueStore::_get_compress_dict(
+  CompressorRef c,
+  int64_t pool,
+  const bufferlist& bl,
+  uint32_t *id)
+{
+  Compressor::DictionaryRef d;
+  *id = 0;
+  std::lock_guard<std::mutex> l(comp_dict_lock);
+  CompressPoolDict& pd = comp_pool_dicts[pool];
+  if (pd.id) {
+    auto p = comp_dicts.find(pd.id);
+    if (p != comp_dicts.end() && p->second.type == (int)c->get_type()) {
+      d = p->second.dict;
+      *id = pd.id;
+      ++pd.blobs;
+    }
+  }
+  uint64_t retrain = comp_dict_retrain_blobs;
+  if (pd.training || (*id && (!retrain || pd.blobs < retrain))) {
+    return d;
+  }
+  // sample until there is enough to (re)train on
+  pd.samples.push_back(bl);
+  pd.sample_bytes += bl.length();
+  if (pd.sample_bytes >=
+      cct->_conf->get_val<uint64_t>("bluestore_compression_dict_sample_bytes")) {
+    dout(10) << __func__ << " pool " << pool << " training on "
+	     << pd.samples.size() << " samples, " << pd.sample_bytes
+	     << " bytes" << dendl;
+    pd.training = true;
+    vector<bufferlist> samples;
+    samples.swap(pd.samples);
+    pd.sample_bytes = 0;
+    comp_dict_finisher->queue(new FunctionContext(
+      [this, c, pool, samples](int r) mutable {
+	_train_compress_dict(c, pool, samples);
+      }));
+  }
+  return d;
+}
+
+Compressor::DictionaryRef BlueStore::_load_compress_dict(
+  CompressorRef c,
+  uint32_t id)
+{
+  {
+    std::lock_guard<std::mutex> l(comp_dict_lock);
+    auto p = comp_dicts.find(id);
+    if (p != comp_dicts.end()) {
+      return p->second.dict;
+    }
+  }
+  string key;
+  _key_encode_u32(id, &key);
+  bufferlist bl;
+  int r = db->get(PREFIX_COMPRESS_DICT, key, &bl);
+  if (r < 0) {
+    derr << __func__ << " compression dict " << id << " not found" << dendl;
+    return Compressor::DictionaryRef();
+  }
+  bluestore_compression_dict_t cd;
+  bufferlist::iterator p = bl.begin();
+  try {
+    ::decode(cd, p);
+  } catch (buffer::error& e) {
+    derr << __func__ << " failed to decode compression dict " << id << dendl;
+    return Compressor::DictionaryRef();
+  }
+  if (cd.type != c->get_type()) {
+    derr << __func__ << " compression dict " << id << " is of type "
+	 << (int)cd.type << ", not " << c->get_type() << dendl;
+    return Compressor::DictionaryRef();
+  }
+  Compressor::DictionaryRef d = c->load_dictionary(cd.data);
+  if (!d) {
+    derr << __func__ << " unable to load compression dict " << id << dendl;
+    return d;
+  }
+  dout(10) << __func__ << " dict " << id << " of pool " << cd.pool << dendl;
+  std::lock_guard<std::mutex> l(comp_dict_lock);
+  return comp_dicts.emplace(id, CompressDict{cd.type, d}).first->second.dict;
+}
+
+void BlueStore::_train_compress_dict(
+  CompressorRef c,
+  int64_t pool,
+  vector<bufferlist>& samples)
+{
+  bluestore_compression_dict_t cd;
+  cd.pool = pool;
+  cd.type = c->get_type();
+  int r = c->train_dictionary(
+    samples,
+    cct->_conf->get_val<uint64_t>("bluestore_compression_dict_size"),
+    &cd.data);
+  Compressor::DictionaryRef d;
+  if (r == 0) {
+    d = c->load_dictionary(cd.data);
+  }
+  if (!d) {
+    dout(5) << __func__ << " pool " << pool << " training failed: "
+	    << cpp_strerror(r) << dendl;
+    std::lock_guard<std::mutex> l(comp_dict_lock);
+    CompressPoolDict& pd = comp_pool_dicts[pool];
+    pd.training = false;
+    pd.blobs = 0;
+    return;
+  }
+
+  uint32_t id;
+  {
+    std::lock_guard<std::mutex> l(comp_dict_lock);
+    id = ++comp_dict_last_id;
+  }
+  // the dictionary must be durable before any blob refers to it
+  string key;
+  _key_encode_u32(id, &key);
+  bufferlist bl;
+  ::encode(cd, bl);
+  KeyValueDB::Transaction t = db->get_transaction();
+  t->set(PREFIX_COMPRESS_DICT, key, bl);
+  r = db->submit_transaction_sync(t);
+
+  std::lock_guard<std::mutex> l(comp_dict_lock);
+  CompressPoolDict& pd = comp_pool_dicts[pool];
+  pd.training = false;
+  pd.blobs = 0;
+  if (r < 0) {
+    derr << __func__ << " failed to store compression dict " << id
+	 << ": " << cpp_strerror(r) << dendl;
+    return;
+  }
+  dout(10) << __func__ << " pool " << pool << " dict " << id
+	   << " len " << cd.data.length() << " replaces " << pd.id << dendl;
+  comp_dicts[id] = CompressDict{cd.type, d};
+  pd.id = id;
+  logger->inc(l_bluestore_compress_dict_trained);
+}
+
 void BlueStore::_kv_sync_thread()
 {
   dout(10) << __func__ << " start" << dendl;
@@ -8260,7 +9055,6 @@ void BlueStore::_kv_sync_thread()
   kv_sync_started = true;
   kv_cond.notify_all();
   while (true) {
-    assert(kv_committing.empty());
     if (kv_queue.empty() &&
 	((deferred_done_queue.empty() && deferred_stable_queue.empty()) ||
 	 !deferred_aggressive)) {
@@ -8270,8 +9064,8 @@ void BlueStore::_kv_sync_thread()
       kv_cond.wait(l);
       dout(20) << __func__ << " wake" << dendl;
     } else {
+      KVSyncBatch *b = new KVSyncBatch;
       deque<TransContext*> kv_submitting;
-      deque<DeferredBatch*> deferred_done, deferred_stable;
       uint64_t aios = 0, costs = 0;
 
       dout(20) << __func__ << " committing " << kv_queue.size()
@@ -8279,21 +9073,22 @@ void BlueStore::_kv_sync_thread()
 	       << " deferred done " << deferred_done_queue.size()
 	       << " stable " << deferred_stable_queue.size()
 	       << dendl;
-      kv_committing.swap(kv_queue);
+      b->committing.swap(kv_queue);
       kv_submitting.swap(kv_queue_unsubmitted);
-      deferred_done.swap(deferred_done_queue);
-      deferred_stable.swap(deferred_stable_queue);
+      b->deferred_done.swap(deferred_done_queue);
+      b->deferred_stable.swap(deferred_stable_queue);
       aios = kv_ios;
       costs = kv_throttle_costs;
       kv_ios = 0;
       kv_throttle_costs = 0;
-      utime_t start = ceph_clock_now();
+      b->start = ceph_clock_now();
       l.unlock();
 
-      dout(30) << __func__ << " committing " << kv_committing << dendl;
+      dout(30) << __func__ << " committing " << b->committing << dendl;
       dout(30) << __func__ << " submitting " << kv_submitting << dendl;
-      dout(30) << __func__ << " deferred_done " << deferred_done << dendl;
-      dout(30) << __func__ << " deferred_stable " << deferred_stable << dendl;
+      dout(30) << __func__ << " deferred_done " << b->deferred_done << dendl;
+      dout(30) << __func__ << " deferred_stable " << b->deferred_stable
+	       << dendl;
 
       bool force_flush = false;
       // if bluefs is sharing the same device as data (only), then we
@@ -8303,8 +9098,8 @@ void BlueStore::_kv_sync_thread()
       if (bluefs_single_shared_device && bluefs) {
 	if (aios) {
 	  force_flush = true;
-	} else if (kv_committing.empty() && kv_submitting.empty() &&
-		   deferred_stable.empty()) {
+	} else if (b->committing.empty() && kv_submitting.empty() &&
+		   b->deferred_stable.empty()) {
 	  force_flush = true;  // there's nothing else to commit!
 	} else if (deferred_aggressive) {
 	  force_flush = true;
@@ -8320,40 +9115,42 @@ void BlueStore::_kv_sync_thread()
 	bdev->flush();
 
 	// if we flush then deferred done are now deferred stable
-	deferred_stable.insert(deferred_stable.end(), deferred_done.begin(),
-			       deferred_done.end());
-	deferred_done.clear();
+	b->deferred_stable.insert(b->deferred_stable.end(),
+				  b->deferred_done.begin(),
+				  b->deferred_done.end());
+	b->deferred_done.clear();
       }
-      utime_t after_flush = ceph_clock_now();
+      b->after_flush = ceph_clock_now();
 
       // we will use one final transaction to force a sync
-      KeyValueDB::Transaction synct = db->get_transaction();
+      b->synct = db->get_transaction();
+      KeyValueDB::Transaction synct = b->synct;
 
       // increase {nid,blobid}_max?  note that this covers both the
       // case where we are approaching the max and the case we passed
       // it.  in either case, we increase the max in the earlier txn
       // we submit.
-      uint64_t new_nid_max = 0, new_blobid_max = 0;
       if (nid_last + cct->_conf->bluestore_nid_prealloc/2 > nid_max) {
 	KeyValueDB::Transaction t =
 	  kv_submitting.empty() ? synct : kv_submitting.front()->t;
-	new_nid_max = nid_last + cct->_conf->bluestore_nid_prealloc;
+	b->new_nid_max = nid_last + cct->_conf->bluestore_nid_prealloc;
 	bufferlist bl;
-	::encode(new_nid_max, bl);
+	::encode(b->new_nid_max, bl);
 	t->set(PREFIX_SUPER, "nid_max", bl);
-	dout(10) << __func__ << " new_nid_max " << new_nid_max << dendl;
+	dout(10) << __func__ << " new_nid_max " << b->new_nid_max << dendl;
       }
       if (blobid_last + cct->_conf->bluestore_blobid_prealloc/2 > blobid_max) {
 	KeyValueDB::Transaction t =
 	  kv_submitting.empty() ? synct : kv_submitting.front()->t;
-	new_blobid_max = blobid_last + cct->_conf->bluestore_blobid_prealloc;
+	b->new_blobid_max = blobid_last + cct->_conf->bluestore_blobid_prealloc;
 	bufferlist bl;
-	::encode(new_blobid_max, bl);
+	::encode(b->new_blobid_max, bl);
 	t->set(PREFIX_SUPER, "blobid_max", bl);
-	dout(10) << __func__ << " new_blobid_max " << new_blobid_max << dendl;
+	dout(10) << __func__ << " new_blobid_max " << b->new_blobid_max
+		 << dendl;
       }
 
-      for (auto txc : kv_committing) {
+      for (auto txc : b->committing) {
 	if (txc->state == TransContext::STATE_KV_QUEUED) {
 	  txc->log_state_latency(logger, l_bluestore_state_kv_queued_lat);
 	  int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction(txc->t);
@@ -8385,15 +9182,21 @@ void BlueStore::_kv_sync_thread()
       // transaction is ready for commit.
       throttle_bytes.put(costs);
 
-      PExtentVector bluefs_gift_extents;
-      if (bluefs &&
-	  after_flush - bluefs_last_balance >
+      // the bluefs usage we balance against is only accurate once any
+      // earlier gift or reclaim has committed, so do not overlap those.
+      bool can_balance = true;
+      if (kv_pipeline_depth) {
+	std::lock_guard<std::mutex> m(kv_commit_lock);
+	can_balance = kv_commit_in_flight == 0;
+      }
+      if (bluefs && can_balance &&
+	  b->after_flush - bluefs_last_balance >
 	  cct->_conf->bluestore_bluefs_balance_interval) {
-	bluefs_last_balance = after_flush;
-	int r = _balance_bluefs_freespace(&bluefs_gift_extents);
+	bluefs_last_balance = b->after_flush;
+	int r = _balance_bluefs_freespace(&b->bluefs_gift_extents);
 	assert(r >= 0);
 	if (r > 0) {
-	  for (auto& p : bluefs_gift_extents) {
+	  for (auto& p : b->bluefs_gift_extents) {
 	    bluefs_extents.insert(p.offset, p.length);
 	  }
 	  bufferlist bl;
@@ -8403,10 +9206,11 @@ void BlueStore::_kv_sync_thread()
 	  synct->set(PREFIX_SUPER, "bluefs_extents", bl);
 	}
       }
+      b->bluefs_extents_reclaiming.swap(bluefs_extents_reclaiming);
 
       // cleanup sync deferred keys
-      for (auto b : deferred_stable) {
-	for (auto& txc : b->txcs) {
+      for (auto dbatch : b->deferred_stable) {
+	for (auto& txc : dbatch->txcs) {
 	  bluestore_deferred_transaction_t& wt = *txc.deferred_txn;
 	  if (!wt.released.empty()) {
 	    // kraken replay compat only
@@ -8423,107 +9227,187 @@ void BlueStore::_kv_sync_thread()
 	}
       }
 
-      // submit synct synchronously (block and wait for it to commit)
-      int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction_sync(synct);
-      assert(r == 0);
+      b->submitted = ceph_clock_now();
+      logger->hinc(l_bluestore_kv_submit_lat_hist,
+		   (b->submitted - b->start).to_nsec(),
+		   b->committing.size());
 
-      if (new_nid_max) {
-	nid_max = new_nid_max;
-	dout(10) << __func__ << " nid_max now " << nid_max << dendl;
-      }
-      if (new_blobid_max) {
-	blobid_max = new_blobid_max;
-	dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
+      if (kv_pipeline_depth) {
+	// let the commit thread wait for the sync while we go around
+	// again and submit the next batch
+	std::unique_lock<std::mutex> m(kv_commit_lock);
+	while (kv_commit_in_flight >= kv_pipeline_depth) {
+	  kv_commit_cond.wait(m);
+	}
+	++kv_commit_in_flight;
+	kv_commit_queue.push_back(b);
+	kv_commit_cond.notify_all();
+      } else {
+	_kv_sync_batch(b);
       }
 
-      {
-	utime_t finish = ceph_clock_now();
-	utime_t dur_flush = after_flush - start;
-	utime_t dur_kv = finish - after_flush;
-	utime_t dur = finish - start;
-	dout(20) << __func__ << " committed " << kv_committing.size()
-	  << " cleaned " << deferred_stable.size()
-	  << " in " << dur
-	  << " (" << dur_flush << " flush + " << dur_kv << " kv commit)"
-	  << dendl;
-	logger->tinc(l_bluestore_kv_flush_lat, dur_flush);
-	logger->tinc(l_bluestore_kv_commit_lat, dur_kv);
-	logger->tinc(l_bluestore_kv_lat, dur);
-      }
+      l.lock();
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+  kv_sync_started = false;
+}
 
-      if (bluefs) {
-	if (!bluefs_gift_extents.empty()) {
-	  _commit_bluefs_freespace(bluefs_gift_extents);
-	}
-	for (auto p = bluefs_extents_reclaiming.begin();
-	     p != bluefs_extents_reclaiming.end();
-	     ++p) {
-	  dout(20) << __func__ << " releasing old bluefs 0x" << std::hex
-		   << p.get_start() << "~" << p.get_len() << std::dec
-		   << dendl;
-	  alloc->release(p.get_start(), p.get_len());
-	}
-	bluefs_extents_reclaiming.clear();
-      }
+void BlueStore::_kv_sync_batch(KVSyncBatch *b)
+{
+  utime_t sync_start = ceph_clock_now();
+  logger->hinc(l_bluestore_kv_sync_wait_lat_hist,
+	       (sync_start - b->submitted).to_nsec(),
+	       b->committing.size());
 
-      {
-	std::unique_lock<std::mutex> m(kv_finalize_lock);
-	if (kv_committing_to_finalize.empty()) {
-	  kv_committing_to_finalize.swap(kv_committing);
-	} else {
-	  kv_committing_to_finalize.insert(
-	    kv_committing_to_finalize.end(),
-	    kv_committing.begin(),
-	    kv_committing.end());
-	  kv_committing.clear();
-	}
-	if (deferred_stable_to_finalize.empty()) {
-	  deferred_stable_to_finalize.swap(deferred_stable);
-	} else {
-	  deferred_stable_to_finalize.insert(
-	    deferred_stable_to_finalize.end(),
-	    deferred_stable.begin(),
-	    deferred_stable.end());
-          deferred_stable.clear();
-	}
-	kv_finalize_cond.notify_one();
+  // submit synct synchronously (block and wait for it to commit)
+  int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction_sync(b->synct);
+  assert(r == 0);
+
+  if (b->new_nid_max) {
+    nid_max = b->new_nid_max;
+    dout(10) << __func__ << " nid_max now " << nid_max << dendl;
+  }
+  if (b->new_blobid_max) {
+    blobid_max = b->new_blobid_max;
+    dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
+  }
+
+  {
+    utime_t finish = ceph_clock_now();
+    utime_t dur_flush = b->after_flush - b->start;
+    utime_t dur_kv = finish - b->after_flush;
+    utime_t dur = finish - b->start;
+    dout(20) << __func__ << " committed " << b->committing.size()
+	     << " cleaned " << b->deferred_stable.size()
+	     << " in " << dur
+	     << " (" << dur_flush << " flush + " << dur_kv << " kv commit)"
+	     << dendl;
+    logger->tinc(l_bluestore_kv_flush_lat, dur_flush);
+    logger->tinc(l_bluestore_kv_commit_lat, dur_kv);
+    logger->tinc(l_bluestore_kv_lat, dur);
+    logger->hinc(l_bluestore_kv_sync_lat_hist,
+		 (finish - sync_start).to_nsec(),
+		 b->committing.size());
+  }
+
+  if (bluefs) {
+    if (!b->bluefs_gift_extents.empty()) {
+      _commit_bluefs_freespace(b->bluefs_gift_extents);
+    }
+    for (auto p = b->bluefs_extents_reclaiming.begin();
+	 p != b->bluefs_extents_reclaiming.end();
+	 ++p) {
+      dout(20) << __func__ << " releasing old bluefs 0x" << std::hex
+	       << p.get_start() << "~" << p.get_len() << std::dec
+	       << dendl;
+      alloc->release(p.get_start(), p.get_len());
+    }
+  }
+
+  _kv_queue_finalize(b);
+
+  {
+    std::lock_guard<std::mutex> l(kv_lock);
+    // previously deferred "done" are now "stable" by virtue of this
+    // commit cycle.
+    if (!b->deferred_done.empty()) {
+      deferred_stable_queue.insert(deferred_stable_queue.end(),
+				   b->deferred_done.begin(),
+				   b->deferred_done.end());
+      if (kv_pipeline_depth) {
+	kv_cond.notify_one();
       }
+    }
+  }
+  delete b;
+}
 
+void BlueStore::_kv_commit_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock<std::mutex> l(kv_commit_lock);
+  assert(!kv_commit_started);
+  kv_commit_started = true;
+  kv_commit_cond.notify_all();
+  while (true) {
+    if (kv_commit_queue.empty()) {
+      if (kv_commit_stop)
+	break;
+      dout(20) << __func__ << " sleep" << dendl;
+      kv_commit_cond.wait(l);
+      dout(20) << __func__ << " wake" << dendl;
+    } else {
+      // batches are synced strictly in submit order; each sync also
+      // covers everything submitted before it.
+      KVSyncBatch *b = kv_commit_queue.front();
+      kv_commit_queue.pop_front();
+      l.unlock();
+      _kv_sync_batch(b);
       l.lock();
-      // previously deferred "done" are now "stable" by virtue of this
-      // commit cycle.
-      deferred_stable_queue.swap(deferred_done);
+      --kv_commit_in_flight;
+      kv_commit_cond.notify_all();
     }
   }
   dout(10) << __func__ << " finish" << dendl;
-  kv_sync_started = false;
+  kv_commit_started = false;
+}
+
+void BlueStore::_kv_queue_finalize(KVSyncBatch *b)
+{
+  // an OpSequencer always lands on the same finalize thread, so its
+  // txcs and deferred batches are still finalized in commit order.
+  unsigned n = kv_finalize_shards.size();
+  for (unsigned i = 0; i < n; ++i) {
+    KVFinalizeShard *s = kv_finalize_shards[i];
+    bool queued = false;
+    std::lock_guard<std::mutex> l(s->lock);
+    for (auto txc : b->committing) {
+      if (txc->osr->finalize_seq % n == i) {
+	s->kv_committed.push_back(txc);
+	queued = true;
+      }
+    }
+    for (auto dbatch : b->deferred_stable) {
+      if (dbatch->osr->finalize_seq % n == i) {
+	s->deferred_stable.push_back(dbatch);
+	queued = true;
+      }
+    }
+    if (queued) {
+      s->cond.notify_one();
+    }
+  }
 }
 
-void BlueStore::_kv_finalize_thread()
+void BlueStore::_kv_finalize_thread(unsigned shard)
 {
+  KVFinalizeShard *s = kv_finalize_shards[shard];
   deque<TransContext*> kv_committed;
   deque<DeferredBatch*> deferred_stable;
-  dout(10) << __func__ << " start" << dendl;
-  std::unique_lock<std::mutex> l(kv_finalize_lock);
-  assert(!kv_finalize_started);
-  kv_finalize_started = true;
-  kv_finalize_cond.notify_all();
+  dout(10) << __func__ << " " << shard << " start" << dendl;
+  std::unique_lock<std::mutex> l(s->lock);
+  assert(!s->started);
+  s->started = true;
+  s->cond.notify_all();
   while (true) {
     assert(kv_committed.empty());
     assert(deferred_stable.empty());
-    if (kv_committing_to_finalize.empty() &&
-	deferred_stable_to_finalize.empty()) {
-      if (kv_finalize_stop)
+    if (s->kv_committed.empty() &&
+	s->deferred_stable.empty()) {
+      if (s->stop)
 	break;
       dout(20) << __func__ << " sleep" << dendl;
-      kv_finalize_cond.wait(l);
+      s->cond.wait(l);
       dout(20) << __func__ << " wake" << dendl;
     } else {
-      kv_committed.swap(kv_committing_to_finalize);
-      deferred_stable.swap(deferred_stable_to_finalize);
+      kv_committed.swap(s->kv_committed);
+      deferred_stable.swap(s->deferred_stable);
       l.unlock();
       dout(20) << __func__ << " kv_committed " << kv_committed << dendl;
       dout(20) << __func__ << " deferred_stable " << deferred_stable << dendl;
+      utime_t start = ceph_clock_now();
+      size_t num = kv_committed.size();
 
       while (!kv_committed.empty()) {
 	TransContext *txc = kv_committed.front();
@@ -8553,11 +9437,14 @@ void BlueStore::_kv_finalize_thread()
       // this is as good a place as any ...
       _reap_collections();
 
+      logger->hinc(l_bluestore_kv_finalize_lat_hist,
+		   (ceph_clock_now() - start).to_nsec(), num);
+
       l.lock();
     }
   }
-  dout(10) << __func__ << " finish" << dendl;
-  kv_finalize_started = false;
+  dout(10) << __func__ << " " << shard << " finish" << dendl;
+  s->started = false;
 }
 
 bluestore_deferred_op_t *BlueStore::_get_deferred_op(
@@ -9815,6 +10702,70 @@ int BlueStore::_do_alloc_write(
     }
   );
 
+  // objects whose recent blobs didn't compress are left alone for a
+  // while, with exponential back-off
+  bool backoff = false;
+  if (c && o->comp_skip) {
+    --o->comp_skip;
+    backoff = true;
+    dout(20) << __func__ << " compression backed off, " << o->comp_skip
+	     << " more writes" << dendl;
+  }
+  auto compress_failed = [&]() {
+    uint64_t after = comp_backoff;
+    if (!after) {
+      return;
+    }
+    if (o->comp_failed < std::numeric_limits<uint16_t>::max()) {
+      ++o->comp_failed;
+    }
+    if (o->comp_failed >= after) {
+      unsigned n = std::min<unsigned>(o->comp_failed - after, 15);
+      o->comp_skip = std::min<uint64_t>(1u << n, comp_backoff_max);
+    }
+  };
+
+  // compress all the blobs up front, in parallel on the compress
+  // threads if there are several
+  CompressBatch cbatch;
+  if (c) {
+    cbatch.c = c;
+    // small blobs of pools can use a dictionary trained on their data
+    uint64_t dict_max = comp_dict_max_blob_size;
+    spg_t pgid;
+    bool use_dict = dict_max && c->supports_dictionaries() &&
+      coll->cid.is_pg(&pgid);
+    for (auto& wi : wctx->writes) {
+      if (wi.blob_length > min_alloc_size) {
+	assert(wi.b_off == 0);
+	assert(wi.blob_length == wi.bl.length());
+	if (backoff) {
+	  logger->inc(l_bluestore_compress_skipped_bytes, wi.blob_length);
+	  continue;
+	}
+	if (comp_estimate) {
+	  double ratio = Compressor::estimate_ratio(wi.bl);
+	  if (ratio > crr) {
+	    dout(20) << __func__ << std::hex << "  0x" << wi.blob_length
+		     << std::dec << " estimated to compress to " << ratio
+		     << ", leaving uncompressed" << dendl;
+	    logger->inc(l_bluestore_compress_skipped_bytes, wi.blob_length);
+	    compress_failed();
+	    continue;
+	  }
+	}
+	logger->inc(l_bluestore_compress_attempted_bytes, wi.blob_length);
+	cbatch.jobs.emplace_back(&wi.bl);
+	if (use_dict && wi.blob_length <= dict_max) {
+	  CompressJob& j = cbatch.jobs.back();
+	  j.dict = _get_compress_dict(c, pgid.pool(), wi.bl, &j.dict_id);
+	}
+      }
+    }
+    _compress_batch(&cbatch);
+  }
+  auto cjob = cbatch.jobs.begin();
+
   for (auto& wi : wctx->writes) {
     BlobRef b = wi.b;
     bluestore_blob_t& dblob = b->dirty_blob();
@@ -9825,20 +10776,14 @@ int BlueStore::_do_alloc_write(
     unsigned csum_order = block_size_order;
     bufferlist compressed_bl;
     bool compressed = false;
-    if(c && wi.blob_length > min_alloc_size) {
-
-      utime_t start = ceph_clock_now();
-
-      // compress
-      assert(b_off == 0);
-      assert(wi.blob_length == l->length());
+    if (cjob != cbatch.jobs.end() && cjob->in == l) {
       bluestore_compression_header_t chdr;
       chdr.type = c->get_type();
+      chdr.dict_id = cjob->dict_id;
       // FIXME: memory alignment here is bad
-      bufferlist t;
+      bufferlist& t = cjob->out;
 
-      r = c->compress(*l, t);
-      assert(r == 0);
+      assert(cjob->r == 0);
 
       chdr.length = t.length();
       ::encode(chdr, compressed_bl);
@@ -9866,6 +10811,10 @@ int BlueStore::_do_alloc_write(
 	dblob.set_compressed(wi.blob_length, rawlen);
 	compressed = true;
         logger->inc(l_bluestore_compress_success_count);
+	o->comp_failed = 0;
+	if (chdr.dict_id) {
+	  logger->inc(l_bluestore_compress_dict_count);
+	}
       } else {
 	dout(20) << __func__ << std::hex << "  0x" << l->length()
 		 << " compressed to 0x" << rawlen << " -> 0x" << newlen
@@ -9875,9 +10824,10 @@ int BlueStore::_do_alloc_write(
                  << ", leaving uncompressed"
                  << std::dec << dendl;
         logger->inc(l_bluestore_compress_rejected_count);
+	compress_failed();
       }
-      logger->tinc(l_bluestore_compress_lat,
-		   ceph_clock_now() - start);
+      logger->tinc(l_bluestore_compress_lat, cjob->lat);
+      ++cjob;
     }
     if (!compressed && wi.new_blob) {
       // initialize newly created blob only
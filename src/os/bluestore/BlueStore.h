@@ -60,6 +60,10 @@ enum {
   l_bluestore_kv_flush_lat,
   l_bluestore_kv_commit_lat,
   l_bluestore_kv_lat,
+  l_bluestore_kv_submit_lat_hist,
+  l_bluestore_kv_sync_wait_lat_hist,
+  l_bluestore_kv_sync_lat_hist,
+  l_bluestore_kv_finalize_lat_hist,
   l_bluestore_state_prepare_lat,
   l_bluestore_state_aio_wait_lat,
   l_bluestore_state_io_done_lat,
@@ -82,6 +86,10 @@ enum {
   l_bluestore_csum_lat,
   l_bluestore_compress_success_count,
   l_bluestore_compress_rejected_count,
+  l_bluestore_compress_dict_count,
+  l_bluestore_compress_dict_trained,
+  l_bluestore_compress_attempted_bytes,
+  l_bluestore_compress_skipped_bytes,
   l_bluestore_write_pad_bytes,
   l_bluestore_deferred_write_ops,
   l_bluestore_deferred_write_bytes,
@@ -102,6 +110,8 @@ enum {
   l_bluestore_buffer_bytes,
   l_bluestore_buffer_hit_bytes,
   l_bluestore_buffer_miss_bytes,
+  l_bluestore_cache_lock_contended,
+  l_bluestore_cache_clock_spared,
   l_bluestore_write_big,
   l_bluestore_write_big_bytes,
   l_bluestore_write_big_blobs,
@@ -627,6 +637,10 @@ public:
       uint64_t struct_v,
       uint64_t* sbid,
       bool include_ref_map);
+    /// advance p past a blob encoded without its ref map
+    static void skip(
+      bufferptr::iterator& p,
+      uint64_t struct_v);
 #endif
   };
   typedef boost::intrusive_ptr<Blob> BlobRef;
@@ -734,6 +748,7 @@ public:
       unsigned extents = 0;  ///< count extents in this shard
       bool loaded = false;   ///< true if shard is loaded
       bool dirty = false;    ///< true if shard is dirty and needs reencoding
+      bufferlist encoded;    ///< on-disk encoding, if read lazily (!loaded)
     };
     mempool::bluestore_cache_other::vector<Shard> shards;    ///< shards
 
@@ -777,6 +792,57 @@ public:
 		     unsigned *pn);
     unsigned decode_some(bufferlist& bl);
 
+    /// cursor over the extents of an encoded shard; never allocates
+    class ShardView {
+    public:
+      struct Item {
+	uint32_t logical_offset = 0;
+	uint32_t blob_offset = 0;
+	uint32_t length = 0;
+	int spanning_blob_id = -1;  ///< >= 0 if the blob is spanning
+	unsigned blob_index = 0;    ///< else, extent that encodes the blob
+	bool blob_here = false;     ///< the blob is encoded with this extent
+	uint32_t blob_pos = 0;      ///< if so, its byte offset in the shard
+      };
+
+      explicit ShardView(const bufferptr& bp);
+
+      /// decode the next extent; false at the end of the shard
+      bool next(Item *item);
+
+      /// byte offset of the blob encoded with extent n
+      uint32_t find_blob(unsigned n) const;
+
+      uint8_t get_struct_v() const {
+	return struct_v;
+      }
+
+    private:
+      const bufferptr& bp;
+      bufferptr::iterator p;
+      __u8 struct_v = 0;
+      unsigned n = 0;
+      uint64_t pos = 0;
+      uint64_t prev_len = 0;
+    };
+
+    /// decode the blob at pos of an encoded shard, for reading only
+    BlobRef decode_view_blob(const bufferptr& bp, uint32_t pos,
+			     uint8_t struct_v);
+
+    /**
+     * call f(logical_offset, blob_offset, length, blob) for each extent
+     * in a range, in order, until it returns false
+     *
+     * Extents of shards that are not loaded are read straight from the
+     * encoded shard (kept in Shard::encoded) and only the blobs they
+     * reference are decoded; the shard stays unloaded.  The blobs of
+     * such extents are not part of the extent map.
+     */
+    template <typename F>
+    void lazy_map_range(KeyValueDB *db, uint32_t offset, uint32_t length,
+			F&& f);
+
     void bound_encode_spanning_blobs(size_t& p);
     void encode_spanning_blobs(bufferlist::contiguous_appender& p);
     void decode_spanning_blobs(bufferptr::iterator& p);
@@ -836,6 +902,9 @@ public:
       return true;
     }
 
+    /// read the encoded shard from the db
+    void read_shard(KeyValueDB *db, const Shard& shard, bufferlist *v);
+
     /// ensure that a range of the map is loaded
     void fault_range(KeyValueDB *db,
 		     uint32_t offset, uint32_t length);
@@ -1007,6 +1076,12 @@ public:
 
     bluestore_onode_t onode;  ///< metadata stored as value in kv store
     bool exists;              ///< true if object logically exists
+    std::atomic<bool> cache_ref = {false};  ///< touched since last CLOCK sweep
+
+    /// compression back-off: blobs that failed to compress in a row, and
+    /// writes left to store uncompressed before trying again
+    uint16_t comp_failed = 0;
+    uint16_t comp_skip = 0;
 
     ExtentMap extent_map;
 
@@ -1052,6 +1127,21 @@ public:
     Cache(CephContext* cct) : cct(cct), logger(nullptr) {}
     virtual ~Cache() {}
 
+    /// take lock, counting the acquisitions that had to wait for it
+    std::unique_lock<std::recursive_mutex> counted_lock() {
+      std::unique_lock<std::recursive_mutex> l(lock, std::try_to_lock);
+      if (!l.owns_lock()) {
+	logger->inc(l_bluestore_cache_lock_contended);
+	l.lock();
+      }
+      return l;
+    }
+
+    /// true if _touch_onode may be called without holding lock
+    virtual bool lockless_onode_touch() const {
+      return false;
+    }
+
     virtual void _add_onode(OnodeRef& o, int level) = 0;
     virtual void _rm_onode(OnodeRef& o) = 0;
     virtual void _touch_onode(OnodeRef& o) = 0;
@@ -1287,6 +1377,116 @@ public:
       *bytes += buffer_bytes;
     }
 
+#ifdef DEBUG_CACHE
+    void _audit(const char *s) override;
+#endif
+  };
+
+  /// CLOCK (second chance) cache for onodes and buffers
+  ///
+  /// A hit only sets a reference bit, so onode lookups do not need the
+  /// shard lock at all and buffer hits no longer relink any lists.  The
+  /// work moves to _trim, which sweeps a hand around each ring clearing
+  /// reference bits until it finds unreferenced victims.
+  struct ClockCache : public Cache {
+  private:
+    typedef boost::intrusive::list<
+      Onode,
+      boost::intrusive::member_hook<
+        Onode,
+	boost::intrusive::list_member_hook<>,
+	&Onode::lru_item> > onode_ring_t;
+    typedef boost::intrusive::list<
+      Buffer,
+      boost::intrusive::member_hook<
+	Buffer,
+	boost::intrusive::list_member_hook<>,
+	&Buffer::lru_item> > buffer_ring_t;
+
+    onode_ring_t onode_ring;
+    onode_ring_t::iterator onode_hand;   ///< next onode to examine
+
+    buffer_ring_t buffer_ring;
+    buffer_ring_t::iterator buffer_hand; ///< next buffer to examine
+    uint64_t buffer_size = 0;
+
+  public:
+    ClockCache(CephContext* cct)
+      : Cache(cct),
+	onode_hand(onode_ring.end()),
+	buffer_hand(buffer_ring.end()) {}
+
+    bool lockless_onode_touch() const override {
+      return true;
+    }
+
+    uint64_t _get_num_onodes() override {
+      return onode_ring.size();
+    }
+    void _add_onode(OnodeRef& o, int level) override {
+      // just behind the hand, i.e. the last to be looked at
+      o->cache_ref.store(level > 0, std::memory_order_relaxed);
+      onode_ring.insert(onode_hand, *o);
+    }
+    void _rm_onode(OnodeRef& o) override {
+      auto q = onode_ring.iterator_to(*o);
+      if (q == onode_hand) {
+	onode_hand = onode_ring.erase(q);
+      } else {
+	onode_ring.erase(q);
+      }
+    }
+    void _touch_onode(OnodeRef& o) override {
+      // called without the lock; avoid dirtying the line if already set
+      if (!o->cache_ref.load(std::memory_order_relaxed)) {
+	o->cache_ref.store(true, std::memory_order_relaxed);
+      }
+    }
+
+    uint64_t _get_buffer_bytes() override {
+      return buffer_size;
+    }
+    void _add_buffer(Buffer *b, int level, Buffer *near) override {
+      b->cache_private = level > 0;
+      buffer_ring.insert(buffer_hand, *b);
+      buffer_size += b->length;
+    }
+    void _rm_buffer(Buffer *b) override {
+      assert(buffer_size >= b->length);
+      buffer_size -= b->length;
+      auto q = buffer_ring.iterator_to(*b);
+      if (q == buffer_hand) {
+	buffer_hand = buffer_ring.erase(q);
+      } else {
+	buffer_ring.erase(q);
+      }
+    }
+    void _move_buffer(Cache *src, Buffer *b) override {
+      src->_rm_buffer(b);
+      _add_buffer(b, 0, nullptr);
+    }
+    void _adjust_buffer_size(Buffer *b, int64_t delta) override {
+      assert((int64_t)buffer_size + delta >= 0);
+      buffer_size += delta;
+    }
+    void _touch_buffer(Buffer *b) override {
+      b->cache_private = 1;
+    }
+
+    void _trim(uint64_t onode_max, uint64_t buffer_max) override;
+
+    void add_stats(uint64_t *onodes, uint64_t *extents,
+		   uint64_t *blobs,
+		   uint64_t *buffers,
+		   uint64_t *bytes) override {
+      std::lock_guard<std::recursive_mutex> l(lock);
+      *onodes += onode_ring.size();
+      *extents += num_extents;
+      *blobs += num_blobs;
+      *buffers += buffer_ring.size();
+      *bytes += buffer_size;
+    }
+
 #ifdef DEBUG_CACHE
     void _audit(const char *s) override;
 #endif
@@ -1299,10 +1499,16 @@ public:
     /// forward lookups
     mempool::bluestore_cache_other::unordered_map<ghobject_t,OnodeRef> onode_map;
 
+    /// protects onode_map for lookups that do not take cache->lock (see
+    /// Cache::lockless_onode_touch).  writers hold both, cache->lock first.
+    RWLock map_lock;
+
     friend class Collection; // for split_cache()
 
   public:
-    OnodeSpace(Cache *c) : cache(c) {}
+    OnodeSpace(Cache *c)
+      : cache(c),
+	map_lock("BlueStore::OnodeSpace::map_lock", false, false) {}
     ~OnodeSpace() {
       clear();
     }
@@ -1310,8 +1516,10 @@ public:
     OnodeRef add(const ghobject_t& oid, OnodeRef o);
     OnodeRef lookup(const ghobject_t& o);
     void remove(const ghobject_t& oid) {
+      RWLock::WLocker l(map_lock);
       onode_map.erase(oid);
     }
+    bool evict(Onode *o);
     void rename(OnodeRef& o, const ghobject_t& old_oid,
 		const ghobject_t& new_oid,
 		const mempool::bluestore_cache_other::string& new_okey);
@@ -1664,6 +1872,8 @@ public:
     std::atomic_bool registered = {true}; ///< registered in BlueStore's osr_set
     std::atomic_bool zombie = {false};    ///< owning Sequencer has gone away
 
+    unsigned finalize_seq = 0;  ///< picks our kv finalize thread
+
     OpSequencer(CephContext* cct, BlueStore *store)
       : Sequencer_impl(cct),
 	parent(NULL), store(store) {
@@ -1772,15 +1982,92 @@ public:
       return NULL;
     }
   };
+  struct KVCommitThread : public Thread {
+    BlueStore *store;
+    explicit KVCommitThread(BlueStore *s) : store(s) {}
+    void *entry() override {
+      store->_kv_commit_thread();
+      return NULL;
+    }
+  };
   struct KVFinalizeThread : public Thread {
     BlueStore *store;
-    explicit KVFinalizeThread(BlueStore *s) : store(s) {}
+    unsigned shard;
+    KVFinalizeThread(BlueStore *s, unsigned i) : store(s), shard(i) {}
     void *entry() {
-      store->_kv_finalize_thread();
+      store->_kv_finalize_thread(shard);
+      return NULL;
+    }
+  };
+
+  /// one kv_sync_thread cycle: everything that becomes durable (and is
+  /// finalized) with a single synchronous kv commit
+  struct KVSyncBatch {
+    deque<TransContext*> committing;
+    deque<DeferredBatch*> deferred_done;    ///< stable once synct commits
+    deque<DeferredBatch*> deferred_stable;  ///< cleaned up by synct
+    KeyValueDB::Transaction synct;
+    uint64_t new_nid_max = 0;
+    uint64_t new_blobid_max = 0;
+    PExtentVector bluefs_gift_extents;
+    interval_set<uint64_t> bluefs_extents_reclaiming;
+    utime_t start, after_flush, submitted;
+  };
+
+  /// finalize work for the OpSequencers that hash to one thread
+  struct KVFinalizeShard {
+    KVFinalizeThread thread;
+    std::mutex lock;
+    std::condition_variable cond;
+    bool started = false;
+    bool stop = false;
+    deque<TransContext*> kv_committed;     ///< pending finalization
+    deque<DeferredBatch*> deferred_stable; ///< pending finalization
+    KVFinalizeShard(BlueStore *s, unsigned i) : thread(s, i) {}
+  };
+
+  struct CompressThread : public Thread {
+    BlueStore *store;
+    explicit CompressThread(BlueStore *s) : store(s) {}
+    void *entry() override {
+      store->_compress_thread();
       return NULL;
     }
   };
 
+  /// one blob of a write to compress
+  struct CompressJob {
+    bufferlist *in;
+    bufferlist out;         ///< compressed data, without the header
+    Compressor::DictionaryRef dict;
+    uint32_t dict_id = 0;   ///< of dict, 0 for none
+    int r = 0;
+    utime_t lat;
+    explicit CompressJob(bufferlist *i) : in(i) {}
+  };
+
+  /// the blobs of one write; the compress threads and the submitting
+  /// thread claim jobs from it until none are left
+  struct CompressBatch {
+    CompressorRef c;
+    vector<CompressJob> jobs;
+    std::atomic<unsigned> next = {0}; ///< next job to claim
+    unsigned workers = 0;             ///< compress threads on it, under compress_lock
+
+    /// compress the next unclaimed job; false if there was none
+    bool run_one() {
+      unsigned i = next++;
+      if (i >= jobs.size()) {
+	return false;
+      }
+      CompressJob& j = jobs[i];
+      utime_t start = ceph_clock_now();
+      j.r = c->compress(*j.in, j.out, j.dict.get());
+      j.lat = ceph_clock_now() - start;
+      return true;
+    }
+  };
+
   struct DBHistogram {
     struct value_dist {
       uint64_t count;
@@ -1829,6 +2116,7 @@ private:
 
   std::mutex osr_lock;              ///< protect osd_set
   std::set<OpSequencerRef> osr_set; ///< set of all OpSequencers
+  unsigned osr_finalize_seq = 0;    ///< spread osrs over kv finalize threads
 
   std::atomic<uint64_t> nid_last = {0};
   std::atomic<uint64_t> nid_max = {0};
@@ -1855,19 +2143,49 @@ private:
   std::condition_variable kv_cond;
   bool kv_sync_started = false;
   bool kv_stop = false;
-  bool kv_finalize_started = false;
-  bool kv_finalize_stop = false;
   deque<TransContext*> kv_queue;             ///< ready, already submitted
   deque<TransContext*> kv_queue_unsubmitted; ///< ready, need submit by kv thread
-  deque<TransContext*> kv_committing;        ///< currently syncing
   deque<DeferredBatch*> deferred_done_queue;   ///< deferred ios done
   deque<DeferredBatch*> deferred_stable_queue; ///< deferred ios done + stable
 
-  KVFinalizeThread kv_finalize_thread;
-  std::mutex kv_finalize_lock;
-  std::condition_variable kv_finalize_cond;
-  deque<TransContext*> kv_committing_to_finalize;   ///< pending finalization
-  deque<DeferredBatch*> deferred_stable_to_finalize; ///< pending finalization
+  /// with bluestore_kv_sync_pipeline_depth, batches are synced here while
+  /// kv_sync_thread submits the next one
+  KVCommitThread kv_commit_thread;
+  unsigned kv_pipeline_depth = 0;      ///< 0 == sync inline
+  std::mutex kv_commit_lock;
+  std::condition_variable kv_commit_cond;
+  bool kv_commit_started = false;
+  bool kv_commit_stop = false;
+  deque<KVSyncBatch*> kv_commit_queue; ///< submitted, waiting for sync
+  unsigned kv_commit_in_flight = 0;    ///< queued or being synced
+
+  vector<KVFinalizeShard*> kv_finalize_shards;
+
+  vector<CompressThread*> compress_threads;
+  std::mutex compress_lock;
+  std::condition_variable compress_cond;      ///< work for compress threads
+  std::condition_variable compress_done_cond; ///< a batch lost its workers
+  bool compress_stop = false;
+  deque<CompressBatch*> compress_queue;
+
+  /// a trained compression dictionary
+  struct CompressDict {
+    int type;
+    Compressor::DictionaryRef dict;
+  };
+  /// dictionary use and training of one pool
+  struct CompressPoolDict {
+    uint32_t id = 0;                 ///< newest dictionary, 0 if none yet
+    uint64_t blobs = 0;              ///< compressed with it so far
+    vector<bufferlist> samples;      ///< writes to train the next one on
+    uint64_t sample_bytes = 0;
+    bool training = false;
+  };
+  std::mutex comp_dict_lock;
+  uint32_t comp_dict_last_id = 0;           ///< ids are never reused
+  map<uint32_t, CompressDict> comp_dicts;   ///< loaded dictionaries
+  map<int64_t, CompressPoolDict> comp_pool_dicts;
+  Finisher *comp_dict_finisher = nullptr;   ///< trains dictionaries
 
   PerfCounters *logger = nullptr;
 
@@ -1908,6 +2226,11 @@ private:
   CompressorRef compressor;
   std::atomic<uint64_t> comp_min_blob_size = {0};
   std::atomic<uint64_t> comp_max_blob_size = {0};
+  std::atomic<uint64_t> comp_dict_max_blob_size = {0}; ///< 0 if disabled
+  std::atomic<uint64_t> comp_dict_retrain_blobs = {0};
+  std::atomic<bool> comp_estimate = {false};
+  std::atomic<uint64_t> comp_backoff = {0};
+  std::atomic<uint64_t> comp_backoff_max = {0};
 
   std::atomic<uint64_t> max_blob_size = {0};  ///< maximum blob size
 
@@ -2031,7 +2354,24 @@ private:
   void _kv_start();
   void _kv_stop();
   void _kv_sync_thread();
-  void _kv_finalize_thread();
+  void _kv_sync_batch(KVSyncBatch *b);
+  void _kv_commit_thread();
+  void _kv_queue_finalize(KVSyncBatch *b);
+  void _kv_finalize_thread(unsigned shard);
+
+  void _compress_start();
+  void _compress_stop();
+  void _compress_thread();
+  void _compress_batch(CompressBatch *b);
+
+  int _open_compress_dicts();
+  void _close_compress_dicts();
+  Compressor::DictionaryRef _get_compress_dict(CompressorRef c, int64_t pool,
+					       const bufferlist& bl,
+					       uint32_t *id);
+  Compressor::DictionaryRef _load_compress_dict(CompressorRef c, uint32_t id);
+  void _train_compress_dict(CompressorRef c, int64_t pool,
+			    vector<bufferlist>& samples);
 
   bluestore_deferred_op_t *_get_deferred_op(TransContext *txc, OnodeRef o);
   void _deferred_queue(TransContext *txc);
@@ -2171,6 +2511,7 @@ public:
 
   void register_osr(OpSequencer *osr) {
     std::lock_guard<std::mutex> l(osr_lock);
+    osr->finalize_seq = osr_finalize_seq++;
     osr_set.insert(osr);
   }
   void unregister_osr(OpSequencer *osr) {
@@ -2425,7 +2766,7 @@ private:
     uint64_t blob_xoffset,
     const bufferlist& bl,
     uint64_t logical_offset) const;
-  int _decompress(bufferlist& source, bufferlist* result);
+  int _decompress(bufferlist& source, uint64_t max_len, bufferlist* result);
 
 
   // --------------------------------------------------------
@@ -0,0 +1,35 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "IoRingDevice.h"
+#include "ioring.h"
+
+IoRingDevice::IoRingDevice(CephContext* cct, aio_callback_t cb, void *cbpriv)
+  : KernelDevice(cct, cb, cbpriv,
+		 new ioring_queue_t(cct->_conf->bdev_aio_max_queue_depth,
+				    cct->_conf->bdev_ioring_hipri,
+				    cct->_conf->bdev_ioring_sqthread_poll))
+{
+}
+
+bool IoRingDevice::supported()
+{
+  return ioring_queue_t::supported();
+}
+
+int IoRingDevice::collect_metadata(string prefix,
+				   map<string,string> *pm) const
+{
+  int r = KernelDevice::collect_metadata(prefix, pm);
+  (*pm)[prefix + "driver"] = "IoRingDevice";
+  return r;
+}
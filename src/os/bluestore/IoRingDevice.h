@@ -0,0 +1,34 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OS_BLUESTORE_IORINGDEVICE_H
+#define CEPH_OS_BLUESTORE_IORINGDEVICE_H
+
+#include "KernelDevice.h"
+
+/**
+ * KernelDevice variant that submits and reaps io through io_uring
+ * instead of libaio.  Everything above the completion queue (IOContext
+ * accounting, flush semantics, the completion thread) is shared with
+ * KernelDevice.
+ */
+class IoRingDevice : public KernelDevice {
+public:
+  IoRingDevice(CephContext* cct, aio_callback_t cb, void *cbpriv);
+
+  static bool supported();
+
+  int collect_metadata(std::string prefix,
+		       map<std::string,std::string> *pm) const override;
+};
+
+#endif
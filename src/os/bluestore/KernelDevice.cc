@@ -34,13 +34,20 @@
 #define dout_prefix *_dout << "bdev(" << this << " " << path << ") "
 
 KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv)
+  : KernelDevice(cct, cb, cbpriv,
+		 new aio_queue_t(cct->_conf->bdev_aio_max_queue_depth))
+{
+}
+
+KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv,
+			   io_queue_t *q)
   : BlockDevice(cct),
     fd_direct(-1),
     fd_buffered(-1),
     size(0), block_size(0),
     fs(NULL), aio(false), dio(false),
     debug_lock("KernelDevice::debug_lock"),
-    aio_queue(cct->_conf->bdev_aio_max_queue_depth),
+    io_queue(q),
     aio_callback(cb),
     aio_callback_priv(cbpriv),
     aio_stop(false),
@@ -307,13 +314,14 @@ int KernelDevice::_aio_start()
 {
   if (aio) {
     dout(10) << __func__ << dendl;
-    int r = aio_queue.init();
+    int r = io_queue->init({fd_direct, fd_buffered});
     if (r < 0) {
       if (r == -EAGAIN) {
-	derr << __func__ << " io_setup(2) failed with EAGAIN; "
+	derr << __func__ << " io queue setup failed with EAGAIN; "
 	     << "try increasing /proc/sys/fs/aio-max-nr" << dendl;
       } else {
-	derr << __func__ << " io_setup(2) failed: " << cpp_strerror(r) << dendl;
+	derr << __func__ << " io queue setup failed: " << cpp_strerror(r)
+	     << dendl;
       }
       return r;
     }
@@ -329,7 +337,7 @@ void KernelDevice::_aio_stop()
     aio_stop = true;
     aio_thread.join();
     aio_stop = false;
-    aio_queue.shutdown();
+    io_queue->shutdown();
   }
 }
 
@@ -341,7 +349,7 @@ void KernelDevice::_aio_thread()
     dout(40) << __func__ << " polling" << dendl;
     int max = cct->_conf->bdev_aio_reap_max;
     aio_t *aio[max];
-    int r = aio_queue.get_next_completed(cct->_conf->bdev_aio_poll_ms,
+    int r = io_queue->get_next_completed(cct->_conf->bdev_aio_poll_ms,
 					 aio, max);
     if (r < 0) {
       derr << __func__ << " got " << cpp_strerror(r) << dendl;
@@ -511,8 +519,7 @@ void KernelDevice::aio_submit(IOContext *ioc)
 
   void *priv = static_cast<void*>(ioc);
   int r, retries = 0;
-  r = aio_queue.submit_batch(ioc->running_aios.begin(), e, 
-			     ioc->num_running.load(), priv, &retries);
+  r = io_queue->submit_batch(ioc->running_aios.begin(), e, priv, &retries);
   
   if (retries)
     derr << __func__ << " retries " << retries << dendl;
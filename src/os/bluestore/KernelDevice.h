@@ -16,6 +16,7 @@
 #define CEPH_OS_BLUESTORE_KERNELDEVICE_H
 
 #include <atomic>
+#include <memory>
 
 #include "os/fs/FS.h"
 #include "include/interval_set.h"
@@ -37,7 +38,7 @@ class KernelDevice : public BlockDevice {
   std::atomic<bool> io_since_flush = {false};
   std::mutex flush_mutex;
 
-  aio_queue_t aio_queue;
+  std::unique_ptr<io_queue_t> io_queue;
   aio_callback_t aio_callback;
   void *aio_callback_priv;
   bool aio_stop;
@@ -74,6 +75,11 @@ class KernelDevice : public BlockDevice {
   void debug_aio_link(aio_t& aio);
   void debug_aio_unlink(aio_t& aio);
 
+protected:
+  /// for subclasses that complete io through a different kernel queue
+  KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv,
+	       io_queue_t *q);
+
 public:
   KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv);
 
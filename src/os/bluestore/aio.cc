@@ -29,8 +29,7 @@ int aio_queue_t::submit(aio_t &aio, int *retries)
   return r;
 }
 
-int aio_queue_t::submit_batch(aio_iter begin, aio_iter end, 
-			      uint16_t aios_size, void *priv, 
+int aio_queue_t::submit_batch(aio_iter begin, aio_iter end, void *priv,
 			      int *retries)
 {
   // 2^16 * 125us = ~8 seconds, so max sleep is ~16 seconds
@@ -38,7 +37,7 @@ int aio_queue_t::submit_batch(aio_iter begin, aio_iter end,
   int delay = 125;
 
   aio_iter cur = begin;
-  struct iocb *piocb[aios_size];
+  struct iocb *piocb[std::distance(begin, end)];
   int r, pos = 0;
   while (cur != end) {
     cur->priv = priv;
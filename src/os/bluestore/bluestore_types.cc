@@ -1126,6 +1126,7 @@ void bluestore_compression_header_t::dump(Formatter *f) const
 {
   f->dump_unsigned("type", type);
   f->dump_unsigned("length", length);
+  f->dump_unsigned("dict_id", dict_id);
 }
 
 void bluestore_compression_header_t::generate_test_instances(
@@ -1134,4 +1135,24 @@ void bluestore_compression_header_t::generate_test_instances(
   o.push_back(new bluestore_compression_header_t);
   o.push_back(new bluestore_compression_header_t(1));
   o.back()->length = 1234;
+  o.push_back(new bluestore_compression_header_t(3));
+  o.back()->length = 4321;
+  o.back()->dict_id = 7;
+}
+
+void bluestore_compression_dict_t::dump(Formatter *f) const
+{
+  f->dump_int("pool", pool);
+  f->dump_unsigned("type", type);
+  f->dump_unsigned("length", data.length());
+}
+
+void bluestore_compression_dict_t::generate_test_instances(
+  list<bluestore_compression_dict_t*>& o)
+{
+  o.push_back(new bluestore_compression_dict_t);
+  o.push_back(new bluestore_compression_dict_t);
+  o.back()->pool = 3;
+  o.back()->type = 3;
+  o.back()->data.append("dictionary");
 }
@@ -563,6 +563,35 @@ public:
       denc(unused, p);
     }
   }
+  /// advance p past an encoded blob without decoding (or allocating) it;
+  /// returns the blob's flags
+  static uint32_t skip(bufferptr::iterator& p, uint64_t struct_v) {
+    assert(struct_v == 1 || struct_v == 2);
+    unsigned num;
+    denc_varint(num, p);
+    while (num--) {
+      uint64_t v;
+      denc_lba(v, p);
+      denc_varint_lowz(v, p);
+    }
+    uint32_t f;
+    denc_varint(f, p);
+    if (f & FLAG_COMPRESSED) {
+      uint32_t v;
+      denc_varint_lowz(v, p);
+      denc_varint_lowz(v, p);
+    }
+    if (f & FLAG_CSUM) {
+      p.advance(sizeof(csum_type) + sizeof(csum_chunk_order));
+      int len;
+      denc_varint(len, p);
+      p.advance(len);
+    }
+    if (f & FLAG_HAS_UNUSED) {
+      p.advance(sizeof(unused_t));
+    }
+    return f;
+  }
 
   bool can_split() const {
     return
@@ -1051,15 +1080,19 @@ WRITE_CLASS_DENC(bluestore_deferred_transaction_t)
 struct bluestore_compression_header_t {
   uint8_t type = Compressor::COMP_ALG_NONE;
   uint32_t length = 0;
+  uint32_t dict_id = 0;  ///< bluestore_compression_dict_t used, 0 for none
 
   bluestore_compression_header_t() {}
   bluestore_compression_header_t(uint8_t _type)
     : type(_type) {}
 
   DENC(bluestore_compression_header_t, v, p) {
-    DENC_START(1, 1, p);
+    DENC_START(2, 1, p);
     denc(v.type, p);
     denc(v.length, p);
+    if (struct_v >= 2) {
+      denc(v.dict_id, p);
+    }
     DENC_FINISH(p);
   }
   void dump(Formatter *f) const;
@@ -1067,5 +1100,23 @@ struct bluestore_compression_header_t {
 };
 WRITE_CLASS_DENC(bluestore_compression_header_t)
 
+/// a compression dictionary trained on the data of a pool
+struct bluestore_compression_dict_t {
+  int64_t pool = -1;
+  uint8_t type = Compressor::COMP_ALG_NONE;
+  bufferlist data;
+
+  DENC(bluestore_compression_dict_t, v, p) {
+    DENC_START(1, 1, p);
+    denc(v.pool, p);
+    denc(v.type, p);
+    denc(v.data, p);
+    DENC_FINISH(p);
+  }
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<bluestore_compression_dict_t*>& o);
+};
+WRITE_CLASS_DENC(bluestore_compression_dict_t)
+
 
 #endif
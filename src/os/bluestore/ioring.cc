@@ -0,0 +1,208 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "ioring.h"
+
+#ifdef HAVE_LIBURING
+
+#include <liburing.h>
+
+ioring_queue_t::ioring_queue_t(unsigned iodepth, bool hipri, bool sq_thread)
+  : iodepth(iodepth),
+    hipri(hipri),
+    sq_thread(sq_thread)
+{
+}
+
+ioring_queue_t::~ioring_queue_t()
+{
+  assert(ring == nullptr);
+}
+
+bool ioring_queue_t::supported()
+{
+#ifdef IORING_FEAT_EXT_ARG
+  struct io_uring r;
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int ret = io_uring_queue_init_params(2, &r, &params);
+  if (ret < 0)
+    return false;
+  io_uring_queue_exit(&r);
+  // without EXT_ARG liburing implements io_uring_wait_cqe_timeout() by
+  // queueing a timeout sqe, which would race with submit_batch().
+  return params.features & IORING_FEAT_EXT_ARG;
+#else
+  return false;
+#endif
+}
+
+int ioring_queue_t::init(const std::vector<int> &fds)
+{
+  assert(ring == nullptr);
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  if (hipri)
+    params.flags |= IORING_SETUP_IOPOLL;
+  if (sq_thread)
+    params.flags |= IORING_SETUP_SQPOLL;
+
+  ring = new io_uring;
+  int r = io_uring_queue_init_params(iodepth, ring, &params);
+  if (r < 0) {
+    delete ring;
+    ring = nullptr;
+    return r;
+  }
+
+  // the sqpoll kernel thread can only see registered files, and fixed
+  // files save an fget/fput per io in any case.
+  if (!fds.empty()) {
+    r = io_uring_register_files(ring, &fds[0], fds.size());
+    if (r < 0) {
+      io_uring_queue_exit(ring);
+      delete ring;
+      ring = nullptr;
+      return r;
+    }
+    for (unsigned i = 0; i < fds.size(); ++i)
+      fixed_files[fds[i]] = i;
+  }
+  return 0;
+}
+
+void ioring_queue_t::shutdown()
+{
+  if (ring) {
+    if (!fixed_files.empty()) {
+      io_uring_unregister_files(ring);
+      fixed_files.clear();
+    }
+    io_uring_queue_exit(ring);
+    delete ring;
+    ring = nullptr;
+  }
+}
+
+int ioring_queue_t::_prep_sqe(aio_t &aio)
+{
+  struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+  if (!sqe)
+    return -EAGAIN;
+
+  int fd = aio.fd;
+  auto p = fixed_files.find(fd);
+  if (p != fixed_files.end())
+    fd = p->second;
+
+  switch (aio.iocb.aio_lio_opcode) {
+  case IO_CMD_PWRITEV:
+    io_uring_prep_writev(sqe, fd, &aio.iov[0], aio.iov.size(), aio.offset);
+    break;
+  case IO_CMD_PREAD:
+    io_uring_prep_read(sqe, fd, aio.iocb.u.c.buf, aio.iocb.u.c.nbytes,
+		       aio.offset);
+    break;
+  default:
+    assert(0 == "unexpected aio opcode");
+  }
+  if (p != fixed_files.end())
+    sqe->flags |= IOSQE_FIXED_FILE;
+  io_uring_sqe_set_data(sqe, &aio);
+  return 0;
+}
+
+void ioring_queue_t::_backout_sqes(unsigned n)
+{
+  // Hand the sq slots of sqes the kernel never consumed back to the
+  // ring.  liburing has no call for this, so rewind its tails; this is
+  // safe because, without SQPOLL, the kernel only reads the sq from
+  // io_uring_enter(2), which we serialize with sq_mutex.
+  assert(!sq_thread);
+  struct io_uring_sq *sq = &ring->sq;
+  sq->sqe_tail -= n;
+  sq->sqe_head = sq->sqe_tail;
+  __atomic_store_n(sq->ktail, sq->sqe_tail, __ATOMIC_RELEASE);
+}
+
+int ioring_queue_t::submit_batch(aio_iter begin, aio_iter end, void *priv,
+				 int *retries)
+{
+  // 2^16 * 125us = ~8 seconds, so max sleep is ~16 seconds
+  int attempts = 16;
+  int delay = 125;
+  int queued = 0, done = 0;
+
+  std::lock_guard<std::mutex> l(sq_mutex);
+  aio_iter cur = begin;
+  while (cur != end || queued > 0) {
+    // fill as much of the sq as we can, then hand the whole lot to the
+    // kernel with a single io_uring_enter(2).
+    while (cur != end) {
+      cur->priv = priv;
+      if (_prep_sqe(*cur) < 0)
+	break;
+      ++queued;
+      ++cur;
+    }
+    int r = io_uring_submit(ring);
+    if (r == -EAGAIN || r == -EBUSY) {
+      if (attempts-- > 0) {
+	usleep(delay);
+	delay *= 2;
+	(*retries)++;
+	continue;
+      }
+    }
+    if (r < 0) {
+      // with SQPOLL the sqes are already visible to the kernel thread,
+      // which will still pick them up; otherwise nobody will.
+      if (queued > 0 && !sq_thread)
+	_backout_sqes(queued);
+      return r;
+    }
+    queued -= r;
+    done += r;
+  }
+  return done;
+}
+
+int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
+{
+  struct io_uring_cqe *cqe = nullptr;
+  struct __kernel_timespec t = {
+    timeout_ms / 1000,
+    (timeout_ms % 1000) * 1000 * 1000
+  };
+
+  int r = 0;
+  do {
+    r = io_uring_wait_cqe_timeout(ring, &cqe, &t);
+  } while (r == -EINTR);
+  if (r == -ETIME)
+    return 0;
+  if (r < 0)
+    return r;
+
+  // reap everything that is already there without another syscall
+  unsigned head;
+  unsigned seen = 0;
+  int n = 0;
+  io_uring_for_each_cqe(ring, head, cqe) {
+    if (n == max)
+      break;
+    ++seen;
+#ifdef LIBURING_UDATA_TIMEOUT
+    // liburing's own timeout completions; never ours
+    if (cqe->user_data == LIBURING_UDATA_TIMEOUT)
+      continue;
+#endif
+    aio_t *aio = static_cast<aio_t*>(io_uring_cqe_get_data(cqe));
+    aio->rval = cqe->res;
+    paio[n++] = aio;
+  }
+  io_uring_cq_advance(ring, seen);
+  return n;
+}
+
+#endif
@@ -0,0 +1,58 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#pragma once
+
+#include "acconfig.h"
+
+#include <map>
+#include <mutex>
+
+#include "aio.h"
+
+#ifdef HAVE_LIBURING
+
+struct io_uring;
+
+/**
+ * io_uring backed completion queue
+ *
+ * This is a drop-in replacement for aio_queue_t that consumes the same
+ * aio_t requests (prepared with io_prep_pread/io_prep_pwritev) so that
+ * IOContext and the BlockDevice aio_submit() contract stay unchanged.
+ *
+ * The device fds are registered with the ring at init() time so that
+ * every sqe references a fixed file, and a whole IOContext batch is
+ * handed to the kernel with a single io_uring_enter(2).
+ *
+ * Submission and completion run on different threads.  We only use
+ * kernels with IORING_FEAT_EXT_ARG, where waiting with a timeout does
+ * not consume an sqe, so the completion side never touches the sq.
+ */
+struct ioring_queue_t final : public io_queue_t {
+  unsigned iodepth;
+  bool hipri;
+  bool sq_thread;
+
+  ioring_queue_t(unsigned iodepth, bool hipri, bool sq_thread);
+  ~ioring_queue_t() override;
+
+  static bool supported();
+
+  int init(const std::vector<int> &fds) override;
+  void shutdown() override;
+
+  int submit_batch(aio_iter begin, aio_iter end, void *priv,
+		   int *retries) override;
+  int get_next_completed(int timeout_ms, aio_t **paio, int max) override;
+
+private:
+  struct io_uring *ring = nullptr;
+  std::mutex sq_mutex;                 ///< serializes sqe producers
+  std::map<int,unsigned> fixed_files;  ///< fd -> registered file index
+
+  int _prep_sqe(aio_t &aio);
+  void _backout_sqes(unsigned n);
+};
+
+#endif
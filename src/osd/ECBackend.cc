@@ -151,6 +151,7 @@ ostream &operator<<(ostream &lhs, const ECBackend::Op &rhs)
       << " pending_read=" << rhs.pending_read
       << " remote_read=" << rhs.remote_read
       << " remote_read_result=" << rhs.remote_read_result
+      << " using_delta=" << rhs.using_delta
       << " pending_apply=" << rhs.pending_apply
       << " pending_commit=" << rhs.pending_commit
       << " plan.to_read=" << rhs.plan.to_read
@@ -1188,7 +1189,8 @@ void ECBackend::handle_sub_read_reply(
   // For redundant reads check for completion as each shard comes in,
   // or in a non-recovery read check for completion once all the shards read.
   // TODO: It would be nice if recovery could send more reads too
-  if (rop.do_redundant_reads || (!rop.for_recovery && rop.in_progress.empty())) {
+  if (rop.do_redundant_reads ||
+      (!rop.for_recovery && !rop.raw_read && rop.in_progress.empty())) {
     for (map<hobject_t, read_result_t>::const_iterator iter =
         rop.complete.begin();
       iter != rop.complete.end();
@@ -1384,6 +1386,7 @@ void ECBackend::on_change()
     cache.release_write_pin(op.second.pin);
   }
   tid_to_op_map.clear();
+  delta_writes_in_progress.clear();
 
   for (map<ceph_tid_t, ReadOp>::iterator i = tid_to_read_map.begin();
        i != tid_to_read_map.end();
@@ -1610,7 +1613,8 @@ void ECBackend::start_read_op(
   map<hobject_t, read_request_t> &to_read,
   OpRequestRef _op,
   bool do_redundant_reads,
-  bool for_recovery)
+  bool for_recovery,
+  bool raw_read)
 {
   ceph_tid_t tid = get_parent()->get_tid();
   assert(!tid_to_read_map.count(tid));
@@ -1623,6 +1627,7 @@ void ECBackend::start_read_op(
       for_recovery,
       _op,
       std::move(to_read))).first->second;
+  op.raw_read = raw_read;
   dout(10) << __func__ << ": starting " << op << dendl;
   if (_op) {
     op.trace = _op->pg_trace;
@@ -1773,12 +1778,162 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
     },
     get_parent()->get_dpp());
 
+  if (op->requires_rmw() &&
+      get_parent()->get_pool().allows_ecoverwrites() &&
+      ec_impl->supports_parity_delta() &&
+      cct->_conf->get_val<bool>("osd_ec_parity_delta_writes")) {
+    ECTransaction::plan_parity_delta(
+      op->plan,
+      sinfo,
+      ec_impl->get_chunk_count() - ec_impl->get_data_chunk_count(),
+      get_parent()->get_dpp());
+  }
+
   dout(10) << __func__ << ": " << *op << dendl;
 
   waiting_state.push_back(*op);
   check_ops();
 }
 
+bool ECBackend::use_parity_delta(Op *op)
+{
+  if (!op->requires_rmw() ||
+      op->plan.delta_chunks.empty() ||
+      !pipeline_state.caching_enabled())
+    return false;
+  for (auto &&hpair: op->plan.delta_chunks) {
+    // the old chunks are read from the shards, nothing else may be
+    // about to change them
+    if (!cache.is_idle(hpair.first)) {
+      dout(20) << __func__ << ": " << hpair.first
+	       << " has writes in progress" << dendl;
+      return false;
+    }
+    // queued writes to the object would have to wait for this one,
+    // let them share its stripes through the cache instead
+    for (auto &&i: waiting_state) {
+      if (&i != op && i.plan.will_write.count(hpair.first)) {
+	dout(20) << __func__ << ": " << hpair.first
+		 << " has writes queued" << dendl;
+	return false;
+      }
+    }
+    set<pg_shard_t> shards;
+    get_remaining_shards(hpair.first, set<int>(), &shards);
+    if (shards.size() != ec_impl->get_chunk_count()) {
+      dout(20) << __func__ << ": " << hpair.first
+	       << " is not available on all shards" << dendl;
+      return false;
+    }
+  }
+  return true;
+}
+
+struct OnDeltaReadComplete :
+  public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
+  ECBackend *ec;
+  ceph_tid_t tid;
+  OnDeltaReadComplete(ECBackend *ec, ceph_tid_t tid)
+    : ec(ec), tid(tid) {}
+  void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override {
+    ec->handle_delta_read_complete(tid, in.second);
+  }
+};
+
+void ECBackend::start_delta_read(Op *op)
+{
+  assert(op->plan.delta_chunks.size() == 1);
+  const hobject_t &hoid = op->plan.delta_chunks.begin()->first;
+  const set<int> &touched = op->plan.delta_chunks.begin()->second;
+  const int k = ec_impl->get_data_chunk_count();
+
+  // the touched data chunks and the coding chunks, as they are
+  set<pg_shard_t> shards, need;
+  get_remaining_shards(hoid, set<int>(), &shards);
+  for (auto &&i: shards) {
+    if (i.shard >= k || touched.count(i.shard))
+      need.insert(i);
+  }
+  const extent_set &stripes = op->plan.to_read[hoid];
+  list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+  for (auto extent: stripes) {
+    to_read.push_back(boost::make_tuple(extent.first, extent.second, 0));
+  }
+
+  dout(10) << __func__ << ": " << hoid << " " << stripes
+	   << " from " << need << dendl;
+  map<hobject_t, read_request_t> for_read_op;
+  for_read_op.insert(
+    make_pair(
+      hoid,
+      read_request_t(
+	to_read,
+	need,
+	false,
+	new OnDeltaReadComplete(this, op->tid))));
+  start_read_op(
+    CEPH_MSG_PRIO_DEFAULT,
+    for_read_op,
+    op->client_op,
+    false, false, true);
+}
+
+void ECBackend::handle_delta_read_complete(
+  ceph_tid_t tid,
+  read_result_t &res)
+{
+  auto iter = tid_to_op_map.find(tid);
+  assert(iter != tid_to_op_map.end());
+  Op *op = &(iter->second);
+  assert(op->using_delta);
+  const hobject_t &hoid = op->plan.delta_chunks.begin()->first;
+
+  const unsigned want = op->plan.delta_chunks.begin()->second.size() +
+    ec_impl->get_chunk_count() - ec_impl->get_data_chunk_count();
+  bool complete = res.r == 0 && res.errors.empty();
+  for (auto &&extent: res.returned) {
+    uint64_t len = sinfo.aligned_logical_offset_to_chunk_offset(
+      extent.get<1>());
+    if (!complete || extent.get<2>().size() != want) {
+      complete = false;
+      break;
+    }
+    for (auto &&j: extent.get<2>()) {
+      if (j.second.length() != len) {
+	complete = false;
+	break;
+      }
+    }
+  }
+  if (!complete) {
+    // read whole stripes then, the writes queued behind this one
+    // still wait for it
+    dout(10) << __func__ << ": " << hoid << " r=" << res.r
+	     << " errors=" << res.errors
+	     << ", falling back to full stripe reads" << dendl;
+    objects_read_async_no_cache(
+      op->remote_read,
+      [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
+	for (auto &&i: results) {
+	  op->remote_read_result.emplace(i.first, i.second.second);
+	}
+	check_ops();
+      });
+    return;
+  }
+
+  auto &chunks = op->delta_read_result[hoid];
+  for (auto &&extent: res.returned) {
+    uint64_t chunk_off = sinfo.aligned_logical_offset_to_chunk_offset(
+      extent.get<0>());
+    for (auto &&j: extent.get<2>()) {
+      chunks[j.first.shard].insert(chunk_off, j.second.length(), j.second);
+    }
+  }
+  dout(20) << __func__ << ": " << *op << dendl;
+  check_ops();
+}
+
 bool ECBackend::try_state_to_reads()
 {
   if (waiting_state.empty())
@@ -1794,11 +1949,28 @@ bool ECBackend::try_state_to_reads()
     return false;
   }
 
+  if (op->requires_rmw()) {
+    for (auto &&hpair: op->plan.to_read) {
+      if (delta_writes_in_progress.count(hpair.first)) {
+	dout(20) << __func__ << ": blocking " << *op
+		 << " because of a parity delta write on " << hpair.first
+		 << dendl;
+	return false;
+      }
+    }
+  }
+
   if (op->invalidates_cache()) {
     dout(20) << __func__ << ": invalidating cache after this op"
 	     << dendl;
     pipeline_state.invalidate();
     op->using_cache = false;
+  } else if (use_parity_delta(op)) {
+    op->using_cache = false;
+    op->using_delta = true;
+    for (auto &&hpair: op->plan.delta_chunks) {
+      ++delta_writes_in_progress[hpair.first];
+    }
   } else {
     op->using_cache = pipeline_state.caching_enabled();
   }
@@ -1839,7 +2011,9 @@ bool ECBackend::try_state_to_reads()
 
   dout(10) << __func__ << ": " << *op << dendl;
 
-  if (!op->remote_read.empty()) {
+  if (op->using_delta) {
+    start_delta_read(op);
+  } else if (!op->remote_read.empty()) {
     assert(get_parent()->get_pool().allows_ecoverwrites());
     objects_read_async_no_cache(
       op->remote_read,
@@ -1903,6 +2077,7 @@ bool ECBackend::try_reads_to_commit()
       (get_osdmap()->require_osd_release < CEPH_RELEASE_KRAKEN),
       sinfo,
       op->remote_read_result,
+      op->delta_read_result,
       op->log_entries,
       &written,
       &trans,
@@ -1930,7 +2105,9 @@ bool ECBackend::try_reads_to_commit()
     written_set[i.first] = i.second.get_interval_set();
   }
   dout(20) << __func__ << ": written_set: " << written_set << dendl;
-  assert(written_set == op->plan.will_write);
+  if (op->delta_read_result.empty()) {
+    assert(written_set == op->plan.will_write);
+  }
 
   if (op->using_cache) {
     for (auto &&hpair: written) {
@@ -1940,6 +2117,7 @@ bool ECBackend::try_reads_to_commit()
   }
   op->remote_read.clear();
   op->remote_read_result.clear();
+  op->delta_read_result.clear();
 
   dout(10) << "onreadable_sync: " << op->on_local_applied_sync << dendl;
   ObjectStore::Transaction empty;
@@ -2051,6 +2229,14 @@ bool ECBackend::try_finish_rmw()
   if (op->using_cache) {
     cache.release_write_pin(op->pin);
   }
+  if (op->using_delta) {
+    for (auto &&hpair: op->plan.delta_chunks) {
+      auto iter = delta_writes_in_progress.find(hpair.first);
+      assert(iter != delta_writes_in_progress.end());
+      if (--iter->second == 0)
+	delta_writes_in_progress.erase(iter);
+    }
+  }
   tid_to_op_map.erase(op->tid);
 
   if (waiting_reads.empty() &&
@@ -378,6 +378,9 @@ public:
     // True if reading for recovery which could possibly reading only a subset
     // of the available shards.
     bool for_recovery;
+    // True if the caller wants the chunks of all the shards it asked for
+    // as they are, the op completes once they all replied.
+    bool raw_read = false;
 
     ZTracer::Trace trace;
 
@@ -427,7 +430,8 @@ public:
     int priority,
     map<hobject_t, read_request_t> &to_read,
     OpRequestRef op,
-    bool do_redundant_reads, bool for_recovery);
+    bool do_redundant_reads, bool for_recovery,
+    bool raw_read = false);
 
   void do_read_op(ReadOp &rop);
   int send_all_remaining_reads(
@@ -477,14 +481,20 @@ public:
     bool invalidates_cache() const { return plan.invalidates_cache; }
 
     // must be true if requires_rmw(), must be false if invalidates_cache()
+    // or using_delta
     bool using_cache = false;
 
+    // partial stripes are written as parity deltas, see plan.delta_chunks
+    bool using_delta = false;
+
     /// In progress read state;
     map<hobject_t,extent_set> pending_read; // subset already being read
     map<hobject_t,extent_set> remote_read;  // subset we must read
     map<hobject_t,extent_map> remote_read_result;
+    map<hobject_t,map<int,extent_map>> delta_read_result; // chunks by shard
     bool read_in_progress() const {
-      return !remote_read.empty() && remote_read_result.empty();
+      return !remote_read.empty() && remote_read_result.empty() &&
+	delta_read_result.empty();
     }
 
     /// In progress write state
@@ -563,7 +573,14 @@ public:
   op_list waiting_commit;       /// writes waiting on initial commit
   eversion_t completed_to;
   eversion_t committed_to;
+  /// parity delta writes by object, the cache knows nothing of them so
+  /// rmw writes to the same objects wait until they are done
+  map<hobject_t,int> delta_writes_in_progress;
   void start_rmw(Op *op, PGTransactionUPtr &&t);
+  bool use_parity_delta(Op *op);
+  void start_delta_read(Op *op);
+  friend struct OnDeltaReadComplete;
+  void handle_delta_read_complete(ceph_tid_t tid, read_result_t &res);
   bool try_state_to_reads();
   bool try_reads_to_commit();
   bool try_finish_rmw();
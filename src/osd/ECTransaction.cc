@@ -82,6 +82,17 @@ void encode_and_write(
   }
 }
 
+bufferlist get_chunk(
+  const extent_map &chunks,
+  uint64_t offset,
+  uint64_t length) {
+  auto chunk = chunks.intersect(offset, length);
+  assert(chunk.ext_count() == 1);
+  assert(chunk.begin().get_off() == offset);
+  assert(chunk.begin().get_len() == length);
+  return chunk.begin().get_val();
+}
+
 bool ECTransaction::requires_overwrite(
   uint64_t prev_size,
   const PGTransaction::ObjectOperation &op) {
@@ -95,6 +106,77 @@ bool ECTransaction::requires_overwrite(
       (op.truncate->first < prev_size)));
 }
 
+bool ECTransaction::plan_parity_delta(
+  WritePlan &plan,
+  const ECUtil::stripe_info_t &sinfo,
+  unsigned coding_chunks,
+  DoutPrefixProvider *dpp)
+{
+  assert(plan.t);
+  if (plan.invalidates_cache ||
+      plan.to_read.size() != 1 ||
+      plan.t->op_map.size() != 1)
+    return false;
+  const hobject_t &oid = plan.to_read.begin()->first;
+  const extent_set &to_read = plan.to_read.begin()->second;
+  auto opiter = plan.t->op_map.find(oid);
+  if (opiter == plan.t->op_map.end())
+    return false;
+  auto &op = opiter->second;
+  if (!op.is_none() || op.truncate || op.has_source() ||
+      op.buffer_updates.empty())
+    return false;
+
+  const uint64_t stripe_width = sinfo.get_stripe_width();
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const unsigned data_chunks = stripe_width / chunk_size;
+  extent_set raw_write_set;
+  for (auto &&extent: op.buffer_updates) {
+    raw_write_set.insert(extent.get_off(), extent.get_len());
+  }
+
+  // every partially written stripe must be one we would read, so that
+  // none of them is padded with zeroes past the end of the object
+  set<int> touched;
+  for (auto extent = raw_write_set.begin();
+       extent != raw_write_set.end();
+       ++extent) {
+    uint64_t end = extent.get_start() + extent.get_len();
+    for (uint64_t stripe =
+	   sinfo.logical_to_prev_stripe_offset(extent.get_start());
+	 stripe < end;
+	 stripe += stripe_width) {
+      uint64_t start = MAX(stripe, extent.get_start());
+      uint64_t finish = MIN(stripe + stripe_width, end);
+      extent_set in_stripe;
+      in_stripe.insert(stripe, stripe_width);
+      in_stripe.intersection_of(raw_write_set);
+      if ((uint64_t)in_stripe.size() == stripe_width)
+	continue;
+      if (!to_read.contains(stripe, stripe_width))
+	return false;
+      for (uint64_t c = (start - stripe) / chunk_size;
+	   c <= (finish - 1 - stripe) / chunk_size;
+	   ++c) {
+	touched.insert(c);
+      }
+    }
+  }
+  assert(!touched.empty());
+
+  // full rmw reads k chunks and writes k + m, a delta reads and writes
+  // the touched chunks plus the m coding chunks
+  if (2 * touched.size() + coding_chunks >= 2 * data_chunks) {
+    ldpp_dout(dpp, 20) << __func__ << ": " << oid << " touches " << touched
+		       << ", full stripe rmw is cheaper" << dendl;
+    return false;
+  }
+  ldpp_dout(dpp, 20) << __func__ << ": " << oid << " touches " << touched
+		     << " of " << to_read << dendl;
+  plan.delta_chunks[oid] = std::move(touched);
+  return true;
+}
+
 void ECTransaction::generate_transactions(
   WritePlan &plan,
   ErasureCodeInterfaceRef &ecimpl,
@@ -102,6 +184,7 @@ void ECTransaction::generate_transactions(
   bool legacy_log_entries,
   const ECUtil::stripe_info_t &sinfo,
   const map<hobject_t,extent_map> &partial_extents,
+  const map<hobject_t,map<int,extent_map>> &partial_chunks,
   vector<pg_log_entry_t> &entries,
   map<hobject_t,extent_map> *written_map,
   map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -542,6 +625,22 @@ void ECTransaction::generate_transactions(
 	want.insert(i);
       }
       auto to_overwrite = to_write.intersect(0, append_after);
+      extent_map to_delta;
+      auto dciter = plan.delta_chunks.find(oid);
+      auto pciter = partial_chunks.find(oid);
+      if (dciter != plan.delta_chunks.end() &&
+	  pciter != partial_chunks.end()) {
+	// the partial stripes get parity deltas, what is left are full
+	// stripes
+	const extent_set &partial_stripes = plan.to_read.at(oid);
+	for (auto extent: partial_stripes) {
+	  to_delta.insert(to_overwrite.intersect(extent.first, extent.second));
+	  to_overwrite.erase(extent.first, extent.second);
+	}
+	ldpp_dout(dpp, 20) << __func__ << ": to_delta: "
+			   << to_delta
+			   << dendl;
+      }
       ldpp_dout(dpp, 20) << __func__ << ": to_overwrite: "
 			 << to_overwrite
 			 << dendl;
@@ -590,6 +689,89 @@ void ECTransaction::generate_transactions(
 	  dpp);
       }
 
+      if (!to_delta.empty()) {
+	const uint64_t stripe_width = sinfo.get_stripe_width();
+	const uint64_t chunk_size = sinfo.get_chunk_size();
+	const unsigned k = ecimpl->get_data_chunk_count();
+	const unsigned n = ecimpl->get_chunk_count();
+	const extent_set &partial_stripes = plan.to_read.at(oid);
+	for (auto extent: partial_stripes) {
+	  for (uint64_t stripe = extent.first;
+	       stripe < extent.first + extent.second;
+	       stripe += stripe_width) {
+	    auto in_stripe = to_delta.intersect(stripe, stripe_width);
+	    if (in_stripe.empty())
+	      continue;
+	    uint64_t chunk_off =
+	      sinfo.aligned_logical_offset_to_chunk_offset(stripe);
+	    map<int, bufferlist> old_data, new_data, coding;
+	    for (auto c : dciter->second) {
+	      uint64_t chunk_start = stripe + c * chunk_size;
+	      auto in_chunk = in_stripe.intersect(chunk_start, chunk_size);
+	      if (in_chunk.empty())
+		continue;
+	      auto shard_iter = pciter->second.find(c);
+	      assert(shard_iter != pciter->second.end());
+	      old_data[c] = get_chunk(shard_iter->second, chunk_off, chunk_size);
+	      extent_map chunk;
+	      chunk.insert(0, chunk_size, old_data[c]);
+	      for (auto &&piece: in_chunk) {
+		chunk.insert(piece.get_off() - chunk_start, piece.get_len(),
+			     piece.get_val());
+	      }
+	      new_data[c] = get_chunk(chunk, 0, chunk_size);
+	    }
+	    for (unsigned c = k; c < n; ++c) {
+	      auto shard_iter = pciter->second.find(c);
+	      assert(shard_iter != pciter->second.end());
+	      coding[c] = get_chunk(shard_iter->second, chunk_off, chunk_size);
+	    }
+	    int r = ecimpl->apply_delta(old_data, new_data, &coding);
+	    assert(r == 0);
+
+	    ldpp_dout(dpp, 20) << __func__ << ": delta "
+			       << stripe << "~" << stripe_width
+			       << " data chunks " << old_data.size()
+			       << dendl;
+	    if (entry) {
+	      if (rollback_extents.empty()) {
+		for (auto &&st : *transactions) {
+		  st.second.touch(
+		    coll_t(spg_t(pgid, st.first)),
+		    ghobject_t(oid, entry->version.version, st.first));
+		}
+	      }
+	      // rollback restores the range on every shard
+	      rollback_extents.emplace_back(make_pair(chunk_off, chunk_size));
+	      for (auto &&st : *transactions) {
+		st.second.clone_range(
+		  coll_t(spg_t(pgid, st.first)),
+		  ghobject_t(oid, ghobject_t::NO_GEN, st.first),
+		  ghobject_t(oid, entry->version.version, st.first),
+		  chunk_off,
+		  chunk_size,
+		  chunk_off);
+	      }
+	    }
+	    for (auto &&st : *transactions) {
+	      auto biter = new_data.find(st.first);
+	      if (biter == new_data.end()) {
+		biter = coding.find(st.first);
+		if (biter == coding.end())
+		  continue;
+	      }
+	      st.second.write(
+		coll_t(spg_t(pgid, st.first)),
+		ghobject_t(oid, ghobject_t::NO_GEN, st.first),
+		chunk_off,
+		chunk_size,
+		biter->second,
+		fadvise_flags);
+	    }
+	  }
+	}
+      }
+
       auto to_append = to_write.intersect(
 	append_after,
 	std::numeric_limits<uint64_t>::max() - append_after);
@@ -30,6 +30,12 @@ namespace ECTransaction {
     map<hobject_t,extent_set> will_write; // superset of to_read
 
     map<hobject_t,ECUtil::HashInfoRef> hash_infos;
+
+    /* data chunks touched by the partial stripes in to_read, set by
+     * plan_parity_delta if the write can update the coding chunks from
+     * those and the old coding chunks instead of re-encoding the
+     * stripes */
+    map<hobject_t,set<int>> delta_chunks;
   };
 
   bool requires_overwrite(
@@ -182,6 +188,21 @@ namespace ECTransaction {
     return plan;
   }
 
+  /**
+   * Fill in plan.delta_chunks if the partial stripes of plan can be
+   * written as parity deltas: a single overwrite within the current
+   * object size for which reading and writing the touched data chunks
+   * plus the coding chunks is cheaper than reading and rewriting the
+   * whole stripes.
+   *
+   * @return true if plan.delta_chunks was set
+   */
+  bool plan_parity_delta(
+    WritePlan &plan,
+    const ECUtil::stripe_info_t &sinfo,
+    unsigned coding_chunks,
+    DoutPrefixProvider *dpp);
+
   void generate_transactions(
     WritePlan &plan,
     ErasureCodeInterfaceRef &ecimpl,
@@ -189,6 +210,7 @@ namespace ECTransaction {
     bool legacy_log_entries,
     const ECUtil::stripe_info_t &sinfo,
     const map<hobject_t,extent_map> &partial_extents,
+    const map<hobject_t,map<int,extent_map>> &partial_chunks,
     vector<pg_log_entry_t> &entries,
     map<hobject_t,extent_map> *written,
     map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -27,18 +27,27 @@ int ECUtil::decode(
   if (total_data_size == 0)
     return 0;
 
+  vector<int> data_chunks;
+  const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+  for (int i = 0; i < (int)ec_impl->get_data_chunk_count(); ++i) {
+    data_chunks.push_back((int)chunk_mapping.size() > i ? chunk_mapping[i] : i);
+  }
+  set<int> want_to_read(data_chunks.begin(), data_chunks.end());
+  map<int, bufferlist> decoded;
+  int r = ec_impl->decode_stripes(
+    want_to_read, sinfo.get_chunk_size(), to_decode, &decoded);
+  assert(r == 0);
+
+  // interleave the data chunks back into stripes
+  vector<bufferlist::iterator> chunks;
+  for (auto &&i: data_chunks) {
+    assert(decoded[i].length() == total_data_size);
+    chunks.push_back(decoded[i].begin());
+  }
   for (uint64_t i = 0; i < total_data_size; i += sinfo.get_chunk_size()) {
-    map<int, bufferlist> chunks;
-    for (map<int, bufferlist>::iterator j = to_decode.begin();
-	 j != to_decode.end();
-	 ++j) {
-      chunks[j->first].substr_of(j->second, i, sinfo.get_chunk_size());
+    for (auto &&j: chunks) {
+      j.copy(sinfo.get_chunk_size(), *out);
     }
-    bufferlist bl;
-    int r = ec_impl->decode_concat(chunks, &bl);
-    assert(bl.length() == sinfo.get_stripe_width());
-    assert(r == 0);
-    out->claim_append(bl);
   }
   return 0;
 }
@@ -71,23 +80,15 @@ int ECUtil::decode(
     need.insert(i->first);
   }
 
-  for (uint64_t i = 0; i < total_data_size; i += sinfo.get_chunk_size()) {
-    map<int, bufferlist> chunks;
-    for (map<int, bufferlist>::iterator j = to_decode.begin();
-	 j != to_decode.end();
-	 ++j) {
-      chunks[j->first].substr_of(j->second, i, sinfo.get_chunk_size());
-    }
-    map<int, bufferlist> out_bls;
-    int r = ec_impl->decode(need, chunks, &out_bls);
-    assert(r == 0);
-    for (map<int, bufferlist*>::iterator j = out.begin();
-	 j != out.end();
-	 ++j) {
-      assert(out_bls.count(j->first));
-      assert(out_bls[j->first].length() == sinfo.get_chunk_size());
-      j->second->claim_append(out_bls[j->first]);
-    }
+  map<int, bufferlist> out_bls;
+  int r = ec_impl->decode_stripes(
+    need, sinfo.get_chunk_size(), to_decode, &out_bls);
+  assert(r == 0);
+  for (map<int, bufferlist*>::iterator j = out.begin();
+       j != out.end();
+       ++j) {
+    assert(out_bls.count(j->first));
+    j->second->claim_append(out_bls[j->first]);
   }
   for (map<int, bufferlist*>::iterator i = out.begin();
        i != out.end();
@@ -113,19 +114,34 @@ int ECUtil::encode(
   if (logical_size == 0)
     return 0;
 
-  for (uint64_t i = 0; i < logical_size; i += sinfo.get_stripe_width()) {
-    map<int, bufferlist> encoded;
-    bufferlist buf;
-    buf.substr_of(in, i, sinfo.get_stripe_width());
-    int r = ec_impl->encode(want, buf, &encoded);
-    assert(r == 0);
-    for (map<int, bufferlist>::iterator i = encoded.begin();
-	 i != encoded.end();
-	 ++i) {
-      assert(i->second.length() == sinfo.get_chunk_size());
-      (*out)[i->first].claim_append(i->second);
+  // lay the data chunks of all the stripes out back to back, one
+  // buffer per chunk, and encode them in a single call
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const uint64_t stripes = logical_size / sinfo.get_stripe_width();
+  const unsigned k = ec_impl->get_data_chunk_count();
+  const unsigned n = ec_impl->get_chunk_count();
+  const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+  vector<char*> data(k);
+  map<int, bufferlist> encoded;
+  for (unsigned i = 0; i < n; ++i) {
+    int chunk = chunk_mapping.size() > i ? chunk_mapping[i] : i;
+    bufferptr buf(buffer::create_page_aligned(stripes * chunk_size));
+    if (i < k)
+      data[i] = buf.c_str();
+    encoded[chunk].push_back(std::move(buf));
+  }
+  bufferlist::iterator p = in.begin();
+  for (uint64_t stripe = 0; stripe < stripes; ++stripe) {
+    for (unsigned i = 0; i < k; ++i) {
+      p.copy(chunk_size, data[i] + stripe * chunk_size);
     }
   }
+  int r = ec_impl->encode_stripes(want, chunk_size, &encoded);
+  assert(r == 0);
+  for (auto &&i: want) {
+    assert(encoded.count(i));
+    (*out)[i].claim(encoded[i]);
+  }
 
   for (map<int, bufferlist>::iterator i = out->begin();
        i != out->end();
@@ -407,6 +407,11 @@ public:
     pin.open(next_write_tid++);
   }
 
+  /// true if no write in progress has extents of oid reserved
+  bool is_idle(const hobject_t &oid) {
+    return !get_if_exists(oid);
+  }
+
   /**
    * Reserves extents required for rmw, and learn
    * which need to be read
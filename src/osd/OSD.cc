@@ -3181,6 +3181,21 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(
     l_osd_pg_biginfo, "osd_pg_biginfo", "PG updated its biginfo attr");
 
+  osd_plb.add_u64_counter(
+    l_osd_op_wq_steal_attempt, "op_wq_steal_attempt",
+    "Idle op worker looked for work on other shards");
+  osd_plb.add_u64_counter(
+    l_osd_op_wq_steal, "op_wq_steal",
+    "Op worker dequeued an item from another shard");
+
+  // bumped by every op worker for every client op
+  for (int idx : { l_osd_op, l_osd_op_inb, l_osd_op_outb,
+		   l_osd_op_lat, l_osd_op_process_lat, l_osd_op_prepare_lat,
+		   l_osd_op_r, l_osd_op_r_outb, l_osd_op_r_lat,
+		   l_osd_op_w, l_osd_op_w_inb, l_osd_op_w_lat }) {
+    osd_plb.set_sharded(idx);
+  }
+
   logger = osd_plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -10122,6 +10137,20 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
 
   // peek at spg_t
   sdata->sdata_op_ordering_lock.Lock();
+  if (sdata->pqueue->empty() && work_stealing && num_shards > 1) {
+    // rather than sleeping, help out a backed-up shard.  the item is then
+    // handled exactly as one of that shard's own threads would: it goes
+    // through the victim's pg_slot to_process list, so per-pg ordering
+    // is preserved.
+    sdata->sdata_op_ordering_lock.Unlock();
+    uint32_t victim = _steal_shard(shard_index);
+    if (victim < num_shards) {
+      shard_index = victim;
+      sdata = shard_list[victim];
+    } else {
+      sdata->sdata_op_ordering_lock.Lock();
+    }
+  }
   if (sdata->pqueue->empty()) {
     dout(20) << __func__ << " empty q, waiting" << dendl;
     // optimistically sleep a moment; maybe another work item will come along.
@@ -10129,8 +10158,10 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
       osd->cct->_conf->threadpool_default_timeout, 0);
     sdata->sdata_lock.Lock();
     sdata->sdata_op_ordering_lock.Unlock();
+    ++sdata->num_waiting;
     sdata->sdata_cond.WaitInterval(sdata->sdata_lock,
       utime_t(osd->cct->_conf->threadpool_empty_queue_max_wait, 0));
+    --sdata->num_waiting;
     sdata->sdata_lock.Unlock();
     sdata->sdata_op_ordering_lock.Lock();
     if (sdata->pqueue->empty()) {
@@ -10312,6 +10343,48 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
   pg->unlock();
 }
 
+uint32_t OSD::ShardedOpWQ::_steal_shard(uint32_t shard_index)
+{
+  if (osd->logger) {
+    osd->logger->inc(l_osd_op_wq_steal_attempt);
+  }
+  for (uint32_t i = 1; i < num_shards; ++i) {
+    uint32_t victim = (shard_index + i) % num_shards;
+    ShardData *vdata = shard_list[victim];
+    // a contended ordering lock means the shard's own threads are busy
+    // with it; don't add to the pile-up.
+    if (!vdata->sdata_op_ordering_lock.TryLock()) {
+      continue;
+    }
+    if (vdata->pqueue->length() >= steal_min_queue) {
+      dout(20) << __func__ << " stealing from shard " << victim
+	       << " with " << vdata->pqueue->length() << " queued" << dendl;
+      if (osd->logger) {
+	osd->logger->inc(l_osd_op_wq_steal);
+      }
+      return victim;
+    }
+    vdata->sdata_op_ordering_lock.Unlock();
+  }
+  return num_shards;
+}
+
+void OSD::ShardedOpWQ::_wake_idle_shard(uint32_t shard_index)
+{
+  for (uint32_t i = 1; i < num_shards; ++i) {
+    ShardData *idle = shard_list[(shard_index + i) % num_shards];
+    // num_waiting only changes under sdata_lock, so a thread counted here
+    // is either asleep or already on its way out of the wait
+    if (idle->num_waiting.load() == 0) {
+      continue;
+    }
+    idle->sdata_lock.Lock();
+    idle->sdata_cond.SignalOne();
+    idle->sdata_lock.Unlock();
+    return;
+  }
+}
+
 void OSD::ShardedOpWQ::_enqueue(pair<spg_t, PGQueueable> item) {
   uint32_t shard_index =
     item.first.hash_to_shard(shard_list.size());
@@ -10330,12 +10403,18 @@ void OSD::ShardedOpWQ::_enqueue(pair<spg_t, PGQueueable> item) {
     sdata->pqueue->enqueue(
       item.second.get_owner(),
       priority, cost, item);
+  uint64_t queued = sdata->pqueue->length();
   sdata->sdata_op_ordering_lock.Unlock();
 
   sdata->sdata_lock.Lock();
   sdata->sdata_cond.SignalOne();
   sdata->sdata_lock.Unlock();
 
+  // idle threads of other shards only look for work to steal when they
+  // wake up, so don't leave them sleeping while this one backs up
+  if (work_stealing && queued >= steal_min_queue) {
+    _wake_idle_shard(shard_index);
+  }
 }
 
 void OSD::ShardedOpWQ::_enqueue_front(pair<spg_t, PGQueueable> item)
@@ -177,6 +177,9 @@ enum {
   l_osd_pg_fastinfo,
   l_osd_pg_biginfo,
 
+  l_osd_op_wq_steal_attempt,
+  l_osd_op_wq_steal,
+
   l_osd_last,
 };
 
@@ -1629,6 +1632,8 @@ private:
     struct ShardData {
       Mutex sdata_lock;
       Cond sdata_cond;
+      /// threads sleeping on sdata_cond; changed under sdata_lock
+      std::atomic<unsigned> num_waiting = {0};
 
       Mutex sdata_op_ordering_lock;   ///< protects all members below
 
@@ -1699,6 +1704,19 @@ private:
     OSD *osd;
     uint32_t num_shards;
 
+    /// let idle threads take work queued on other shards
+    const bool work_stealing;
+    /// only steal from shards with at least this many queued items
+    const uint64_t steal_min_queue;
+
+    /// find a shard to steal from; returns it with its ordering lock held,
+    /// or num_shards if there is nothing worth taking
+    uint32_t _steal_shard(uint32_t shard_index);
+
+    /// wake a sleeping thread of another shard so it can steal from
+    /// shard_index, which is backing up
+    void _wake_idle_shard(uint32_t shard_index);
+
   public:
     ShardedOpWQ(uint32_t pnum_shards,
 		OSD *o,
@@ -1707,7 +1725,11 @@ private:
 		ShardedThreadPool* tp)
       : ShardedThreadPool::ShardedWQ<pair<spg_t,PGQueueable>>(ti, si, tp),
         osd(o),
-        num_shards(pnum_shards) {
+        num_shards(pnum_shards),
+	work_stealing(
+	  o->cct->_conf->get_val<bool>("osd_op_queue_work_stealing")),
+	steal_min_queue(
+	  o->cct->_conf->get_val<uint64_t>("osd_op_queue_steal_min_queue")) {
       for (uint32_t i = 0; i < num_shards; i++) {
 	char lock_name[32] = {0};
 	snprintf(lock_name, sizeof(lock_name), "%s.%d", "OSD:ShardedOpWQ:", i);
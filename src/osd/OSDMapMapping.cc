@@ -13,7 +13,8 @@ MEMPOOL_DEFINE_OBJECT_FACTORY(OSDMapMapping, osdmapmapping,
 
 // ensure that we have a PoolMappings for each pool and that
 // the dimensions (pg_num and size) match up.
-void OSDMapMapping::_init_mappings(const OSDMap& osdmap)
+void OSDMapMapping::_init_mappings(const OSDMap& osdmap,
+				   std::set<int64_t> *reset_pools)
 {
   num_pgs = 0;
   auto q = pools.begin();
@@ -36,6 +37,9 @@ void OSDMapMapping::_init_mappings(const OSDMap& osdmap)
     }
     pools.emplace(p.first, PoolMapping(p.second.get_size(),
 				       p.second.get_pg_num()));
+    if (reset_pools) {
+      reset_pools->insert(p.first);
+    }
   }
   pools.erase(q, pools.end());
   assert(pools.size() == osdmap.get_pools().size());
@@ -56,6 +60,256 @@ void OSDMapMapping::update(const OSDMap& osdmap, pg_t pgid)
   _update_range(osdmap, pgid.pool(), pgid.ps(), pgid.ps() + 1);
 }
 
+void OSDMapMapping::update(const OSDMap& osdmap,
+			   const OSDMap::Incremental& inc)
+{
+  std::map<int64_t,interval_set<unsigned>> dirty;
+  if (!_start_incremental(osdmap, inc, &dirty)) {
+    update(osdmap);
+    return;
+  }
+  for (auto& p : dirty) {
+    for (auto q = p.second.begin(); q != p.second.end(); ++q) {
+      _update_range(osdmap, p.first, q.get_start(),
+		    q.get_start() + q.get_len());
+    }
+  }
+  _finish(osdmap);
+}
+
+std::unique_ptr<OSDMapMapping::MappingJob> OSDMapMapping::start_update(
+  const OSDMap& osdmap,
+  const OSDMap::Incremental& inc,
+  ParallelPGMapper& mapper,
+  unsigned pgs_per_item,
+  bool check)
+{
+  std::unique_ptr<MappingJob> job(
+    new MappingJob(&osdmap, this, check ? mapper.get_cct() : nullptr));
+  std::map<int64_t,interval_set<unsigned>> dirty;
+  if (_start_incremental(osdmap, inc, &dirty)) {
+    mapper.queue(job.get(), pgs_per_item, dirty);
+  } else {
+    _start(osdmap);
+    mapper.queue(job.get(), pgs_per_item);
+  }
+  return job;
+}
+
+bool OSDMapMapping::_start_incremental(
+  const OSDMap& osdmap,
+  const OSDMap::Incremental& inc,
+  std::map<int64_t,interval_set<unsigned>> *dirty)
+{
+  // look at the old rows before _init_mappings throws any away
+  if (!_get_dirty(osdmap, inc, dirty)) {
+    return false;
+  }
+  epoch = 0;
+  std::set<int64_t> reset_pools;
+  _init_mappings(osdmap, &reset_pools);
+  for (auto pool : reset_pools) {
+    auto& ranges = (*dirty)[pool];
+    ranges.clear();
+    ranges.insert(0, pools.find(pool)->second.pg_num);
+  }
+  for (auto p = dirty->begin(); p != dirty->end(); ) {
+    if (p->second.empty() || !pools.count(p->first)) {
+      p = dirty->erase(p);
+    } else {
+      ++p;
+    }
+  }
+  return true;
+}
+
+/*
+ * Work out which PGs inc may have moved.  Anything that changes the
+ * input of crush for an OSD (its weight, or whether it exists or is up,
+ * since down OSDs are filtered out after crush) can move any PG of any
+ * pool whose rule can reach that OSD, so those pools are remapped in
+ * full.  An OSD going down or changing its primary affinity only affects
+ * the PGs it is currently mapped to.  Explicit pg_temp, primary_temp and
+ * upmap changes only affect the PGs they name.
+ *
+ * Returns false if a full recompute is needed.
+ */
+bool OSDMapMapping::_get_dirty(
+  const OSDMap& osdmap,
+  const OSDMap::Incremental& inc,
+  std::map<int64_t,interval_set<unsigned>> *dirty)
+{
+  if (epoch == 0 ||
+      inc.epoch != epoch + 1 ||
+      osdmap.get_epoch() != inc.epoch ||
+      inc.fullmap.length() ||
+      inc.crush.length() ||
+      inc.new_max_osd >= 0 ||
+      acting_rmap.size() != (unsigned)osdmap.get_max_osd()) {
+    return false;
+  }
+
+  auto mark_pool = [&](int64_t pool) {
+    const pg_pool_t *pi = osdmap.get_pg_pool(pool);
+    if (pi && pi->get_pg_num()) {
+      auto& ranges = (*dirty)[pool];
+      ranges.clear();
+      ranges.insert(0, pi->get_pg_num());
+    }
+  };
+  auto mark_pg = [&](pg_t pgid) {
+    const pg_pool_t *pi = osdmap.get_pg_pool(pgid.pool());
+    if (pi && pgid.ps() < pi->get_pg_num()) {
+      auto& ranges = (*dirty)[pgid.pool()];
+      if (!ranges.contains(pgid.ps())) {
+	ranges.insert(pgid.ps(), 1);
+      }
+    }
+  };
+
+  for (auto& p : inc.new_pools) {
+    mark_pool(p.first);
+  }
+  for (auto& p : inc.new_pg_temp) {
+    mark_pg(p.first);
+  }
+  for (auto& p : inc.new_primary_temp) {
+    mark_pg(p.first);
+  }
+  for (auto& p : inc.new_pg_upmap) {
+    mark_pg(p.first);
+  }
+  for (auto& p : inc.new_pg_upmap_items) {
+    mark_pg(p.first);
+  }
+  for (auto pgid : inc.old_pg_upmap) {
+    mark_pg(pgid);
+  }
+  for (auto pgid : inc.old_pg_upmap_items) {
+    mark_pg(pgid);
+  }
+
+  std::set<int> remap_osds;  // may change what crush returns
+  std::set<int> moved_osds;  // everything that changed, incl. the above
+  for (auto& p : inc.new_weight) {
+    remap_osds.insert(p.first);
+  }
+  for (auto& p : inc.new_up_client) {
+    remap_osds.insert(p.first);
+  }
+  for (auto& p : inc.new_state) {
+    uint32_t s = p.second ? p.second : CEPH_OSD_UP;
+    if ((s & CEPH_OSD_EXISTS) ||
+	((s & CEPH_OSD_UP) && osdmap.is_up(p.first))) {
+      // created, destroyed, or marked up
+      remap_osds.insert(p.first);
+    } else if (s & CEPH_OSD_UP) {
+      // marked down
+      moved_osds.insert(p.first);
+    }
+  }
+  for (auto& p : inc.new_primary_affinity) {
+    moved_osds.insert(p.first);
+  }
+  moved_osds.insert(remap_osds.begin(), remap_osds.end());
+  if (moved_osds.empty()) {
+    return true;
+  }
+
+  if (!remap_osds.empty()) {
+    std::map<int,bool> rule_hits;  // rule -> reaches a remap osd
+    for (auto& p : osdmap.get_pools()) {
+      const pg_pool_t& pi = p.second;
+      int ruleno = osdmap.crush->find_rule(pi.get_crush_rule(), pi.get_type(),
+					   pi.get_size());
+      if (ruleno < 0) {
+	continue;
+      }
+      auto r = rule_hits.find(ruleno);
+      if (r == rule_hits.end()) {
+	std::map<int,float> rule_osds;
+	if (osdmap.crush->get_rule_weight_osd_map(ruleno, &rule_osds) < 0) {
+	  return false;
+	}
+	bool hit = false;
+	for (auto osd : remap_osds) {
+	  if (rule_osds.count(osd)) {
+	    hit = true;
+	    break;
+	  }
+	}
+	r = rule_hits.emplace(ruleno, hit).first;
+      }
+      if (r->second) {
+	mark_pool(p.first);
+      }
+    }
+  }
+
+  // explicit mappings that name a moved osd
+  for (auto& p : osdmap.pg_upmap) {
+    for (auto osd : p.second) {
+      if (moved_osds.count(osd)) {
+	mark_pg(p.first);
+	break;
+      }
+    }
+  }
+  for (auto& p : osdmap.pg_upmap_items) {
+    for (auto& q : p.second) {
+      if (moved_osds.count(q.first) || moved_osds.count(q.second)) {
+	mark_pg(p.first);
+	break;
+      }
+    }
+  }
+  for (auto& p : *osdmap.pg_temp) {
+    for (auto osd : p.second) {
+      if (moved_osds.count(osd)) {
+	mark_pg(p.first);
+	break;
+      }
+    }
+  }
+  for (auto& p : *osdmap.primary_temp) {
+    if (moved_osds.count(p.second)) {
+      mark_pg(p.first);
+    }
+  }
+
+  // and every pg currently mapped to one, via the acting reverse map or,
+  // for up sets, a scan of the rows we are not already redoing in full
+  for (auto osd : moved_osds) {
+    if (osd >= 0 && osd < (int)acting_rmap.size()) {
+      for (auto pgid : acting_rmap[osd]) {
+	mark_pg(pgid);
+      }
+    }
+  }
+  for (auto& p : pools) {
+    const PoolMapping& pm = p.second;
+    auto d = dirty->find(p.first);
+    if (d != dirty->end() && (unsigned)d->second.size() == pm.pg_num) {
+      continue;
+    }
+    for (unsigned ps = 0; ps < pm.pg_num; ++ps) {
+      const int32_t *row = &pm.table[pm.row_size() * ps];
+      if (moved_osds.count(row[0]) || moved_osds.count(row[1])) {
+	mark_pg(pg_t(ps, p.first));
+	continue;
+      }
+      const int32_t *up = row + 4 + pm.size;
+      for (int i = 0; i < row[3]; ++i) {
+	if (moved_osds.count(up[i])) {
+	  mark_pg(pg_t(ps, p.first));
+	  break;
+	}
+      }
+    }
+  }
+  return true;
+}
+
 void OSDMapMapping::_build_rmap(const OSDMap& osdmap)
 {
   acting_rmap.resize(osdmap.get_max_osd());
@@ -89,6 +343,49 @@ void OSDMapMapping::_finish(const OSDMap& osdmap)
   epoch = osdmap.get_epoch();
 }
 
+unsigned OSDMapMapping::check(const OSDMap& osdmap, std::ostream *out) const
+{
+  OSDMapMapping full;
+  full.update(osdmap);
+  unsigned errors = 0;
+  if (pools.size() != full.pools.size()) {
+    if (out) {
+      *out << "have " << pools.size() << " pools, expected "
+	   << full.pools.size() << "\n";
+    }
+    ++errors;
+  }
+  for (auto& p : full.pools) {
+    auto q = pools.find(p.first);
+    if (q == pools.end()) {
+      if (out) {
+	*out << "pool " << p.first << " missing\n";
+      }
+      errors += p.second.pg_num;
+      continue;
+    }
+    for (unsigned ps = 0; ps < p.second.pg_num; ++ps) {
+      vector<int> up, acting, full_up, full_acting;
+      int up_primary, acting_primary, full_up_primary, full_acting_primary;
+      q->second.get(ps, &up, &up_primary, &acting, &acting_primary);
+      p.second.get(ps, &full_up, &full_up_primary,
+		    &full_acting, &full_acting_primary);
+      if (up != full_up || up_primary != full_up_primary ||
+	  acting != full_acting || acting_primary != full_acting_primary) {
+	if (out) {
+	  *out << pg_t(ps, p.first) << " up " << up << " p" << up_primary
+	       << " acting " << acting << " p" << acting_primary
+	       << ", expected up " << full_up << " p" << full_up_primary
+	       << " acting " << full_acting << " p" << full_acting_primary
+	       << "\n";
+	}
+	++errors;
+      }
+    }
+  }
+  return errors;
+}
+
 void OSDMapMapping::_dump()
 {
   for (auto& p : pools) {
@@ -122,6 +419,23 @@ void OSDMapMapping::_update_range(
   }
 }
 
+void OSDMapMapping::MappingJob::complete()
+{
+  mapping->_finish(*osdmap);
+  if (check_cct) {
+    stringstream ss;
+    unsigned errors = mapping->check(*osdmap, &ss);
+    if (errors) {
+      lderr(check_cct) << __func__ << " e" << osdmap->get_epoch() << " "
+		       << errors << " pgs differ from a full recompute:\n"
+		       << ss.str() << dendl;
+      ceph_abort_msg(check_cct, "incremental pg mapping mismatch");
+    }
+    ldout(check_cct, 10) << __func__ << " e" << osdmap->get_epoch()
+			 << " matches a full recompute" << dendl;
+  }
+}
+
 // ---------------------------
 
 void ParallelPGMapper::Job::finish_one()
@@ -170,3 +484,26 @@ void ParallelPGMapper::queue(
   }
   assert(any);
 }
+
+void ParallelPGMapper::queue(
+  Job *job,
+  unsigned pgs_per_item,
+  const std::map<int64_t,interval_set<unsigned>>& pgs)
+{
+  // hold a reference of our own so that the job completes even if there
+  // is nothing to remap
+  job->start_one();
+  for (auto& p : pgs) {
+    for (auto q = p.second.begin(); q != p.second.end(); ++q) {
+      unsigned end = q.get_start() + q.get_len();
+      for (unsigned ps = q.get_start(); ps < end; ps += pgs_per_item) {
+	unsigned ps_end = MIN(ps + pgs_per_item, end);
+	job->start_one();
+	wq.queue(new Item(job, p.first, ps, ps_end));
+	ldout(cct, 20) << __func__ << " " << job << " " << p.first << " [" << ps
+		       << "," << ps_end << ")" << dendl;
+      }
+    }
+  }
+  job->finish_one();
+}
@@ -9,9 +9,9 @@
 #include <map>
 
 #include "osd/osd_types.h"
+#include "osd/OSDMap.h"
 #include "common/WorkQueue.h"
-
-class OSDMap;
+#include "include/interval_set.h"
 
 /// work queue to perform work on batches of pgids on multiple CPUs
 class ParallelPGMapper {
@@ -158,6 +158,15 @@ public:
   void queue(
     Job *job,
     unsigned pgs_per_item);
+  /// queue only the given ps ranges of each pool
+  void queue(
+    Job *job,
+    unsigned pgs_per_item,
+    const std::map<int64_t,interval_set<unsigned>>& pgs);
+
+  CephContext *get_cct() const {
+    return cct;
+  }
 
   void drain() {
     wq.drain();
@@ -243,10 +252,11 @@ private:
   mempool::osdmap_mapping::vector<
     mempool::osdmap_mapping::vector<pg_t>> acting_rmap;  // osd -> pg
   //unused: mempool::osdmap_mapping::vector<std::vector<pg_t>> up_rmap;  // osd -> pg
-  epoch_t epoch;
+  epoch_t epoch = 0;
   uint64_t num_pgs = 0;
 
-  void _init_mappings(const OSDMap& osdmap);
+  void _init_mappings(const OSDMap& osdmap,
+		      std::set<int64_t> *reset_pools = nullptr);
   void _update_range(
     const OSDMap& map,
     int64_t pool,
@@ -255,8 +265,17 @@ private:
   void _build_rmap(const OSDMap& osdmap);
 
   void _start(const OSDMap& osdmap) {
+    // an aborted job leaves a partial mapping behind; make sure nobody
+    // mistakes it for a complete one
+    epoch = 0;
     _init_mappings(osdmap);
   }
+  bool _get_dirty(const OSDMap& osdmap,
+		  const OSDMap::Incremental& inc,
+		  std::map<int64_t,interval_set<unsigned>> *dirty);
+  bool _start_incremental(const OSDMap& osdmap,
+			  const OSDMap::Incremental& inc,
+			  std::map<int64_t,interval_set<unsigned>> *dirty);
   void _finish(const OSDMap& osdmap);
 
   void _dump();
@@ -265,16 +284,14 @@ private:
 
   struct MappingJob : public ParallelPGMapper::Job {
     OSDMapMapping *mapping;
-    MappingJob(const OSDMap *osdmap, OSDMapMapping *m)
-      : Job(osdmap), mapping(m) {
-      mapping->_start(*osdmap);
-    }
+    CephContext *check_cct;  ///< if set, verify against a full recompute
+    MappingJob(const OSDMap *osdmap, OSDMapMapping *m,
+	       CephContext *check_cct = nullptr)
+      : Job(osdmap), mapping(m), check_cct(check_cct) {}
     void process(int64_t pool, unsigned ps_begin, unsigned ps_end) override {
       mapping->_update_range(*osdmap, pool, ps_begin, ps_end);
     }
-    void complete() override {
-      mapping->_finish(*osdmap);
-    }
+    void complete() override;
   };
 
 public:
@@ -302,15 +319,40 @@ public:
 
   void update(const OSDMap& map);
   void update(const OSDMap& map, pg_t pgid);
+  /**
+   * update to map, which must be the result of applying inc
+   *
+   * Only the PGs that inc can possibly have moved are recomputed.  If
+   * the mapping is not for the epoch right before inc, or inc changes
+   * something that may move any PG (e.g. the crush map), this falls back
+   * to a full update.
+   */
+  void update(const OSDMap& map, const OSDMap::Incremental& inc);
 
   std::unique_ptr<MappingJob> start_update(
     const OSDMap& map,
     ParallelPGMapper& mapper,
     unsigned pgs_per_item) {
     std::unique_ptr<MappingJob> job(new MappingJob(&map, this));
+    _start(map);
     mapper.queue(job.get(), pgs_per_item);
     return job;
   }
+  /// incremental version of the above; if check, verify the result
+  std::unique_ptr<MappingJob> start_update(
+    const OSDMap& map,
+    const OSDMap::Incremental& inc,
+    ParallelPGMapper& mapper,
+    unsigned pgs_per_item,
+    bool check = false);
+
+  /**
+   * compare against a full recompute for map
+   *
+   * @param out [out] description of each mismatch, if non-null
+   * @return number of PGs that do not match
+   */
+  unsigned check(const OSDMap& map, std::ostream *out) const;
 
   epoch_t get_epoch() const {
     return epoch;
@@ -5531,7 +5531,7 @@ next:
     formatter->open_array_section("objects");
     while (is_truncated) {
       map<string, rgw_bucket_dir_entry> result;
-      int r = store->cls_bucket_list(bucket_info, RGW_NO_SHARD, marker, prefix, 1000, true,
+      int r = store->cls_bucket_list(bucket_info, RGW_NO_SHARD, marker, prefix, "", 1000, true,
                                      result, &is_truncated, &marker,
                                      bucket_object_check_filter);
 
@@ -16,6 +16,7 @@
 
 #include "rgw_asio_frontend.h"
 #include "rgw_asio_client.h"
+#include "rgw_tools.h"
 
 #define dout_subsys ceph_subsys_rgw
 
@@ -69,8 +70,46 @@ void Pauser::wait()
 
 using tcp = boost::asio::ip::tcp;
 
+// suspends the connection's coroutine on librados completions. the
+// completion callback runs on a librados thread, so it resumes the
+// coroutine through the strand the coroutine was spawned on
+class AsioYield : public RGWYield {
+  boost::asio::io_service::strand strand;
+  boost::asio::yield_context yield;
+  boost::asio::deadline_timer timer;
+  bool done{false}; // only accessed on the strand
+
+  static void finish(librados::completion_t, void *arg) {
+    auto y = static_cast<AsioYield*>(arg);
+    y->strand.post([y] {
+                     y->done = true;
+                     y->timer.cancel();
+                   });
+  }
+ public:
+  AsioYield(boost::asio::io_service::strand strand,
+            boost::asio::yield_context yield)
+    : strand(strand), yield(yield), timer(strand.get_io_service()) {}
+
+  librados::AioCompletion *create_completion() override {
+    return librados::Rados::aio_create_completion(this, finish, nullptr);
+  }
+
+  void wait(librados::AioCompletion *c) override {
+    // finish() can only run once we give up the strand, so waiting on the
+    // timer until it fires never misses the wakeup
+    boost::system::error_code ec;
+    timer.expires_at(boost::posix_time::pos_infin);
+    while (!done) {
+      timer.async_wait(yield[ec]);
+    }
+    done = false;
+  }
+};
+
 // coroutine to handle a client connection to completion
 static void handle_connection(RGWProcessEnv& env, tcp::socket socket,
+                              boost::asio::io_service::strand strand,
                               boost::asio::yield_context yield)
 {
   auto cct = env.store->ctx();
@@ -78,6 +117,12 @@ static void handle_connection(RGWProcessEnv& env, tcp::socket socket,
 
   beast::flat_streambuf buffer{1024};
 
+  AsioYield async_yield{strand, yield};
+  RGWYield *y = nullptr;
+  if (cct->_conf->rgw_beast_enable_async) {
+    y = &async_yield;
+  }
+
   // read messages from the socket until eof
   for (;;) {
     // parse the header
@@ -117,7 +162,7 @@ static void handle_connection(RGWProcessEnv& env, tcp::socket socket,
                                   &real_client))));
     RGWRestfulIO client(&real_client_io);
     process_request(env.store, env.rest, &req, env.uri_prefix,
-                    *env.auth_registry, &client, env.olog);
+                    *env.auth_registry, &client, env.olog, y);
 
     if (real_client.get_conn_close()) {
       return;
@@ -189,9 +234,11 @@ void AsioFrontend::accept(boost::system::error_code ec)
   }
   auto socket = std::move(peer_socket);
   // spawn a coroutine to handle the connection
-  boost::asio::spawn(service,
+  boost::asio::io_service::strand strand{service};
+  boost::asio::spawn(strand,
                      [&] (boost::asio::yield_context yield) {
-                       handle_connection(env, std::move(socket), yield);
+                       handle_connection(env, std::move(socket), strand,
+                                         yield);
                      });
   acceptor.async_accept(peer_socket,
                         [this] (boost::system::error_code ec) {
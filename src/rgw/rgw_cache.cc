@@ -2,6 +2,8 @@
 // vim: ts=8 sw=2 smarttab
 
 #include "rgw_cache.h"
+#include "common/perf_counters.h"
+#include "include/stringify.h"
 
 #include <errno.h>
 
@@ -9,50 +11,112 @@
 
 using namespace std;
 
+enum {
+  l_rgw_cache_shard_first = 15500,
+  l_rgw_cache_shard_hit,
+  l_rgw_cache_shard_miss,
+  l_rgw_cache_shard_evict,
+  l_rgw_cache_shard_second_chance,
+  l_rgw_cache_shard_entries,
+  l_rgw_cache_shard_last,
+};
+
+ObjectCache::~ObjectCache()
+{
+  for (auto shard : shards) {
+    shard->lru.clear();
+    if (shard->perf_counters) {
+      cct->get_perfcounters_collection()->remove(shard->perf_counters);
+      delete shard->perf_counters;
+    }
+    delete shard;
+  }
+}
+
+void ObjectCache::set_ctx(CephContext *_cct)
+{
+  cct = _cct;
+  if (!shards.empty()) {
+    return;
+  }
+
+  size_t num_shards = cct->_conf->rgw_cache_shards;
+  shard_lru_size = std::max<size_t>(cct->_conf->rgw_cache_lru_size / num_shards, 1);
+
+  for (size_t i = 0; i < num_shards; ++i) {
+    string name = "rgw_cache_shard_" + stringify(i);
+    Shard *shard = new Shard("ObjectCache::" + name);
+
+    PerfCountersBuilder plb(cct, name, l_rgw_cache_shard_first, l_rgw_cache_shard_last);
+    plb.add_u64_counter(l_rgw_cache_shard_hit, "hit", "Cache hits");
+    plb.add_u64_counter(l_rgw_cache_shard_miss, "miss", "Cache misses");
+    plb.add_u64_counter(l_rgw_cache_shard_evict, "evict", "Entries evicted from the LRU");
+    plb.add_u64_counter(l_rgw_cache_shard_second_chance, "second_chance",
+                        "Entries kept in the LRU because they were hit");
+    plb.add_u64(l_rgw_cache_shard_entries, "entries", "Cached entries");
+    shard->perf_counters = plb.create_perf_counters();
+    cct->get_perfcounters_collection()->add(shard->perf_counters);
+
+    shards.push_back(shard);
+  }
+}
+
+ObjectCache::Shard& ObjectCache::get_shard(const string& name)
+{
+  assert(!shards.empty());
+  return *shards[std::hash<string>()(name) % shards.size()];
+}
+
+void ObjectCache::lock_all()
+{
+  // always in the same order, see chain_cache_entry()
+  for (auto shard : shards) {
+    shard->lock.get_write();
+  }
+}
+
+void ObjectCache::unlock_all()
+{
+  for (auto iter = shards.rbegin(); iter != shards.rend(); ++iter) {
+    (*iter)->lock.unlock();
+  }
+}
+
 int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cache_entry_info *cache_info)
 {
-  RWLock::RLocker l(lock);
+  if (!enabled) {
+    return -ENOENT;
+  }
+
+  Shard& shard = get_shard(name);
+  RWLock::RLocker l(shard.lock);
 
   if (!enabled) {
     return -ENOENT;
   }
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
+  auto iter = shard.entries.find(name);
+  if (iter == shard.entries.end()) {
     ldout(cct, 10) << "cache get: name=" << name << " : miss" << dendl;
     if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
+    shard.perf_counters->inc(l_rgw_cache_shard_miss);
     return -ENOENT;
   }
 
   ObjectCacheEntry *entry = &iter->second;
 
-  if (lru_counter - entry->lru_promotion_ts > lru_window) {
-    ldout(cct, 20) << "cache get: touching lru, lru_counter=" << lru_counter
-                   << " promotion_ts=" << entry->lru_promotion_ts << dendl;
-    lock.unlock();
-    lock.get_write(); /* promote lock to writer */
-
-    /* need to redo this because entry might have dropped off the cache */
-    iter = cache_map.find(name);
-    if (iter == cache_map.end()) {
-      ldout(cct, 10) << "lost race! cache get: name=" << name << " : miss" << dendl;
-      if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
-      return -ENOENT;
-    }
-
-    entry = &iter->second;
-    /* check again, we might have lost a race here */
-    if (lru_counter - entry->lru_promotion_ts > lru_window) {
-      touch_lru(name, *entry, iter->second.lru_iter);
-    }
+  /* avoid dirtying the cache line if the entry was already referenced */
+  if (!entry->referenced.load(std::memory_order_relaxed)) {
+    entry->referenced.store(true, std::memory_order_relaxed);
   }
 
-  ObjectCacheInfo& src = iter->second.info;
+  ObjectCacheInfo& src = entry->info;
   if ((src.flags & mask) != mask) {
     ldout(cct, 10) << "cache get: name=" << name << " : type miss (requested=0x"
                    << std::hex << mask << ", cached=0x" << src.flags
                    << std::dec << ")" << dendl;
     if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
+    shard.perf_counters->inc(l_rgw_cache_shard_miss);
     return -ENOENT;
   }
   ldout(cct, 10) << "cache get: name=" << name << " : hit (requested=0x"
@@ -65,30 +129,51 @@ int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cac
     cache_info->gen = entry->gen;
   }
   if(perfcounter) perfcounter->inc(l_rgw_cache_hit);
+  shard.perf_counters->inc(l_rgw_cache_shard_hit);
 
   return 0;
 }
 
 bool ObjectCache::chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_entries, RGWChainedCache::Entry *chained_entry)
 {
-  RWLock::WLocker l(lock);
-
   if (!enabled) {
     return false;
   }
 
-  list<rgw_cache_entry_info *>::iterator citer;
+  /* the entries may live in different shards; lock them in shard order */
+  set<Shard *> locked_shards;
+  for (auto cache_info : cache_info_entries) {
+    locked_shards.insert(&get_shard(cache_info->cache_locator));
+  }
+  vector<Shard *> ordered_shards;
+  for (auto shard : shards) {
+    if (locked_shards.count(shard)) {
+      shard->lock.get_write();
+      ordered_shards.push_back(shard);
+    }
+  }
+
+  auto unlock = [&ordered_shards]() {
+    for (auto iter = ordered_shards.rbegin(); iter != ordered_shards.rend(); ++iter) {
+      (*iter)->lock.unlock();
+    }
+  };
+
+  if (!enabled) {
+    unlock();
+    return false;
+  }
 
   list<ObjectCacheEntry *> cache_entry_list;
 
   /* first verify that all entries are still valid */
-  for (citer = cache_info_entries.begin(); citer != cache_info_entries.end(); ++citer) {
-    rgw_cache_entry_info *cache_info = *citer;
-
+  for (auto cache_info : cache_info_entries) {
     ldout(cct, 10) << "chain_cache_entry: cache_locator=" << cache_info->cache_locator << dendl;
-    map<string, ObjectCacheEntry>::iterator iter = cache_map.find(cache_info->cache_locator);
-    if (iter == cache_map.end()) {
+    Shard& shard = get_shard(cache_info->cache_locator);
+    auto iter = shard.entries.find(cache_info->cache_locator);
+    if (iter == shard.entries.end()) {
       ldout(cct, 20) << "chain_cache_entry: couldn't find cache locator" << dendl;
+      unlock();
       return false;
     }
 
@@ -96,6 +181,7 @@ bool ObjectCache::chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_ent
 
     if (entry->gen != cache_info->gen) {
       ldout(cct, 20) << "chain_cache_entry: entry.gen (" << entry->gen << ") != cache_info.gen (" << cache_info->gen << ")" << dendl;
+      unlock();
       return false;
     }
 
@@ -105,20 +191,22 @@ bool ObjectCache::chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_ent
 
   chained_entry->cache->chain_cb(chained_entry->key, chained_entry->data);
 
-  list<ObjectCacheEntry *>::iterator liter;
-
-  for (liter = cache_entry_list.begin(); liter != cache_entry_list.end(); ++liter) {
-    ObjectCacheEntry *entry = *liter;
-
+  for (auto entry : cache_entry_list) {
     entry->chained_entries.push_back(make_pair(chained_entry->cache, chained_entry->key));
   }
 
+  unlock();
   return true;
 }
 
 void ObjectCache::put(string& name, ObjectCacheInfo& info, rgw_cache_entry_info *cache_info)
 {
-  RWLock::WLocker l(lock);
+  if (!enabled) {
+    return;
+  }
+
+  Shard& shard = get_shard(name);
+  RWLock::WLocker l(shard.lock);
 
   if (!enabled) {
     return;
@@ -126,12 +214,12 @@ void ObjectCache::put(string& name, ObjectCacheInfo& info, rgw_cache_entry_info
 
   ldout(cct, 10) << "cache put: name=" << name << " info.flags=0x"
                  << std::hex << info.flags << std::dec << dendl;
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
-    ObjectCacheEntry entry;
-    entry.lru_iter = lru.end();
-    cache_map.insert(pair<string, ObjectCacheEntry>(name, entry));
-    iter = cache_map.find(name);
+  auto iter = shard.entries.find(name);
+  if (iter == shard.entries.end()) {
+    iter = shard.entries.emplace(piecewise_construct, forward_as_tuple(name),
+                                 forward_as_tuple()).first;
+    iter->second.name = &iter->first;
+    shard.perf_counters->set(l_rgw_cache_shard_entries, shard.entries.size());
   }
   ObjectCacheEntry& entry = iter->second;
   ObjectCacheInfo& target = entry.info;
@@ -145,7 +233,7 @@ void ObjectCache::put(string& name, ObjectCacheInfo& info, rgw_cache_entry_info
   entry.chained_entries.clear();
   entry.gen++;
 
-  touch_lru(name, entry, entry.lru_iter);
+  touch_lru(shard, entry);
 
   target.status = info.status;
 
@@ -195,101 +283,109 @@ void ObjectCache::put(string& name, ObjectCacheInfo& info, rgw_cache_entry_info
 
 void ObjectCache::remove(string& name)
 {
-  RWLock::WLocker l(lock);
+  if (!enabled) {
+    return;
+  }
+
+  Shard& shard = get_shard(name);
+  RWLock::WLocker l(shard.lock);
 
   if (!enabled) {
     return;
   }
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end())
+  auto iter = shard.entries.find(name);
+  if (iter == shard.entries.end())
     return;
 
   ldout(cct, 10) << "removing " << name << " from cache" << dendl;
-  ObjectCacheEntry& entry = iter->second;
+  remove_entry(shard, iter->second);
+}
 
+void ObjectCache::remove_entry(Shard& shard, ObjectCacheEntry& entry)
+{
   for (list<pair<RGWChainedCache *, string> >::iterator iiter = entry.chained_entries.begin();
        iiter != entry.chained_entries.end(); ++iiter) {
     RGWChainedCache *chained_cache = iiter->first;
     chained_cache->invalidate(iiter->second);
   }
 
-  remove_lru(name, iter->second.lru_iter);
-  cache_map.erase(iter);
+  if (entry.lru_hook.is_linked()) {
+    shard.lru.erase(shard.lru.iterator_to(entry));
+  }
+  shard.entries.erase(*entry.name);
+  shard.perf_counters->set(l_rgw_cache_shard_entries, shard.entries.size());
+}
+
+void ObjectCache::touch_lru(Shard& shard, ObjectCacheEntry& entry)
+{
+  if (entry.lru_hook.is_linked()) {
+    ldout(cct, 10) << "moving " << *entry.name << " to cache LRU end" << dendl;
+    shard.lru.erase(shard.lru.iterator_to(entry));
+  } else {
+    ldout(cct, 10) << "adding " << *entry.name << " to cache LRU end" << dendl;
+  }
+  shard.lru.push_back(entry);
+  entry.referenced = false;
+
+  trim_lru(shard, entry);
 }
 
-void ObjectCache::touch_lru(string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter)
+void ObjectCache::trim_lru(Shard& shard, ObjectCacheEntry& keep)
 {
-  while (lru_size > (size_t)cct->_conf->rgw_cache_lru_size) {
-    list<string>::iterator iter = lru.begin();
-    if ((*iter).compare(name) == 0) {
+  while (shard.lru.size() > shard_lru_size) {
+    ObjectCacheEntry& entry = shard.lru.front();
+    if (&entry == &keep) {
       /*
        * if the entry we're touching happens to be at the lru end, don't remove it,
        * lru shrinking can wait for next time
        */
       break;
     }
-    map<string, ObjectCacheEntry>::iterator map_iter = cache_map.find(*iter);
-    ldout(cct, 10) << "removing entry: name=" << *iter << " from cache LRU" << dendl;
-    if (map_iter != cache_map.end())
-      cache_map.erase(map_iter);
-    lru.pop_front();
-    lru_size--;
-  }
-
-  if (lru_iter == lru.end()) {
-    lru.push_back(name);
-    lru_size++;
-    lru_iter--;
-    ldout(cct, 10) << "adding " << name << " to cache LRU end" << dendl;
-  } else {
-    ldout(cct, 10) << "moving " << name << " to cache LRU end" << dendl;
-    lru.erase(lru_iter);
-    lru.push_back(name);
-    lru_iter = lru.end();
-    --lru_iter;
-  }
-
-  lru_counter++;
-  entry.lru_promotion_ts = lru_counter;
-}
 
-void ObjectCache::remove_lru(string& name, std::list<string>::iterator& lru_iter)
-{
-  if (lru_iter == lru.end())
-    return;
+    shard.lru.pop_front();
+    if (entry.referenced.exchange(false)) {
+      /* hit since it was last looked at, give it another round */
+      shard.lru.push_back(entry);
+      shard.perf_counters->inc(l_rgw_cache_shard_second_chance);
+      continue;
+    }
 
-  lru.erase(lru_iter);
-  lru_size--;
-  lru_iter = lru.end();
+    ldout(cct, 10) << "removing entry: name=" << *entry.name << " from cache LRU" << dendl;
+    shard.perf_counters->inc(l_rgw_cache_shard_evict);
+    remove_entry(shard, entry);
+  }
 }
 
 void ObjectCache::set_enabled(bool status)
 {
-  RWLock::WLocker l(lock);
+  lock_all();
 
   enabled = status;
 
   if (!enabled) {
     do_invalidate_all();
   }
+
+  unlock_all();
 }
 
 void ObjectCache::invalidate_all()
 {
-  RWLock::WLocker l(lock);
+  lock_all();
 
   do_invalidate_all();
+
+  unlock_all();
 }
 
 void ObjectCache::do_invalidate_all()
 {
-  cache_map.clear();
-  lru.clear();
-
-  lru_size = 0;
-  lru_counter = 0;
-  lru_window = 0;
+  for (auto shard : shards) {
+    shard->lru.clear();
+    shard->entries.clear();
+    shard->perf_counters->set(l_rgw_cache_shard_entries, 0);
+  }
 
   for (list<RGWChainedCache *>::iterator iter = chained_cache.begin(); iter != chained_cache.end(); ++iter) {
     (*iter)->invalidate_all();
@@ -297,7 +393,7 @@ void ObjectCache::do_invalidate_all()
 }
 
 void ObjectCache::chain_cache(RGWChainedCache *cache) {
-  RWLock::WLocker l(lock);
+  lock_all();
   chained_cache.push_back(cache);
+  unlock_all();
 }
-
@@ -5,8 +5,12 @@
 #define CEPH_RGWCACHE_H
 
 #include "rgw_rados.h"
+#include <atomic>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <vector>
+#include <boost/intrusive/list.hpp>
 #include "include/types.h"
 #include "include/utime.h"
 #include "include/assert.h"
@@ -126,40 +130,63 @@ WRITE_CLASS_ENCODER(RGWCacheNotifyInfo)
 
 struct ObjectCacheEntry {
   ObjectCacheInfo info;
-  std::list<string>::iterator lru_iter;
-  uint64_t lru_promotion_ts;
+  const string *name;  // key of the entry in its shard
+  boost::intrusive::list_member_hook<> lru_hook;
+  std::atomic<bool> referenced; // hit since it was last considered for eviction
   uint64_t gen;
   std::list<pair<RGWChainedCache *, string> > chained_entries;
 
-  ObjectCacheEntry() : lru_promotion_ts(0), gen(0) {}
+  ObjectCacheEntry() : name(NULL), referenced(false), gen(0) {}
 };
 
+/*
+ * The cache is split into shards by hash of the object name. Each shard has
+ * its own lock, hash table and LRU, so lookups of different objects rarely
+ * contend. Hits only set the entry's referenced bit under the shared lock;
+ * the LRU order is fixed up lazily when the shard needs to evict (second
+ * chance), so the exclusive lock is only taken to modify the cache.
+ */
 class ObjectCache {
-  std::map<string, ObjectCacheEntry> cache_map;
-  std::list<string> lru;
-  unsigned long lru_size;
-  unsigned long lru_counter;
-  unsigned long lru_window;
-  RWLock lock;
+  typedef boost::intrusive::list<
+    ObjectCacheEntry,
+    boost::intrusive::member_hook<ObjectCacheEntry,
+                                  boost::intrusive::list_member_hook<>,
+                                  &ObjectCacheEntry::lru_hook> > LRU;
+
+  struct Shard {
+    RWLock lock;
+    std::unordered_map<string, ObjectCacheEntry> entries;
+    LRU lru;
+    PerfCounters *perf_counters;
+
+    explicit Shard(const string& lock_name)
+      : lock(lock_name), perf_counters(NULL) {}
+  };
+
+  std::vector<Shard *> shards;
+  size_t shard_lru_size;
   CephContext *cct;
 
-  list<RGWChainedCache *> chained_cache;
+  list<RGWChainedCache *> chained_cache; // protected by all shard locks
 
-  bool enabled;
+  std::atomic<bool> enabled;
 
-  void touch_lru(string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter);
-  void remove_lru(string& name, std::list<string>::iterator& lru_iter);
+  Shard& get_shard(const string& name);
+  void lock_all();
+  void unlock_all();
+
+  void touch_lru(Shard& shard, ObjectCacheEntry& entry);
+  void trim_lru(Shard& shard, ObjectCacheEntry& keep);
+  void remove_entry(Shard& shard, ObjectCacheEntry& entry);
 
   void do_invalidate_all();
 public:
-  ObjectCache() : lru_size(0), lru_counter(0), lru_window(0), lock("ObjectCache"), cct(NULL), enabled(false) { }
+  ObjectCache() : shard_lru_size(0), cct(NULL), enabled(false) { }
+  ~ObjectCache();
   int get(std::string& name, ObjectCacheInfo& bl, uint32_t mask, rgw_cache_entry_info *cache_info);
   void put(std::string& name, ObjectCacheInfo& bl, rgw_cache_entry_info *cache_info);
   void remove(std::string& name);
-  void set_ctx(CephContext *_cct) {
-    cct = _cct;
-    lru_window = cct->_conf->rgw_cache_lru_size / 2;
-  }
+  void set_ctx(CephContext *_cct);
   bool chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_entries, RGWChainedCache::Entry *chained_entry);
 
   void set_enabled(bool status);
@@ -241,7 +268,8 @@ public:
                      rgw_cache_entry_info *cache_info) override;
 
   int raw_obj_stat(rgw_raw_obj& obj, uint64_t *psize, real_time *pmtime, uint64_t *epoch, map<string, bufferlist> *attrs,
-                   bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker) override;
+                   bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker,
+                   RGWYield *y = nullptr) override;
 
   int delete_system_obj(rgw_raw_obj& obj, RGWObjVersionTracker *objv_tracker) override;
 
@@ -461,7 +489,8 @@ int RGWCache<T>::put_system_obj_data(void *ctx, rgw_raw_obj& obj, bufferlist& da
 template <class T>
 int RGWCache<T>::raw_obj_stat(rgw_raw_obj& obj, uint64_t *psize, real_time *pmtime,
                           uint64_t *pepoch, map<string, bufferlist> *attrs,
-                          bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker)
+                          bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker,
+                          RGWYield *y)
 {
   rgw_pool pool;
   string oid;
@@ -489,7 +518,7 @@ int RGWCache<T>::raw_obj_stat(rgw_raw_obj& obj, uint64_t *psize, real_time *pmti
       objv_tracker->read_version = info.version;
     goto done;
   }
-  r = T::raw_obj_stat(obj, &size, &mtime, &epoch, &info.xattrs, first_chunk, objv_tracker);
+  r = T::raw_obj_stat(obj, &size, &mtime, &epoch, &info.xattrs, first_chunk, objv_tracker, y);
   if (r < 0) {
     if (r == -ENOENT) {
       info.status = r;
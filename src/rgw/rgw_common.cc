@@ -152,6 +152,9 @@ int rgw_perf_start(CephContext *cct)
   plb.add_u64_counter(l_rgw_keystone_token_cache_hit, "keystone_token_cache_hit", "Keystone token cache hits");
   plb.add_u64_counter(l_rgw_keystone_token_cache_miss, "keystone_token_cache_miss", "Keystone token cache miss");
 
+  plb.add_u64_counter(l_rgw_compress_b, "compress_b", "Size of data compression was tried on");
+  plb.add_u64_counter(l_rgw_compress_skipped_b, "compress_skipped_b", "Size of data stored uncompressed as likely incompressible");
+
   perfcounter = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(perfcounter);
   return 0;
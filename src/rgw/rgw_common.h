@@ -256,6 +256,9 @@ enum {
   l_rgw_keystone_token_cache_hit,
   l_rgw_keystone_token_cache_miss,
 
+  l_rgw_compress_b,
+  l_rgw_compress_skipped_b,
+
   l_rgw_last,
 };
 
@@ -16,9 +16,25 @@ int RGWPutObj_Compress::handle_data(bufferlist& bl, off_t ofs, void **phandle, r
   }
   if (bl.length() > 0) {
     // compression stuff
+    bool hopeless = false;
+    if (ofs == 0) {
+      // don't bother with objects that are already compressed or encrypted
+      double max_ratio = cct->_conf->get_val<double>("rgw_compression_estimate_ratio");
+      if (max_ratio < 1) {
+        double ratio = Compressor::estimate_ratio(bl);
+        if (ratio > max_ratio) {
+          ldout(cct, 10) << "First part estimated to compress to " << ratio
+              << ", storing uncompressed" << dendl;
+          hopeless = true;
+        }
+      }
+    }
     if ((ofs > 0 && compressed) ||                                // if previous part was compressed
-        (ofs == 0)) {                                             // or it's the first part
+        (ofs == 0 && !hopeless)) {                                // or it's the first part
       ldout(cct, 10) << "Compression for rgw is enabled, compress part " << bl.length() << dendl;
+      if (perfcounter) {
+        perfcounter->inc(l_rgw_compress_b, bl.length());
+      }
       int cr = compressor->compress(bl, in_bl);
       if (cr < 0) {
         if (ofs > 0) {
@@ -42,6 +58,9 @@ int RGWPutObj_Compress::handle_data(bufferlist& bl, off_t ofs, void **phandle, r
       }
     } else {
       compressed = false;
+      if (perfcounter) {
+        perfcounter->inc(l_rgw_compress_skipped_b, bl.length());
+      }
       in_bl.claim(bl);
     }
     // end of compression stuff
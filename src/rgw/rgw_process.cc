@@ -115,7 +115,8 @@ int process_request(RGWRados* const store,
                     const std::string& frontend_prefix,
                     const rgw_auth_registry_t& auth_registry,
                     RGWRestfulIO* const client_io,
-                    OpsLogSocket* const olog)
+                    OpsLogSocket* const olog,
+                    RGWYield* const yield)
 {
   int ret = 0;
 
@@ -135,6 +136,7 @@ int process_request(RGWRados* const store,
   struct req_state *s = &rstate;
 
   RGWObjectCtx rados_ctx(store, s);
+  rados_ctx.yield = yield;
   s->obj_ctx = &rados_ctx;
 
   s->req_id = store->unique_id(req->id);
@@ -189,6 +189,8 @@ public:
   void set_access_key(RGWAccessKey& key) { access_key = key; }
 };
 
+class RGWYield;
+
 /* process stream request */
 extern int process_request(RGWRados* store,
                            RGWREST* rest,
@@ -196,7 +198,8 @@ extern int process_request(RGWRados* store,
                            const std::string& frontend_prefix,
                            const rgw_auth_registry_t& auth_registry,
                            RGWRestfulIO* client_io,
-                           OpsLogSocket* olog);
+                           OpsLogSocket* olog,
+                           RGWYield* yield = nullptr);
 
 extern int rgw_process_authenticated(RGWHandler_REST* handler,
                                      RGWOp*& op,
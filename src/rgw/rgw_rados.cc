@@ -6,6 +6,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <cmath>
 #include <boost/algorithm/string.hpp>
 
 #include <boost/format.hpp>
@@ -5596,6 +5597,14 @@ int RGWRados::Bucket::List::list_objects(int64_t max,
     }
   }
   
+  /* let the index skip over common prefixes. keys in other namespaces
+   * start with '_', so the delimiter must not match there, and filtered
+   * listings need to see the keys under the prefixes */
+  string cls_delim;
+  if (!params.filter && params.delim.find('_') == string::npos) {
+    cls_delim = params.delim;
+  }
+
   string skip_after_delim;
   while (truncated && count <= max) {
     if (skip_after_delim > cur_marker.name) {
@@ -5604,7 +5613,7 @@ int RGWRados::Bucket::List::list_objects(int64_t max,
     }
     std::map<string, rgw_bucket_dir_entry> ent_map;
     int r = store->cls_bucket_list(target->get_bucket_info(), shard_id, cur_marker, cur_prefix,
-                                   read_ahead + 1 - count, params.list_versions, ent_map,
+                                   cls_delim, read_ahead + 1 - count, params.list_versions, ent_map,
                                    &truncated, &cur_marker);
     if (r < 0)
       return r;
@@ -5622,7 +5631,11 @@ int RGWRados::Bucket::List::list_objects(int64_t max,
        */
       bool valid = rgw_obj_key::parse_raw_oid(index_key.name, &obj);
       if (!valid) {
-        ldout(cct, 0) << "ERROR: could not parse object name: " << obj.name << dendl;
+        /* the delimiter can cut a common prefix inside the namespace of
+         * keys we don't list */
+        if (!entry.is_common_prefix()) {
+          ldout(cct, 0) << "ERROR: could not parse object name: " << obj.name << dendl;
+        }
         continue;
       }
       bool check_ns = (obj.ns == params.ns);
@@ -5672,9 +5685,9 @@ int RGWRados::Bucket::List::list_objects(int64_t max,
             next_marker = prefix_key;
             (*common_prefixes)[prefix_key] = true;
 
-            int marker_delim_pos = cur_marker.name.find(params.delim, cur_prefix.size());
+            int marker_delim_pos = index_key.name.find(params.delim, cur_prefix.size());
 
-            skip_after_delim = cur_marker.name.substr(0, marker_delim_pos);
+            skip_after_delim = index_key.name.substr(0, marker_delim_pos);
             skip_after_delim.append(bigger_than_delim);
 
             ldout(cct, 20) << "skip_after_delim=" << skip_after_delim << dendl;
@@ -6952,12 +6965,12 @@ int RGWRados::Object::Write::_do_write_meta(uint64_t size, uint64_t accounted_si
   }
 
   if (!index_op->is_prepared()) {
-    r = index_op->prepare(CLS_RGW_OP_ADD, &state->write_tag);
+    r = index_op->prepare(CLS_RGW_OP_ADD, &state->write_tag, target->get_ctx().yield);
     if (r < 0)
       return r;
   }
 
-  r = ref.ioctx.operate(ref.oid, &op);
+  r = rgw_rados_operate(ref.ioctx, ref.oid, &op, target->get_ctx().yield, &epoch);
   if (r < 0) { /* we can expect to get -ECANCELED if object was replaced under,
                 or -ENOENT if was removed, or -EEXIST if it did not exist
                 before and now it does */
@@ -6968,7 +6981,6 @@ int RGWRados::Object::Write::_do_write_meta(uint64_t size, uint64_t accounted_si
     goto done_cancel;
   }
 
-  epoch = ref.ioctx.get_last_version();
   poolid = ref.ioctx.get_id();
 
   r = target->complete_atomic_modification();
@@ -8325,7 +8337,7 @@ int RGWRados::check_bucket_empty(RGWBucketInfo& bucket_info)
 
   do {
 #define NUM_ENTRIES 1000
-    int r = cls_bucket_list(bucket_info, RGW_NO_SHARD, marker, prefix, NUM_ENTRIES, true, ent_map,
+    int r = cls_bucket_list(bucket_info, RGW_NO_SHARD, marker, prefix, "", NUM_ENTRIES, true, ent_map,
                         &is_truncated, &marker);
     if (r < 0)
       return r;
@@ -8874,12 +8886,14 @@ int RGWRados::Object::Delete::delete_obj()
   index_op.set_bilog_flags(params.bilog_flags);
 
 
-  r = index_op.prepare(CLS_RGW_OP_DEL, &state->write_tag);
+  RGWYield *y = target->get_ctx().yield;
+  r = index_op.prepare(CLS_RGW_OP_DEL, &state->write_tag, y);
   if (r < 0)
     return r;
 
   store->remove_rgw_head_obj(op);
-  r = ref.ioctx.operate(ref.oid, &op);
+  uint64_t epoch;
+  r = rgw_rados_operate(ref.ioctx, ref.oid, &op, y, &epoch);
   bool need_invalidate = false;
   if (r == -ECANCELED) {
     /* raced with another operation, we can regard it as removed */
@@ -8894,7 +8908,7 @@ int RGWRados::Object::Delete::delete_obj()
       tombstone_entry entry{*state};
       obj_tombstone_cache->add(obj, entry);
     }
-    r = index_op.complete_del(poolid, ref.ioctx.get_last_version(), state->mtime, params.remove_objs);
+    r = index_op.complete_del(poolid, epoch, state->mtime, params.remove_objs);
     
     int ret = target->complete_atomic_modification();
     if (ret < 0) {
@@ -9086,7 +9100,8 @@ int RGWRados::get_system_obj_state_impl(RGWObjectCtx *rctx, rgw_raw_obj& obj, RG
 
   s->obj = obj;
 
-  int r = raw_obj_stat(obj, &s->size, &s->mtime, &s->epoch, &s->attrset, (s->prefetch_data ? &s->data : NULL), objv_tracker);
+  int r = raw_obj_stat(obj, &s->size, &s->mtime, &s->epoch, &s->attrset, (s->prefetch_data ? &s->data : NULL), objv_tracker,
+                       rctx->yield);
   if (r == -ENOENT) {
     s->exists = false;
     s->has_attrs = true;
@@ -9147,7 +9162,8 @@ int RGWRados::get_obj_state_impl(RGWObjectCtx *rctx, const RGWBucketInfo& bucket
   int r = -ENOENT;
 
   if (!assume_noent) {
-    r = RGWRados::raw_obj_stat(raw_obj, &s->size, &s->mtime, &s->epoch, &s->attrset, (s->prefetch_data ? &s->data : NULL), NULL);
+    r = RGWRados::raw_obj_stat(raw_obj, &s->size, &s->mtime, &s->epoch, &s->attrset, (s->prefetch_data ? &s->data : NULL), NULL,
+                               rctx->yield);
   }
 
   if (r == -ENOENT) {
@@ -9949,7 +9965,7 @@ int RGWRados::SystemObject::Read::stat(RGWObjVersionTracker *objv_tracker)
                                 stat_params.lastmod, stat_params.obj_size, objv_tracker);
 }
 
-int RGWRados::Bucket::UpdateIndex::prepare(RGWModifyOp op, const string *write_tag)
+int RGWRados::Bucket::UpdateIndex::prepare(RGWModifyOp op, const string *write_tag, RGWYield *y)
 {
   if (blind) {
     return 0;
@@ -9965,7 +9981,7 @@ int RGWRados::Bucket::UpdateIndex::prepare(RGWModifyOp op, const string *write_t
   }
 
   int r = guard_reshard(nullptr, [&](BucketShard *bs) -> int { 
-    return store->cls_obj_prepare_op(*bs, op, optag, obj, bilog_flags, zones_trace);
+    return store->cls_obj_prepare_op(*bs, op, optag, obj, bilog_flags, zones_trace, y);
   });
 
   if (r < 0) {
@@ -10166,7 +10182,7 @@ int RGWRados::Object::Read::read(int64_t ofs, int64_t end, bufferlist& bl)
   ldout(cct, 20) << "rados->read obj-ofs=" << ofs << " read_ofs=" << read_ofs << " read_len=" << read_len << dendl;
   op.read(read_ofs, read_len, pbl, NULL);
 
-  r = state.io_ctx.operate(read_obj.oid, &op, NULL);
+  r = rgw_rados_operate(state.io_ctx, read_obj.oid, &op, NULL, source->get_ctx().yield);
   ldout(cct, 20) << "rados->read r=" << r << " bl.length=" << bl.length() << dendl;
 
   if (r < 0) {
@@ -10225,15 +10241,14 @@ int RGWRados::get_system_obj(RGWObjectCtx& obj_ctx, RGWRados::SystemObject::Read
     ldout(cct, 20) << "read_state.get_ref() on obj=" << obj << " returned " << r << dendl;
     return r;
   }
-  r = ref->ioctx.operate(ref->oid, &op, NULL);
+  uint64_t op_ver;
+  r = rgw_rados_operate(ref->ioctx, ref->oid, &op, NULL, obj_ctx.yield, &op_ver);
   if (r < 0) {
     ldout(cct, 20) << "rados->read r=" << r << " bl.length=" << bl.length() << dendl;
     return r;
   }
   ldout(cct, 20) << "rados->read r=" << r << " bl.length=" << bl.length() << dendl;
 
-  uint64_t op_ver = ref->ioctx.get_last_version();
-
   if (read_state.last_ver > 0 &&
       read_state.last_ver != op_ver) {
     ldout(cct, 5) << "raced with an object write, abort" << dendl;
@@ -11521,7 +11536,7 @@ int RGWRados::follow_olh(const RGWBucketInfo& bucket_info, RGWObjectCtx& obj_ctx
 
 int RGWRados::raw_obj_stat(rgw_raw_obj& obj, uint64_t *psize, real_time *pmtime, uint64_t *epoch,
                            map<string, bufferlist> *attrs, bufferlist *first_chunk,
-                           RGWObjVersionTracker *objv_tracker)
+                           RGWObjVersionTracker *objv_tracker, RGWYield *y)
 {
   rgw_rados_ref ref;
   int r = get_raw_obj_ref(obj, &ref);
@@ -11547,11 +11562,7 @@ int RGWRados::raw_obj_stat(rgw_raw_obj& obj, uint64_t *psize, real_time *pmtime,
     op.read(0, cct->_conf->rgw_max_chunk_size, first_chunk, NULL);
   }
   bufferlist outbl;
-  r = ref.ioctx.operate(ref.oid, &op, &outbl);
-
-  if (epoch) {
-    *epoch = ref.ioctx.get_last_version();
-  }
+  r = rgw_rados_operate(ref.ioctx, ref.oid, &op, &outbl, y, epoch);
 
   if (r < 0)
     return r;
@@ -12601,7 +12612,8 @@ int RGWRados::cls_rgw_init_index(librados::IoCtx& index_ctx, librados::ObjectWri
 }
 
 int RGWRados::cls_obj_prepare_op(BucketShard& bs, RGWModifyOp op, string& tag,
-                                 rgw_obj& obj, uint16_t bilog_flags, rgw_zone_set *_zones_trace)
+                                 rgw_obj& obj, uint16_t bilog_flags, rgw_zone_set *_zones_trace,
+                                 RGWYield *y)
 {
   rgw_zone_set zones_trace;
   if (_zones_trace) {
@@ -12615,7 +12627,7 @@ int RGWRados::cls_obj_prepare_op(BucketShard& bs, RGWModifyOp op, string& tag,
   cls_rgw_obj_key key(obj.key.get_index_key_name(), obj.key.instance);
   cls_rgw_guard_bucket_resharding(o, -ERR_BUSY_RESHARDING);
   cls_rgw_bucket_prepare_op(o, op, tag, key, obj.key.get_loc(), get_zone().log_data, bilog_flags, zones_trace);
-  return bs.index_ctx.operate(bs.bucket_obj, &o);
+  return rgw_rados_operate(bs.index_ctx, bs.bucket_obj, &o, y);
 }
 
 int RGWRados::cls_obj_complete_op(BucketShard& bs, const rgw_obj& obj, RGWModifyOp op, string& tag,
@@ -12684,10 +12696,29 @@ int RGWRados::cls_obj_set_bucket_tag_timeout(RGWBucketInfo& bucket_info, uint64_
   return CLSRGWIssueSetTagTimeout(index_ctx, bucket_objs, cct->_conf->rgw_bucket_index_max_aio, timeout)();
 }
 
+/*
+ * Number of entries to ask each index shard for when num_entries are
+ * wanted in total. Assuming the keys are spread evenly over the shards,
+ * each shard holds about num_entries / num_shards of the next num_entries
+ * keys; ask for a few standard deviations more than that, so that the
+ * merge rarely runs out of entries of a shard before it has enough.
+ */
+static uint32_t calc_bucket_list_per_shard(uint32_t num_entries, uint32_t num_shards)
+{
+  if (num_shards <= 1) {
+    return num_entries;
+  }
+  const uint32_t min_read = 8;
+  const double expected = (double)num_entries / num_shards;
+  uint32_t calc_read = 1 + (uint32_t)(expected + 3 * sqrt(expected));
+  return std::min(num_entries, std::max(min_read, calc_read));
+}
+
 int RGWRados::cls_bucket_list(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_index_key& start, const string& prefix,
-		              uint32_t num_entries, bool list_versions, map<string, rgw_bucket_dir_entry>& m,
-			      bool *is_truncated, rgw_obj_index_key *last_entry,
-			      bool (*force_check_filter)(const string&  name))
+                              const string& delimiter, uint32_t num_entries, bool list_versions,
+                              map<string, rgw_bucket_dir_entry>& m,
+                              bool *is_truncated, rgw_obj_index_key *last_entry,
+                              bool (*force_check_filter)(const string&  name))
 {
   ldout(cct, 10) << "cls_bucket_list " << bucket_info.bucket << " start " << start.name << "[" << start.instance << "] num_entries " << num_entries << dendl;
 
@@ -12700,37 +12731,56 @@ int RGWRados::cls_bucket_list(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_
   if (r < 0)
     return r;
 
+  const uint32_t num_entries_per_shard = calc_bucket_list_per_shard(num_entries, oids.size());
+  ldout(cct, 20) << "cls_bucket_list requesting " << num_entries_per_shard
+                 << " entries from each of " << oids.size() << " shards" << dendl;
+
   cls_rgw_obj_key start_key(start.name, start.instance);
-  r = CLSRGWIssueBucketList(index_ctx, start_key, prefix, num_entries, list_versions,
-                            oids, list_results, cct->_conf->rgw_bucket_index_max_aio)();
+  r = CLSRGWIssueBucketList(index_ctx, start_key, prefix, delimiter, num_entries_per_shard,
+                            list_versions, oids, list_results, cct->_conf->rgw_bucket_index_max_aio)();
   if (r < 0)
     return r;
 
   // Create a list of iterators that are used to iterate each shard
-  vector<map<string, struct rgw_bucket_dir_entry>::iterator> vcurrents(list_results.size());
-  vector<map<string, struct rgw_bucket_dir_entry>::iterator> vends(list_results.size());
-  vector<string> vnames(list_results.size());
+  vector<map<string, struct rgw_bucket_dir_entry>::iterator> vcurrents;
+  vector<map<string, struct rgw_bucket_dir_entry>::iterator> vends;
+  vector<string> vnames;
+  vector<bool> vtruncated;
+  vcurrents.reserve(list_results.size());
+  vends.reserve(list_results.size());
+  vnames.reserve(list_results.size());
+  vtruncated.reserve(list_results.size());
   map<int, struct rgw_cls_list_ret>::iterator iter = list_results.begin();
   *is_truncated = false;
   for (; iter != list_results.end(); ++iter) {
     vcurrents.push_back(iter->second.dir.m.begin());
     vends.push_back(iter->second.dir.m.end());
     vnames.push_back(oids[iter->first]);
+    vtruncated.push_back(iter->second.is_truncated);
     *is_truncated = (*is_truncated || iter->second.is_truncated);
   }
 
   // Create a map to track the next candidate entry from each shard, if the entry
   // from a specified shard is selected/erased, the next entry from that shard will
-  // be inserted for next round selection
+  // be inserted for next round selection. Object names are unique across shards,
+  // but every shard with keys under a common prefix returns an entry for it, so
+  // duplicates are dropped here
   map<string, size_t> candidates;
-  for (size_t i = 0; i < vcurrents.size(); ++i) {
-    if (vcurrents[i] != vends[i]) {
-      candidates[vcurrents[i]->first] = i;
+  auto add_candidate = [&](size_t pos) {
+    for (; vcurrents[pos] != vends[pos]; ++vcurrents[pos]) {
+      if (candidates.emplace(vcurrents[pos]->first, pos).second) {
+        break;
+      }
     }
+  };
+  for (size_t i = 0; i < vcurrents.size(); ++i) {
+    add_candidate(i);
   }
 
   map<string, bufferlist> updates;
   uint32_t count = 0;
+  string last_entry_visited;
+  bool last_entry_is_prefix = false;
   while (count < num_entries && !candidates.empty()) {
     r = 0;
     // Select the next one
@@ -12738,15 +12788,25 @@ int RGWRados::cls_bucket_list(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_
     const string& name = vcurrents[pos]->first;
     struct rgw_bucket_dir_entry& dirent = vcurrents[pos]->second;
 
-    bool force_check = force_check_filter && force_check_filter(dirent.key.name);
-    if ((!dirent.exists && !dirent.is_delete_marker()) || !dirent.pending_map.empty() || force_check) {
-      /* there are uncommitted ops. We need to check the current state,
-       * and if the tags are old we need to do cleanup as well. */
-      librados::IoCtx sub_ctx;
-      sub_ctx.dup(index_ctx);
-      r = check_disk_state(sub_ctx, bucket_info, dirent, dirent, updates[vnames[pos]]);
-      if (r < 0 && r != -ENOENT) {
-          return r;
+    last_entry_visited = name;
+    last_entry_is_prefix = dirent.is_common_prefix();
+
+    if (last_entry_is_prefix) {
+      // another shard's entry for this prefix may already have been merged
+      if (m.find(name) != m.end()) {
+        r = -EEXIST;
+      }
+    } else {
+      bool force_check = force_check_filter && force_check_filter(dirent.key.name);
+      if ((!dirent.exists && !dirent.is_delete_marker()) || !dirent.pending_map.empty() || force_check) {
+        /* there are uncommitted ops. We need to check the current state,
+         * and if the tags are old we need to do cleanup as well. */
+        librados::IoCtx sub_ctx;
+        sub_ctx.dup(index_ctx);
+        r = check_disk_state(sub_ctx, bucket_info, dirent, dirent, updates[vnames[pos]]);
+        if (r < 0 && r != -ENOENT) {
+            return r;
+        }
       }
     }
     if (r >= 0) {
@@ -12758,9 +12818,14 @@ int RGWRados::cls_bucket_list(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_
     // Refresh the candidates map
     candidates.erase(candidates.begin());
     ++vcurrents[pos];
-    if (vcurrents[pos] != vends[pos]) {
-      candidates[vcurrents[pos]->first] = pos;
+    if (vcurrents[pos] == vends[pos] && vtruncated[pos]) {
+      // the shard has more entries that we did not ask for, and they may
+      // sort before the remaining candidates of the other shards
+      ldout(cct, 20) << "cls_bucket_list: ran out of entries of truncated shard "
+                     << vnames[pos] << dendl;
+      break;
     }
+    add_candidate(pos);
   }
 
   // Suggest updates if there is any
@@ -12781,8 +12846,14 @@ int RGWRados::cls_bucket_list(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_
     if (vcurrents[i] != vends[i])
       *is_truncated = true;
   }
-  if (!m.empty())
-    *last_entry = m.rbegin()->first;
+  if (!last_entry_visited.empty()) {
+    // continue after the last entry we looked at, even if it was skipped;
+    // a common prefix is continued after everything under it
+    if (last_entry_is_prefix) {
+      last_entry_visited.append(1, (char)0xFF);
+    }
+    *last_entry = last_entry_visited;
+  }
 
   return 0;
 }
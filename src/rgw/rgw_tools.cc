@@ -189,6 +189,60 @@ const char *rgw_find_mime_by_ext(string& ext)
   return iter->second.c_str();
 }
 
+int rgw_rados_operate(librados::IoCtx& ioctx, const string& oid,
+                      librados::ObjectReadOperation *op, bufferlist *pbl,
+                      RGWYield *y, uint64_t *pversion)
+{
+  if (!y) {
+    int r = ioctx.operate(oid, op, pbl);
+    if (pversion) {
+      *pversion = ioctx.get_last_version();
+    }
+    return r;
+  }
+
+  librados::AioCompletion *c = y->create_completion();
+  int r = ioctx.aio_operate(oid, c, op, pbl);
+  if (r < 0) {
+    c->release();
+    return r;
+  }
+  y->wait(c);
+  r = c->get_return_value();
+  if (pversion) {
+    *pversion = c->get_version64();
+  }
+  c->release();
+  return r;
+}
+
+int rgw_rados_operate(librados::IoCtx& ioctx, const string& oid,
+                      librados::ObjectWriteOperation *op,
+                      RGWYield *y, uint64_t *pversion)
+{
+  if (!y) {
+    int r = ioctx.operate(oid, op);
+    if (pversion) {
+      *pversion = ioctx.get_last_version();
+    }
+    return r;
+  }
+
+  librados::AioCompletion *c = y->create_completion();
+  int r = ioctx.aio_operate(oid, c, op);
+  if (r < 0) {
+    c->release();
+    return r;
+  }
+  y->wait(c);
+  r = c->get_return_value();
+  if (pversion) {
+    *pversion = c->get_version64();
+  }
+  c->release();
+  return r;
+}
+
 int rgw_tools_init(CephContext *cct)
 {
   ext_mime_map = new std::map<std::string, std::string>;
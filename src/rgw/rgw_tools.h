@@ -7,6 +7,7 @@
 #include <string>
 
 #include "include/types.h"
+#include "include/rados/librados.hpp"
 #include "common/ceph_time.h"
 #include "rgw_common.h"
 
@@ -24,6 +25,32 @@ int rgw_get_system_obj(RGWRados *rgwstore, RGWObjectCtx& obj_ctx, const rgw_pool
 int rgw_delete_system_obj(RGWRados *rgwstore, const rgw_pool& pool, const string& oid,
                           RGWObjVersionTracker *objv_tracker);
 
+/**
+ * Lets a frontend that runs requests on coroutines suspend the request
+ * while a librados operation is in flight instead of blocking its
+ * thread. No locks may be held across wait().
+ */
+class RGWYield {
+public:
+  virtual ~RGWYield() {}
+
+  /// create a completion that resumes the waiter of this yield context
+  virtual librados::AioCompletion *create_completion() = 0;
+  /// suspend until the completion created above is complete
+  virtual void wait(librados::AioCompletion *c) = 0;
+};
+
+/*
+ * Run op on oid, suspending on y if the request has a yield context and
+ * blocking otherwise. pversion returns the object version the op saw.
+ */
+int rgw_rados_operate(librados::IoCtx& ioctx, const string& oid,
+                      librados::ObjectReadOperation *op, bufferlist *pbl,
+                      RGWYield *y, uint64_t *pversion = nullptr);
+int rgw_rados_operate(librados::IoCtx& ioctx, const string& oid,
+                      librados::ObjectWriteOperation *op,
+                      RGWYield *y, uint64_t *pversion = nullptr);
+
 int rgw_tools_init(CephContext *cct);
 void rgw_tools_cleanup();
 const char *rgw_find_mime_by_ext(string& ext);
@@ -23,9 +23,15 @@ struct T : public Thread {
   }
 
   void *entry() override {
-    while (num-- > 0)
+    uint64_t off = 0;
+    while (num-- > 0) {
       generic_dout(0) << "this is a typical log line.  set "
 		      << myset << " and map " << mymap << dendl;
+      generic_dout(0) << "write " << off << "~" << 4096 << " v " << num
+		      << " lat " << 0.000123 << " this " << (void*)this
+		      << dendl;
+      off += 4096;
+    }
     return 0;
   }
 };
@@ -35,7 +41,7 @@ int main(int argc, const char **argv)
   int threads = atoi(argv[1]);
   int num = atoi(argv[2]);
 
-  cout << threads << " threads, " << num << " lines per thread" << std::endl;
+  cout << threads << " threads, " << num * 2 << " lines per thread" << std::endl;
 
   vector<const char*> args;
   argv_to_vec(argc, argv, args);
@@ -44,6 +50,9 @@ int main(int argc, const char **argv)
   auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_OSD,
 			 CODE_ENVIRONMENT_UTILITY, 0);
 
+  cout << "log_binary_capture "
+       << g_conf->get_val<bool>("log_binary_capture") << std::endl;
+
   utime_t start = ceph_clock_now();
 
   list<T*> ls;
@@ -69,6 +78,7 @@ int main(int argc, const char **argv)
   utime_t end = ceph_clock_now();
   utime_t dur = end - start;
 
-  cout << dur << std::endl;
+  cout << dur << " (" << (dur.to_nsec() / ((uint64_t)threads * num * 2))
+       << " ns per line)" << std::endl;
   return 0;
 }
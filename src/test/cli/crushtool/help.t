@@ -91,6 +91,10 @@
         [--simulate]       simulate placements using a random
                            number generator in place of the CRUSH
                            algorithm
+        [--straw2-scalar]  do not vectorize straw2 bucket selection
+        [--check-straw2-simd]
+                           compare vectorized straw2 mappings with
+                           the scalar code
      --show-utilization    show OSD usage
      --show-utilization-all
                            include zero weight items
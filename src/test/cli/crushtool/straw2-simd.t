@@ -0,0 +1,7 @@
+#
+# vectorized straw2 draws must map exactly like the scalar code
+#
+  $ crushtool --outfn straw2-simd.map --build --num_osds 300 host straw2 12 rack straw2 5 root straw2 0
+  $ crushtool -i straw2-simd.map --test --check-straw2-simd --num-rep 3 --min-x 0 --max-x 20000 2>&1 | grep mismatch
+  [1]
+  $ rm straw2-simd.map
@@ -2,6 +2,7 @@
 // vim: ts=8 sw=2 smarttab
 
 #include "include/types.h"
+#include "common/ceph_time.h"
 #include "cls/rgw/cls_rgw_client.h"
 #include "cls/rgw/cls_rgw_ops.h"
 
@@ -9,6 +10,7 @@
 #include "test/librados/test.h"
 
 #include <errno.h>
+#include <iostream>
 #include <string>
 #include <vector>
 #include <map>
@@ -375,6 +377,145 @@ TEST(cls_rgw, index_suggest)
   test_stats(ioctx, bucket_oid, 0, num_objs / 2, total_size);
 }
 
+static void index_add(OpMgr& mgr, librados::IoCtx& ioctx, string& oid, string obj, int epoch)
+{
+  string tag = "tag-" + obj;
+  string loc = "loc-" + obj;
+  index_prepare(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, obj, loc);
+
+  rgw_bucket_dir_entry_meta meta;
+  meta.category = 0;
+  meta.size = 1024;
+  index_complete(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, epoch, obj, meta);
+}
+
+/* list all shards to the end, one shard at a time */
+static void list_shards(librados::IoCtx& ioctx, map<int, string>& oids,
+                        const string& delimiter, uint32_t num_entries,
+                        map<string, rgw_bucket_dir_entry> *entries, int *calls)
+{
+  for (auto& shard : oids) {
+    map<int, string> shard_oids;
+    shard_oids[shard.first] = shard.second;
+    cls_rgw_obj_key marker;
+    bool truncated = true;
+    while (truncated) {
+      map<int, struct rgw_cls_list_ret> results;
+      ASSERT_EQ(0, CLSRGWIssueBucketList(ioctx, marker, "", delimiter, num_entries, false,
+                                         shard_oids, results, 8)());
+      ++(*calls);
+      rgw_cls_list_ret& ret = results[shard.first];
+      truncated = ret.is_truncated;
+      for (auto& i : ret.dir.m) {
+        marker.name = i.first;
+        if (i.second.is_common_prefix()) {
+          marker.name.append(1, (char)0xFF);
+        }
+        (*entries)[i.first] = i.second;
+      }
+    }
+  }
+}
+
+TEST(cls_rgw, index_list_delimited)
+{
+  string bucket_oid = "bucket-list-delimited";
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  int epoch = 0;
+  for (int i = 0; i < 10; i++) {
+    index_add(mgr, ioctx, bucket_oid, str_int("a/obj", i), ++epoch);
+    index_add(mgr, ioctx, bucket_oid, str_int("c/d/obj", i), ++epoch);
+  }
+  index_add(mgr, ioctx, bucket_oid, "b", ++epoch);
+  index_add(mgr, ioctx, bucket_oid, "c/obj", ++epoch);
+
+  map<int, string> oids;
+  oids[0] = bucket_oid;
+
+  map<int, struct rgw_cls_list_ret> results;
+  cls_rgw_obj_key marker;
+  ASSERT_EQ(0, CLSRGWIssueBucketList(ioctx, marker, "", "/", 100, false,
+                                     oids, results, 8)());
+  map<string, rgw_bucket_dir_entry>& m = results[0].dir.m;
+  ASSERT_FALSE(results[0].is_truncated);
+  ASSERT_EQ(3u, m.size());
+  ASSERT_TRUE(m["a/"].is_common_prefix());
+  ASSERT_FALSE(m["b"].is_common_prefix());
+  ASSERT_EQ(1024u, m["b"].meta.size);
+  ASSERT_TRUE(m["c/"].is_common_prefix());
+
+  /* below a prefix */
+  results.clear();
+  ASSERT_EQ(0, CLSRGWIssueBucketList(ioctx, marker, "c/", "/", 100, false,
+                                     oids, results, 8)());
+  ASSERT_EQ(2u, results[0].dir.m.size());
+  ASSERT_TRUE(results[0].dir.m["c/d/"].is_common_prefix());
+  ASSERT_EQ(1u, results[0].dir.m.count("c/obj"));
+
+  /* one entry at a time */
+  map<string, rgw_bucket_dir_entry> entries;
+  int calls = 0;
+  list_shards(ioctx, oids, "/", 1, &entries, &calls);
+  ASSERT_EQ(3u, entries.size());
+  ASSERT_GE(4, calls);
+
+  /* without a delimiter everything is returned */
+  entries.clear();
+  list_shards(ioctx, oids, "", 1000, &entries, &calls);
+  ASSERT_EQ(22u, entries.size());
+}
+
+TEST(cls_rgw, index_list_delimited_bench)
+{
+  const int num_shards = 8;
+  const int num_dirs = 10;
+  const int objs_per_dir = 200;
+
+  OpMgr mgr;
+  map<int, string> oids;
+  for (int i = 0; i < num_shards; i++) {
+    oids[i] = str_int("bucket-list-bench", i);
+    ObjectWriteOperation *op = mgr.write_op();
+    cls_rgw_bucket_init(*op);
+    ASSERT_EQ(0, ioctx.operate(oids[i], op));
+  }
+
+  int epoch = 0;
+  for (int i = 0; i < num_dirs; i++) {
+    for (int j = 0; j < objs_per_dir; j++) {
+      string obj = str_int(str_int("dir", i) + "/obj", j);
+      string& oid = oids[(i * objs_per_dir + j) % num_shards];
+      index_add(mgr, ioctx, oid, obj, ++epoch);
+    }
+  }
+
+  for (auto& delimiter : {string(), string("/")}) {
+    map<string, rgw_bucket_dir_entry> entries;
+    int calls = 0;
+    ceph::mono_time start = ceph::mono_clock::now();
+    list_shards(ioctx, oids, delimiter, 100, &entries, &calls);
+    auto elapsed = ceph::mono_clock::now() - start;
+
+    std::cout << "listing " << num_dirs * objs_per_dir << " objects in "
+              << num_shards << " shards with delimiter '" << delimiter
+              << "': " << entries.size() << " entries, " << calls << " calls, "
+              << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()
+              << "us" << std::endl;
+
+    if (delimiter.empty()) {
+      ASSERT_EQ((size_t)(num_dirs * objs_per_dir), entries.size());
+    } else {
+      ASSERT_EQ((size_t)num_dirs, entries.size());
+    }
+  }
+}
+
 /* test garbage collection */
 static void create_obj(cls_rgw_obj& obj, int i, int j)
 {
@@ -128,3 +128,41 @@ TEST(Readahead, alignment) {
   ASSERT_RA(1400, 300, r.update(1290, 10, Readahead::NO_LIMIT)); // internal readahead size 320
   ASSERT_RA(0, 0, r.update(1300, 10, Readahead::NO_LIMIT));
 }
+
+TEST(Readahead, interleaved_streams) {
+  Readahead single;
+  single.set_trigger_requests(2);
+  Readahead r;
+  r.set_trigger_requests(2);
+  r.set_max_streams(2);
+  for (uint64_t off = 0; off < 30; off += 10) {
+    // with a single stream the readers keep resetting each other
+    ASSERT_RA(0, 0, single.update(1000 + off, 10, Readahead::NO_LIMIT));
+    ASSERT_RA(0, 0, single.update(5000 + off, 10, Readahead::NO_LIMIT));
+  }
+  ASSERT_RA(0, 0, r.update(1000, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(5000, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(1010, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(5010, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(1030, 20, r.update(1020, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(5030, 20, r.update(5020, 10, Readahead::NO_LIMIT));
+  // a third reader takes over the least recently used stream
+  ASSERT_RA(0, 0, r.update(9000, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(1030, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(5030, 10, Readahead::NO_LIMIT));
+}
+
+TEST(Readahead, adaptive) {
+  Readahead r;
+  r.set_trigger_requests(2);
+  r.set_adaptive(true);
+  ASSERT_RA(0, 0, r.update(1000, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(0, 0, r.update(1010, 10, Readahead::NO_LIMIT));
+  ASSERT_RA(1030, 20, r.update(1020, 10, Readahead::NO_LIMIT));
+  // the reader never waited, keep the size
+  ASSERT_RA(1050, 20, r.update(1030, 10, Readahead::NO_LIMIT));
+  r.report_miss(1040, 10);
+  ASSERT_RA(0, 0, r.update(1040, 10, Readahead::NO_LIMIT));
+  // it did wait, grow
+  ASSERT_RA(1070, 40, r.update(1050, 10, Readahead::NO_LIMIT));
+}
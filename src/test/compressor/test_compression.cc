@@ -376,6 +376,34 @@ TEST(ZlibCompressor, zlib_isal_compatibility)
 }
 #endif
 
+TEST(Compressor, estimate_ratio)
+{
+  unsigned len = 65536;
+  bufferlist random, runs, text;
+  bufferptr bp(len);
+  for (unsigned i = 0; i < len; ++i) {
+    bp.c_str()[i] = rand();
+  }
+  random.append(bp);
+  bufferptr rp(len);
+  for (unsigned i = 0; i < len; ++i) {
+    rp.c_str()[i] = i / 256;
+  }
+  runs.append(rp);
+  while (text.length() < len) {
+    text.append("the quick brown fox jumps over the lazy dog ");
+  }
+
+  // order-0 entropy of runs is high, but they compress well
+  EXPECT_GT(Compressor::estimate_ratio(random), .95);
+  EXPECT_LT(Compressor::estimate_ratio(runs), .5);
+  EXPECT_LT(Compressor::estimate_ratio(text), .5);
+
+  bufferlist tiny;
+  tiny.append(bp.c_str(), 16);
+  EXPECT_EQ(0, Compressor::estimate_ratio(tiny));
+}
+
 TEST(CompressionPlugin, all)
 {
   const char* env = getenv("CEPH_LIB");
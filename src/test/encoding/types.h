@@ -122,6 +122,7 @@ TYPE(SequencerPosition)
 #include "os/bluestore/bluestore_types.h"
 TYPE(bluestore_cnode_t)
 TYPE(bluestore_compression_header_t)
+TYPE(bluestore_compression_dict_t)
 TYPE(bluestore_extent_ref_map_t)
 TYPE(bluestore_pextent_t)
 // TODO: bluestore_blob_t repurposes the "feature" param of encode() for its
@@ -129,6 +129,93 @@ TYPED_TEST(ErasureCodeTest, encode_decode)
   }
 }
 
+TYPED_TEST(ErasureCodeTest, parity_delta)
+{
+  TypeParam jerasure;
+  ErasureCodeProfile profile;
+  profile["k"] = "2";
+  profile["m"] = "2";
+  profile["packetsize"] = "8";
+  jerasure.init(profile, &cerr);
+  EXPECT_TRUE(jerasure.supports_parity_delta());
+
+  unsigned chunk_size = jerasure.get_chunk_size(LARGE_ENOUGH);
+  string payload;
+  for (unsigned i = 0; i < 2 * chunk_size; i++)
+    payload.push_back('A' + i % 26);
+  bufferlist in;
+  in.append(payload);
+  set<int> want_to_encode = { 0, 1, 2, 3 };
+  map<int, bufferlist> encoded;
+  EXPECT_EQ(0, jerasure.encode(want_to_encode, in, &encoded));
+
+  // overwrite part of the first data chunk and encode from scratch
+  payload.replace(10, 100, 100, 'X');
+  bufferlist modified;
+  modified.append(payload);
+  map<int, bufferlist> reencoded;
+  EXPECT_EQ(0, jerasure.encode(want_to_encode, modified, &reencoded));
+
+  map<int, bufferlist> old_data, new_data, coding;
+  old_data[0] = encoded[0];
+  new_data[0] = reencoded[0];
+  coding[2] = encoded[2];
+  coding[3] = encoded[3];
+  EXPECT_EQ(0, jerasure.apply_delta(old_data, new_data, &coding));
+  EXPECT_TRUE(coding[2].contents_equal(reencoded[2]));
+  EXPECT_TRUE(coding[3].contents_equal(reencoded[3]));
+}
+
+TYPED_TEST(ErasureCodeTest, encode_decode_stripes)
+{
+  TypeParam jerasure;
+  ErasureCodeProfile profile;
+  profile["k"] = "2";
+  profile["m"] = "2";
+  profile["packetsize"] = "8";
+  jerasure.init(profile, &cerr);
+
+  unsigned chunk_size = jerasure.get_chunk_size(LARGE_ENOUGH);
+  unsigned stripes = 3;
+  set<int> want_to_encode = { 0, 1, 2, 3 };
+  map<int, bufferlist> per_stripe;
+  map<int, bufferlist> encoded;
+  for (int i = 0; i < 4; i++) {
+    bufferptr ptr(buffer::create_aligned(stripes * chunk_size,
+					 ErasureCode::SIMD_ALIGN));
+    encoded[i].push_back(ptr);
+  }
+  for (unsigned s = 0; s < stripes; s++) {
+    string payload;
+    for (unsigned i = 0; i < 2 * chunk_size; i++)
+      payload.push_back('A' + (i + s * 7) % 26);
+    bufferlist in;
+    in.append(payload);
+    map<int, bufferlist> one;
+    EXPECT_EQ(0, jerasure.encode(want_to_encode, in, &one));
+    for (int i = 0; i < 4; i++)
+      per_stripe[i].append(one[i]);
+    for (int i = 0; i < 2; i++)
+      encoded[i].copy_in(s * chunk_size, chunk_size, one[i].c_str());
+  }
+
+  // a single call over all stripes matches encoding them one by one
+  EXPECT_EQ(0, jerasure.encode_stripes(want_to_encode, chunk_size, &encoded));
+  for (int i = 0; i < 4; i++)
+    EXPECT_TRUE(encoded[i].contents_equal(per_stripe[i]));
+
+  // recover both data chunks of every stripe from the coding chunks
+  map<int, bufferlist> chunks;
+  chunks[2] = encoded[2];
+  chunks[3] = encoded[3];
+  set<int> want_to_read = { 0, 1 };
+  map<int, bufferlist> decoded;
+  EXPECT_EQ(0, jerasure.decode_stripes(want_to_read, chunk_size, chunks,
+				       &decoded));
+  EXPECT_TRUE(decoded[0].contents_equal(per_stripe[0]));
+  EXPECT_TRUE(decoded[1].contents_equal(per_stripe[1]));
+}
+
 TYPED_TEST(ErasureCodeTest, minimum_to_decode)
 {
   TypeParam jerasure;
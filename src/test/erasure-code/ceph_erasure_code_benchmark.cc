@@ -49,7 +49,15 @@ int ErasureCodeBench::setup(int argc, char** argv) {
     ("plugin,p", po::value<string>()->default_value("jerasure"),
      "erasure code plugin name")
     ("workload,w", po::value<string>()->default_value("encode"),
-     "run either encode or decode")
+     "run encode, decode, rmw, delta or stripes. rmw re-encodes a stripe after "
+     "overwriting --overwritten data chunks, delta updates its coding "
+     "chunks from the old and new content of the overwritten chunks. "
+     "stripes encodes --size as stripes of --stripe-width bytes, one call "
+     "per stripe and then all of them in a single call")
+    ("stripe-width", po::value<int>()->default_value(4096),
+     "stripe width used by the stripes workload")
+    ("overwritten", po::value<int>()->default_value(1),
+     "number of data chunks overwritten by the rmw and delta workloads")
     ("erasures,e", po::value<int>()->default_value(1),
      "number of erasures when decoding")
     ("erased", po::value<vector<int> >(),
@@ -113,6 +121,8 @@ int ErasureCodeBench::setup(int argc, char** argv) {
   plugin = vm["plugin"].as<string>();
   workload = vm["workload"].as<string>();
   erasures = vm["erasures"].as<int>();
+  overwritten = vm["overwritten"].as<int>();
+  stripe_width = vm["stripe-width"].as<int>();
   if (vm.count("erasures-generation") > 0 &&
       vm["erasures-generation"].as<string>() == "exhaustive")
     exhaustive_erasures = true;
@@ -143,6 +153,10 @@ int ErasureCodeBench::run() {
 
   if (workload == "encode")
     return encode();
+  else if (workload == "rmw" || workload == "delta")
+    return overwrite();
+  else if (workload == "stripes")
+    return stripes();
   else
     return decode();
 }
@@ -188,6 +202,152 @@ int ErasureCodeBench::encode()
   return 0;
 }
 
+int ErasureCodeBench::stripes()
+{
+  ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
+  ErasureCodeInterfaceRef erasure_code;
+  stringstream messages;
+  int code = instance.factory(plugin,
+			      g_conf->get_val<std::string>("erasure_code_dir"),
+			      profile, &erasure_code, &messages);
+  if (code) {
+    cerr << messages.str() << endl;
+    return code;
+  }
+
+  unsigned chunk_size = erasure_code->get_chunk_size(stripe_width);
+  if (stripe_width <= 0 || chunk_size * k != (unsigned)stripe_width) {
+    cout << "stripe width is " << stripe_width << ". But it needs to be "
+	 << "a multiple of k and of the plugin alignment" << endl;
+    return -EINVAL;
+  }
+  unsigned stripe_count = in_size / stripe_width;
+  if (stripe_count == 0) {
+    cout << "size is " << in_size << ". But it needs to be >= stripe width "
+	 << stripe_width << endl;
+    return -EINVAL;
+  }
+
+  set<int> want_to_encode;
+  for (int i = 0; i < k + m; i++) {
+    want_to_encode.insert(i);
+  }
+  bufferlist stripe;
+  stripe.append(string(stripe_width, 'X'));
+  stripe.rebuild_aligned(ErasureCode::SIMD_ALIGN);
+
+  utime_t begin_time = ceph_clock_now();
+  for (int i = 0; i < max_iterations; i++) {
+    for (unsigned s = 0; s < stripe_count; s++) {
+      map<int,bufferlist> encoded;
+      code = erasure_code->encode(want_to_encode, stripe, &encoded);
+      if (code)
+	return code;
+    }
+  }
+  utime_t end_time = ceph_clock_now();
+  cout << (end_time - begin_time) << "\t"
+       << (max_iterations * (stripe_count * stripe_width / 1024)) << endl;
+
+  begin_time = ceph_clock_now();
+  for (int i = 0; i < max_iterations; i++) {
+    map<int,bufferlist> encoded;
+    for (int j = 0; j < k + m; j++) {
+      bufferptr ptr(buffer::create_aligned(stripe_count * chunk_size,
+					   ErasureCode::SIMD_ALIGN));
+      if (j < k)
+	memset(ptr.c_str(), 'X', ptr.length());
+      encoded[j].push_back(ptr);
+    }
+    code = erasure_code->encode_stripes(want_to_encode, chunk_size, &encoded);
+    if (code)
+      return code;
+  }
+  end_time = ceph_clock_now();
+  cout << (end_time - begin_time) << "\t"
+       << (max_iterations * (stripe_count * stripe_width / 1024)) << endl;
+  return 0;
+}
+
+int ErasureCodeBench::overwrite()
+{
+  ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
+  ErasureCodeInterfaceRef erasure_code;
+  stringstream messages;
+  int code = instance.factory(plugin,
+			      g_conf->get_val<std::string>("erasure_code_dir"),
+			      profile, &erasure_code, &messages);
+  if (code) {
+    cerr << messages.str() << endl;
+    return code;
+  }
+  if (erasure_code->get_data_chunk_count() != (unsigned int)k ||
+      (erasure_code->get_chunk_count() - erasure_code->get_data_chunk_count()
+       != (unsigned int)m)) {
+    cout << "parameter k is " << k << "/m is " << m << ". But data chunk count is "
+      << erasure_code->get_data_chunk_count() <<"/parity chunk count is "
+      << erasure_code->get_chunk_count() - erasure_code->get_data_chunk_count() << endl;
+    return -EINVAL;
+  }
+  if (overwritten <= 0 || overwritten > k) {
+    cout << "overwritten is " << overwritten << ". But it needs to be in [1,"
+	 << k << "]." << endl;
+    return -EINVAL;
+  }
+  bool delta = workload == "delta";
+  if (delta && !erasure_code->supports_parity_delta()) {
+    cerr << plugin << " does not support parity delta updates" << endl;
+    return -EOPNOTSUPP;
+  }
+
+  bufferlist in;
+  in.append(string(in_size, 'X'));
+  in.rebuild_aligned(ErasureCode::SIMD_ALIGN);
+  set<int> want_to_encode;
+  for (int i = 0; i < k + m; i++) {
+    want_to_encode.insert(i);
+  }
+  map<int,bufferlist> encoded;
+  code = erasure_code->encode(want_to_encode, in, &encoded);
+  if (code)
+    return code;
+  unsigned chunk_size = encoded[0].length();
+
+  map<int,bufferlist> old_data, new_data;
+  for (int i = 0; i < overwritten; i++) {
+    old_data[i] = encoded[i];
+    new_data[i].append(string(chunk_size, 'Y'));
+    new_data[i].rebuild_aligned(ErasureCode::SIMD_ALIGN);
+  }
+
+  utime_t begin_time = ceph_clock_now();
+  for (int i = 0; i < max_iterations; i++) {
+    if (delta) {
+      map<int,bufferlist> coding;
+      for (int j = k; j < k + m; j++)
+	coding[j] = encoded[j];
+      code = erasure_code->apply_delta(old_data, new_data, &coding);
+    } else {
+      bufferlist stripe;
+      for (int j = 0; j < k; j++)
+	stripe.append(j < overwritten ? new_data[j] : encoded[j]);
+      map<int,bufferlist> reencoded;
+      code = erasure_code->encode(want_to_encode, stripe, &reencoded);
+    }
+    if (code)
+      return code;
+  }
+  utime_t end_time = ceph_clock_now();
+  if (verbose) {
+    // chunk I/O per overwrite, which dominates once the shards are remote
+    int chunks = delta ? overwritten + m : k;
+    cout << "chunks read " << chunks
+	 << " written " << (delta ? chunks : k + m) << endl;
+  }
+  cout << (end_time - begin_time) << "\t" << (max_iterations * (in_size / 1024)) << endl;
+  return 0;
+}
+
 static void display_chunks(const map<int,bufferlist> &chunks,
 			   unsigned int chunk_count) {
   cout << "chunks ";
@@ -26,6 +26,8 @@ class ErasureCodeBench {
   int in_size;
   int max_iterations;
   int erasures;
+  int overwritten;
+  int stripe_width;
   int k;
   int m;
 
@@ -49,6 +51,8 @@ public:
 		      ErasureCodeInterfaceRef erasure_code);
   int decode();
   int encode();
+  int overwrite();
+  int stripes();
 };
 
 #endif
@@ -0,0 +1,210 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Multi-threaded libcephfs benchmark.
+ *
+ * All threads share one mount, and each of them works on its own file,
+ * so the only thing they contend on is the client itself.  For every
+ * power of two up to --threads it reports the aggregate throughput of
+ * buffered writes, reads and stats, e.g. on a vstart cluster:
+ *
+ *   ceph_bench_libcephfs --threads 16 --size 64M --block-size 4K
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/cephfs/libcephfs.h"
+
+using namespace std::chrono;
+
+struct Config {
+  int threads = 8;
+  uint64_t size = 16 << 20;       // per thread
+  uint64_t block_size = 4096;
+  int stats = 10000;              // per thread
+  std::string dir = "/bench_libcephfs";
+};
+
+static void usage()
+{
+  std::cerr << "usage: ceph_bench_libcephfs [flags]\n"
+	    << "  --threads <n>        maximum number of threads (default 8)\n"
+	    << "  --size <bytes>       bytes written and read by each thread\n"
+	    << "  --block-size <bytes> size of each read and write\n"
+	    << "  --stats <n>          stats issued by each thread\n"
+	    << "  --dir <path>         directory to work in\n"
+	    << "other arguments are passed to ceph_conf_parse_argv()"
+	    << std::endl;
+}
+
+static uint64_t parse_size(const char *s)
+{
+  char *end;
+  uint64_t v = strtoull(s, &end, 10);
+  switch (*end) {
+  case 'k': case 'K': v <<= 10; break;
+  case 'm': case 'M': v <<= 20; break;
+  case 'g': case 'G': v <<= 30; break;
+  }
+  return v;
+}
+
+static std::string file_name(const Config &conf, int i)
+{
+  return conf.dir + "/file." + std::to_string(i);
+}
+
+enum Op { OP_WRITE, OP_READ, OP_STAT };
+
+static int run_thread(struct ceph_mount_info *cmount, const Config &conf,
+		      int i, Op op)
+{
+  std::string name = file_name(conf, i);
+  if (op == OP_STAT) {
+    struct ceph_statx stx;
+    for (int n = 0; n < conf.stats; n++) {
+      int r = ceph_statx(cmount, name.c_str(), &stx, CEPH_STATX_SIZE,
+			 AT_NO_ATTR_SYNC);
+      if (r < 0)
+	return r;
+    }
+    return 0;
+  }
+
+  int fd = ceph_open(cmount, name.c_str(),
+		     op == OP_WRITE ? O_CREAT|O_WRONLY : O_RDONLY, 0644);
+  if (fd < 0)
+    return fd;
+  std::vector<char> buf(conf.block_size, 'a' + i % 26);
+  int r = 0;
+  for (uint64_t off = 0; off < conf.size; off += conf.block_size) {
+    if (op == OP_WRITE)
+      r = ceph_write(cmount, fd, buf.data(), buf.size(), off);
+    else
+      r = ceph_read(cmount, fd, buf.data(), buf.size(), off);
+    if (r < 0)
+      break;
+  }
+  if (r >= 0 && op == OP_WRITE)
+    r = ceph_fsync(cmount, fd, 0);
+  ceph_close(cmount, fd);
+  return r < 0 ? r : 0;
+}
+
+static int run(struct ceph_mount_info *cmount, const Config &conf,
+	       int threads, Op op)
+{
+  std::vector<std::thread> workers;
+  std::vector<int> results(threads, 0);
+  auto start = steady_clock::now();
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back([&, i]() {
+	results[i] = run_thread(cmount, conf, i, op);
+      });
+  }
+  for (auto &w : workers)
+    w.join();
+  double secs = duration<double>(steady_clock::now() - start).count();
+  for (int r : results) {
+    if (r < 0) {
+      std::cerr << "thread failed: " << strerror(-r) << std::endl;
+      return r;
+    }
+  }
+
+  static const char *names[] = { "write", "read", "stat" };
+  std::cout << names[op] << "\t" << threads << "\t";
+  if (op == OP_STAT) {
+    std::cout << (uint64_t)(threads * conf.stats / secs) << " stats/s";
+  } else {
+    uint64_t ops = threads * (conf.size / conf.block_size);
+    std::cout << (uint64_t)(ops / secs) << " ops/s\t"
+	      << (uint64_t)(threads * conf.size / secs / (1 << 20)) << " MB/s";
+  }
+  std::cout << std::endl;
+  return 0;
+}
+
+int main(int argc, const char **argv)
+{
+  Config conf;
+  std::vector<const char*> args;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "-h" || a == "--help") {
+      usage();
+      return 0;
+    } else if (a == "--threads" && i + 1 < argc) {
+      conf.threads = atoi(argv[++i]);
+    } else if (a == "--size" && i + 1 < argc) {
+      conf.size = parse_size(argv[++i]);
+    } else if (a == "--block-size" && i + 1 < argc) {
+      conf.block_size = parse_size(argv[++i]);
+    } else if (a == "--stats" && i + 1 < argc) {
+      conf.stats = atoi(argv[++i]);
+    } else if (a == "--dir" && i + 1 < argc) {
+      conf.dir = argv[++i];
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  if (conf.threads <= 0 || conf.block_size == 0) {
+    usage();
+    return 1;
+  }
+
+  struct ceph_mount_info *cmount;
+  int r = ceph_create(&cmount, NULL);
+  if (r == 0)
+    r = ceph_conf_read_file(cmount, NULL);
+  if (r == 0)
+    r = ceph_conf_parse_argv(cmount, args.size(), args.data());
+  if (r == 0)
+    r = ceph_mount(cmount, "/");
+  if (r < 0) {
+    std::cerr << "failed to mount: " << strerror(-r) << std::endl;
+    return 1;
+  }
+  r = ceph_mkdir(cmount, conf.dir.c_str(), 0755);
+  if (r < 0 && r != -EEXIST) {
+    std::cerr << "failed to create " << conf.dir << ": " << strerror(-r)
+	      << std::endl;
+    ceph_shutdown(cmount);
+    return 1;
+  }
+
+  std::cout << "op\tthreads\tthroughput" << std::endl;
+  for (int threads = 1; threads <= conf.threads && r == 0; threads *= 2) {
+    for (Op op : { OP_WRITE, OP_READ, OP_STAT }) {
+      r = run(cmount, conf, threads, op);
+      if (r < 0)
+	break;
+    }
+  }
+
+  for (int i = 0; i < conf.threads; i++)
+    ceph_unlink(cmount, file_name(conf, i).c_str());
+  ceph_rmdir(cmount, conf.dir.c_str());
+  ceph_shutdown(cmount);
+  return r < 0 ? 1 : 0;
+}
@@ -1039,6 +1039,28 @@ TEST(LibCephFS, ReadEmptyFile) {
   ceph_shutdown(cmount);
 }
 
+TEST(LibCephFS, ReadWriteNegativeSize) {
+  struct ceph_mount_info *cmount;
+  ASSERT_EQ(0, ceph_create(&cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_read_file(cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_parse_env(cmount, NULL));
+  ASSERT_EQ(0, ceph_mount(cmount, NULL));
+
+  char testf[256];
+  sprintf(testf, "test_negsize%d", getpid());
+  char buf[16] = "0123456789abcde";
+  int fd = ceph_open(cmount, testf, O_CREAT|O_TRUNC|O_RDWR, 0644);
+  ASSERT_LT(0, fd);
+  ASSERT_EQ(-EINVAL, ceph_write(cmount, fd, buf, -1, 0));
+  ASSERT_EQ(-EINVAL, ceph_read(cmount, fd, buf, -1, 0));
+  ASSERT_EQ((int)sizeof(buf), ceph_write(cmount, fd, buf, sizeof(buf), 0));
+  ASSERT_EQ((int)sizeof(buf), ceph_read(cmount, fd, buf, sizeof(buf), 0));
+
+  ASSERT_EQ(0, ceph_close(cmount, fd));
+  ASSERT_EQ(0, ceph_unlink(cmount, testf));
+  ceph_shutdown(cmount);
+}
+
 TEST(LibCephFS, PreadvPwritev) {
   struct ceph_mount_info *cmount;
   ASSERT_EQ(ceph_create(&cmount, NULL), 0);
@@ -0,0 +1,234 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "test/librbd/test_fixture.h"
+#include "test/librbd/test_support.h"
+#include "cls/rbd/cls_rbd_client.h"
+#include "common/Cond.h"
+#include "include/buffer.h"
+#include "include/stringify.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/cache/FileImageCache.h"
+#include "librbd/io/ImageRequestWQ.h"
+#include "librbd/io/ReadResult.h"
+#include <unistd.h>
+
+namespace librbd {
+namespace cache {
+
+class TestFileImageCache : public TestFixture {
+public:
+  void SetUp() override {
+    TestFixture::SetUp();
+    ASSERT_EQ(0, open_image(m_image_name, &m_ictx));
+    m_ictx->persistent_cache_path = "/tmp";
+    m_ictx->persistent_cache_size = 8 << 20;
+    m_ictx->persistent_cache_persist_on_flush = true;
+    m_path = "/tmp/rbd-" + stringify(m_ictx->md_ctx.get_id()) + "." +
+             m_ictx->id + ".log";
+    ::unlink(m_path.c_str());
+  }
+
+  void TearDown() override {
+    ::unlink(m_path.c_str());
+    TestFixture::TearDown();
+  }
+
+  bufferlist create_data(char c, uint64_t length = 4096) {
+    bufferlist bl;
+    bl.append(std::string(length, c));
+    return bl;
+  }
+
+  int init(FileImageCache<ImageCtx> &cache) {
+    C_SaferCond ctx;
+    cache.init(&ctx);
+    return ctx.wait();
+  }
+
+  int shut_down(FileImageCache<ImageCtx> &cache) {
+    C_SaferCond ctx;
+    cache.shut_down(&ctx);
+    return ctx.wait();
+  }
+
+  int write(FileImageCache<ImageCtx> &cache, uint64_t off,
+            const bufferlist &bl) {
+    C_SaferCond ctx;
+    cache.aio_write({{off, bl.length()}}, bufferlist(bl), 0, &ctx);
+    return ctx.wait();
+  }
+
+  int read(FileImageCache<ImageCtx> &cache, uint64_t off, uint64_t len,
+           bufferlist *bl) {
+    C_SaferCond ctx;
+    cache.aio_read({{off, len}}, bl, 0, &ctx);
+    return ctx.wait();
+  }
+
+  int flush(FileImageCache<ImageCtx> &cache) {
+    C_SaferCond ctx;
+    cache.flush(&ctx);
+    return ctx.wait();
+  }
+
+  int invalidate(FileImageCache<ImageCtx> &cache) {
+    C_SaferCond ctx;
+    cache.invalidate(&ctx);
+    return ctx.wait();
+  }
+
+  bool image_contains(ImageCtx *ictx, uint64_t off, const bufferlist &bl) {
+    bufferlist read_bl;
+    ssize_t r = ictx->io_work_queue->read(off, bl.length(),
+                                          io::ReadResult{&read_bl}, 0);
+    return r == (ssize_t)bl.length() && read_bl.contents_equal(bl);
+  }
+
+  int get_owner(std::string *owner) {
+    return cls_client::metadata_get(&m_ioctx, m_ictx->header_oid,
+                                     ImageCtx::METADATA_PERSISTENT_CACHE_OWNER,
+                                     owner);
+  }
+
+  int set_owner(const std::string &owner) {
+    bufferlist bl;
+    bl.append(owner);
+    return cls_client::metadata_set(
+      &m_ioctx, m_ictx->header_oid,
+      {{ImageCtx::METADATA_PERSISTENT_CACHE_OWNER, bl}});
+  }
+
+  int remove_owner() {
+    return cls_client::metadata_remove(
+      &m_ioctx, m_ictx->header_oid, ImageCtx::METADATA_PERSISTENT_CACHE_OWNER);
+  }
+
+  // write through the image so that the cache owns the exclusive lock
+  int acquire_lock(FileImageCache<ImageCtx> &cache) {
+    m_ictx->image_cache = &cache;
+    int r = acquire_exclusive_lock(*m_ictx);
+    m_ictx->image_cache = nullptr;
+    return r;
+  }
+
+  ImageCtx *m_ictx = nullptr;
+  std::string m_path;
+};
+
+TEST_F(TestFileImageCache, Flush) {
+  REQUIRE_FEATURE(RBD_FEATURE_EXCLUSIVE_LOCK);
+
+  FileImageCache<ImageCtx> cache(*m_ictx);
+  ASSERT_EQ(0, init(cache));
+  ASSERT_EQ(0, acquire_lock(cache));
+
+  std::string owner;
+  ASSERT_EQ(-ENOENT, get_owner(&owner));
+
+  bufferlist bl = create_data('a');
+  ASSERT_EQ(0, write(cache, 8192, bl));
+  ASSERT_EQ(0, get_owner(&owner));
+  ASSERT_NE(std::string::npos, owner.find(m_path));
+
+  bufferlist read_bl;
+  ASSERT_EQ(0, read(cache, 8192, bl.length(), &read_bl));
+  ASSERT_TRUE(read_bl.contents_equal(bl));
+
+  ASSERT_EQ(0, flush(cache));
+  ASSERT_TRUE(image_contains(m_ictx, 8192, bl));
+
+  // the image stops naming the log once it is written back on release
+  ASSERT_EQ(0, invalidate(cache));
+  ASSERT_EQ(-ENOENT, get_owner(&owner));
+
+  ASSERT_EQ(0, write(cache, 0, bl));
+  ASSERT_EQ(0, get_owner(&owner));
+  ASSERT_EQ(0, shut_down(cache));
+  ASSERT_EQ(-ENOENT, get_owner(&owner));
+  ASSERT_TRUE(image_contains(m_ictx, 0, bl));
+}
+
+TEST_F(TestFileImageCache, NonOwnerShutDownAndReplay) {
+  REQUIRE_FEATURE(RBD_FEATURE_EXCLUSIVE_LOCK);
+
+  bufferlist bl = create_data('b');
+  std::string owner;
+  {
+    // without the exclusive lock nothing is written back
+    FileImageCache<ImageCtx> cache(*m_ictx);
+    ASSERT_EQ(0, init(cache));
+    ASSERT_EQ(0, write(cache, 0, bl));
+    ASSERT_EQ(0, shut_down(cache));
+  }
+  ASSERT_EQ(0, get_owner(&owner));
+  ASSERT_FALSE(image_contains(m_ictx, 0, bl));
+
+  FileImageCache<ImageCtx> cache(*m_ictx);
+  ASSERT_EQ(0, init(cache));
+  bufferlist read_bl;
+  ASSERT_EQ(0, read(cache, 0, bl.length(), &read_bl));
+  ASSERT_TRUE(read_bl.contents_equal(bl));
+
+  ASSERT_EQ(0, acquire_lock(cache));
+  ASSERT_EQ(0, flush(cache));
+  ASSERT_TRUE(image_contains(m_ictx, 0, bl));
+
+  ASSERT_EQ(0, shut_down(cache));
+  ASSERT_EQ(-ENOENT, get_owner(&owner));
+}
+
+TEST_F(TestFileImageCache, StaleReplayDiscarded) {
+  REQUIRE_FEATURE(RBD_FEATURE_EXCLUSIVE_LOCK);
+
+  {
+    FileImageCache<ImageCtx> cache(*m_ictx);
+    ASSERT_EQ(0, init(cache));
+    ASSERT_EQ(0, write(cache, 0, create_data('c')));
+    ASSERT_EQ(0, shut_down(cache));
+  }
+
+  // the log is given up on and another client writes to the image
+  ASSERT_EQ(0, remove_owner());
+  bufferlist bl = create_data('d');
+  {
+    ImageCtx *ictx2;
+    ASSERT_EQ(0, open_image(m_image_name, &ictx2));
+    ASSERT_EQ((ssize_t)bl.length(),
+              ictx2->io_work_queue->write(0, bl.length(), bufferlist(bl), 0));
+    close_image(ictx2);
+  }
+
+  FileImageCache<ImageCtx> cache(*m_ictx);
+  ASSERT_EQ(0, init(cache));
+  bufferlist read_bl;
+  ASSERT_EQ(0, read(cache, 0, bl.length(), &read_bl));
+  ASSERT_TRUE(read_bl.contents_equal(bl));
+
+  ASSERT_EQ(0, acquire_lock(cache));
+  ASSERT_EQ(0, flush(cache));
+  ASSERT_TRUE(image_contains(m_ictx, 0, bl));
+  ASSERT_EQ(0, shut_down(cache));
+}
+
+TEST_F(TestFileImageCache, OtherOwner) {
+  REQUIRE_FEATURE(RBD_FEATURE_EXCLUSIVE_LOCK);
+
+  ASSERT_EQ(0, set_owner("otherhost:/tmp/other.log"));
+  {
+    FileImageCache<ImageCtx> cache(*m_ictx);
+    ASSERT_EQ(-EBUSY, init(cache));
+  }
+
+  // the record may also show up while the cache is open
+  ASSERT_EQ(0, remove_owner());
+  FileImageCache<ImageCtx> cache(*m_ictx);
+  ASSERT_EQ(0, init(cache));
+  ASSERT_EQ(0, set_owner("otherhost:/tmp/other.log"));
+  ASSERT_EQ(-EBUSY, write(cache, 0, create_data('e')));
+  ASSERT_EQ(0, remove_owner());
+  ASSERT_EQ(0, shut_down(cache));
+}
+
+} // namespace cache
+} // namespace librbd
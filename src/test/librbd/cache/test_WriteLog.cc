@@ -0,0 +1,247 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "test/librbd/test_fixture.h"
+#include "test/librbd/test_support.h"
+#include "include/buffer.h"
+#include "librbd/cache/file/LogMap.h"
+#include "librbd/cache/file/WriteLog.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace librbd {
+namespace cache {
+namespace file {
+
+class TestWriteLog : public TestFixture {
+public:
+  typedef std::list<WriteLog::Entry> Entries;
+
+  void SetUp() override {
+    TestFixture::SetUp();
+    m_cct = reinterpret_cast<CephContext*>(m_ioctx.cct());
+    m_path = "/tmp/" + m_image_name + ".log";
+    ::unlink(m_path.c_str());
+  }
+
+  void TearDown() override {
+    ::unlink(m_path.c_str());
+    TestFixture::TearDown();
+  }
+
+  bufferlist create_data(char c, uint64_t length) {
+    bufferlist bl;
+    bl.append(std::string(length, c));
+    return bl;
+  }
+
+  bool read_data(WriteLog &log, const WriteLog::Entry &entry, char c) {
+    bufferlist bl;
+    if (log.read(entry.data_offset(), entry.length, &bl) < 0) {
+      return false;
+    }
+    return bl.contents_equal(create_data(c, entry.length));
+  }
+
+  CephContext *m_cct;
+  std::string m_path;
+};
+
+TEST_F(TestWriteLog, LogMapOverwrite) {
+  LogMap log_map;
+  log_map.add(0, 100, 1, 1000);
+  log_map.add(20, 10, 2, 5000);
+  log_map.add(90, 20, 3, 7000);
+
+  LogMap::Extents extents;
+  log_map.map(0, 120, &extents);
+  ASSERT_EQ(5U, extents.size());
+  ASSERT_EQ(0U, extents[0].image_offset);
+  ASSERT_EQ(20U, extents[0].length);
+  ASSERT_EQ(1U, extents[0].seq);
+  ASSERT_EQ(20U, extents[1].image_offset);
+  ASSERT_EQ(2U, extents[1].seq);
+  ASSERT_EQ(5000U, extents[1].log_offset);
+  ASSERT_EQ(30U, extents[2].image_offset);
+  ASSERT_EQ(60U, extents[2].length);
+  ASSERT_EQ(1030U, extents[2].log_offset);
+  ASSERT_EQ(90U, extents[3].image_offset);
+  ASSERT_EQ(3U, extents[3].seq);
+  ASSERT_EQ(110U, extents[4].image_offset);
+  ASSERT_EQ(10U, extents[4].length);
+  ASSERT_EQ(0U, extents[4].seq);
+
+  // only what is still backed by the older entries goes away
+  log_map.remove(0, 100, 1);
+  extents.clear();
+  log_map.map(0, 120, &extents);
+  ASSERT_EQ(5U, extents.size());
+  ASSERT_EQ(0U, extents[0].seq);
+  ASSERT_EQ(2U, extents[1].seq);
+  ASSERT_EQ(0U, extents[2].seq);
+  ASSERT_EQ(3U, extents[3].seq);
+  ASSERT_EQ(0U, extents[4].seq);
+
+  log_map.remove(0, 120, 3);
+  ASSERT_TRUE(log_map.empty());
+}
+
+TEST_F(TestWriteLog, AppendReplay) {
+  {
+    WriteLog log(m_cct, m_path);
+    Entries entries;
+    ASSERT_EQ(0, log.open("image", 1 << 20, &entries));
+    ASSERT_TRUE(entries.empty());
+
+    WriteLog::Entry entry;
+    ASSERT_EQ(0, log.append_write(4096, create_data('a', 4096), &entry));
+    ASSERT_EQ(1U, entry.seq);
+    ASSERT_EQ(0, log.append_write(0, create_data('b', 100), &entry));
+    ASSERT_EQ(0, log.append_sync(&entry));
+    ASSERT_EQ(WriteLog::ENTRY_TYPE_SYNC, entry.type);
+    ASSERT_EQ(0, log.sync());
+  }
+
+  WriteLog log(m_cct, m_path);
+  Entries entries;
+  ASSERT_EQ(0, log.open("image", 1 << 20, &entries));
+  ASSERT_EQ(3U, entries.size());
+
+  auto it = entries.begin();
+  ASSERT_EQ(WriteLog::ENTRY_TYPE_WRITE, it->type);
+  ASSERT_EQ(4096U, it->image_offset);
+  ASSERT_TRUE(read_data(log, *it, 'a'));
+  ++it;
+  ASSERT_EQ(0U, it->image_offset);
+  ASSERT_EQ(100U, it->length);
+  ASSERT_TRUE(read_data(log, *it, 'b'));
+  ++it;
+  ASSERT_EQ(WriteLog::ENTRY_TYPE_SYNC, it->type);
+  ASSERT_EQ(3U, it->seq);
+
+  // retired entries are not replayed
+  ASSERT_EQ(0, log.retire(entries.front()));
+  log.close();
+
+  WriteLog log2(m_cct, m_path);
+  entries.clear();
+  ASSERT_EQ(0, log2.open("image", 1 << 20, &entries));
+  ASSERT_EQ(2U, entries.size());
+  ASSERT_EQ(2U, entries.front().seq);
+}
+
+TEST_F(TestWriteLog, WrapAround) {
+  const uint64_t log_size = WriteLog::DATA_START + 64 * 1024;
+  const uint64_t length = 10000;
+
+  Entries live;
+  {
+    WriteLog log(m_cct, m_path);
+    Entries entries;
+    ASSERT_EQ(0, log.open("image", log_size, &entries));
+
+    // keep a few entries live while going around the ring several times
+    for (uint64_t i = 0; i < 40; ++i) {
+      while (!log.can_append(length)) {
+        ASSERT_FALSE(live.empty());
+        ASSERT_EQ(0, log.retire(live.front()));
+        live.pop_front();
+      }
+      WriteLog::Entry entry;
+      ASSERT_EQ(0, log.append_write(i * length,
+                                    create_data('a' + (i % 26), length),
+                                    &entry));
+      ASSERT_LE(entry.data_offset() + length, log_size);
+      live.push_back(entry);
+    }
+    ASSERT_EQ(0, log.sync());
+  }
+
+  WriteLog log(m_cct, m_path);
+  Entries entries;
+  ASSERT_EQ(0, log.open("image", log_size, &entries));
+  ASSERT_EQ(live.size(), entries.size());
+  auto live_it = live.begin();
+  for (auto &entry : entries) {
+    ASSERT_EQ(live_it->seq, entry.seq);
+    ASSERT_EQ(live_it->image_offset, entry.image_offset);
+    ASSERT_TRUE(read_data(log, entry, 'a' + ((entry.image_offset / length) % 26)));
+    ++live_it;
+  }
+}
+
+TEST_F(TestWriteLog, Full) {
+  WriteLog log(m_cct, m_path);
+  Entries entries;
+  ASSERT_EQ(0, log.open("image", WriteLog::DATA_START + 16384, &entries));
+
+  uint64_t length = log.get_max_entry_length();
+  ASSERT_FALSE(log.can_append(length + 1));
+
+  WriteLog::Entry entry;
+  while (log.can_append(length)) {
+    ASSERT_EQ(0, log.append_write(0, create_data('x', length), &entry));
+  }
+  ASSERT_EQ(-ENOSPC, log.append_write(0, create_data('x', length), &entry));
+
+  ASSERT_EQ(0, log.retire(entry));
+  ASSERT_TRUE(log.empty());
+  ASSERT_TRUE(log.can_append(length));
+}
+
+TEST_F(TestWriteLog, TornEntry) {
+  WriteLog::Entry torn;
+  {
+    WriteLog log(m_cct, m_path);
+    Entries entries;
+    ASSERT_EQ(0, log.open("image", 1 << 20, &entries));
+
+    WriteLog::Entry entry;
+    ASSERT_EQ(0, log.append_write(0, create_data('a', 512), &entry));
+    ASSERT_EQ(0, log.append_write(512, create_data('b', 512), &torn));
+    ASSERT_EQ(0, log.append_write(1024, create_data('c', 512), &entry));
+    ASSERT_EQ(0, log.sync());
+  }
+
+  // corrupt the data of the middle entry
+  int fd = ::open(m_path.c_str(), O_WRONLY);
+  ASSERT_LE(0, fd);
+  ASSERT_EQ(1, ::pwrite(fd, "z", 1, torn.data_offset() + 100));
+  ::close(fd);
+
+  {
+    WriteLog log(m_cct, m_path);
+    Entries entries;
+    ASSERT_EQ(0, log.open("image", 1 << 20, &entries));
+    ASSERT_EQ(1U, entries.size());
+    ASSERT_EQ(0U, entries.front().image_offset);
+
+    // the entries after the torn one stay lost
+    WriteLog::Entry entry;
+    ASSERT_EQ(0, log.append_write(4096, create_data('d', 100), &entry));
+    ASSERT_EQ(torn.seq, entry.seq);
+    ASSERT_EQ(0, log.sync());
+  }
+
+  WriteLog log(m_cct, m_path);
+  Entries entries;
+  ASSERT_EQ(0, log.open("image", 1 << 20, &entries));
+  ASSERT_EQ(2U, entries.size());
+  ASSERT_EQ(4096U, entries.back().image_offset);
+}
+
+TEST_F(TestWriteLog, OtherImage) {
+  {
+    WriteLog log(m_cct, m_path);
+    Entries entries;
+    ASSERT_EQ(0, log.open("image", 1 << 20, &entries));
+  }
+
+  WriteLog log(m_cct, m_path);
+  Entries entries;
+  ASSERT_EQ(-EEXIST, log.open("other", 1 << 20, &entries));
+}
+
+} // namespace file
+} // namespace cache
+} // namespace librbd
@@ -12,10 +12,13 @@
 #include "librbd/ObjectMap.h"
 #include "librbd/Operations.h"
 #include "librbd/api/DiffIterate.h"
+#include "librbd/cache/ParentCache.h"
 #include "librbd/io/AioCompletion.h"
 #include "librbd/io/ImageRequest.h"
 #include "librbd/io/ImageRequestWQ.h"
 #include "osdc/Striper.h"
+#include "common/ceph_json.h"
+#include "common/Formatter.h"
 #include <boost/scope_exit.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/assign/list_of.hpp>
@@ -1154,6 +1157,99 @@ TEST_F(TestInternal, TestCoR)
   rados_ioctx_destroy(d_ioctx);
 }
 
+static uint64_t get_parent_cache_counter(CephContext *cct,
+                                         const std::string &counter) {
+  JSONFormatter f;
+  cct->get_perfcounters_collection()->dump_formatted(
+    &f, false, "librbd-parent-cache", counter);
+  std::stringstream ss;
+  f.flush(ss);
+
+  JSONParser parser;
+  std::string json = ss.str();
+  if (!parser.parse(json.c_str(), json.size())) {
+    return 0;
+  }
+  JSONObj *logger = parser.find_obj("librbd-parent-cache");
+  JSONObj *obj = logger ? logger->find_obj(counter) : nullptr;
+  return obj ? strtoull(obj->get_data().c_str(), nullptr, 10) : 0;
+}
+
+TEST_F(TestInternal, ParentCacheRead)
+{
+  REQUIRE_FEATURE(RBD_FEATURE_LAYERING);
+
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  bufferlist bl;
+  bl.append(std::string(256, '1'));
+  ASSERT_EQ(256, ictx->io_work_queue->write(0, bl.length(), bufferlist{bl}, 0));
+
+  ASSERT_EQ(0, snap_create(*ictx, "snap1"));
+  ASSERT_EQ(0,
+	    ictx->operations->snap_protect(cls::rbd::UserSnapshotNamespace(),
+					   "snap1"));
+
+  uint64_t features;
+  ASSERT_EQ(0, librbd::get_features(ictx, &features));
+
+  uint64_t hits = get_parent_cache_counter(ictx->cct, "hit");
+  uint64_t misses = get_parent_cache_counter(ictx->cct, "miss");
+
+  // two clones of the same parent share the cached parent objects
+  for (int i = 0; i < 2; ++i) {
+    std::string clone_name = get_temp_image_name();
+    int order = ictx->order;
+    ASSERT_EQ(0, librbd::clone(m_ioctx, m_image_name.c_str(), "snap1",
+                               m_ioctx, clone_name.c_str(), features, &order,
+                               0, 0));
+
+    librbd::ImageCtx *ictx2;
+    ASSERT_EQ(0, open_image(clone_name, &ictx2));
+    ASSERT_EQ(0, ictx2->operations->metadata_set(
+      "conf_rbd_parent_cache_enabled", "true"));
+    close_image(ictx2);
+
+    ASSERT_EQ(0, open_image(clone_name, &ictx2));
+    ASSERT_TRUE(ictx2->parent != nullptr);
+    ASSERT_TRUE(ictx2->parent->parent_cache != nullptr);
+
+    for (int j = 0; j < 2; ++j) {
+      bufferlist read_bl;
+      librbd::io::ReadResult read_result{&read_bl};
+      ASSERT_EQ(256,
+                ictx2->io_work_queue->read(0, 256,
+                                           librbd::io::ReadResult{read_result},
+                                           0));
+      ASSERT_TRUE(bl.contents_equal(read_bl));
+
+      ASSERT_EQ(256,
+                ictx2->io_work_queue->read(1024, 256,
+                                           librbd::io::ReadResult{read_result},
+                                           0));
+      ASSERT_TRUE(read_bl.is_zero());
+    }
+
+    // a hole in the parent is fetched once and then remembered
+    librbd::ImageCtx *parent = ictx2->parent;
+    for (int j = 0; j < 2; ++j) {
+      bufferlist read_bl;
+      C_SaferCond ctx;
+      parent->parent_cache->read(parent, parent->get_object_name(1000), 1000,
+                                 parent->snap_id, 0, 256, &read_bl, &ctx);
+      ASSERT_EQ(-ENOENT, ctx.wait());
+    }
+    close_image(ictx2);
+  }
+
+  // only the first read of each object went to the cluster.  the second
+  // clone starts with an empty rbd cache, so at least its first read and
+  // the last three reads of the hole were served by the parent cache.
+  ASSERT_EQ(misses + 2, get_parent_cache_counter(ictx->cct, "miss"));
+  ASSERT_LE(hits + 4, get_parent_cache_counter(ictx->cct, "hit"));
+}
+
 TEST_F(TestInternal, FlattenNoEmptyObjects)
 {
   REQUIRE_FEATURE(RBD_FEATURE_LAYERING);
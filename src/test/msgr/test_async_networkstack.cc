@@ -28,6 +28,7 @@
 
 #include "msg/async/Event.h"
 #include "msg/async/Stack.h"
+#include "msg/async/PosixStack.h"
 
 
 #if GTEST_HAS_PARAM_TEST
@@ -244,6 +245,205 @@ TEST_P(NetworkWorkerTest, SimpleTest) {
   });
 }
 
+TEST_P(NetworkWorkerTest, ZeroCopySendTest) {
+  if (strcmp(GetParam(), "posix")) {
+    cerr << __func__ << " MSG_ZEROCOPY is only used by the posix stack" << std::endl;
+    return;
+  }
+  g_ceph_context->_conf->set_val("ms_async_zerocopy_send", "true", false);
+  g_ceph_context->_conf->set_val("ms_async_zerocopy_min_size", "65536", false);
+  entity_addr_t bind_addr;
+  ASSERT_TRUE(bind_addr.parse(get_addr().c_str()));
+
+  exec_events([this, bind_addr](Worker *worker) mutable {
+    if (worker->id != 0)
+      return;
+    entity_addr_t cli_addr;
+    SocketOptions options;
+    ServerSocket bind_socket;
+    EventCenter *center = &worker->center;
+    ssize_t r = worker->listen(bind_addr, options, &bind_socket);
+    ASSERT_EQ(0, r);
+
+    ConnectedSocket cli_socket, srv_socket;
+    r = worker->connect(bind_addr, options, &cli_socket);
+    ASSERT_EQ(0, r);
+    {
+      C_poll cb(center);
+      center->create_file_event(bind_socket.fd(), EVENT_READABLE, &cb);
+      ASSERT_TRUE(cb.poll(500));
+      center->delete_file_event(bind_socket.fd(), EVENT_READABLE);
+      r = bind_socket.accept(&srv_socket, options, &cli_addr, worker);
+      ASSERT_EQ(0, r);
+    }
+    {
+      C_poll cb(center);
+      center->create_file_event(cli_socket.fd(), EVENT_READABLE, &cb);
+      r = cli_socket.is_connected();
+      if (r == 0) {
+        ASSERT_EQ(true, cb.poll(500));
+        r = cli_socket.is_connected();
+      }
+      ASSERT_EQ(1, r);
+      center->delete_file_event(cli_socket.fd(), EVENT_READABLE);
+    }
+
+    PerfCounters *logger = worker->get_perf_counter();
+    uint64_t zc_before = logger->get(l_msgr_send_zerocopy_bytes);
+    uint64_t copy_before = logger->get(l_msgr_send_copy_bytes);
+
+    // a small header that is copied followed by large zero-copy payloads
+    const unsigned header_len = 128, payload_len = 1 << 20;
+    bufferptr payload(buffer::create_page_aligned(payload_len));
+    for (unsigned i = 0; i < payload_len; ++i)
+      payload.c_str()[i] = i * 7;
+    bufferlist expected, bl;
+    expected.append(string(header_len, 'h'));
+    expected.append(payload);
+    expected.append(payload);
+    bl = expected;
+    ASSERT_EQ(3u, bl.buffers().size());
+
+    bufferlist received;
+    char buf[65536];
+    C_poll cb(center);
+    center->create_file_event(srv_socket.fd(), EVENT_READABLE, &cb);
+    int retries = 1000;
+    while (received.length() < expected.length()) {
+      if (bl.length()) {
+        r = cli_socket.send(bl, false);
+        ASSERT_GE(r, 0);
+      }
+      r = srv_socket.read(buf, sizeof(buf));
+      if (r == -EAGAIN) {
+        ASSERT_TRUE(--retries > 0);
+        cb.poll(10);
+        cb.reset();
+        continue;
+      }
+      ASSERT_GT(r, 0);
+      received.append(buf, r);
+    }
+    ASSERT_TRUE(received.contents_equal(expected));
+
+    uint64_t zc = logger->get(l_msgr_send_zerocopy_bytes) - zc_before;
+    uint64_t copied = logger->get(l_msgr_send_copy_bytes) - copy_before;
+    ASSERT_EQ(expected.length(), zc + copied);
+    ASSERT_GE(copied, header_len);
+    cerr << __func__ << " zerocopy " << zc << " copied " << copied << std::endl;
+
+    // once the kernel reports completion the socket drops its references
+    // to the payload (reaped on the next read or send)
+    expected.clear();
+    retries = 1000;
+    while (payload.raw_nref() > 1) {
+      ASSERT_TRUE(--retries > 0);
+      cb.poll(10);
+      cb.reset();
+      cli_socket.read(buf, sizeof(buf));
+    }
+
+    center->delete_file_event(srv_socket.fd(), EVENT_READABLE);
+    srv_socket.close();
+    cli_socket.close();
+    bind_socket.abort_accept();
+  });
+  g_ceph_context->_conf->set_val("ms_async_zerocopy_send", "false", false);
+}
+
+TEST_P(NetworkWorkerTest, ZeroCopyCloseTest) {
+  if (strcmp(GetParam(), "posix")) {
+    cerr << __func__ << " MSG_ZEROCOPY is only used by the posix stack" << std::endl;
+    return;
+  }
+  g_ceph_context->_conf->set_val("ms_async_zerocopy_send", "true", false);
+  g_ceph_context->_conf->set_val("ms_async_zerocopy_min_size", "65536", false);
+  entity_addr_t bind_addr;
+  ASSERT_TRUE(bind_addr.parse(get_addr().c_str()));
+
+  exec_events([this, bind_addr](Worker *worker) mutable {
+    if (worker->id != 0)
+      return;
+    entity_addr_t cli_addr;
+    SocketOptions options;
+    ServerSocket bind_socket;
+    EventCenter *center = &worker->center;
+    ssize_t r = worker->listen(bind_addr, options, &bind_socket);
+    ASSERT_EQ(0, r);
+
+    ConnectedSocket cli_socket, srv_socket;
+    r = worker->connect(bind_addr, options, &cli_socket);
+    ASSERT_EQ(0, r);
+    {
+      C_poll cb(center);
+      center->create_file_event(bind_socket.fd(), EVENT_READABLE, &cb);
+      ASSERT_TRUE(cb.poll(500));
+      center->delete_file_event(bind_socket.fd(), EVENT_READABLE);
+      r = bind_socket.accept(&srv_socket, options, &cli_addr, worker);
+      ASSERT_EQ(0, r);
+    }
+    {
+      C_poll cb(center);
+      center->create_file_event(cli_socket.fd(), EVENT_READABLE, &cb);
+      r = cli_socket.is_connected();
+      if (r == 0) {
+        ASSERT_EQ(true, cb.poll(500));
+        r = cli_socket.is_connected();
+      }
+      ASSERT_EQ(1, r);
+      center->delete_file_event(cli_socket.fd(), EVENT_READABLE);
+    }
+
+    const unsigned payload_len = 4 << 20;
+    bufferptr payload(buffer::create_page_aligned(payload_len));
+    memset(payload.c_str(), 'z', payload_len);
+    bufferlist bl;
+    bl.append(payload);
+    ssize_t sent = cli_socket.send(bl, false);
+    ASSERT_GT(sent, 0);
+
+    // close before the peer has read anything.  whatever the kernel has
+    // not released yet must stay referenced by the worker.
+    bl.clear();
+    cli_socket.close();
+
+    // the peer still gets all the data, then eof
+    char buf[65536];
+    ssize_t received = 0;
+    C_poll cb(center);
+    center->create_file_event(srv_socket.fd(), EVENT_READABLE, &cb);
+    int retries = 1000;
+    while (true) {
+      r = srv_socket.read(buf, sizeof(buf));
+      if (r == -EAGAIN) {
+        ASSERT_TRUE(--retries > 0);
+        cb.poll(10);
+        cb.reset();
+        continue;
+      }
+      ASSERT_GE(r, 0);
+      if (r == 0)
+        break;
+      ASSERT_EQ('z', buf[0]);
+      received += r;
+    }
+    ASSERT_EQ(sent, received);
+
+    PosixWorker *pw = static_cast<PosixWorker*>(worker);
+    retries = 1000;
+    while (payload.raw_nref() > 1) {
+      ASSERT_TRUE(--retries > 0);
+      usleep(1000);
+      pw->reap_lingering();
+    }
+
+    center->delete_file_event(srv_socket.fd(), EVENT_READABLE);
+    srv_socket.close();
+    bind_socket.abort_accept();
+  });
+  g_ceph_context->_conf->set_val("ms_async_zerocopy_send", "false", false);
+}
+
 TEST_P(NetworkWorkerTest, ConnectFailedTest) {
   entity_addr_t bind_addr;
   ASSERT_TRUE(bind_addr.parse(get_addr().c_str()));
@@ -5,11 +5,13 @@
  * Author: Ramesh Chander, Ramesh.Chander@sandisk.com
  */
 #include <iostream>
+#include <random>
 #include <boost/scoped_ptr.hpp>
 #include <gtest/gtest.h>
 
 #include "common/Mutex.h"
 #include "common/Cond.h"
+#include "common/Clock.h"
 #include "common/errno.h"
 #include "include/stringify.h"
 #include "include/Context.h"
@@ -218,7 +220,7 @@ TEST_P(AllocTest, test_alloc_big)
 
 TEST_P(AllocTest, test_alloc_hint_bmap)
 {
-  if (GetParam() == std::string("stupid")) {
+  if (GetParam() != std::string("bitmap")) {
     return;
   }
   int64_t blocks = BitMapArea::get_level_factor(g_ceph_context, 2) * 4;
@@ -290,11 +292,126 @@ TEST_P(AllocTest, test_alloc_non_aligned_len)
   EXPECT_EQ(want_size, alloc->allocate(want_size, alloc_unit, 0, &extents));
 }
 
+TEST_P(AllocTest, test_alloc_release_merge)
+{
+  int64_t block_size = 4096;
+  int64_t blocks = 1024;
+  init_alloc(blocks * block_size, block_size);
+  alloc->init_add_free(0, blocks * block_size);
+
+  // punch holes, then give them back out of order; avl must coalesce
+  // everything again so one allocation can take the whole device
+  AllocExtentVector extents;
+  EXPECT_EQ(0, alloc->reserve(blocks * block_size));
+  EXPECT_EQ(blocks * block_size,
+	    alloc->allocate(blocks * block_size, block_size, block_size, 0,
+			    &extents));
+  EXPECT_EQ(0u, alloc->get_free());
+  for (size_t i = 0; i < extents.size(); i += 2) {
+    alloc->release(extents[i].offset, extents[i].length);
+  }
+  for (size_t i = 1; i < extents.size(); i += 2) {
+    alloc->release(extents[i].offset, extents[i].length);
+  }
+  EXPECT_EQ((uint64_t)(blocks * block_size), alloc->get_free());
+
+  extents.clear();
+  EXPECT_EQ(0, alloc->reserve(blocks * block_size));
+  EXPECT_EQ(blocks * block_size,
+	    alloc->allocate(blocks * block_size, block_size, 0, &extents));
+  if (GetParam() == std::string("avl")) {
+    EXPECT_EQ(1u, extents.size());
+  }
+}
+
+/*
+ * Allocation throughput and fragmentation over a long random workload:
+ * fill the device to 75% with a mix of small and large allocations, then
+ * keep it there by alternately freeing a random live extent and
+ * allocating a new one.  A fixed seed keeps runs comparable.  This takes
+ * a while, run it with --gtest_also_run_disabled_tests.
+ */
+TEST_P(AllocTest, DISABLED_test_alloc_bench_random)
+{
+  const uint64_t block_size = 4096;
+  const uint64_t capacity = 1ull << 34;
+  const uint64_t target = capacity / 4 * 3;
+  const unsigned churn_ops = 200000;
+
+  init_alloc(capacity, block_size);
+  alloc->init_add_free(0, capacity);
+
+  std::mt19937_64 rng(0);
+  std::vector<AllocExtent> live;
+  uint64_t used = 0;
+  uint64_t allocs = 0, pieces = 0, fragmented = 0;
+
+  auto do_alloc = [&]() -> bool {
+    // mostly 4k-64k, one in eight up to 4m
+    uint64_t want = rng() % 8 ?
+      (1 + rng() % 16) * block_size :
+      (1 + rng() % 1024) * block_size;
+    int r = alloc->reserve(want);
+    EXPECT_EQ(0, r);
+    if (r < 0) {
+      return false;
+    }
+    AllocExtentVector extents;
+    int64_t got = alloc->allocate(want, block_size, 0, &extents);
+    EXPECT_EQ((int64_t)want, got);
+    if (got != (int64_t)want) {
+      return false;
+    }
+    ++allocs;
+    pieces += extents.size();
+    if (extents.size() > 1) {
+      ++fragmented;
+    }
+    for (auto& e : extents) {
+      live.push_back(e);
+    }
+    used += want;
+    return true;
+  };
+  auto report = [&](const char *phase, unsigned ops, utime_t dur) {
+    std::cout << GetParam() << " " << phase << ": " << ops << " ops in "
+	      << dur << " (" << (uint64_t)(ops / (double)dur) << " ops/sec), "
+	      << (double)pieces / allocs << " extents/alloc, "
+	      << (100.0 * fragmented / allocs) << "% allocs fragmented, "
+	      << live.size() << " live extents" << std::endl;
+  };
+
+  utime_t start = ceph_clock_now();
+  unsigned fill_ops = 0;
+  while (used < target) {
+    ASSERT_TRUE(do_alloc());
+    ++fill_ops;
+  }
+  report("fill", fill_ops, ceph_clock_now() - start);
+
+  allocs = pieces = fragmented = 0;
+  start = ceph_clock_now();
+  for (unsigned i = 0; i < churn_ops; ++i) {
+    if (used >= target) {
+      size_t idx = rng() % live.size();
+      AllocExtent e = live[idx];
+      live[idx] = live.back();
+      live.pop_back();
+      alloc->release(e.offset, e.length);
+      used -= e.length;
+    } else {
+      ASSERT_TRUE(do_alloc());
+    }
+  }
+  report("churn", churn_ops, ceph_clock_now() - start);
+  EXPECT_EQ(capacity - used, alloc->get_free());
+}
+
 
 INSTANTIATE_TEST_CASE_P(
   Allocator,
   AllocTest,
-  ::testing::Values("stupid", "bitmap"));
+  ::testing::Values("stupid", "bitmap", "avl"));
 
 #else
 
@@ -1106,6 +1106,136 @@ TEST_P(StoreTest, CompressionTest) {
   g_ceph_context->_conf->apply_changes(NULL);
 }
 
+TEST_P(StoreTest, CompressionThreadsTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  g_conf->set_val("bluestore_compression_algorithm", "snappy");
+  g_conf->set_val("bluestore_compression_mode", "force");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  // compress inline, then with more threads than blobs per write
+  for (auto threads : {"0", "8"}) {
+    g_conf->set_val("bluestore_compression_threads", threads);
+    g_ceph_context->_conf->apply_changes(NULL);
+    int r = store->umount();
+    ASSERT_EQ(0, r);
+    r = store->mount();
+    ASSERT_EQ(0, r);
+
+    doCompressionTest(store);
+  }
+
+  g_conf->set_val("bluestore_compression_threads", "2");
+  g_conf->set_val("bluestore_compression_mode", "none");
+  g_ceph_context->_conf->apply_changes(NULL);
+  int r = store->umount();
+  ASSERT_EQ(0, r);
+  r = store->mount();
+  ASSERT_EQ(0, r);
+}
+
+TEST_P(StoreTest, CompressionDictTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  if (!Compressor::create(g_ceph_context, "zstd"))
+    return;
+
+  string algorithm =
+    g_conf->get_val<string>("bluestore_compression_algorithm");
+  g_conf->set_val("bluestore_compression_algorithm", "zstd");
+  g_conf->set_val("bluestore_compression_mode", "force");
+  g_conf->set_val("bluestore_compression_dict", "true");
+  g_conf->set_val("bluestore_compression_dict_sample_bytes", "262144");
+  g_ceph_context->_conf->apply_changes(NULL);
+  int r = store->umount();
+  ASSERT_EQ(0, r);
+  r = store->mount();
+  ASSERT_EQ(0, r);
+
+  ObjectStore::Sequencer osr("test");
+  coll_t cid(spg_t(pg_t(0, 7), shard_id_t::NO_SHARD));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // small records sharing most of their content
+  auto make_data = [](int i) {
+    bufferlist bl;
+    for (int j = 0; bl.length() < 16384; ++j) {
+      bl.append("{\"user\": \"user" + stringify(i) + "\", \"seq\": " +
+		stringify(j) + ", \"status\": \"active\", \"tags\": []}\n");
+    }
+    return bl;
+  };
+  auto write = [&](int from, int to) {
+    for (int i = from; i < to; ++i) {
+      ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i),
+					  CEPH_NOSNAP)));
+      bufferlist bl = make_data(i);
+      ObjectStore::Transaction t;
+      t.write(cid, hoid, 0, bl.length(), bl);
+      r = apply_transaction(store, &osr, std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+  };
+  auto verify = [&](int to) {
+    for (int i = 0; i < to; ++i) {
+      ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i),
+					  CEPH_NOSNAP)));
+      bufferlist bl;
+      r = store->read(cid, hoid, 0, 0, bl);
+      bufferlist expected = make_data(i);
+      ASSERT_EQ((int)expected.length(), r);
+      ASSERT_TRUE(bl_eq(expected, bl));
+    }
+  };
+
+  const PerfCounters* logger = store->get_perf_counters();
+
+  // enough to train on; umount waits for the training to finish
+  write(0, 32);
+  r = store->umount();
+  ASSERT_EQ(0, r);
+  ASSERT_GT(logger->get(l_bluestore_compress_dict_trained), 0u);
+  r = store->mount();
+  ASSERT_EQ(0, r);
+
+  // these use the dictionary, which must survive a remount
+  uint64_t dict_count = logger->get(l_bluestore_compress_dict_count);
+  write(32, 64);
+  ASSERT_GT(logger->get(l_bluestore_compress_dict_count), dict_count);
+  verify(64);
+  r = store->umount();
+  ASSERT_EQ(0, r);
+  r = store->mount();
+  ASSERT_EQ(0, r);
+  verify(64);
+
+  {
+    ObjectStore::Transaction t;
+    for (int i = 0; i < 64; ++i) {
+      t.remove(cid, ghobject_t(hobject_t(sobject_t("Object " + stringify(i),
+						     CEPH_NOSNAP))));
+    }
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  g_conf->set_val("bluestore_compression_dict", "false");
+  g_conf->set_val("bluestore_compression_dict_sample_bytes", "4194304");
+  g_conf->set_val("bluestore_compression_mode", "none");
+  g_conf->set_val("bluestore_compression_algorithm", algorithm);
+  g_ceph_context->_conf->apply_changes(NULL);
+  r = store->umount();
+  ASSERT_EQ(0, r);
+  r = store->mount();
+  ASSERT_EQ(0, r);
+}
+
 TEST_P(StoreTest, SimpleObjectTest) {
   ObjectStore::Sequencer osr("test");
   int r;
@@ -4246,6 +4376,7 @@ TEST_P(StoreTestSpecificAUSize, SyntheticMatrixSharding) {
     { "bluestore_extent_map_shard_min_size", "60", 0 },
     { "bluestore_extent_map_shard_max_size", "300", 0 },
     { "bluestore_extent_map_shard_target_size", "150", 0 },
+    { "bluestore_extent_map_lazy_read", "false", "true", 0 },
     { "bluestore_default_buffered_read", "true", 0 },
     { "bluestore_default_buffered_write", "true", 0 },
     { 0 },
@@ -4253,6 +4384,110 @@ TEST_P(StoreTestSpecificAUSize, SyntheticMatrixSharding) {
   do_matrix(m, store, doSyntheticTest);
 }
 
+TEST_P(StoreTestSpecificAUSize, SyntheticMatrixCacheType) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  // the cache shards are created with the store, so the type has to be
+  // set before each run rather than as part of the matrix
+  for (auto type : { "lru", "2q", "clock" }) {
+    g_conf->set_val("bluestore_cache_type", type);
+    const char *m[][10] = {
+      { "bluestore_min_alloc_size", "4096", 0 }, // must be the first!
+      { "num_ops", "20000", 0 },
+      { "max_write", "65536", 0 },
+      { "max_size", "1048576", 0 },
+      { "alignment", "4096", 0 },
+      { "bluestore_default_buffered_read", "true", 0 },
+      { "bluestore_default_buffered_write", "true", 0 },
+      { 0 },
+    };
+    do_matrix(m, store, doSyntheticTest);
+    TearDown();
+    store.reset();
+  }
+  g_conf->set_val("bluestore_cache_type", "2q");
+}
+
+TEST_P(StoreTestSpecificAUSize, KvPipelineUmountUnderLoad) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  struct C_Commit : public Context {
+    std::mutex *lock;
+    vector<unsigned> *order;
+    unsigned seq;
+    C_Commit(std::mutex *l, vector<unsigned> *o, unsigned s)
+      : lock(l), order(o), seq(s) {}
+    void finish(int r) override {
+      std::lock_guard<std::mutex> l(*lock);
+      order->push_back(seq);
+    }
+  };
+
+  // pipeline depth, finalize threads; both take effect on mount
+  const char *settings[][2] = {
+    { "0", "1" }, { "2", "1" }, { "0", "4" }, { "4", "4" },
+  };
+  for (auto& setting : settings) {
+    cout << "pipeline depth " << setting[0] << ", finalize threads "
+	 << setting[1] << std::endl;
+    g_conf->set_val("bluestore_kv_sync_pipeline_depth", setting[0]);
+    g_conf->set_val("bluestore_kv_finalize_threads", setting[1]);
+    StartDeferred(4096);
+
+    // several sequencers so completions spread over the finalize shards
+    const unsigned num_osr = 8, per_osr = 200;
+    vector<std::unique_ptr<ObjectStore::Sequencer>> osrs;
+    vector<coll_t> cids;
+    for (unsigned i = 0; i < num_osr; ++i) {
+      osrs.emplace_back(new ObjectStore::Sequencer("test"));
+      cids.push_back(coll_t(spg_t(pg_t(i, 11), shard_id_t::NO_SHARD)));
+      ObjectStore::Transaction t;
+      t.create_collection(cids[i], 0);
+      ASSERT_EQ(0, apply_transaction(store, osrs[i].get(), std::move(t)));
+    }
+
+    std::mutex lock;
+    vector<vector<unsigned>> order(num_osr);
+    bufferlist bl;
+    bl.append(std::string(4096, 'x'));
+    for (unsigned n = 0; n < per_osr; ++n) {
+      for (unsigned i = 0; i < num_osr; ++i) {
+	ObjectStore::Transaction t;
+	ghobject_t hoid(hobject_t(sobject_t("obj" + stringify(n),
+					    CEPH_NOSNAP)));
+	t.write(cids[i], hoid, 0, bl.length(), bl);
+	store->queue_transaction(osrs[i].get(), std::move(t), nullptr,
+				 new C_Commit(&lock, &order[i], n));
+      }
+    }
+
+    // stop the kv threads while commits are still in flight; every
+    // completion must still be delivered, in order per sequencer
+    ASSERT_EQ(0, store->umount());
+    for (unsigned i = 0; i < num_osr; ++i) {
+      ASSERT_EQ(per_osr, order[i].size());
+      for (unsigned n = 0; n < per_osr; ++n)
+	ASSERT_EQ(n, order[i][n]);
+    }
+
+    ASSERT_EQ(0, store->mount());
+    for (unsigned i = 0; i < num_osr; ++i) {
+      struct stat st;
+      ghobject_t hoid(hobject_t(sobject_t("obj" + stringify(per_osr - 1),
+					  CEPH_NOSNAP)));
+      ASSERT_EQ(0, store->stat(cids[i], hoid, &st));
+      ASSERT_EQ(4096, st.st_size);
+    }
+    osrs.clear();
+    TearDown();
+    store.reset();
+  }
+  g_conf->set_val("bluestore_kv_sync_pipeline_depth", "0");
+  g_conf->set_val("bluestore_kv_finalize_threads", "1");
+}
+
 TEST_P(StoreTestSpecificAUSize, ZipperPatternSharded) {
   if(string(GetParam()) != "bluestore")
     return;
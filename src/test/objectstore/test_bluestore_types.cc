@@ -865,6 +865,64 @@ TEST(bluestore_blob_t, can_split_at)
   ASSERT_FALSE(a.can_split_at(0x2800));
 }
 
+TEST(bluestore_blob_t, skip)
+{
+  for (unsigned i = 0; i < 16; ++i) {
+    bluestore_blob_t b;
+    b.allocated_test(bluestore_pextent_t(0x10000, 0x2000));
+    b.allocated_test(bluestore_pextent_t(0x40000, 0x1000));
+    if (i & 1) {
+      b.init_csum(Checksummer::CSUM_CRC32C, 12, 0x3000);
+    }
+    if (i & 2) {
+      b.add_unused(0x2000, 0x1000);
+      ASSERT_TRUE(b.has_unused());
+    }
+    if (i & 4) {
+      b.set_compressed(0x8000, 0x3000);
+    }
+    if (i & 8) {
+      b.set_flag(bluestore_blob_t::FLAG_SHARED);
+    }
+    const uint32_t marker = 0xdeadbeef;
+    size_t bound = 0;
+    b.bound_encode(bound, 2);
+    denc(marker, bound);
+    bufferlist bl;
+    {
+      auto app = bl.get_contiguous_appender(bound);
+      b.encode(app, 2);
+      denc(marker, app);
+    }
+    auto p = bl.front().begin();
+    ASSERT_EQ(b.flags, bluestore_blob_t::skip(p, 2));
+    uint32_t v;
+    denc(v, p);
+    ASSERT_EQ(marker, v);
+    ASSERT_TRUE(p.end());
+
+    // a shared Blob is followed by its sbid
+    BlueStore::Blob B;
+    B.dirty_blob() = b;
+    const uint64_t sbid = 0x1234;
+    bound = 0;
+    B.bound_encode(bound, 2, sbid, false);
+    denc(marker, bound);
+    bufferlist bl2;
+    {
+      auto app = bl2.get_contiguous_appender(bound);
+      B.encode(app, 2, sbid, false);
+      denc(marker, app);
+    }
+    ASSERT_EQ(bl.length() + ((i & 8) ? sizeof(sbid) : 0), bl2.length());
+    auto p2 = bl2.front().begin();
+    BlueStore::Blob::skip(p2, 2);
+    denc(v, p2);
+    ASSERT_EQ(marker, v);
+    ASSERT_TRUE(p2.end());
+  }
+}
+
 TEST(bluestore_blob_t, prune_tail)
 {
   bluestore_blob_t a;
@@ -1030,6 +1088,64 @@ TEST(Blob, legacy_decode)
   }
 }
 
+TEST(ClockCache, onode_second_chance)
+{
+  PerfCountersBuilder b(g_ceph_context, "clock_cache_test",
+			l_bluestore_first, l_bluestore_last);
+  b.add_u64_counter(l_bluestore_onode_hits, "onode_hits", "");
+  b.add_u64_counter(l_bluestore_onode_misses, "onode_misses", "");
+  b.add_u64_counter(l_bluestore_cache_clock_spared, "clock_spared", "");
+  std::unique_ptr<PerfCounters> logger(b.create_perf_counters());
+
+  BlueStore store(g_ceph_context, "", 4096);
+  std::unique_ptr<BlueStore::Cache> cache(
+    BlueStore::Cache::create(g_ceph_context, "clock", logger.get()));
+  ASSERT_TRUE(cache->lockless_onode_touch());
+  {
+    BlueStore::CollectionRef coll(
+      new BlueStore::Collection(&store, cache.get(), coll_t()));
+    vector<ghobject_t> oids;
+    for (unsigned i = 0; i < 4; ++i) {
+      oids.push_back(ghobject_t(hobject_t(sobject_t("obj" + stringify(i),
+						    CEPH_NOSNAP))));
+      BlueStore::OnodeRef o(new BlueStore::Onode(coll.get(), oids[i], ""));
+      coll->onode_map.add(oids[i], o);
+    }
+    auto trim = [&](uint64_t onode_max) {
+      std::lock_guard<std::recursive_mutex> l(cache->lock);
+      cache->_trim(onode_max, 0);
+    };
+    auto cached = [&](unsigned i) {
+      return coll->onode_map.lookup(oids[i]).get() != nullptr;
+    };
+
+    // everything starts referenced, so the first sweep spares all of
+    // them and the oldest goes on the second pass
+    trim(3);
+    ASSERT_EQ(3u, cache->_get_num_onodes());
+    ASSERT_EQ(4u, logger->get(l_bluestore_cache_clock_spared));
+
+    // the hit on obj1 makes the hand pass over it to obj2
+    ASSERT_TRUE(cached(1));
+    trim(2);
+    ASSERT_EQ(2u, cache->_get_num_onodes());
+    ASSERT_FALSE(cached(0));
+    ASSERT_FALSE(cached(2));
+
+    // pinned onodes are never evicted
+    BlueStore::OnodeRef pinned = coll->onode_map.lookup(oids[3]);
+    ASSERT_TRUE(pinned);
+    trim(0);
+    ASSERT_EQ(1u, cache->_get_num_onodes());
+    ASSERT_FALSE(cached(1));
+    ASSERT_TRUE(cached(3));
+    pinned.reset();
+    trim(0);
+    ASSERT_EQ(0u, cache->_get_num_onodes());
+    ASSERT_EQ(3u, logger->get(l_bluestore_onode_misses));
+  }
+}
+
 TEST(ExtentMap, seek_lextent)
 {
   BlueStore store(g_ceph_context, "", 4096);
@@ -1079,6 +1195,80 @@ TEST(ExtentMap, seek_lextent)
   ASSERT_EQ(em.extent_map.end(), em.seek_lextent(500));
 }
 
+TEST(ExtentMap, shard_view)
+{
+  BlueStore store(g_ceph_context, "", 4096);
+  BlueStore::LRUCache cache(g_ceph_context);
+  BlueStore::CollectionRef coll(new BlueStore::Collection(&store, &cache, coll_t()));
+  BlueStore::Onode onode(coll.get(), ghobject_t(), "");
+  BlueStore::ExtentMap em(&onode);
+
+  // shared, private, shared: a skip that misses the sbid desyncs the
+  // cursor for every extent after the first blob
+  BlueStore::BlobRef b[3];
+  for (unsigned i = 0; i < 3; ++i) {
+    b[i] = new BlueStore::Blob;
+    b[i]->dirty_blob().allocated_test(
+      bluestore_pextent_t(0x100000 * (i + 1), 0x2000));
+    if (i != 1) {
+      b[i]->shared_blob = new BlueStore::SharedBlob(100 + i, coll.get());
+      b[i]->dirty_blob().set_flag(bluestore_blob_t::FLAG_SHARED);
+    } else {
+      b[i]->shared_blob = new BlueStore::SharedBlob(coll.get());
+    }
+  }
+  em.extent_map.insert(*new BlueStore::Extent(0, 0, 0x1000, b[0]));
+  em.extent_map.insert(*new BlueStore::Extent(0x1000, 0x1000, 0x1000, b[0]));
+  em.extent_map.insert(*new BlueStore::Extent(0x2000, 0, 0x2000, b[1]));
+  em.extent_map.insert(*new BlueStore::Extent(0x6000, 0x800, 0x800, b[2]));
+  em.extent_map.insert(*new BlueStore::Extent(0x7000, 0, 0x1000, b[1]));
+
+  bufferlist bl;
+  unsigned n = 0;
+  ASSERT_FALSE(em.encode_some(0, 0x10000, bl, &n));
+  ASSERT_EQ(5u, n);
+  bl.rebuild();
+  bufferptr bp = bl.front();
+
+  struct {
+    uint32_t logical_offset, blob_offset, length;
+    bool blob_here;
+    unsigned blob_index;
+  } expected[] = {
+    { 0,      0,      0x1000, true,  0 },
+    { 0x1000, 0x1000, 0x1000, false, 0 },
+    { 0x2000, 0,      0x2000, true,  2 },
+    { 0x6000, 0x800,  0x800,  true,  3 },
+    { 0x7000, 0,      0x1000, false, 2 },
+  };
+  BlueStore::ExtentMap::ShardView v(bp);
+  BlueStore::ExtentMap::ShardView::Item item;
+  for (auto& e : expected) {
+    ASSERT_TRUE(v.next(&item));
+    ASSERT_EQ(e.logical_offset, item.logical_offset);
+    ASSERT_EQ(e.blob_offset, item.blob_offset);
+    ASSERT_EQ(e.length, item.length);
+    ASSERT_EQ(-1, item.spanning_blob_id);
+    ASSERT_EQ(e.blob_here, item.blob_here);
+    ASSERT_EQ(e.blob_index, item.blob_index);
+  }
+  ASSERT_FALSE(v.next(&item));
+
+  // the blobs found by the view decode to what was encoded
+  for (unsigned i = 0; i < 3; ++i) {
+    unsigned index = expected[i == 0 ? 0 : i + 1].blob_index;
+    uint64_t sbid = 0;
+    auto p = bp.begin(v.find_blob(index));
+    BlueStore::Blob d;
+    d.decode(coll.get(), p, v.get_struct_v(), &sbid, false);
+    ASSERT_EQ(b[i]->get_blob().get_extents(), d.get_blob().get_extents());
+    ASSERT_EQ(i != 1, d.get_blob().is_shared());
+    if (i != 1) {
+      ASSERT_EQ(100u + i, sbid);
+    }
+  }
+}
+
 TEST(ExtentMap, has_any_lextents)
 {
   BlueStore store(g_ceph_context, "", 4096);
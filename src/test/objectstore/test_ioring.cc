@@ -0,0 +1,118 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <gtest/gtest.h>
+
+#include "include/stringify.h"
+#include "os/bluestore/ioring.h"
+
+class IoRingTest : public ::testing::Test {
+public:
+  static const unsigned block_size = 4096;
+  std::string fn;
+  int fd = -1;
+
+  void SetUp() override {
+    fn = "ceph_test_ioring.tmp." + stringify(getpid());
+    fd = ::open(fn.c_str(), O_CREAT|O_RDWR|O_TRUNC, 0644);
+    ASSERT_GE(fd, 0);
+  }
+  void TearDown() override {
+    ::close(fd);
+    ::unlink(fn.c_str());
+  }
+
+  // submit everything in @p aios and wait for all of it to complete
+  void run(ioring_queue_t &q, list<aio_t> &aios) {
+    int retries = 0;
+    int r = q.submit_batch(aios.begin(), aios.end(), this, &retries);
+    ASSERT_EQ((int)aios.size(), r);
+    unsigned done = 0;
+    aio_t *paio[8];
+    while (done < aios.size()) {
+      r = q.get_next_completed(1000, paio, 8);
+      ASSERT_GT(r, 0);
+      for (int i = 0; i < r; ++i) {
+	ASSERT_EQ(this, paio[i]->priv);
+	ASSERT_EQ((int)paio[i]->length, paio[i]->get_return_value());
+      }
+      done += r;
+    }
+  }
+};
+
+TEST_F(IoRingTest, WriteRead)
+{
+  if (!ioring_queue_t::supported()) {
+    std::cout << "io_uring not supported, skipping" << std::endl;
+    return;
+  }
+  // more ios than sq entries, so submit_batch has to go round a few times
+  const unsigned n = 64;
+  ioring_queue_t q(16, false, false);
+  ASSERT_EQ(0, q.init({fd}));
+
+  list<aio_t> writes;
+  for (unsigned i = 0; i < n; ++i) {
+    bufferlist bl;
+    bl.append(buffer::create_page_aligned(block_size));
+    memset(bl.c_str(), 'a' + i % 26, block_size);
+    writes.push_back(aio_t(nullptr, fd));
+    aio_t &aio = writes.back();
+    bl.prepare_iov(&aio.iov);
+    aio.bl.claim_append(bl);
+    aio.pwritev(i * block_size, block_size);
+  }
+  run(q, writes);
+
+  list<aio_t> reads;
+  for (unsigned i = 0; i < n; ++i) {
+    reads.push_back(aio_t(nullptr, fd));
+    reads.back().pread(i * block_size, block_size);
+  }
+  run(q, reads);
+  unsigned i = 0;
+  for (auto &aio : reads) {
+    string expected(block_size, 'a' + i++ % 26);
+    ASSERT_EQ(expected, string(aio.bl.c_str(), block_size));
+  }
+
+  // nothing left over
+  aio_t *paio[1];
+  ASSERT_EQ(0, q.get_next_completed(10, paio, 1));
+  q.shutdown();
+}
+
+TEST_F(IoRingTest, ReapLimit)
+{
+  if (!ioring_queue_t::supported()) {
+    std::cout << "io_uring not supported, skipping" << std::endl;
+    return;
+  }
+  ioring_queue_t q(16, false, false);
+  ASSERT_EQ(0, q.init({fd}));
+  ASSERT_EQ(0, ::ftruncate(fd, 8 * block_size));
+
+  list<aio_t> reads;
+  for (unsigned i = 0; i < 8; ++i) {
+    reads.push_back(aio_t(this, fd));
+    reads.back().pread(i * block_size, block_size);
+  }
+  int retries = 0;
+  ASSERT_EQ(8, q.submit_batch(reads.begin(), reads.end(), this, &retries));
+
+  // completions beyond max stay queued for the next call
+  unsigned done = 0;
+  aio_t *paio[3];
+  while (done < 8) {
+    int r = q.get_next_completed(1000, paio, 3);
+    ASSERT_GT(r, 0);
+    ASSERT_LE(r, 3);
+    done += r;
+  }
+  ASSERT_EQ(8u, done);
+  q.shutdown();
+}
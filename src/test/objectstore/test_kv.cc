@@ -308,6 +308,201 @@ TEST_P(KVTest, RMRange) {
   fini();
 }
 
+TEST_P(KVTest, ColumnFamilies) {
+  if (string(GetParam()) != "rocksdb")
+    return;
+
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  ASSERT_EQ(0, KeyValueDB::parse_column_families("A(3)= B=", &cfs));
+  ASSERT_EQ(2u, cfs.size());
+  ASSERT_EQ(3u, cfs[0].shard_cnt);
+  ASSERT_EQ(0, db->set_column_families(cfs));
+  ASSERT_EQ(0, db->create_and_open(cout));
+
+  bufferlist value;
+  value.append("value");
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < 20; ++i) {
+      t->set("A", stringify(100 + i), value);
+    }
+    t->set("B", "key1", value);
+    t->set("B", "key2", value);
+    t->set("C", "key1", value);
+    t->set("C", "key2", value);
+    db->submit_transaction_sync(t);
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkey("A", "105");
+    t->rm_range_keys("A", "110", "115");
+    t->rmkey("B", "key1");
+    db->submit_transaction_sync(t);
+  }
+
+  auto check = [&]() {
+    bufferlist v;
+    ASSERT_EQ(0, db->get("A", "100", &v));
+    ASSERT_EQ(-ENOENT, db->get("A", "105", &v));
+    ASSERT_EQ(-ENOENT, db->get("A", "112", &v));
+    ASSERT_EQ(0, db->get("A", "115", &v));
+    ASSERT_EQ(-ENOENT, db->get("B", "key1", &v));
+    ASSERT_EQ(0, db->get("B", "key2", &v));
+    ASSERT_EQ(0, db->get("C", "key1", &v));
+
+    // the sharded prefix iterates in key order
+    KeyValueDB::Iterator it = db->get_iterator("A");
+    string last;
+    unsigned n = 0;
+    for (it->seek_to_first(); it->valid(); it->next(), ++n) {
+      ASSERT_LT(last, it->key());
+      last = it->key();
+    }
+    ASSERT_EQ(14u, n);
+    it->seek_to_last();
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ("119", it->key());
+    it->prev();
+    ASSERT_EQ("118", it->key());
+    it->lower_bound("110");
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ("115", it->key());
+
+    // and the whole keyspace stays ordered across families
+    KeyValueDB::WholeSpaceIterator wit = db->get_iterator();
+    pair<string,string> lastk;
+    n = 0;
+    for (wit->seek_to_first(); wit->valid(); wit->next(), ++n) {
+      ASSERT_LT(lastk, wit->raw_key());
+      lastk = wit->raw_key();
+    }
+    ASSERT_EQ(17u, n);
+    wit->seek_to_last("A");
+    ASSERT_TRUE(wit->valid());
+    ASSERT_EQ(make_pair(string("A"), string("119")), wit->raw_key());
+    wit->next();
+    ASSERT_EQ(make_pair(string("B"), string("key2")), wit->raw_key());
+  };
+  check();
+  fini();
+
+  // the on-disk layout is picked up again without set_column_families
+  init();
+  ASSERT_EQ(0, db->open(cout));
+  check();
+  fini();
+}
+
+TEST_P(KVTest, Reshard) {
+  if (string(GetParam()) != "rocksdb")
+    return;
+
+  ASSERT_EQ(0, db->create_and_open(cout));
+  bufferlist value;
+  value.append("value");
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < 100; ++i) {
+      t->set("A", stringify(i), value);
+      t->set("B", stringify(i), value);
+    }
+    db->submit_transaction_sync(t);
+  }
+
+  auto count = [&](const string &prefix) {
+    unsigned n = 0;
+    KeyValueDB::Iterator it = db->get_iterator(prefix);
+    for (it->seek_to_first(); it->valid(); it->next())
+      ++n;
+    return n;
+  };
+
+  for (auto layout : { "A(4)= B=", "A(2)=", "" }) {
+    std::vector<KeyValueDB::ColumnFamily> cfs;
+    ASSERT_EQ(0, KeyValueDB::parse_column_families(layout, &cfs));
+    ASSERT_EQ(0, db->reshard(cfs, cout));
+    ASSERT_EQ(100u, count("A"));
+    ASSERT_EQ(100u, count("B"));
+    fini();
+    init();
+    ASSERT_EQ(0, db->open(cout));
+    ASSERT_EQ(100u, count("A"));
+    ASSERT_EQ(100u, count("B"));
+    bufferlist v;
+    ASSERT_EQ(0, db->get("A", "42", &v));
+    ASSERT_EQ(0, db->get("B", "42", &v));
+  }
+  fini();
+}
+
+TEST_P(KVTest, ReshardInterrupted) {
+  if (string(GetParam()) != "rocksdb")
+    return;
+
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  ASSERT_EQ(0, KeyValueDB::parse_column_families("A(4)=", &cfs));
+  ASSERT_EQ(0, db->set_column_families(cfs));
+  ASSERT_EQ(0, db->create_and_open(cout));
+  bufferlist value;
+  value.append("value");
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < 100; ++i)
+      t->set("A", stringify(i), value);
+    db->submit_transaction_sync(t);
+  }
+
+  auto count = [&]() {
+    unsigned n = 0;
+    KeyValueDB::Iterator it = db->get_iterator("A");
+    for (it->seek_to_first(); it->valid(); it->next())
+      ++n;
+    return n;
+  };
+  auto reopen = [&]() {
+    fini();
+    init();
+    ASSERT_EQ(0, db->open(cout));
+  };
+  auto reopen_for_reshard = [&]() {
+    fini();
+    init();
+    ASSERT_EQ(-EIO, db->open(cout));
+    fini();
+    init();
+    ASSERT_EQ(0, db->open_for_reshard(cout));
+  };
+  auto reshard = [&](const char *layout) {
+    std::vector<KeyValueDB::ColumnFamily> cfs;
+    EXPECT_EQ(0, KeyValueDB::parse_column_families(layout, &cfs));
+    return db->reshard(cfs, cout);
+  };
+
+  // A(4) -> A(2): the 100 keys are folded into the default family and
+  // then split again, so stopping at 50 interrupts the fold and at 150
+  // the split into the new families
+  for (unsigned stop : { 50, 150 }) {
+    g_ceph_context->_conf->set_val("rocksdb_debug_reshard_interrupt",
+				   stringify(stop));
+    ASSERT_EQ(-EINTR, reshard("A(2)="));
+    g_ceph_context->_conf->set_val("rocksdb_debug_reshard_interrupt", "0");
+    // either way half of the keys sit in the default family, where
+    // they are invisible, so only a rerun may open the db
+    reopen_for_reshard();
+    ASSERT_EQ(0, reshard("A(2)="));
+    ASSERT_EQ(100u, count());
+    reopen();
+    ASSERT_EQ(100u, count());
+    bufferlist v;
+    ASSERT_EQ(0, db->get("A", "42", &v));
+
+    // back to the starting layout for the next round
+    ASSERT_EQ(0, reshard("A(4)="));
+    ASSERT_EQ(100u, count());
+  }
+  fini();
+}
+
 
 INSTANTIATE_TEST_CASE_P(
   KeyValueDB,
@@ -446,6 +446,96 @@ TEST_F(OSDMapTest, PrimaryAffinity) {
   }
 }
 
+TEST_F(OSDMapTest, IncrementalMapping) {
+  set_up_map();
+  mapping.update(osdmap);
+
+  auto apply = [&](OSDMap::Incremental& inc) {
+    inc.fsid = osdmap.get_fsid();
+    osdmap.apply_incremental(inc);
+    mapping.update(osdmap, inc);
+    ASSERT_EQ(osdmap.get_epoch(), mapping.get_epoch());
+    ASSERT_EQ(0u, mapping.check(osdmap, &cout));
+  };
+
+  {
+    // mark an osd down
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[0] = CEPH_OSD_UP;
+    apply(inc);
+    ASSERT_TRUE(osdmap.is_down(0));
+  }
+  {
+    // ... and out
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_weight[0] = CEPH_OSD_OUT;
+    apply(inc);
+  }
+  {
+    // reweight another and change a primary affinity
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_weight[1] = CEPH_OSD_IN / 2;
+    inc.new_primary_affinity[2] = 0;
+    apply(inc);
+  }
+  {
+    // explicit pg_temp, primary_temp and upmap entries
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_pg_temp[pg_t(3, my_rep_pool)] = {3, 4, 5};
+    inc.new_primary_temp[pg_t(4, my_rep_pool)] = 5;
+    vector<int> up;
+    osdmap.pg_to_up_acting_osds(pg_t(5, my_rep_pool), &up, nullptr,
+				nullptr, nullptr);
+    for (int osd = 0; osd < (int)get_num_osds(); ++osd) {
+      if (osdmap.is_up(osd) &&
+	  std::find(up.begin(), up.end(), osd) == up.end()) {
+	inc.new_pg_upmap_items[pg_t(5, my_rep_pool)] = {{up[0], osd}};
+	break;
+      }
+    }
+    apply(inc);
+  }
+  {
+    // an osd named by the temp mappings goes down
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[5] = CEPH_OSD_UP;
+    apply(inc);
+  }
+  {
+    // bring everything back
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    entity_addr_t addr;
+    inc.new_up_client[0] = addr;
+    inc.new_up_client[5] = addr;
+    inc.new_weight[0] = CEPH_OSD_IN;
+    inc.new_weight[1] = CEPH_OSD_IN;
+    inc.new_primary_affinity[2] = CEPH_OSD_DEFAULT_PRIMARY_AFFINITY;
+    inc.new_pg_temp[pg_t(3, my_rep_pool)] = {};
+    inc.new_primary_temp[pg_t(4, my_rep_pool)] = -1;
+    inc.old_pg_upmap_items.insert(pg_t(5, my_rep_pool));
+    apply(inc);
+  }
+  {
+    // grow a pool
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    pg_pool_t *p = inc.get_new_pool(my_rep_pool,
+				    osdmap.get_pg_pool(my_rep_pool));
+    p->set_pg_num(128);
+    p->set_pgp_num(128);
+    apply(inc);
+  }
+  {
+    // skipping an epoch falls back to a full update
+    OSDMap::Incremental skipped(osdmap.get_epoch() + 1);
+    skipped.new_weight[3] = 0;
+    skipped.fsid = osdmap.get_fsid();
+    osdmap.apply_incremental(skipped);
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[4] = CEPH_OSD_UP;
+    apply(inc);
+  }
+}
+
 TEST(PGTempMap, basic)
 {
   PGTempMap m;
@@ -13,6 +13,8 @@
  */
 
 #include <gtest/gtest.h>
+#include <random>
+#include "erasure-code/ErasureCode.h"
 #include "osd/PGTransaction.h"
 #include "osd/ECTransaction.h"
 
@@ -122,3 +124,351 @@ TEST(ectransaction, many_writes)
   ASSERT_EQ(0u, plan.to_read.size());
   ASSERT_EQ(1u, plan.will_write.size());
 }
+
+TEST(ectransaction, parity_delta)
+{
+  hobject_t h;
+  // k=4 with 4096-byte chunks, m=2, on an object of 4 stripes
+  ECUtil::stripe_info_t sinfo(4, 16384);
+  auto plan_write = [&](uint64_t off, uint64_t len) {
+    PGTransactionUPtr t(new PGTransaction);
+    bufferlist a;
+    a.append_zero(len);
+    t->write(h, off, a.length(), a, 0);
+    return ECTransaction::get_write_plan(
+      sinfo,
+      std::move(t),
+      [&](const hobject_t &i) {
+	ECUtil::HashInfoRef ref(new ECUtil::HashInfo(6));
+	ref->set_projected_total_logical_size(sinfo, 65536);
+	return ref;
+      },
+      &dpp);
+  };
+
+  {
+    // a single chunk of a stripe
+    auto plan = plan_write(20480 + 100, 512);
+    ASSERT_EQ(1u, plan.to_read.size());
+    ASSERT_TRUE(ECTransaction::plan_parity_delta(plan, sinfo, 2, &dpp));
+    ASSERT_EQ(set<int>({1}), plan.delta_chunks[h]);
+  }
+  {
+    // partial head and tail stripes around a full one
+    auto plan = plan_write(16384 - 512, 16384 + 1024);
+    ASSERT_TRUE(ECTransaction::plan_parity_delta(plan, sinfo, 2, &dpp));
+    ASSERT_EQ(set<int>({0, 3}), plan.delta_chunks[h]);
+  }
+  {
+    // three chunks plus parity is more than the whole stripe
+    auto plan = plan_write(100, 10000);
+    ASSERT_FALSE(ECTransaction::plan_parity_delta(plan, sinfo, 2, &dpp));
+    ASSERT_TRUE(plan.delta_chunks.empty());
+  }
+  {
+    // extends the object
+    auto plan = plan_write(65536 - 512, 1024);
+    ASSERT_FALSE(ECTransaction::plan_parity_delta(plan, sinfo, 2, &dpp));
+  }
+}
+
+// a linear code with two coding chunks: the xor of the data chunks, and
+// the xor of the data chunks each rotated by its index
+class ErasureCodeXor : public ErasureCode {
+  unsigned k;
+public:
+  explicit ErasureCodeXor(unsigned k) : k(k) {}
+  int init(ErasureCodeProfile &profile, ostream *ss) override {
+    return 0;
+  }
+  unsigned int get_chunk_count() const override {
+    return k + 2;
+  }
+  unsigned int get_data_chunk_count() const override {
+    return k;
+  }
+  unsigned int get_chunk_size(unsigned int object_size) const override {
+    return (object_size + k - 1) / k;
+  }
+  bool supports_parity_delta() const override {
+    return true;
+  }
+  int encode_chunks(const set<int> &want_to_encode,
+		    map<int, bufferlist> *encoded) override {
+    unsigned len = (*encoded)[0].length();
+    char *p = (*encoded)[k].c_str();
+    char *q = (*encoded)[k + 1].c_str();
+    memset(p, 0, len);
+    memset(q, 0, len);
+    for (unsigned i = 0; i < k; ++i) {
+      const char *d = (*encoded)[i].c_str();
+      for (unsigned j = 0; j < len; ++j) {
+	p[j] ^= d[j];
+	q[(j + i) % len] ^= d[j];
+      }
+    }
+    return 0;
+  }
+};
+
+// the objects of one shard, as the transactions leave them
+struct ShardObjects {
+  map<ghobject_t, bufferlist> objects;
+  map<ghobject_t, extent_set> writes;
+
+  static void write_at(bufferlist &obj, uint64_t off, const bufferlist &bl) {
+    bufferlist out;
+    if (off > obj.length()) {
+      out = obj;
+      out.append_zero(off - obj.length());
+    } else {
+      out.substr_of(obj, 0, off);
+    }
+    out.append(bl);
+    if (off + bl.length() < obj.length()) {
+      bufferlist tail;
+      tail.substr_of(obj, off + bl.length(),
+		     obj.length() - off - bl.length());
+      out.append(tail);
+    }
+    obj.swap(out);
+  }
+
+  void apply(ObjectStore::Transaction &t) {
+    auto i = t.begin();
+    while (i.have_op()) {
+      auto op = i.decode_op();
+      switch (op->op) {
+      case ObjectStore::Transaction::OP_TOUCH:
+	objects[i.get_oid(op->oid)];
+	break;
+      case ObjectStore::Transaction::OP_WRITE:
+	{
+	  ghobject_t oid = i.get_oid(op->oid);
+	  bufferlist bl;
+	  i.decode_bl(bl);
+	  ASSERT_EQ(op->len, bl.length());
+	  write_at(objects[oid], op->off, bl);
+	  writes[oid].union_insert(op->off, op->len);
+	}
+	break;
+      case ObjectStore::Transaction::OP_CLONERANGE2:
+	{
+	  bufferlist &src = objects[i.get_oid(op->oid)];
+	  ASSERT_LE(op->off + op->len, src.length());
+	  bufferlist bl;
+	  bl.substr_of(src, op->off, op->len);
+	  write_at(objects[i.get_oid(op->dest_oid)], op->dest_off, bl);
+	}
+	break;
+      case ObjectStore::Transaction::OP_SETATTR:
+	{
+	  i.decode_string();
+	  bufferlist bl;
+	  i.decode_bl(bl);
+	}
+	break;
+      case ObjectStore::Transaction::OP_SETALLOCHINT:
+	break;
+      default:
+	FAIL() << "unexpected op " << op->op;
+      }
+    }
+  }
+};
+
+struct RollbackExtents : public ObjectModDesc::Visitor {
+  version_t gen = 0;
+  vector<pair<uint64_t, uint64_t> > extents;
+  void rollback_extents(
+    version_t g,
+    const vector<pair<uint64_t, uint64_t> > &e) override {
+    gen = g;
+    extents.insert(extents.end(), e.begin(), e.end());
+  }
+};
+
+TEST(ectransaction, parity_delta_matches_rmw)
+{
+  // k=4 with 4096-byte chunks, m=2, on an object of 4 stripes
+  const unsigned k = 4, n = 6;
+  const uint64_t object_size = 65536;
+  ECUtil::stripe_info_t sinfo(k, 16384);
+  ErasureCodeInterfaceRef ec(new ErasureCodeXor(k));
+  hobject_t h(object_t("foo"), "", CEPH_NOSNAP, 0, 1, "");
+  pg_t pgid(0, 1);
+
+  std::mt19937 rng(0);
+  auto random_bl = [&](uint64_t len) {
+    bufferlist bl;
+    bufferptr bp(len);
+    for (uint64_t i = 0; i < len; ++i)
+      bp[i] = rng();
+    bl.append(bp);
+    return bl;
+  };
+  bufferlist orig = random_bl(object_size);
+  set<int> all;
+  for (unsigned i = 0; i < n; ++i)
+    all.insert(i);
+  map<int, bufferlist> orig_shards;
+  ASSERT_EQ(0, ECUtil::encode(sinfo, ec, orig, all, &orig_shards));
+
+  struct Result {
+    map<int, ShardObjects> shards;
+    extent_set written;
+    RollbackExtents rollback;
+  };
+  auto run = [&](uint64_t off, const bufferlist &data, bool delta,
+		 ECTransaction::WritePlan *pplan, Result *res) {
+    PGTransactionUPtr t(new PGTransaction);
+    ObjectContextRef obc(new ObjectContext);
+    obc->obs.oi.soid = h;
+    obc->obs.exists = true;
+    t->add_obc(obc);
+    bufferlist bl = data;
+    t->write(h, off, bl.length(), bl, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo,
+      std::move(t),
+      [&](const hobject_t &i) {
+	ECUtil::HashInfoRef ref(new ECUtil::HashInfo(n));
+	ref->set_total_chunk_size_clear_hash(
+	  sinfo.aligned_logical_offset_to_chunk_offset(object_size));
+	ref->set_projected_total_logical_size(sinfo, object_size);
+	return ref;
+      },
+      &dpp);
+    ASSERT_EQ(1u, plan.to_read.count(h));
+    if (delta)
+      ASSERT_TRUE(ECTransaction::plan_parity_delta(plan, sinfo, 2, &dpp));
+
+    // what ECBackend would have read: whole stripes for a rmw, the
+    // touched data chunks and the coding chunks for a delta
+    map<hobject_t,extent_map> partial_extents;
+    map<hobject_t,map<int,extent_map>> partial_chunks;
+    const extent_set &to_read = plan.to_read[h];
+    for (auto extent : to_read) {
+      if (!delta) {
+	bufferlist bl;
+	bl.substr_of(orig, extent.first, extent.second);
+	partial_extents[h].insert(extent.first, extent.second, bl);
+	continue;
+      }
+      uint64_t chunk_off =
+	sinfo.aligned_logical_offset_to_chunk_offset(extent.first);
+      uint64_t chunk_len =
+	sinfo.aligned_logical_offset_to_chunk_offset(extent.second);
+      for (int i : all) {
+	if (i < (int)k && !plan.delta_chunks[h].count(i))
+	  continue;
+	bufferlist bl;
+	bl.substr_of(orig_shards[i], chunk_off, chunk_len);
+	partial_chunks[h][i].insert(chunk_off, chunk_len, bl);
+      }
+    }
+
+    vector<pg_log_entry_t> entries;
+    entries.push_back(
+      pg_log_entry_t(pg_log_entry_t::MODIFY, h, eversion_t(1, 2),
+		     eversion_t(1, 1), 0, osd_reqid_t(), utime_t(), 0));
+    map<hobject_t,extent_map> written;
+    map<shard_id_t, ObjectStore::Transaction> transactions;
+    for (int i : all)
+      transactions[shard_id_t(i)];
+    set<hobject_t> temp_added, temp_removed;
+    ECTransaction::generate_transactions(
+      plan, ec, pgid, false, sinfo, partial_extents, partial_chunks,
+      entries, &written, &transactions, &temp_added, &temp_removed, &dpp);
+
+    for (int i : all) {
+      auto &shard = res->shards[i];
+      shard.objects[ghobject_t(h, ghobject_t::NO_GEN, shard_id_t(i))] =
+	orig_shards[i];
+      ASSERT_NO_FATAL_FAILURE(shard.apply(transactions[shard_id_t(i)]));
+    }
+    res->written = written[h].get_interval_set();
+    entries[0].mod_desc.visit(&res->rollback);
+    *pplan = std::move(plan);
+  };
+
+  struct {
+    uint64_t off;
+    uint64_t len;
+    set<int> touched;
+  } cases[] = {
+    // a single chunk of a stripe
+    { 20480 + 100, 512, {1} },
+    // partial head and tail stripes around a full one
+    { 16384 - 512, 16384 + 1024, {0, 3} },
+  };
+  for (auto &c : cases) {
+    bufferlist data = random_bl(c.len);
+    bufferlist expected = orig;
+    ShardObjects::write_at(expected, c.off, data);
+    map<int, bufferlist> expected_shards;
+    ASSERT_EQ(0, ECUtil::encode(sinfo, ec, expected, all, &expected_shards));
+
+    ECTransaction::WritePlan rmw_plan, delta_plan;
+    Result rmw, delta;
+    ASSERT_NO_FATAL_FAILURE(run(c.off, data, false, &rmw_plan, &rmw));
+    ASSERT_NO_FATAL_FAILURE(run(c.off, data, true, &delta_plan, &delta));
+    ASSERT_EQ(c.touched, delta_plan.delta_chunks[h]);
+
+    // the rmw reports every stripe it wrote, the delta only the full
+    // stripes; the partial ones never went through the extent cache
+    ASSERT_EQ(rmw_plan.will_write[h], rmw.written);
+    extent_set full_stripes = delta_plan.will_write[h];
+    full_stripes.subtract(delta_plan.to_read[h]);
+    ASSERT_EQ(full_stripes, delta.written);
+
+    for (Result *res : { &rmw, &delta }) {
+      ASSERT_FALSE(res->rollback.extents.empty());
+      for (int i : all) {
+	auto &shard = res->shards[i];
+	ghobject_t obj(h, ghobject_t::NO_GEN, shard_id_t(i));
+	ghobject_t gen(h, res->rollback.gen, shard_id_t(i));
+	ASSERT_TRUE(shard.objects[obj].contents_equal(expected_shards[i]))
+	  << "shard " << i << (res == &rmw ? " rmw" : " delta");
+
+	// rolling back restores the shard as it was
+	ASSERT_TRUE(shard.objects.count(gen));
+	bufferlist restored = shard.objects[obj];
+	for (auto &e : res->rollback.extents) {
+	  bufferlist bl;
+	  bl.substr_of(shard.objects[gen], e.first, e.second);
+	  ShardObjects::write_at(restored, e.first, bl);
+	}
+	ASSERT_TRUE(restored.contents_equal(orig_shards[i]))
+	  << "shard " << i << (res == &rmw ? " rmw" : " delta");
+      }
+    }
+
+    // a rmw rewrites every shard in the partial stripes, a delta only
+    // the touched data chunks and the coding chunks
+    const extent_set &partial_stripes = delta_plan.to_read[h];
+    const extent_set &full = full_stripes;
+    extent_set partial_chunks, full_chunks;
+    for (auto extent : partial_stripes) {
+      partial_chunks.insert(
+	sinfo.aligned_logical_offset_to_chunk_offset(extent.first),
+	sinfo.aligned_logical_offset_to_chunk_offset(extent.second));
+    }
+    for (auto extent : full) {
+      full_chunks.insert(
+	sinfo.aligned_logical_offset_to_chunk_offset(extent.first),
+	sinfo.aligned_logical_offset_to_chunk_offset(extent.second));
+    }
+    for (int i : all) {
+      ghobject_t obj(h, ghobject_t::NO_GEN, shard_id_t(i));
+      ASSERT_TRUE(partial_chunks.subset_of(rmw.shards[i].writes[obj]));
+      extent_set &writes = delta.shards[i].writes[obj];
+      if (i < (int)k && !c.touched.count(i)) {
+	ASSERT_TRUE(writes.subset_of(full_chunks)) << "shard " << i;
+      } else {
+	ASSERT_TRUE(partial_chunks.subset_of(writes)) << "shard " << i;
+      }
+    }
+  }
+}
+
@@ -29,6 +29,7 @@
 #include "include/msgr.h" // for CEPH_ENTITY_TYPE_CLIENT
 #include "gtest/gtest.h"
 
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h>
 #include <map>
@@ -40,6 +41,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <thread>
 #include <time.h>
 #include <unistd.h>
 
@@ -219,3 +221,108 @@ TEST(PerfCounters, ResetPerfCounters) {
   ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf reset\", \"var\": \"test_perfcounter_1\", \"format\": \"json\" }", &msg));
   ASSERT_EQ(sd("{\"error\":\"Not find: test_perfcounter_1\"}"), msg);
 }
+
+enum {
+  TEST_PERFCOUNTERS3_ELEMENT_FIRST = 600,
+  TEST_PERFCOUNTERS3_ELEMENT_COUNTER,
+  TEST_PERFCOUNTERS3_ELEMENT_AVG,
+  TEST_PERFCOUNTERS3_ELEMENT_LAST,
+};
+
+static PerfCounters* setup_test_perfcounters3(CephContext *cct, bool sharded)
+{
+  PerfCountersBuilder bld(cct, "test_perfcounter_3",
+	  TEST_PERFCOUNTERS3_ELEMENT_FIRST, TEST_PERFCOUNTERS3_ELEMENT_LAST);
+  bld.add_u64_counter(TEST_PERFCOUNTERS3_ELEMENT_COUNTER, "counter");
+  bld.add_time_avg(TEST_PERFCOUNTERS3_ELEMENT_AVG, "avg");
+  if (sharded) {
+    bld.set_sharded(TEST_PERFCOUNTERS3_ELEMENT_COUNTER);
+    bld.set_sharded(TEST_PERFCOUNTERS3_ELEMENT_AVG);
+  }
+  return bld.create_perf_counters();
+}
+
+static void hammer_perfcounters3(PerfCounters *pc, int threads, int ops)
+{
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back([pc, ops]() {
+	for (int j = 0; j < ops; j++) {
+	  pc->inc(TEST_PERFCOUNTERS3_ELEMENT_COUNTER);
+	  pc->tinc(TEST_PERFCOUNTERS3_ELEMENT_AVG, utime_t(0, 1000));
+	}
+      });
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+}
+
+TEST(PerfCounters, ShardedPerfCounters) {
+  AdminSocketClient client(get_rand_socket_path());
+  std::string msg;
+  PerfCountersCollection *coll = g_ceph_context->get_perfcounters_collection();
+  coll->clear();
+  PerfCounters* fake_pf = setup_test_perfcounters3(g_ceph_context, true);
+  coll->add(fake_pf);
+
+  hammer_perfcounters3(fake_pf, 8, 1000);
+  ASSERT_EQ(8000u, fake_pf->get(TEST_PERFCOUNTERS3_ELEMENT_COUNTER));
+  ASSERT_EQ(make_pair(8000ul, 8ul),
+	    fake_pf->get_tavg_ms(TEST_PERFCOUNTERS3_ELEMENT_AVG));
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf dump\", \"format\": \"json\" }", &msg));
+  ASSERT_EQ(sd("{\"test_perfcounter_3\":{\"counter\":8000,"
+	    "\"avg\":{\"avgcount\":8000,\"sum\":0.008000000,\"avgtime\":0.000001000}}}"), msg);
+
+  fake_pf->set(TEST_PERFCOUNTERS3_ELEMENT_COUNTER, 5);
+  ASSERT_EQ(5u, fake_pf->get(TEST_PERFCOUNTERS3_ELEMENT_COUNTER));
+
+  fake_pf->reset();
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf dump\", \"format\": \"json\" }", &msg));
+  ASSERT_EQ(sd("{\"test_perfcounter_3\":{\"counter\":0,"
+	    "\"avg\":{\"avgcount\":0,\"sum\":0.000000000,\"avgtime\":0.000000000}}}"), msg);
+  coll->clear();
+}
+
+TEST(PerfCounters, ShardPerThread) {
+  // as many threads as shards each get a shard to themselves
+  PerfCounters::perf_counter_data_any_d data;
+  data.shards.reset(
+    new PerfCounters::perf_counter_shard_d[PerfCounters::num_shards]);
+  std::vector<PerfCounters::perf_counter_shard_d*> picked(
+    PerfCounters::num_shards);
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < PerfCounters::num_shards; i++) {
+    workers.emplace_back([&data, &picked, i] {
+	picked[i] = data.pick_a_shard();
+      });
+  }
+  for (auto& t : workers) {
+    t.join();
+  }
+  std::sort(picked.begin(), picked.end());
+  ASSERT_EQ(picked.end(), std::unique(picked.begin(), picked.end()));
+}
+
+// not a pass/fail test: prints how long threads take to bump the same
+// counters, with and without sharding.  it does 62M updates, so it only
+// runs with --gtest_also_run_disabled_tests
+TEST(PerfCounters, DISABLED_ShardedScaling) {
+  const int ops = 1000000;
+  for (bool sharded : { false, true }) {
+    for (int threads = 1; threads <= 16; threads *= 2) {
+      PerfCounters* pc = setup_test_perfcounters3(g_ceph_context, sharded);
+      ceph::mono_time start = ceph::mono_clock::now();
+      hammer_perfcounters3(pc, threads, ops);
+      ceph::timespan elapsed = ceph::mono_clock::now() - start;
+      ASSERT_EQ((uint64_t)threads * ops,
+		pc->get(TEST_PERFCOUNTERS3_ELEMENT_COUNTER));
+      std::cout << (sharded ? "sharded" : "shared") << " threads " << threads
+		<< " ns/op "
+		<< std::chrono::duration_cast<std::chrono::nanoseconds>(
+		  elapsed).count() / ((uint64_t)threads * ops)
+		<< std::endl;
+      delete pc;
+    }
+  }
+}
@@ -0,0 +1,158 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include "gtest/gtest.h"
+
+#include "global/global_context.h"
+#include "include/stringify.h"
+#include "rgw/rgw_cache.h"
+
+class counting_chained_cache : public RGWChainedCache {
+public:
+  map<string, int> chained;
+  int invalidated = 0;
+  int invalidated_all = 0;
+
+  void chain_cb(const string& key, void *data) override {
+    chained[key]++;
+  }
+  void invalidate(const string& key) override {
+    chained.erase(key);
+    invalidated++;
+  }
+  void invalidate_all() override {
+    chained.clear();
+    invalidated_all++;
+  }
+};
+
+class TestObjectCache : public ::testing::Test {
+public:
+  ObjectCache cache;
+
+  void init(int lru_size, int shards) {
+    g_ceph_context->_conf->set_val("rgw_cache_lru_size", stringify(lru_size));
+    g_ceph_context->_conf->set_val("rgw_cache_shards", stringify(shards));
+    g_ceph_context->_conf->apply_changes(nullptr);
+    cache.set_ctx(g_ceph_context);
+    cache.set_enabled(true);
+  }
+
+  void put(string name, const string& data) {
+    ObjectCacheInfo info;
+    info.flags = CACHE_FLAG_DATA;
+    info.data.append(data);
+    cache.put(name, info, nullptr);
+  }
+
+  bool get(string name, string *data = nullptr) {
+    ObjectCacheInfo info;
+    if (cache.get(name, info, CACHE_FLAG_DATA, nullptr) < 0) {
+      return false;
+    }
+    if (data) {
+      *data = info.data.to_str();
+    }
+    return true;
+  }
+};
+
+TEST_F(TestObjectCache, PutGetRemove)
+{
+  init(100, 4);
+
+  put("foo", "bar");
+  string data;
+  ASSERT_TRUE(get("foo", &data));
+  ASSERT_EQ("bar", data);
+
+  ObjectCacheInfo info;
+  string name = "foo";
+  ASSERT_EQ(-ENOENT, cache.get(name, info, CACHE_FLAG_XATTRS, nullptr));
+
+  cache.remove(name);
+  ASSERT_FALSE(get("foo"));
+}
+
+TEST_F(TestObjectCache, Disabled)
+{
+  init(100, 4);
+
+  cache.set_enabled(false);
+  put("foo", "bar");
+  ASSERT_FALSE(get("foo"));
+
+  cache.set_enabled(true);
+  put("foo", "bar");
+  ASSERT_TRUE(get("foo"));
+}
+
+TEST_F(TestObjectCache, Bounded)
+{
+  init(16, 4);
+
+  for (int i = 0; i < 1000; ++i) {
+    put("obj" + stringify(i), "data");
+  }
+
+  int cached = 0;
+  for (int i = 0; i < 1000; ++i) {
+    if (get("obj" + stringify(i))) {
+      ++cached;
+    }
+  }
+  ASSERT_LE(cached, 16);
+  ASSERT_TRUE(get("obj999"));
+}
+
+TEST_F(TestObjectCache, SecondChance)
+{
+  init(4, 1);
+
+  put("a", "a");
+  put("b", "b");
+  put("c", "c");
+  put("d", "d");
+
+  // the hit keeps "a" around, "b" is the oldest unreferenced entry
+  ASSERT_TRUE(get("a"));
+  put("e", "e");
+  ASSERT_TRUE(get("a"));
+  ASSERT_FALSE(get("b"));
+  ASSERT_TRUE(get("c"));
+  ASSERT_TRUE(get("d"));
+  ASSERT_TRUE(get("e"));
+}
+
+TEST_F(TestObjectCache, ChainedInvalidation)
+{
+  init(100, 4);
+
+  counting_chained_cache chained;
+  cache.chain_cache(&chained);
+
+  ObjectCacheInfo info;
+  info.flags = CACHE_FLAG_DATA;
+  rgw_cache_entry_info foo_info;
+  rgw_cache_entry_info bar_info;
+  string foo = "foo";
+  string bar = "bar";
+  cache.put(foo, info, &foo_info);
+  cache.put(bar, info, &bar_info);
+
+  list<rgw_cache_entry_info *> entries = {&foo_info, &bar_info};
+  string key = "chained";
+  RGWChainedCache::Entry entry(&chained, key, nullptr);
+  ASSERT_TRUE(cache.chain_cache_entry(entries, &entry));
+  ASSERT_EQ(1U, chained.chained.size());
+
+  // updating any of the underlying objects drops the chained entry
+  cache.put(bar, info, nullptr);
+  ASSERT_EQ(1, chained.invalidated);
+  ASSERT_TRUE(chained.chained.empty());
+
+  // and stale cache infos can no longer be chained
+  ASSERT_FALSE(cache.chain_cache_entry(entries, &entry));
+
+  cache.invalidate_all();
+  ASSERT_EQ(1, chained.invalidated_all);
+}
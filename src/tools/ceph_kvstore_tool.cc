@@ -262,6 +262,21 @@ class StoreTool
   void compact_range(string prefix, string start, string end) {
     db->compact_range(prefix, start, end);
   }
+
+  int reshard(const string &layout) {
+    std::vector<KeyValueDB::ColumnFamily> cfs;
+    int r = KeyValueDB::parse_column_families(layout, &cfs);
+    if (r < 0) {
+      std::cerr << "invalid column family layout '" << layout << "'"
+		<< std::endl;
+      return r;
+    }
+    r = db->reshard(cfs, std::cout);
+    if (r == -EOPNOTSUPP) {
+      std::cerr << "store does not support column families" << std::endl;
+    }
+    return r;
+  }
 };
 
 void usage(const char *pname)
@@ -283,6 +298,7 @@ void usage(const char *pname)
     << "  compact\n"
     << "  compact-prefix <prefix>\n"
     << "  compact-range <prefix> <start> <end>\n"
+    << "  reshard <prefix[(shards)]=options ...>\n"
     << std::endl;
 }
 
@@ -529,6 +545,16 @@ int main(int argc, const char *argv[])
     string start(url_unescape(argv[5]));
     string end(url_unescape(argv[6]));
     st.compact_range(prefix, start, end);
+  } else if (cmd == "reshard") {
+    if (argc < 5) {
+      usage(argv[0]);
+      return 1;
+    }
+    int ret = st.reshard(argv[4]);
+    if (ret < 0) {
+      std::cerr << "error resharding: " << cpp_strerror(ret) << std::endl;
+      return 1;
+    }
   } else {
     std::cerr << "Unrecognized command: " << cmd << std::endl;
     return 1;
@@ -199,6 +199,10 @@ void usage()
   cout << "      [--simulate]       simulate placements using a random\n";
   cout << "                         number generator in place of the CRUSH\n";
   cout << "                         algorithm\n";
+  cout << "      [--straw2-scalar]  do not vectorize straw2 bucket selection\n";
+  cout << "      [--check-straw2-simd]\n";
+  cout << "                         compare vectorized straw2 mappings with\n";
+  cout << "                         the scalar code\n";
   cout << "   --show-utilization    show OSD usage\n";
   cout << "   --show-utilization-all\n";
   cout << "                         include zero weight items\n";
@@ -357,6 +361,10 @@ int main(int argc, const char **argv)
     } else if (ceph_argparse_witharg(args, i, &full_location, err, "--show-location", (char*)NULL)) {
     } else if (ceph_argparse_flag(args, i, "-s", "--simulate", (char*)NULL)) {
       tester.set_random_placement();
+    } else if (ceph_argparse_flag(args, i, "--straw2-scalar", (char*)NULL)) {
+      crush_set_straw2_simd(0);
+    } else if (ceph_argparse_flag(args, i, "--check-straw2-simd", (char*)NULL)) {
+      tester.set_check_straw2_simd(true);
     } else if (ceph_argparse_flag(args, i, "--enable-unsafe-tunables", (char*)NULL)) {
       unsafe_tunables = true;
     } else if (ceph_argparse_witharg(args, i, &choose_local_tries, err,